@@ -3,11 +3,20 @@
 
 #include <iostream>
 #include <string>
+#include <list>
+#include <map>
+#include <vector>
 #include <gdal_priv.h>
 #include <cpl_conv.h>
 #include <gdalwarper.h>
 #include <stdlib.h>
 #include <ogr_spatialref.h>
+#include "raster.hpp"
+#include "geotiff_stats.hpp"
+#include "geotiff_mmap.hpp"
+#include "geotiff_sample.hpp"
+#include "geotiff_warp.hpp"
+#include "geotiff_pool.hpp"
 
 using namespace std;
 typedef std::string String; 
@@ -17,6 +26,19 @@ typedef std::string String;
 #define GEOTIFF_PARAM_SX 1
 #define GEOTIFF_PARAM_SY 5
 
+// Minimum size (in bytes) of the row chunks requested to GDAL when reading a full band
+#define GEOTIFF_CHUNK_BYTES (4*1024*1024)
+
+// GDAL data type matching each supported C++ pixel type (used as RasterIO eBufType)
+template<typename T> struct GDALTypeOf { static const GDALDataType type = GDT_Unknown; };
+template<> struct GDALTypeOf<unsigned char>  { static const GDALDataType type = GDT_Byte; };
+template<> struct GDALTypeOf<unsigned short> { static const GDALDataType type = GDT_UInt16; };
+template<> struct GDALTypeOf<short>          { static const GDALDataType type = GDT_Int16; };
+template<> struct GDALTypeOf<unsigned int>   { static const GDALDataType type = GDT_UInt32; };
+template<> struct GDALTypeOf<int>            { static const GDALDataType type = GDT_Int32; };
+template<> struct GDALTypeOf<float>          { static const GDALDataType type = GDT_Float32; };
+template<> struct GDALTypeOf<double>         { static const GDALDataType type = GDT_Float64; };
+
 class Geotiff { 
  
   private: // NOTE: "private" keyword is redundant here.  
@@ -25,6 +47,8 @@ class Geotiff {
            // they are private. 
  
     const char* filename;        // name of Geotiff
+    GeotiffDatasetLease lease;   // pooled handle behind geotiffDataset (see GeotiffDatasetPool)
+    std::list<GeotiffDatasetLease> retiredLeases; // handles replaced by BuildOverviews, still referenced by views
     GDALDataset *geotiffDataset; // Geotiff GDAL datset object. 
     double geotransform[6];      // 6-element geotranform array.
     int dimensions[3];           // X,Y, and Z dimensions. 
@@ -34,6 +58,15 @@ class Geotiff {
     int bGotNodata;
 	// See: https://gdal.org/development/rfc/rfc15_nodatabitmask.html#rfc-15
 
+    int GetChunkRows(int layerIndex, int xSize); // number of rows (multiple of the block height) per RasterIO call
+    std::map<int, Raster<float> > rasterBands; // storage behind the float** views returned by GetRasterBand, by band
+    std::vector<RasterBandInfo> bandInfo;  // per-band metadata (no-data, scale, offset), bandInfo[0] is band 1
+
+    void LoadBandInfo();
+
+    template<typename T>
+    bool ReadBlockRows(int layerIndex, int xOff, int yOff, Raster<T> &bandLayer); // RasterIO straight into bandLayer, by block-rows
+
 
   public: 
      
@@ -41,11 +74,13 @@ class Geotiff {
     // of this Geotiff class. 
     Geotiff( const char* tiffname ) { 
       filename = tiffname ; 
-      GDALAllRegister();
+      datasetSpatialRef = NULL;
       bValidDataset = true;
  
-      // set pointer to Geotiff dataset as class member.  
-      geotiffDataset = (GDALDataset*) GDALOpen(filename, GA_ReadOnly);
+      // set pointer to Geotiff dataset as class member. Handles are pooled
+      // process-wide: reopening a recently used file reuses its open handle
+      lease = GeotiffDatasetPool::Instance().Acquire(filename);
+      geotiffDataset = lease.Get();
       if (geotiffDataset == NULL){
         // some problem ocurred reading the file. Flag it
         cout << "[geotiff] Error reading file: " << filename << endl;
@@ -60,16 +95,13 @@ class Geotiff {
       if (nBands < 1){
         cout << "[Geotiff::Geotiff] Retrieved invalid number of bands from geotiffDataset (" << __FILE__ << "@" << __LINE__ << endl;
       }
-      if (nBands > 1){
-        cout << "[Geotiff::Geotiff] More than 1 band found in the geotiff file. We will use only the first one" << endl;
-        cout << "[Geotiff::Geotiff] multiband import not supported yet" << endl;
-      }
       // retrieve, if available, no-data definition for the first band
-      // BLUEPRINT: vector of no-data definitions. We could have 1 per band. How common is that?
       dfNoData = GDALGetRasterNoDataValue (GDALGetRasterBand( geotiffDataset, 1 ), &bGotNodata);
+      // per-band no-data, scale and offset (multiband datasets, see ReadCube)
+      LoadBandInfo();
       geotiffDataset->GetGeoTransform(geotransform);
-      // WIP: Retrieve Spatial Ref an populate local container;
-      datasetSpatialRef = new OGRSpatialReference(geotiffDataset->GetProjectionRef());
+      // WIP: Retrieve Spatial Ref an populate local container (parsed once per file by the pool);
+      datasetSpatialRef = lease.CloneSpatialRef();
     }
  
     // define destructor function to close dataset, 
@@ -78,7 +110,8 @@ class Geotiff {
     ~Geotiff() {
       // close the Geotiff dataset, free memory for array.  
       delete datasetSpatialRef; // free locally stored copy of OGRSpatialReference
-      GDALClose(geotiffDataset);
+      lease.Release();          // the handle goes back to the pool, still open
+      retiredLeases.clear();    // outdated handles: closed by the pool
     }
 
     double GetGeoTransformParam(int paramID); //returns value of single geoTransform parameter for RasterBand(1)
@@ -155,46 +188,275 @@ class Geotiff {
         *  Returns the NoData as a double. 
         */
 
+    RasterBandInfo GetBandInfo(int layerIndex);
+    /*
+        * function RasterBandInfo GetBandInfo(int layerIndex):
+        * Returns the metadata of band layerIndex (1 ... n bands):
+        * native data type, no-data value (if any), scale and offset.
+        */
+
+    RasterStatistics GetStatistics(int layerIndex, bool approximate = false) { return GeotiffGetStatistics(filename, layerIndex, approximate); }
+    /*
+        * function RasterStatistics GetStatistics(int layerIndex, bool approximate):
+        * Returns min, max, mean, standard deviation, histogram and nodata
+        * count of band layerIndex. See GeotiffGetStatistics (geotiff_stats.hpp)
+        * for the exact / approximate modes and the caching rules.
+        */
+
+    GDALDataType GetDataType(int layerIndex);
+    /*
+        * function GDALDataType GetDataType(int layerIndex):
+        * Returns the native GDAL data type of the band, so the
+        * matching C++ type can be requested with Read<T>.
+        */
+
+    void GetBlockSize(int layerIndex, int *blockSize);
+    /*
+        * function void GetBlockSize(int layerIndex, int *blockSize):
+        * Returns in blockSize[0], blockSize[1] the natural block size (X, Y)
+        * of the band: tile size for tiled files, or (nCols x rows per strip)
+        * for striped files. Reads aligned to this size decode each block once.
+        */
+
     float** GetRasterBand(int z);
     /*
         * function float** GetRasterBand(int z): 
         * This function reads a band from a geotiff at a 
         * specified vertical level (z value, 1 ... 
-        * n bands). To this end, the Geotiff's GDAL 
-        * data type is passed to a switch statement, 
-        * and the template function GetArray2D (see below)
-        * is called with the appropriate C++ data type. 
-        * The GetArray2D function uses the passed-in C++ 
-        * data type to properly read the band data from 
-        * the Geotiff, cast the data to float**, and return
-        * it to this function. This function returns that 
-        * float** pointer. 
+        * n bands). GDAL converts the band data from its
+        * native type to float while reading it (see
+        * Read<T>), and this function returns a float**
+        * pointer to the rows.
+        *
+        * The float** is a view (one pointer per row) over a
+        * single contiguous buffer owned by this Geotiff object.
+        * Do NOT delete[] the rows nor the array: the memory is
+        * released by ReleaseRasterBand() or by the destructor.
+        * Asking again for a band that was not released returns
+        * the same view (no second read or copy), so changes made
+        * through it are seen by every holder of the pointer.
+        * Prefer ReadRaster() for new code.
+        */
+
+    void ReleaseRasterBand(float** bandLayer);
+    /*
+        * function void ReleaseRasterBand(float** bandLayer):
+        * Frees the storage of a band previously returned by
+        * GetRasterBand, before this Geotiff object is destroyed.
+        * The view is shared by every GetRasterBand call on that
+        * band: all copies of the pointer become invalid.
+        */
+
+    Raster<float> ReadRaster(int z);
+    /*
+        * function Raster<float> ReadRaster(int z):
+        * Reads band z (1 ... n bands) into a contiguous, owning
+        * float raster (single aligned allocation, see raster.hpp).
+        * The memory is released when the Raster goes out of scope.
+        * Returns an empty Raster if the band cannot be read.
+        */
+
+    template<typename T>
+    Raster<T> Read(int z);
+    /*
+        * function Raster<T> Read<T>(int z):
+        * Reads band z (1 ... n bands) into a Raster<T>. GDAL writes
+        * directly into the raster buffer in the requested type
+        * (RasterIO eBufType), with no staging buffer and no extra
+        * conversion pass. Reading in the band native type (e.g.
+        * Read<unsigned char> for Byte bands) copies the data as is.
+        * Supported T: unsigned char, unsigned short, short,
+        * unsigned int, int, float, double.
+        * Returns an empty Raster if the band cannot be read.
+        */
+
+    template<typename T>
+    Raster<T> ReadWindow(int z, int xOff, int yOff, int xSize, int ySize);
+    /*
+        * function Raster<T> ReadWindow<T>(int z, int xOff, int yOff, int xSize, int ySize):
+        * Reads the (xSize x ySize) pixel window starting at
+        * (xOff, yOff) of band z, as Read<T> does for the full band.
+        * Only the blocks intersecting the window are read.
+        * The window must lie inside the raster, otherwise an
+        * empty Raster is returned.
+        */
+
+    template<typename T>
+    Raster<T> ReadGeoWindow(int z, double minX, double minY, double maxX, double maxY, int *window = NULL);
+    /*
+        * function Raster<T> ReadGeoWindow<T>(int z, double minX, double minY, double maxX, double maxY, int *window):
+        * Reads the pixels of band z covered by a bounding box given
+        * in the dataset georeferenced coordinates (clipped to the
+        * raster). If window is not NULL, the pixel window that was
+        * read [xOff, yOff, xSize, ySize] is returned in it.
+        * Returns an empty Raster if the box misses the raster.
+        */
+
+    template<typename T>
+    GeotiffMappedBand<T> MapBand(int z);
+    /*
+        * function GeotiffMappedBand<T> MapBand<T>(int z):
+        * Returns a read-only typed view of band z straight over a memory
+        * mapping of the file (uncompressed GTiff in host byte order, T equal
+        * to the band native type): no read, no buffer, no copy, and the pages
+        * are shared with every other process mapping the same file.
+        * Otherwise the view falls back to a Read<T> copy (see isMapped()).
+        */
+
+    Raster<float> ReadMasked(int z, RasterMask *mask = NULL, bool nanFill = true);
+    Raster<float> ReadWindowMasked(int z, int xOff, int yOff, int xSize, int ySize, RasterMask *mask = NULL, bool nanFill = true);
+    /*
+        * function Raster<float> ReadMasked(int z, RasterMask *mask, bool nanFill):
+        * Reads band z (or a pixel window of it) as float, resolving nodata
+        * in the same pass as the type conversion (SIMD compares):
+        *  - pixels equal to the band's own nodata value, NaN pixels, and
+        *    pixels masked out by the GDAL mask band (RFC 15: .msk, internal
+        *    or per-dataset masks, alpha) are invalid
+        *  - if nanFill, invalid pixels are returned as NaN
+        *  - if mask is not NULL, it is filled with the packed validity bits
+        * Returns an empty Raster on error.
+        */
+
+    size_t Sample(int z, const double *x, const double *y, size_t n, float *values,
+                  SampleMethod method = SAMPLE_BILINEAR, const OGRSpatialReference *srcSRS = NULL);
+    /*
+        * function size_t Sample(int z, const double *x, const double *y, size_t n, float *values, SampleMethod method, const OGRSpatialReference *srcSRS):
+        * Samples band z at n points (x[i], y[i]), given in srcSRS (NULL:
+        * dataset coordinates), with nearest, bilinear or bicubic interpolation.
+        * NaN is returned for points outside the raster or on nodata.
+        * Returns the number of valid samples. For repeated queries keep a
+        * GeotiffSampler instead, so its tile cache survives between batches.
+        */
+
+    Raster<float> Warp(int z, const GeotiffGrid &target, GDALResampleAlg resampling = GRA_Bilinear);
+    /*
+        * function Raster<float> Warp(int z, const GeotiffGrid &target, GDALResampleAlg resampling):
+        * Reprojects / resamples band z onto the target grid, in memory and
+        * multithreaded (see GeotiffWarper). NaN marks target pixels without
+        * data. To align many bands or files to the same grid, keep one
+        * GeotiffWarper so the coordinate transformer is built only once.
+        */
+
+    template<typename T>
+    RasterCube<T> ReadCube(const std::vector<int> &bands, RasterLayout layout);
+    template<typename T>
+    RasterCube<T> ReadCubeWindow(const std::vector<int> &bands, RasterLayout layout, int xOff, int yOff, int xSize, int ySize);
+    /*
+        * function RasterCube<T> ReadCube<T>(const std::vector<int> &bands, RasterLayout layout):
+        * Reads several bands (all of them if bands is empty) into a
+        * single RasterCube, with one GDALDataset::RasterIO call (band
+        * map) per block-row. layout selects planar (RASTER_BSQ) or
+        * pixel interleaved (RASTER_BIP) storage. The cube carries the
+        * no-data, scale and offset of every band (cube.bandInfo).
+        * ReadCubeWindow reads only a pixel window (inside the raster).
+        * Returns an empty cube on error.
+        */
+
+    template<typename T>
+    Raster<T> ReadResampled(int z, int outCols, int outRows, GDALRIOResampleAlg resampling = GRIORA_Average);
+    template<typename T>
+    Raster<T> ReadWindowResampled(int z, int xOff, int yOff, int xSize, int ySize, int outCols, int outRows,
+                                  GDALRIOResampleAlg resampling = GRIORA_Average);
+    /*
+        * function Raster<T> ReadResampled<T>(int z, int outCols, int outRows, GDALRIOResampleAlg resampling):
+        * Reads band z (or a pixel window of it) at a lower resolution, into
+        * an (outCols x outRows) Raster. The coarsest overview that is still
+        * at least as fine as the requested resolution is read, so only a
+        * fraction of the full resolution blocks is decoded. Without a
+        * suitable overview the full resolution band is resampled by GDAL
+        * (GRIORA_Average: mean of the covered pixels, GRIORA_NearestNeighbour:
+        * plain decimation, GRIORA_Mode for class maps, ...).
+        * E.g. ReadResampled<float>(1, nCols/16, nRows/16) for a 1/16 preview.
+        * Returns an empty Raster on error.
+        */
+
+    int GetOverviewCount(int layerIndex);
+    /*
+        * function int GetOverviewCount(int layerIndex):
+        * Returns the number of overviews (internal or .ovr) of the band.
+        */
+
+    bool BuildOverviews(const std::vector<int> &factors = std::vector<int>(), const char *resampling = "AVERAGE",
+                        bool external = false, int nThreads = 0);
+    /*
+        * function bool BuildOverviews(const std::vector<int> &factors, const char *resampling, bool external, int nThreads):
+        * Builds overviews for all bands, with the given decimation factors
+        * (empty: 2, 4, 8, ... down to the size of one block) and resampling
+        * method (GDAL names: "AVERAGE", "NEAREST", "MODE", "CUBIC", ...).
+        * external = true writes them in a .ovr sidecar and leaves the file
+        * untouched; otherwise the file is reopened in update mode and the
+        * overviews are stored inside it. nThreads sets GDAL_NUM_THREADS for
+        * the computation (<= 0: all CPU cores).
+        * Internal overviews reopen the dataset: GetDataset() returns the new
+        * handle afterwards, while the previous one is kept open until the
+        * Geotiff is destroyed, so pointers already taken from it (such as
+        * GeotiffView) stay valid but do not see the new overviews. If the
+        * file cannot be updated or reopened, the object keeps its previous
+        * handle and false is returned.
+        */
+
+    bool GetGeoWindow(double minX, double minY, double maxX, double maxY, int *window);
+    /*
+        * function bool GetGeoWindow(double minX, double minY, double maxX, double maxY, int *window):
+        * Converts a georeferenced bounding box into the pixel window
+        * [xOff, yOff, xSize, ySize] covering it, clipped to the raster,
+        * using the cached geotransform. Returns false if the box does
+        * not intersect the raster.
+        */
+
+    bool GeoToPixel(double geoX, double geoY, double *pixelX, double *pixelY);
+    void PixelToGeo(double pixelX, double pixelY, double *geoX, double *geoY);
+    /*
+        * Conversions between georeferenced and (fractional) pixel
+        * coordinates through the cached geotransform. Pixel (0, 0)
+        * is the upper-left corner of the upper-left pixel.
+        * GeoToPixel returns false if the geotransform is not invertible.
         */
 
   
     template<typename T>
     float** GetArray2D(int layerIndex,float** bandLayer); 
        /*
-        * function float** GetArray2D(int layerIndex): 
+        * function float** GetArray2D(int layerIndex, float** bandLayer): 
         * This function returns a pointer (to a pointer)
         * for a float array that holds the band (array)
         * data from the geotiff, for a specified layer 
         * index layerIndex (1,2,3... for GDAL, for Geotiffs
         * with more than one band or data layer, 3D that is). 
         *
-        * Note this is a template function that is meant 
-        * to take in a valid C++ data type (i.e. char, 
-        * short, int, float), for the Geotiff in question 
-        * such that the Geotiff band data may be properly 
-        * read-in as numbers. Then, this function casts 
-        * the data to a float data type automatically. 
+        * bandLayer is an array of nRows row pointers supplied by
+        * the caller; each row is allocated with new float[nCols]
+        * (release them with delete[]). T is kept so existing
+        * callers still compile: GDAL converts the band to float
+        * while unpacking it, so T does not change the result.
+        *
+        * The band is fetched by whole block-rows (see GetBlockSize), one
+        * RasterIO call per block-row, so each tile/strip is decoded only once.
+        * Returns NULL if the band cannot be read (rows allocated so
+        * far are released).
+        */
+
+    float** GetArray2D(int layerIndex,Raster<float> &bandLayer); 
+       /*
+        * function float** GetArray2D(int layerIndex, Raster<float> &bandLayer): 
+        * Same read, into bandLayer (nCols x nRows) instead of separate
+        * rows. Returns the row pointer view of bandLayer, or NULL if
+        * the band cannot be read or bandLayer has the wrong size.
         */
- 
-       // get the raster data type (ENUM integer 1-12, 
-       // see GDAL C/C++ documentation for more details)         
 
-    // template<typename T>
     float* GetArray1D(int layerIndex,float* bandLayer);
+       /*
+        * function float* GetArray1D(int layerIndex, float* bandLayer):
+        * Reads band layerIndex into a flat, row-major float array
+        * (nCols*nRows elements). If bandLayer is not NULL it is used
+        * as the output buffer and must hold nCols*nRows floats;
+        * if NULL, a new array is allocated (release with delete[]).
+        * The data is read once, straight into the output buffer:
+        * small integer types are widened in place with SIMD (see
+        * geotiff_simd.hpp), other types are converted by GDAL.
+        * Returns NULL if the band cannot be read (an array allocated
+        * here is released first).
+        */
 
 };
 
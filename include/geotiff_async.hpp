@@ -0,0 +1,130 @@
+#ifndef _GEOTIFF_ASYNC_HPP_
+#define _GEOTIFF_ASYNC_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <gdal_priv.h>
+#include "raster.hpp"
+#include "geotiff_pool.hpp"
+
+// Default number of I/O threads of a GeotiffAsyncReader
+#define GEOTIFF_ASYNC_THREADS 4
+// Maximum number of queued requests: submitting more blocks the caller (back-pressure)
+#define GEOTIFF_ASYNC_MAX_PENDING 1024
+// Pending requests inspected when looking for windows to merge with the one being served
+#define GEOTIFF_ASYNC_MERGE_SCAN 64
+// Maximum size (pixels) of a merged read
+#define GEOTIFF_ASYNC_MAX_MERGE_PIXELS (16*1024*1024)
+
+// Outcome of an asynchronous read
+struct GeotiffAsyncResult {
+  int band;               // 1-indexed band number
+  int xOff, yOff;         // requested window
+  int xSize, ySize;
+  Raster<float> data;     // (xSize x ySize) pixels, empty on error
+  std::string error;      // error message (empty on success)
+
+  GeotiffAsyncResult() : band(0), xOff(0), yOff(0), xSize(0), ySize(0) {}
+  bool isValid() const { return error.empty() && !data.isEmpty(); }
+};
+
+class GeotiffAsyncReader {
+
+  public:
+
+    typedef std::function<void(GeotiffAsyncResult &result)> Callback;
+
+  private:
+
+    struct Request {
+      GeotiffAsyncResult result;                  // window, then data or error
+      Callback callback;                          // if empty, the promise is fulfilled instead
+      std::promise<GeotiffAsyncResult> promise;
+    };
+
+    std::string filename;
+    std::vector<GDALDataset *> handles;  // one independent handle per I/O thread
+    std::vector<GeotiffDatasetLease> leases; // pooled handles behind handles[]
+    std::vector<std::thread> workers;
+    int nRows, nCols, nBands;
+    std::vector<int> blockXSizes, blockYSizes; // natural block size of each band (tile requests)
+    bool bValid;
+
+    std::mutex lock;
+    std::condition_variable queueNotEmpty, queueNotFull, queueDrained;
+    std::list<Request> pending;          // FIFO of requests not yet picked by a worker
+    size_t maxPending;
+    size_t nActive;                      // requests being served by the workers
+    bool bStop;
+    size_t nReads, nRequests, nMerged;
+
+    void Submit(Request &request);
+    void Worker(int worker);
+    static void Complete(Request &request);
+
+  public:
+
+    GeotiffAsyncReader(const char *filename, int nThreads = GEOTIFF_ASYNC_THREADS, size_t maxQueued = GEOTIFF_ASYNC_MAX_PENDING);
+    /*
+     * Leases nThreads independent read-only handles on filename (nThreads
+     * <= 0: one per CPU core) from the dataset pool, and starts one I/O
+     * thread per handle.
+     */
+
+    ~GeotiffAsyncReader();
+    /*
+     * Serves every request already submitted, then stops the I/O threads.
+     */
+
+    GeotiffAsyncReader(const GeotiffAsyncReader &) = delete;
+    GeotiffAsyncReader &operator=(const GeotiffAsyncReader &) = delete;
+
+    bool isValid() { return bValid; }
+    void GetDimensions(int *dim);
+    void GetBlockSize(int band, int *blockSize);
+
+    std::future<GeotiffAsyncResult> ReadWindow(int band, int xOff, int yOff, int xSize, int ySize);
+    void ReadWindow(int band, int xOff, int yOff, int xSize, int ySize, const Callback &callback);
+    /*
+     * function std::future<GeotiffAsyncResult> ReadWindow(int band, int xOff, int yOff, int xSize, int ySize)
+     * Queues the read of a pixel window of band (as float) and returns at
+     * once. The result is delivered through the future, or passed to
+     * callback on an I/O thread (it may move result.data out; it must not
+     * block for long, nor throw). Errors (invalid band or window, GDAL read errors)
+     * are reported in result.error, never by exceptions or exit().
+     * Pending requests on the same band whose windows overlap or touch are
+     * served together by a single RasterIO call on their bounding box, so
+     * shared blocks are decoded once. Blocks the caller while maxQueued
+     * requests are already queued.
+     */
+
+    std::future<GeotiffAsyncResult> ReadTile(int band, int tileX, int tileY);
+    void ReadTile(int band, int tileX, int tileY, const Callback &callback);
+    /*
+     * function std::future<GeotiffAsyncResult> ReadTile(int band, int tileX, int tileY)
+     * Same as ReadWindow for block (tileX, tileY) of the band natural
+     * block grid (see GetBlockSize(band)), clipped to the raster.
+     */
+
+    void Wait();
+    /*
+     * function void Wait()
+     * Blocks until every submitted request has been completed
+     */
+
+    void GetCounters(size_t *reads, size_t *requests, size_t *merged);
+    /*
+     * function void GetCounters(size_t *reads, size_t *requests, size_t *merged)
+     * Returns the number of RasterIO calls issued, of requests served, and
+     * of requests served by a read shared with other requests
+     */
+};
+
+#endif
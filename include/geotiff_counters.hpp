@@ -0,0 +1,143 @@
+#ifndef _GEOTIFF_COUNTERS_HPP_
+#define _GEOTIFF_COUNTERS_HPP_
+
+#include <string>
+
+// I/O instrumentation. The counters are only updated when the library is built with
+// GEOTIFF_ENABLE_STATS (cmake -DGEOTIFF_ENABLE_STATS=ON); otherwise the GEOTIFF_STATS_* macros
+// expand to nothing (their arguments are not even evaluated) and the counters stay at zero
+
+// Public read entry points with their own call count and time
+enum GeotiffCall {
+  GEOTIFF_CALL_GETARRAY2D = 0,
+  GEOTIFF_CALL_GETARRAY1D,
+  GEOTIFF_CALL_READ,              // Read<T>, ReadRaster
+  GEOTIFF_CALL_READ_WINDOW,       // ReadWindow<T>, ReadGeoWindow<T>
+  GEOTIFF_CALL_READ_MASKED,       // ReadMasked, ReadWindowMasked
+  GEOTIFF_CALL_READ_RESAMPLED,    // ReadResampled<T>, ReadWindowResampled<T>
+  GEOTIFF_CALL_READ_CUBE,         // ReadCube<T>, ReadCubeWindow<T>
+  GEOTIFF_CALL_VIEW_TILE,         // GeotiffView tile cache misses
+  GEOTIFF_CALL_PARALLEL_TILE,     // GeotiffParallelReader tile reads
+  GEOTIFF_CALL_ASYNC_READ,        // GeotiffAsyncReader (one per merged read)
+  GEOTIFF_CALL_PIPELINE_BLOCK,    // GeotiffPipeline input blocks
+  GEOTIFF_CALL_SAMPLE,            // GeotiffSampler::Sample
+  GEOTIFF_CALL_WARP,              // GeotiffWarper::Warp, WarpWindow
+  GEOTIFF_CALL_MOSAIC,            // GeotiffMosaic::Read, Sample
+  GEOTIFF_CALL_COUNT
+};
+
+struct GeotiffCallCounters {
+  unsigned long long calls;
+  double seconds;                 // wall time spent inside the call (summed over threads)
+};
+
+struct GeotiffCounters {
+  bool enabled;                           // false: built without GEOTIFF_ENABLE_STATS, everything is zero
+  unsigned long long bytesRead;           // bytes delivered by RasterIO into the caller buffers
+  unsigned long long rasterIOCalls;
+  unsigned long long blocksRead;          // natural blocks intersected by the RasterIO windows (decoded unless cached by GDAL)
+  double rasterIOSeconds;
+  double conversionSeconds;               // library side type conversion / masking (GDAL internal conversion is in rasterIOSeconds)
+  unsigned long long allocations;         // Raster / RasterCube buffers and GetArray1D arrays
+  unsigned long long allocationBytes;
+  double allocationSeconds;
+  GeotiffCallCounters calls[GEOTIFF_CALL_COUNT];
+};
+
+const char *GeotiffCallName(int call);
+/*
+ * function const char *GeotiffCallName(int call)
+ * Name of a GeotiffCall entry, as used in the JSON report
+ */
+
+GeotiffCounters GeotiffGetCounters();
+/*
+ * function GeotiffCounters GeotiffGetCounters()
+ * Snapshot of the process-wide counters (thread-safe). Counters of
+ * concurrent calls may be caught half updated.
+ */
+
+void GeotiffResetCounters();
+
+std::string GeotiffCountersToJSON(const GeotiffCounters &counters);
+/*
+ * function std::string GeotiffCountersToJSON(const GeotiffCounters &counters)
+ * Returns the counters as a JSON object; calls holds only the entry points
+ * that were called at least once.
+ */
+
+#ifdef GEOTIFF_ENABLE_STATS
+
+#include <atomic>
+#include <chrono>
+#include <gdal_priv.h>
+
+struct GeotiffCounterState {
+  std::atomic<unsigned long long> bytesRead, rasterIOCalls, blocksRead, rasterIONanos, conversionNanos;
+  std::atomic<unsigned long long> allocations, allocationBytes, allocationNanos;
+  std::atomic<unsigned long long> callCount[GEOTIFF_CALL_COUNT], callNanos[GEOTIFF_CALL_COUNT];
+};
+
+extern GeotiffCounterState geotiffCounterState;
+
+inline unsigned long long GeotiffStatsClock(){
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Number of natural blocks of poBand intersected by a pixel window
+inline unsigned long long GeotiffStatsBlocks(GDALRasterBand *poBand, int xOff, int yOff, int xSize, int ySize){
+  int bx, by;
+  poBand->GetBlockSize(&bx, &by);
+  if (bx <= 0 || by <= 0 || xSize <= 0 || ySize <= 0)
+    return 0;
+  return (unsigned long long)((xOff + xSize - 1)/bx - xOff/bx + 1) * ((yOff + ySize - 1)/by - yOff/by + 1);
+}
+
+inline void GeotiffStatsRasterIO(unsigned long long start, unsigned long long bytes, unsigned long long blocks){
+  geotiffCounterState.rasterIONanos += GeotiffStatsClock() - start;
+  geotiffCounterState.rasterIOCalls++;
+  geotiffCounterState.bytesRead += bytes;
+  geotiffCounterState.blocksRead += blocks;
+}
+
+inline void GeotiffStatsConversion(unsigned long long start){
+  geotiffCounterState.conversionNanos += GeotiffStatsClock() - start;
+}
+
+inline void GeotiffStatsAllocation(unsigned long long start, unsigned long long bytes){
+  geotiffCounterState.allocationNanos += GeotiffStatsClock() - start;
+  geotiffCounterState.allocations++;
+  geotiffCounterState.allocationBytes += bytes;
+}
+
+// Counts a call and its duration, from construction to the end of the scope
+class GeotiffCallTimer {
+    GeotiffCall call;
+    unsigned long long start;
+  public:
+    explicit GeotiffCallTimer(GeotiffCall c) : call(c), start(GeotiffStatsClock()) {}
+    ~GeotiffCallTimer(){
+      geotiffCounterState.callNanos[call] += GeotiffStatsClock() - start;
+      geotiffCounterState.callCount[call]++;
+    }
+    GeotiffCallTimer(const GeotiffCallTimer &) = delete;
+    GeotiffCallTimer &operator=(const GeotiffCallTimer &) = delete;
+};
+
+#define GEOTIFF_STATS_CALL(call)                  GeotiffCallTimer geotiffCallTimer_(call)
+#define GEOTIFF_STATS_START(t)                    unsigned long long t = GeotiffStatsClock()
+#define GEOTIFF_STATS_RASTERIO(t, bytes, blocks)  GeotiffStatsRasterIO(t, bytes, blocks)
+#define GEOTIFF_STATS_CONVERSION(t)               GeotiffStatsConversion(t)
+#define GEOTIFF_STATS_ALLOCATION(t, bytes)        GeotiffStatsAllocation(t, bytes)
+
+#else
+
+#define GEOTIFF_STATS_CALL(call)
+#define GEOTIFF_STATS_START(t)
+#define GEOTIFF_STATS_RASTERIO(t, bytes, blocks)
+#define GEOTIFF_STATS_CONVERSION(t)
+#define GEOTIFF_STATS_ALLOCATION(t, bytes)
+
+#endif
+
+#endif
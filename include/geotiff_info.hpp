@@ -0,0 +1,75 @@
+#ifndef _GEOTIFF_INFO_HPP_
+#define _GEOTIFF_INFO_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+
+// Metadata of a GeoTIFF file, read without the full Geotiff setup: no pixel data,
+// no OGRSpatialReference and no console output. Compact enough to index ~10^5 files
+struct GeotiffInfo {
+  std::string filename;
+  int cols, rows, bands;
+  GDALDataType dataType;          // data type of band 1
+  int blockXSize, blockYSize;     // natural block size of band 1
+  double geotransform[6];
+  bool hasGeoTransform;           // false: geotransform is the identity (pixel coordinates)
+  bool hasNoData;
+  double noData;                  // nodata of band 1
+  int epsg;                       // EPSG code from the GeoKeys, 0 if there is none (user-defined or no CRS)
+  std::string wkt;                // dataset SRS as WKT, only when requested (see GeotiffReadInfo)
+
+  GeotiffInfo();
+  bool isValid() const { return cols > 0 && rows > 0; }
+
+  void GetExtent(double *extent) const;
+  /*
+   * function void GetExtent(double *extent)
+   * Bounding box [minX, minY, maxX, maxY] of the raster footprint in
+   * georeferenced coordinates (the four corners, so rotated geotransforms
+   * are enclosed)
+   */
+
+  OGRSpatialReference *CreateSpatialRef() const;
+  /*
+   * function OGRSpatialReference *CreateSpatialRef()
+   * Builds the SRS on demand (owned by the caller): from wkt if it was
+   * kept, from the EPSG code otherwise, or by reopening the file as a last
+   * resort. Returns NULL if the file has no SRS.
+   */
+};
+
+int GeotiffParseEPSG(const char *wkt);
+/*
+ * function int GeotiffParseEPSG(const char *wkt)
+ * Returns the EPSG code of the root node of a WKT1 (AUTHORITY["EPSG","n"])
+ * or WKT2 (ID["EPSG",n]) definition, 0 if there is none. Plain text scan,
+ * no OGR parsing.
+ */
+
+bool GeotiffReadInfo(const char *filename, GeotiffInfo &info, bool withWKT = false);
+/*
+ * function bool GeotiffReadInfo(const char *filename, GeotiffInfo &info, bool withWKT)
+ * Opens filename with the GTiff driver only, fills info and closes it.
+ * The handle is not taken from the dataset pool (metadata scans would
+ * flush it). The EPSG code is read from the GeoKeyDirectory of the file,
+ * so no OGR object is built. withWKT: also keep the SRS WKT in info.wkt
+ * (built by the driver), and take the EPSG code from it when the GeoKeys
+ * have none (e.g. SRS from a .aux.xml sidecar).
+ * Returns false (silently) if the file is not a readable GeoTIFF.
+ */
+
+std::vector<GeotiffInfo> GeotiffScanDirectory(const char *directory, bool recursive = false, int nThreads = 0,
+                                              bool withWKT = false, std::vector<std::string> *failed = NULL);
+/*
+ * function std::vector<GeotiffInfo> GeotiffScanDirectory(const char *directory, bool recursive, int nThreads, bool withWKT, std::vector<std::string> *failed)
+ * Reads the metadata of every .tif / .tiff file in directory (and its
+ * subdirectories if recursive) on nThreads threads (<= 0: one per CPU core).
+ * Each directory is listed once and its listing handed to GDAL, so opening
+ * a file does not list its directory again. Files that cannot be read are
+ * skipped (and appended to failed, if given). The index is sorted by file name.
+ */
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef _GEOTIFF_MMAP_HPP_
+#define _GEOTIFF_MMAP_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <gdal_priv.h>
+#include "raster.hpp"
+
+class Geotiff;
+
+// Read-only memory mapping of a whole file, shared by the views built on it
+class GeotiffMappedFile {
+
+  private:
+
+    const unsigned char *address;
+    size_t length;
+
+  public:
+
+    explicit GeotiffMappedFile(const char *filename);
+    /*
+     * Maps filename read-only (PROT_READ, MAP_SHARED): every process mapping
+     * the same file shares its page cache pages. isValid() is false if the
+     * file cannot be opened or mapped (e.g. /vsi paths).
+     * The file must not be rewritten in place while it is mapped: pages
+     * past the end of a truncated file raise SIGBUS when read (GDAL Create
+     * on the same path truncates it), and writes show through the views.
+     * Write a new file and rename() it over the old path instead: the
+     * mapping keeps the old inode alive.
+     */
+
+    ~GeotiffMappedFile();
+
+    GeotiffMappedFile(const GeotiffMappedFile &) = delete;
+    GeotiffMappedFile &operator=(const GeotiffMappedFile &) = delete;
+
+    bool isValid() const { return address != NULL; }
+    const unsigned char *GetAddress() const { return address; }
+    size_t GetLength() const { return length; }
+};
+
+template<typename T>
+class GeotiffMappedBand {
+
+  private:
+
+    std::shared_ptr<GeotiffMappedFile> file; // mapping (NULL when falling back to a regular read)
+    Raster<T> fallback;                      // band data read with Geotiff::Read<T> when it cannot be mapped
+    std::vector<const T *> blocks;           // first sample of each block of the band, blockY * nBlocksX + blockX
+    int nCols, nRows;
+    int nBlockXSize, nBlockYSize, nBlocksX;
+    size_t lineSpace;                        // distance between rows inside a block, in elements
+    size_t pixelSpace;                       // distance between pixels of a row, in elements (bands if pixel interleaved)
+
+    bool Map(GDALDataset *dataset, const char *filename, int band);
+
+  public:
+
+    GeotiffMappedBand();
+    GeotiffMappedBand(Geotiff &geotiff, int band = 1);
+    /*
+     * Creates a read-only typed view over band of an uncompressed GTiff,
+     * straight over a memory mapping of the file: no RasterIO call, no
+     * buffer and no copy. The blocks are located through the TIFF
+     * BLOCK_OFFSET_x_y / BLOCK_SIZE_x_y metadata, so striped and tiled
+     * files (band or pixel interleaved) are supported.
+     * If the band cannot be mapped (compression, non-native byte order,
+     * T different from the band native type, sparse or unaligned blocks,
+     * NBITS, not a plain file...), the band is read with Geotiff::Read<T>
+     * and the view serves that copy instead: check isMapped() to know.
+     * A mapped view must not outlive in-place rewrites of the file (SIGBUS,
+     * see GeotiffMappedFile).
+     */
+
+    GeotiffMappedBand(const GeotiffMappedBand &) = delete;
+    GeotiffMappedBand &operator=(const GeotiffMappedBand &) = delete;
+    GeotiffMappedBand(GeotiffMappedBand &&other) = default;
+    GeotiffMappedBand &operator=(GeotiffMappedBand &&other) = default;
+
+    bool isValid() const { return !blocks.empty(); }
+    bool isMapped() const { return file != NULL && !blocks.empty(); }
+
+    int GetCols() const { return nCols; }
+    int GetRows() const { return nRows; }
+    int GetBlockXSize() const { return nBlockXSize; }
+    int GetBlockYSize() const { return nBlockYSize; }
+    size_t GetLineSpace() const { return lineSpace; }
+    size_t GetPixelSpace() const { return pixelSpace; }
+
+    const T &operator()(int x, int y) const {
+      const T *block = blocks[(size_t)(y / nBlockYSize) * nBlocksX + x / nBlockXSize];
+      return block[(size_t)(y % nBlockYSize) * lineSpace + (size_t)(x % nBlockXSize) * pixelSpace];
+    }
+    /*
+     * Pixel (x, y). No bounds checking.
+     */
+
+    const T *GetBlock(int blockX, int blockY) const { return blocks[(size_t)blockY * nBlocksX + blockX]; }
+    /*
+     * function const T *GetBlock(int blockX, int blockY)
+     * First pixel of a block: (GetBlockXSize() x GetBlockYSize()) pixels,
+     * rows GetLineSpace() and pixels GetPixelSpace() elements apart.
+     * Right / bottom tiles are stored full size, bottom strips are shorter.
+     */
+
+    const T *GetRow(int y) const {
+      if (nBlockXSize != nCols)
+        return NULL;
+      return blocks[y / nBlockYSize] + (size_t)(y % nBlockYSize) * lineSpace;
+    }
+    /*
+     * function const T *GetRow(int y)
+     * Row y (pixels GetPixelSpace() elements apart) for striped files and
+     * fallback reads; NULL for tiled files, where rows are split in tiles.
+     */
+};
+
+#endif
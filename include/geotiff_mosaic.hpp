@@ -0,0 +1,154 @@
+#ifndef _GEOTIFF_MOSAIC_HPP_
+#define _GEOTIFF_MOSAIC_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include "raster.hpp"
+#include "geotiff_info.hpp"
+
+// Maximum number of children of an R-tree node
+#define GEOTIFF_MOSAIC_NODE_SIZE 16
+// Largest output of GeotiffMosaic::Read (pixels): 1 GiB of float
+#define GEOTIFF_MOSAIC_MAX_PIXELS (256.0*1024*1024)
+// Tiles kept open between reads (least recently used are closed first)
+#define GEOTIFF_MOSAIC_MAX_OPEN_TILES 32
+// Block cache budget of every open tile used by Sample (bytes)
+#define GEOTIFF_MOSAIC_VIEW_CACHE (8*1024*1024)
+
+// How overlapping tiles are combined into the mosaic
+enum MosaicOverlap {
+  MOSAIC_FIRST = 0,   // the first tile (in index order) with a valid pixel wins
+  MOSAIC_LAST  = 1,   // the last tile with a valid pixel wins
+  MOSAIC_MEAN  = 2    // mean of the valid pixels of every tile
+};
+
+class Geotiff;
+class GeotiffView;
+
+// Mosaic over many GeoTIFF tiles, indexed by footprint in a packed R-tree.
+// Tiles must share the SRS and be north-up (no rotation terms in the geotransform)
+class GeotiffMosaic {
+
+  private:
+
+    struct Node {
+      double box[4];      // [minX, minY, maxX, maxY] of every child
+      int first, count;   // children: nodes[first ...] or, for leaves, order[first ...]
+      bool leaf;
+    };
+
+    std::vector<GeotiffInfo> tiles;
+    std::vector<double> extents;  // 4 per tile, see GeotiffInfo::GetExtent
+    std::vector<int> order;       // tile indices, in leaf order
+    std::vector<Node> nodes;      // root last
+    MosaicOverlap overlap;
+    double resX, resY;            // output pixel size (resY > 0, rows go north to south)
+    double originX, originY;      // output pixel grid anchor (upper-left corner of the first tile)
+
+    struct TileHandle {
+      Geotiff *geotiff;           // open tile (its dataset handle is leased from the pool)
+      GeotiffView *view;          // block cache of viewBand, used by Sample (NULL until sampled)
+      int viewBand;
+      bool viewMasked;            // viewBand has a real mask band: samples go through ReadWindowMasked
+      bool hasNoData;
+      float noData;
+      std::list<int>::iterator lruPosition;
+    };
+
+    std::unordered_map<int, TileHandle> handles;  // open tiles, keyed by tile index
+    std::list<int> handleLru;                     // open tile indices, most recently used first
+
+    void BuildTree();
+    void Search(double minX, double minY, double maxX, double maxY, std::vector<int> &result) const;
+    TileHandle *OpenTile(int tile);
+    void CloseTile(int tile);
+    float TileValue(int tile, int band, int col, int row);
+    float SamplePoint(int band, double x, double y, std::vector<int> &hits);
+
+  public:
+
+    GeotiffMosaic();
+    ~GeotiffMosaic();
+
+    GeotiffMosaic(const GeotiffMosaic &) = delete;
+    GeotiffMosaic &operator=(const GeotiffMosaic &) = delete;
+
+    bool Build(const std::vector<GeotiffInfo> &index);
+    /*
+     * function bool Build(const std::vector<GeotiffInfo> &index)
+     * Indexes the footprints of the tiles (see GeotiffReadInfo and
+     * GeotiffScanDirectory): no file is opened. Tiles with rotated
+     * geotransforms, or with an EPSG code different from the first tile,
+     * are skipped. The index order is the order used by MOSAIC_FIRST / LAST.
+     * The output grid is anchored on the first tile, with its pixel size.
+     * Returns false if no tile could be indexed. Tiles left open by
+     * previous reads are closed.
+     */
+
+    bool BuildFromDirectory(const char *directory, bool recursive = false, int nThreads = 0);
+    /*
+     * function bool BuildFromDirectory(const char *directory, bool recursive, int nThreads)
+     * Scans directory (GeotiffScanDirectory) and builds the index from it
+     */
+
+    bool Save(const char *filename) const;
+    bool Load(const char *filename);
+    /*
+     * function bool Save(const char *filename)
+     * Writes the tile index (file names, dimensions, geotransforms, nodata,
+     * EPSG) as plain text. Load() restores it and rebuilds the R-tree
+     * without opening any tile. Both return false on I/O or format errors.
+     */
+
+    void SetOverlap(MosaicOverlap rule) { overlap = rule; }
+    MosaicOverlap GetOverlap() const { return overlap; }
+
+    void SetResolution(double pixelX, double pixelY);
+    /*
+     * function void SetResolution(double pixelX, double pixelY)
+     * Output pixel size (absolute values), by default the one of the first
+     * tile. Tiles with a different pixel size are resampled (nearest).
+     */
+
+    size_t GetTileCount() const { return tiles.size(); }
+    const GeotiffInfo &GetTile(size_t i) const { return tiles[i]; }
+
+    std::vector<int> Query(double minX, double minY, double maxX, double maxY) const;
+    std::vector<int> Query(double x, double y) const;
+    /*
+     * function std::vector<int> Query(double minX, double minY, double maxX, double maxY)
+     * Indices of the tiles whose footprint intersects the box (or contains
+     * the point), in index order. Uses the R-tree only: no file is opened.
+     */
+
+    Raster<float> Read(int band, double minX, double minY, double maxX, double maxY, double *geotransform = NULL);
+    /*
+     * function Raster<float> Read(int band, double minX, double minY, double maxX, double maxY, double *geotransform)
+     * Reads band of the mosaic over the box (snapped outwards to the output
+     * pixel grid) as one raster. Only the tiles intersecting the box are
+     * opened, and only the window of each tile covering the box is read.
+     * Up to GEOTIFF_MOSAIC_MAX_OPEN_TILES tiles stay open between calls.
+     * Overlaps are resolved with the overlap rule; nodata of the tiles and
+     * uncovered pixels are NaN. The geotransform of the result is returned
+     * in geotransform if not NULL. Returns an empty Raster if the box is
+     * invalid, larger than GEOTIFF_MOSAIC_MAX_PIXELS, or if the output
+     * cannot be allocated.
+     */
+
+    float Sample(int band, double x, double y);
+    size_t Sample(int band, const double *x, const double *y, size_t n, float *values);
+    /*
+     * function float Sample(int band, double x, double y)
+     * Value of the mosaic at (x, y): the value Read() returns for the output
+     * pixel containing the point (same grid, same nearest mapping, same
+     * overlap rule). NaN if no tile has a valid pixel there.
+     * The batched form samples n points into values and returns the number
+     * of valid (non NaN) samples. Open tiles keep a small block cache
+     * (GEOTIFF_MOSAIC_VIEW_CACHE), so nearby points decode each block once.
+     */
+};
+
+#endif
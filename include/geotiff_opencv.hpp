@@ -0,0 +1,48 @@
+#ifndef _GEOTIFF_OPENCV_HPP_
+#define _GEOTIFF_OPENCV_HPP_
+
+// OpenCV bridge. Only built when CMake finds OpenCV (GEOTIFF_WITH_OPENCV is then defined)
+
+#include <vector>
+#include <gdal_priv.h>
+#include <opencv2/core/core.hpp>
+#include "geotiff_writer.hpp"
+
+class Geotiff;
+
+int GeotiffCvDepth(GDALDataType dataType);
+GDALDataType GeotiffGDALType(int cvDepth);
+/*
+ * function int GeotiffCvDepth(GDALDataType dataType)
+ * OpenCV depth holding dataType without loss (UInt32 -> CV_64F, as OpenCV has no
+ * unsigned 32-bit depth), -1 if there is none (complex types).
+ * GeotiffGDALType() is the reverse mapping (GDT_Unknown if the depth has no GDAL type).
+ */
+
+bool GeotiffReadMat(Geotiff &geotiff, int band, cv::Mat &mat);
+bool GeotiffReadMatWindow(Geotiff &geotiff, int band, int xOff, int yOff, int xSize, int ySize, cv::Mat &mat);
+bool GeotiffReadMatBands(Geotiff &geotiff, const std::vector<int> &bands, int xOff, int yOff, int xSize, int ySize, cv::Mat &mat);
+/*
+ * function bool GeotiffReadMatWindow(Geotiff &geotiff, int band, int xOff, int yOff, int xSize, int ySize, cv::Mat &mat)
+ * Reads a band (or a pixel window of it) straight into mat: GDAL decodes
+ * the blocks into the Mat buffer (honoring its row step, so a ROI of a
+ * larger Mat works too) with no intermediate buffer. If mat already has
+ * the window size and one channel, its buffer and depth are kept and GDAL
+ * converts to that depth; otherwise mat is (re)allocated with the depth
+ * of the band (see GeotiffCvDepth).
+ * GeotiffReadMatBands reads several bands into the channels of one
+ * pixel-interleaved Mat (one channel per band, up to CV_CN_MAX).
+ * Returns false on invalid windows, bands or unsupported depths.
+ */
+
+bool GeotiffWriteMat(const char *filename, const cv::Mat &mat, Geotiff &reference,
+                     const GeotiffWriterOptions &options = GeotiffWriterOptions());
+/*
+ * function bool GeotiffWriteMat(const char *filename, const cv::Mat &mat, Geotiff &reference, const GeotiffWriterOptions &options)
+ * Writes mat (one band per channel, in the Mat depth) to a new GeoTIFF with
+ * the geotransform, spatial reference and band 1 nodata of reference,
+ * which is expected to share the Mat grid. The Mat buffer is handed to
+ * GDAL as is (row step and channel interleaving included), no copy.
+ */
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef _GEOTIFF_PARALLEL_HPP_
+#define _GEOTIFF_PARALLEL_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <gdal_priv.h>
+#include "raster.hpp"
+#include "geotiff_pool.hpp"
+
+// Minimum size (bytes) of each tile task. Small blocks (e.g. scanline strips) are grouped up to this size
+#define GEOTIFF_PARALLEL_TASK_BYTES (1024*1024)
+
+// Unit of work of the parallel reader: a block-aligned window of one band
+struct GeotiffTileTask {
+  int band;             // 1-indexed band number
+  int xOff, yOff;       // upper-left pixel of the tile in the band
+  int xSize, ySize;     // tile size, in pixels
+  int output;           // index of the output this tile belongs to (e.g. position in the band list)
+};
+
+class GeotiffParallelReader {
+
+  private:
+
+    // Per-worker task queue. The owner pops from the front (tiles in raster order, good locality),
+    // idle workers steal from the back (the tiles the owner would reach last)
+    struct WorkQueue {
+      std::mutex lock;
+      std::deque<GeotiffTileTask> tasks;
+    };
+
+    static bool NextTask(std::vector<WorkQueue> &queues, int worker, GeotiffTileTask &task);
+
+    std::string filename;
+    std::vector<GDALDataset *> handles; // one independent GDAL handle per worker (GDAL handles are not thread-safe)
+    std::vector<GeotiffDatasetLease> leases; // pooled handles behind handles[]
+    int nRows, nCols, nBands;
+    bool bValid;
+
+    template<typename T>
+    bool ReadTiles(const std::vector<GeotiffTileTask> &tiles, std::vector<Raster<T> > &outputs, const std::vector<int> &xOffsets, const std::vector<int> &yOffsets);
+
+  public:
+
+    GeotiffParallelReader(const char *filename, int nThreads = 0);
+    /*
+     * Leases nThreads independent read-only handles on the same file
+     * (nThreads <= 0: one per available CPU core). Each worker thread
+     * only ever uses its own handle.
+     */
+
+    ~GeotiffParallelReader();
+
+    GeotiffParallelReader(const GeotiffParallelReader &) = delete;
+    GeotiffParallelReader &operator=(const GeotiffParallelReader &) = delete;
+
+    bool isValid() { return bValid; }
+    int GetThreadCount() { return (int)handles.size(); }
+    void GetDimensions(int *dim);
+    /*
+     * Returns in dim[0], dim[1], dim[2] the number of columns, rows and bands
+     */
+
+    std::vector<GeotiffTileTask> MakeTiles(int band, int xOff, int yOff, int xSize, int ySize, int output = 0);
+    /*
+     * function std::vector<GeotiffTileTask> MakeTiles(...)
+     * Splits a pixel window of a band into tile tasks aligned to the
+     * band block size (tiles, or groups of strips of at least
+     * GEOTIFF_PARALLEL_TASK_BYTES), so each block is decoded once.
+     */
+
+    bool ForEachTile(const std::vector<GeotiffTileTask> &tiles,
+                     const std::function<bool(GDALDataset *dataset, const GeotiffTileTask &tile, int worker)> &process);
+    /*
+     * function bool ForEachTile(tiles, process)
+     * Runs process() once per tile on the worker threads, with a work
+     * stealing scheduler: tiles are dealt in contiguous runs to the
+     * workers, and a worker that runs out of tiles steals from the
+     * back of another worker's queue. process() receives the worker's own
+     * dataset handle. Returns false if any call returned false (the
+     * remaining tiles are skipped).
+     */
+
+    template<typename T>
+    std::vector<Raster<T> > ReadBands(const std::vector<int> &bands);
+    /*
+     * function std::vector<Raster<T> > ReadBands<T>(const std::vector<int> &bands)
+     * Reads several full bands, with the tiles of all of them spread over
+     * the workers. GDAL writes each tile straight into its place in the
+     * output rasters (eBufType from T, as in Geotiff::Read<T>).
+     * Returns an empty vector if any tile cannot be read.
+     */
+
+    template<typename T>
+    Raster<T> ReadWindow(int band, int xOff, int yOff, int xSize, int ySize);
+    /*
+     * function Raster<T> ReadWindow<T>(int band, int xOff, int yOff, int xSize, int ySize)
+     * Reads a pixel window (or a full band) of one band, splitting it in
+     * tiles read in parallel. Returns an empty Raster on error.
+     */
+};
+
+#endif
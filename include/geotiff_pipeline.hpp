@@ -0,0 +1,92 @@
+#ifndef _GEOTIFF_PIPELINE_HPP_
+#define _GEOTIFF_PIPELINE_HPP_
+
+#include <vector>
+#include <functional>
+#include "raster.hpp"
+
+class Geotiff;
+class GeotiffWriter;
+
+// Block of the raster being processed by a GeotiffPipeline kernel
+struct PipelineBlock {
+  int index;            // block number, in raster order (0, 1, ...)
+  int xOff, yOff;       // upper-left pixel of the block in the raster
+  int xSize, ySize;     // block size (without halo), in pixels
+  int halo;             // halo width, in pixels, around every input block
+};
+
+// Kernel: computes one output block from the input blocks.
+// inputs[i] is (xSize + 2*halo) x (ySize + 2*halo): input pixel (halo + x, halo + y) is raster pixel
+// (xOff + x, yOff + y). Halo pixels outside the raster are NaN. output is (xSize x ySize).
+// Kernels run concurrently on several blocks, so they must not modify shared state without locking.
+typedef std::function<bool(const std::vector<const Raster<float> *> &inputs, Raster<float> &output,
+                           const PipelineBlock &block)> PipelineKernel;
+
+// Sink: consumes the output blocks, one at a time and in raster order (e.g. a reducer)
+typedef std::function<bool(const Raster<float> &output, const PipelineBlock &block)> PipelineSink;
+
+class GeotiffPipeline {
+
+  private:
+
+    struct Input {
+      Geotiff *geotiff;
+      int band;
+    };
+
+    std::vector<Input> inputs;
+    int halo;             // halo width around every input block
+    int blockRows;        // rows per block (0: derived from the first input block size)
+    int nWorkers;         // compute threads
+    int maxInFlight;      // maximum number of blocks between the read and the sink stages
+    int nRows, nCols;
+
+    bool ReadBlock(const PipelineBlock &block, std::vector<Raster<float> > &blockInputs);
+
+  public:
+
+    GeotiffPipeline();
+
+    bool AddInput(Geotiff &geotiff, int band = 1);
+    /*
+     * function bool AddInput(Geotiff &geotiff, int band)
+     * Adds a band to the inputs. All inputs must have the same size.
+     * While Run() is active only the pipeline reader thread uses the
+     * inputs' GDAL datasets.
+     */
+
+    void SetHalo(int pixels) { halo = (pixels > 0) ? pixels : 0; }
+    void SetBlockRows(int rows) { blockRows = (rows > 0) ? rows : 0; }
+    void SetWorkers(int threads) { nWorkers = (threads > 0) ? threads : 1; }
+    void SetMaxInFlight(int blocks) { maxInFlight = (blocks > 0) ? blocks : 1; }
+    /*
+     * Pipeline settings:
+     *  - halo: neighbourhood (pixels) added around each input block, e.g. 1 for 3x3 kernels
+     *  - block rows: height of the full-width blocks (default: the input block height,
+     *    grouped up to GEOTIFF_CHUNK_BYTES)
+     *  - workers: compute threads (default: available CPU cores)
+     *  - max in flight: blocks read but not yet consumed by the sink. Memory use is bounded by
+     *    maxInFlight * (inputs + 1) blocks, whatever the raster size (default: 2 * workers + 2)
+     */
+
+    int GetBlockRows();
+
+    bool Run(const PipelineKernel &kernel, const PipelineSink &sink);
+    /*
+     * function bool Run(const PipelineKernel &kernel, const PipelineSink &sink)
+     * Streams the inputs block by block: one thread reads, the workers
+     * run the kernel, and the sink receives the results in raster
+     * order, all three stages overlapping. Returns false if any read,
+     * kernel or sink call fails (processing stops as soon as possible).
+     */
+
+    bool Run(const PipelineKernel &kernel, GeotiffWriter &writer, int band = 1);
+    /*
+     * function bool Run(const PipelineKernel &kernel, GeotiffWriter &writer, int band)
+     * Same as above, writing every output block to a band of a
+     * GeotiffWriter (which must have the size of the inputs).
+     */
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef _GEOTIFF_POOL_HPP_
+#define _GEOTIFF_POOL_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <mutex>
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+
+// Default maximum number of dataset handles held open by the pool (leased + idle)
+#define GEOTIFF_POOL_MAX_HANDLES 256
+// Default time (seconds) after which an unused pooled handle is closed
+#define GEOTIFF_POOL_IDLE_SECONDS 60
+
+void GeotiffRegisterDrivers();
+/*
+ * function void GeotiffRegisterDrivers()
+ * GDALAllRegister(), run once per process (std::call_once): cheap to call
+ * from every constructor.
+ */
+
+class GeotiffDatasetPool;
+
+// Exclusive use of a pooled, read-only dataset handle. The handle goes back to the pool when the lease is released or destroyed
+class GeotiffDatasetLease {
+
+  friend class GeotiffDatasetPool;
+
+  private:
+
+    GeotiffDatasetPool *pool;
+    GDALDataset *dataset;
+    std::string path;
+    unsigned generation;  // pool generation of the path when the handle was opened (stale handles are closed on release)
+
+  public:
+
+    GeotiffDatasetLease() : pool(NULL), dataset(NULL), generation(0) {}
+    ~GeotiffDatasetLease() { Release(); }
+
+    GeotiffDatasetLease(const GeotiffDatasetLease &) = delete;
+    GeotiffDatasetLease &operator=(const GeotiffDatasetLease &) = delete;
+    GeotiffDatasetLease(GeotiffDatasetLease &&other);
+    GeotiffDatasetLease &operator=(GeotiffDatasetLease &&other);
+
+    bool isValid() const { return dataset != NULL; }
+    GDALDataset *Get() const { return dataset; }
+    GDALDataset *operator->() const { return dataset; }
+    const std::string &GetPath() const { return path; }
+
+    void Release();
+    /*
+     * function void Release()
+     * Returns the handle to the pool (no-op on an empty lease). The
+     * dataset pointer must not be used afterwards.
+     */
+
+    OGRSpatialReference *CloneSpatialRef() const;
+    /*
+     * function OGRSpatialReference *CloneSpatialRef()
+     * Returns a new copy (owned by the caller) of the dataset SRS, parsed
+     * from the WKT only once per path. Never NULL for a valid lease.
+     */
+};
+
+class GeotiffDatasetPool {
+
+  friend class GeotiffDatasetLease;
+
+  private:
+
+    struct IdleHandle {
+      GDALDataset *dataset;
+      double lastUsed;      // seconds (steady clock)
+      std::string path;     // key of the entry owning the handle
+    };
+
+    struct Entry {
+      std::vector<std::list<IdleHandle>::iterator> idle; // idle handles of the path, most recently used last
+      int leased;                      // handles currently leased
+      unsigned generation;             // incremented when the file changes or is invalidated
+      long long mtime, size;           // file state when the handles were opened
+      OGRSpatialReference *srs;        // parsed dataset SRS (NULL until first requested)
+
+      Entry() : leased(0), generation(0), mtime(-1), size(-1), srs(NULL) {}
+    };
+
+    std::mutex lock;
+    std::map<std::string, Entry> entries; // paths with open handles or outstanding leases only
+    std::list<IdleHandle> idleLru;        // idle handles of every path, least recently used first
+    size_t nOpen;                      // handles open (leased + idle)
+    size_t maxHandles;
+    double idleSeconds;
+    double lastSweep;
+    size_t nOpens, nReuses, nEvictions;
+
+    GeotiffDatasetPool();
+    void Return(GeotiffDatasetLease &lease);
+    OGRSpatialReference *CloneSpatialRef(const GeotiffDatasetLease &lease);
+    // the handles to close are collected, and closed once the pool lock is released
+    void CloseIdle(Entry &entry, std::vector<GDALDataset *> &toClose);
+    void CloseIdleHandle(std::list<IdleHandle>::iterator handle, std::vector<GDALDataset *> &toClose);
+    void Prune(std::map<std::string, Entry>::iterator entry);
+    bool EvictOldestIdle(std::vector<GDALDataset *> &toClose);
+    void SweepIdle(double now, std::vector<GDALDataset *> &toClose);
+
+  public:
+
+    static GeotiffDatasetPool &Instance();
+    /*
+     * function GeotiffDatasetPool &Instance()
+     * Process-wide pool (thread-safe). It is never destroyed, so leases
+     * held by static objects stay valid until the process exits.
+     */
+
+    GeotiffDatasetPool(const GeotiffDatasetPool &) = delete;
+    GeotiffDatasetPool &operator=(const GeotiffDatasetPool &) = delete;
+
+    GeotiffDatasetLease Acquire(const char *path);
+    /*
+     * function GeotiffDatasetLease Acquire(const char *path)
+     * Leases a read-only handle on path: an idle handle if there is one
+     * (and the file has not changed since it was opened), a new one
+     * otherwise. When maxHandles handles are open, the least recently
+     * used idle handle (of any path) is closed first; if every handle
+     * is leased, a handle is opened past the limit anyway (the cap is
+     * soft, the call never blocks) and closed when it is released.
+     * Returns an invalid lease if the file cannot be opened.
+     */
+
+    void Invalidate(const char *path);
+    /*
+     * function void Invalidate(const char *path)
+     * Closes the idle handles of path, and marks the leased ones to be
+     * closed on release (call it after modifying the file).
+     */
+
+    void SetLimits(size_t maxOpenHandles, double idleTimeoutSeconds);
+    void EvictIdle();
+    /*
+     * function void EvictIdle()
+     * Closes every handle unused for more than the idle timeout (this is
+     * also done lazily by Acquire and Release)
+     */
+
+    void Clear();
+    /*
+     * function void Clear()
+     * Closes every idle handle (leased handles are closed on release).
+     * Paths are forgotten, with their parsed SRS, as soon as they have no
+     * open handle and no lease, so the pool never grows with the number
+     * of files it has seen
+     */
+
+    void GetCounters(size_t *open, size_t *opens, size_t *reuses, size_t *evictions);
+    /*
+     * function void GetCounters(size_t *open, size_t *opens, size_t *reuses, size_t *evictions)
+     * Returns the handles currently open, and the number of GDALOpenEx calls,
+     * of leases served by an idle handle, and of handles closed by eviction
+     */
+};
+
+#endif
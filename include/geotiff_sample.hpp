@@ -0,0 +1,79 @@
+#ifndef _GEOTIFF_SAMPLE_HPP_
+#define _GEOTIFF_SAMPLE_HPP_
+
+#include <cstddef>
+#include <vector>
+#include <gdal_priv.h>
+#include <ogr_spatialref.h>
+#include "geotiff_view.hpp"
+
+class Geotiff;
+
+// Interpolation used to sample a band at fractional pixel positions
+enum SampleMethod {
+  SAMPLE_NEAREST  = 0,  // value of the pixel containing the point
+  SAMPLE_BILINEAR = 1,  // 2x2 neighbourhood
+  SAMPLE_BICUBIC  = 2   // 4x4 neighbourhood (Keys cubic convolution, a = -0.5)
+};
+
+class GeotiffSampler {
+
+  private:
+
+    GeotiffView view;                          // tile cache, kept across batches
+    int nCols, nRows;
+    double invGeotransform[6];                 // georeferenced -> pixel coordinates
+    bool bValidGeotransform;
+    bool bHasNoData;
+    float fNoData;
+    OGRSpatialReference *targetSRS;            // dataset SRS (copy), NULL if the dataset has none
+    OGRCoordinateTransformation *poTransform;  // source SRS -> dataset SRS, NULL: points already in the dataset SRS
+
+    std::vector<double> pixelX, pixelY;        // per-batch scratch, reused to avoid reallocations
+    std::vector<size_t> order;
+    std::vector<int> tileKeys;
+
+    inline bool isValidValue(float v) const { return v == v && !(bHasNoData && v == fNoData); }
+    float Interpolate(double px, double py, SampleMethod method, const Raster<float> *&tile, int tileX0, int tileY0);
+
+  public:
+
+    GeotiffSampler(Geotiff &geotiff, int band = 1, size_t cacheBytes = GEOTIFF_VIEW_DEFAULT_CACHE);
+    /*
+     * Creates a sampler over a band of an open Geotiff (which must outlive
+     * it). Points are given in the dataset coordinates unless a source SRS
+     * is set. Tiles are read lazily and cached (see GeotiffView).
+     */
+
+    ~GeotiffSampler();
+
+    GeotiffSampler(const GeotiffSampler &) = delete;
+    GeotiffSampler &operator=(const GeotiffSampler &) = delete;
+
+    bool isValid() { return view.isValid() && bValidGeotransform; }
+
+    bool SetSourceSRS(const OGRSpatialReference *srs);
+    bool SetSourceEPSG(int epsg);
+    /*
+     * function bool SetSourceSRS(const OGRSpatialReference *srs)
+     * Coordinates passed to Sample() are in srs (NULL: dataset SRS), e.g.
+     * SetSourceEPSG(4326) for (lon, lat). Axis order is always (x/easting/lon,
+     * y/northing/lat). Returns false if no transformation to the dataset SRS exists.
+     */
+
+    size_t Sample(const double *x, const double *y, size_t n, float *values, SampleMethod method = SAMPLE_BILINEAR);
+    /*
+     * function size_t Sample(const double *x, const double *y, size_t n, float *values, SampleMethod method)
+     * Samples n points: values[i] is the band value at (x[i], y[i]). The
+     * points are sorted by tile, so each tile is fetched once per batch
+     * whatever the query order. Nodata (and NaN) pixels never contribute:
+     * bilinear renormalizes the weights over the valid neighbours, bicubic
+     * falls back to bilinear when its 4x4 neighbourhood has nodata.
+     * Points outside the raster, or with no valid neighbour, return NaN.
+     * Returns the number of valid samples.
+     */
+
+    GeotiffView &GetView() { return view; }
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef _GEOTIFF_SIMD_HPP_
+#define _GEOTIFF_SIMD_HPP_
+
+#include <cstddef>
+#include <limits>
+#include <stdint.h>
+#include <gdal_priv.h>
+
+// Vectorized pixel kernels shared by the Geotiff read paths.
+// The instruction set is selected at compile time: AVX2 when built with -mavx2
+// (see GEOTIFF_ENABLE_AVX2 in CMakeLists.txt), SSE2 on any x86-64, scalar otherwise.
+
+bool GeotiffCanConvertToFloat(GDALDataType srcType);
+  /*
+   * function bool GeotiffCanConvertToFloat(GDALDataType srcType):
+   * Returns true if GeotiffConvertToFloat supports srcType
+   * (Byte, UInt16, Int16, UInt32, Int32, Float32).
+   */
+
+bool GeotiffConvertToFloat(const void *src, GDALDataType srcType, float *dst, size_t n);
+  /*
+   * function bool GeotiffConvertToFloat(const void *src, GDALDataType srcType, float *dst, size_t n):
+   * Widens n pixels of type srcType to float. The conversion runs forward,
+   * so src may overlap dst when src is placed at the END of the dst buffer,
+   * i.e. (char*)src == (char*)(dst + n) - n * sizeof(srcType). This allows
+   * reading a band in its native type into the tail of the float output and
+   * widening it in place, with no second buffer.
+   * Returns false if srcType is not supported.
+   */
+
+bool GeotiffConvertToFloatMasked(const void *src, GDALDataType srcType, float *dst, size_t n,
+                                 bool hasNoData, double noData, bool nanFill, uint64_t *mask);
+  /*
+   * function bool GeotiffConvertToFloatMasked(...):
+   * Same as GeotiffConvertToFloat (same in-place rules; for Float32 src
+   * may also be dst), flagging nodata pixels in the same pass: pixels equal
+   * to noData (compared in the source type, so large 32-bit integers are
+   * exact) and NaN are invalid. If nanFill, invalid pixels are written as
+   * NaN. If mask is not NULL, the validity bits of the n pixels are written
+   * to mask (packed, LSB first, ceil(n / 64) words overwritten).
+   * A noData value that the source type cannot hold matches no pixel.
+   * Returns false if srcType is not supported.
+   */
+
+void GeotiffApplyMaskBand(const unsigned char *maskBand, float *dst, size_t n, bool nanFill, uint64_t *mask);
+  /*
+   * function void GeotiffApplyMaskBand(const unsigned char *maskBand, float *dst, size_t n, bool nanFill, uint64_t *mask):
+   * Combines a GDAL mask band (RFC 15, 0: invalid) with already converted
+   * pixels: where maskBand is 0 the mask bit (if mask is not NULL) is cleared
+   * and, if nanFill, the pixel is set to NaN.
+   */
+
+// Running statistics of a set of pixels. Keeps the mean and the sum of squared deviations
+// (instead of raw sums) so partial results of several tiles / threads merge without loss of precision
+struct GeotiffReduction {
+  size_t count;         // valid pixels
+  size_t noDataCount;   // pixels equal to the nodata value, or NaN
+  double min, max;
+  double mean, m2;      // variance = m2 / count
+
+  GeotiffReduction() : count(0), noDataCount(0), min(std::numeric_limits<double>::infinity()),
+                       max(-std::numeric_limits<double>::infinity()), mean(0.0), m2(0.0) {}
+};
+
+void GeotiffReductionMerge(GeotiffReduction &dst, const GeotiffReduction &src);
+  /*
+   * function void GeotiffReductionMerge(GeotiffReduction &dst, const GeotiffReduction &src):
+   * Accumulates the statistics of src into dst (pairwise update of mean and m2).
+   */
+
+void GeotiffReduceFloat(const float *src, size_t n, bool hasNoData, float noData, GeotiffReduction &r);
+  /*
+   * function void GeotiffReduceFloat(const float *src, size_t n, bool hasNoData, float noData, GeotiffReduction &r):
+   * Accumulates min, max, mean, m2 and the valid / nodata counts of n pixels
+   * into r. NaN pixels, and pixels equal to noData when hasNoData, are
+   * counted as nodata and excluded from the statistics.
+   */
+
+void GeotiffHistogramFloat(const float *src, size_t n, bool hasNoData, float noData,
+                           double min, double max, int nBins, GUIntBig *histogram);
+  /*
+   * function void GeotiffHistogramFloat(...):
+   * Adds the valid pixels of src to histogram (nBins equal bins over
+   * [min, max]). Values outside the range are counted in the first or
+   * last bin; nodata and NaN pixels are skipped.
+   */
+
+const char *GeotiffSIMDName();
+  /*
+   * function const char *GeotiffSIMDName():
+   * Returns the instruction set the kernels were compiled for ("AVX2", "SSE2" or "scalar").
+   */
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef _GEOTIFF_STATS_HPP_
+#define _GEOTIFF_STATS_HPP_
+
+#include <vector>
+#include <gdal_priv.h>
+
+// Default number of histogram bins
+#define GEOTIFF_STATS_BINS 256
+// Approximate statistics are computed on at least (about) this many pixels: the smallest overview
+// that is large enough, or a decimated read of the band
+#define GEOTIFF_STATS_SAMPLE_PIXELS (1024*1024)
+
+// Statistics of one band. Nodata (and NaN) pixels are counted but excluded from min ... histogram
+struct RasterStatistics {
+  int band;                       // 1-indexed band number, 0 if the statistics could not be computed
+  bool approximate;               // computed on an overview or a sample of the band
+  double min, max, mean, stdDev;
+  size_t validCount;              // pixels used for the statistics
+  size_t noDataCount;             // nodata / NaN pixels
+  double histMin, histMax;        // histogram range, split in histogram.size() equal bins
+  std::vector<GUIntBig> histogram;
+
+  RasterStatistics() : band(0), approximate(false), min(0.0), max(0.0), mean(0.0), stdDev(0.0),
+                       validCount(0), noDataCount(0), histMin(0.0), histMax(0.0) {}
+
+  bool isValid() const { return band > 0; }
+};
+
+RasterStatistics GeotiffGetStatistics(const char *filename, int band, bool approximate = false,
+                                      int nBins = GEOTIFF_STATS_BINS, int nThreads = 0);
+  /*
+   * function RasterStatistics GeotiffGetStatistics(const char *filename, int band, bool approximate, int nBins, int nThreads):
+   * Returns min, max, mean, standard deviation, histogram and nodata count
+   * of a band. Results are looked up, in order, in:
+   *  (1) an in-memory cache keyed by file name, modification time and size
+   *  (2) the PAM sidecar (.aux.xml) or internal metadata, if not older than the file
+   * and are computed only if both miss, then stored in both caches.
+   * Exact mode reads the whole band in parallel (GeotiffParallelReader, nThreads
+   * <= 0: one per CPU core) with SIMD reductions; pixels are reduced as float.
+   * Approximate mode uses the smallest overview with at least
+   * GEOTIFF_STATS_SAMPLE_PIXELS pixels, or a decimated read of the band.
+   * Exact results also satisfy approximate requests.
+   * Returns RasterStatistics with band = 0 on error.
+   */
+
+bool GeotiffFindCachedStatistics(const char *filename, int band, bool approximate, RasterStatistics &stats,
+                                 int nBins = GEOTIFF_STATS_BINS);
+  /*
+   * function bool GeotiffFindCachedStatistics(const char *filename, int band, bool approximate, RasterStatistics &stats, int nBins):
+   * Looks the statistics up in the in-memory cache only (same rules as
+   * GeotiffGetStatistics): nothing is opened, computed or written.
+   * Returns false on a miss.
+   */
+
+void GeotiffClearStatisticsCache();
+  /*
+   * function void GeotiffClearStatisticsCache():
+   * Empties the in-memory statistics cache (PAM sidecars are left untouched).
+   */
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef _GEOTIFF_TERRAIN_HPP_
+#define _GEOTIFF_TERRAIN_HPP_
+
+#include <cstddef>
+#include "raster.hpp"
+#include "geotiff_pipeline.hpp"
+
+// Default hillshade illumination (degrees): light from the north-west, 45 degrees above the horizon
+#define GEOTIFF_TERRAIN_AZIMUTH 315.0
+#define GEOTIFF_TERRAIN_ALTITUDE 45.0
+
+class Geotiff;
+
+// Terrain derivatives computed over the 3x3 neighbourhood of every pixel (Horn gradient)
+enum TerrainProduct {
+  TERRAIN_SLOPE     = 0,  // degrees from the horizontal [0, 90)
+  TERRAIN_ASPECT    = 1,  // compass direction the slope faces, degrees [0, 360). Flat pixels are NaN
+  TERRAIN_HILLSHADE = 2,  // illumination [0, 255]
+  TERRAIN_CURVATURE = 3,  // Zevenbergen-Thorne curvature (1/100 z units): positive is convex, negative concave
+  TERRAIN_RUGOSITY  = 4   // surface / planar area of the local tangent plane (1: flat), i.e. 1 / cos(slope)
+};
+
+struct TerrainOptions {
+  double pixelX, pixelY;    // signed pixel size: geotransform SX and SY (negative for north-up rasters)
+  double zFactor;           // elevation units per horizontal unit
+  bool hasNoData;
+  float noData;
+  double azimuth, altitude; // hillshade light source, degrees (azimuth clockwise from north)
+  int nThreads;             // <= 0: one per CPU core
+
+  TerrainOptions();
+  TerrainOptions(Geotiff &geotiff, int band = 1);
+  /*
+   * Options for a band of geotiff: pixel size from
+   * GetGeoTransformParam(GEOTIFF_PARAM_SX / GEOTIFF_PARAM_SY), nodata from
+   * the band metadata. Default (1 x -1 pixels, no nodata) otherwise.
+   */
+};
+
+Raster<float> GeotiffTerrain(const Raster<float> &dem, TerrainProduct product, const TerrainOptions &options);
+bool GeotiffTerrain(float **dem, int cols, int rows, float **output, TerrainProduct product, const TerrainOptions &options);
+/*
+ * function Raster<float> GeotiffTerrain(const Raster<float> &dem, TerrainProduct product, const TerrainOptions &options)
+ * Computes product over a whole band (Raster, or the float** rows returned
+ * by GetRasterBand written into caller rows), split by rows over
+ * options.nThreads threads, with the AVX2 / SSE2 kernels (see GeotiffSIMDName).
+ * A pixel is NaN if any pixel of its 3x3 neighbourhood is nodata or NaN,
+ * and on the raster border.
+ * Atan based products (slope, aspect) use a polynomial approximation
+ * (error < 0.001 degrees).
+ */
+
+Raster<float> GeotiffTerrainReference(const Raster<float> &dem, TerrainProduct product, const TerrainOptions &options);
+/*
+ * function Raster<float> GeotiffTerrainReference(const Raster<float> &dem, TerrainProduct product, const TerrainOptions &options)
+ * Scalar, single threaded implementation with the libm functions: the
+ * baseline the vector kernels are validated and benchmarked against.
+ */
+
+PipelineKernel GeotiffTerrainKernel(TerrainProduct product, const TerrainOptions &options);
+/*
+ * function PipelineKernel GeotiffTerrainKernel(TerrainProduct product, const TerrainOptions &options)
+ * Kernel computing product from the first input of a GeotiffPipeline,
+ * for bands that do not fit in memory. The pipeline halo must be >= 1
+ * (SetHalo(1)); pixels on the raster border are NaN.
+ */
+
+const char *GeotiffTerrainName(TerrainProduct product);
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef _GEOTIFF_VIEW_HPP_
+#define _GEOTIFF_VIEW_HPP_
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <gdal_priv.h>
+#include "raster.hpp"
+
+// Default tile cache budget of a GeotiffView (bytes)
+#define GEOTIFF_VIEW_DEFAULT_CACHE (256*1024*1024)
+// Tiles smaller than this (pixels), e.g. single scanline strips, are grown by whole blocks
+#define GEOTIFF_VIEW_MIN_TILE_PIXELS (64*1024)
+
+class Geotiff;
+
+class GeotiffView {
+
+  private:
+
+    struct CacheEntry {
+      Raster<float> tile;
+      std::list<int>::iterator lruPosition;
+    };
+
+    GDALRasterBand *poBand;       // band being viewed (owned by the dataset)
+    int nCols, nRows;             // band size, in pixels
+    int nTileXSize, nTileYSize;   // tile size, in pixels (aligned to the band block size)
+    int nTilesX, nTilesY;         // number of tiles along X, Y
+    size_t cacheBudget;           // maximum bytes held by the tile cache
+    size_t cachedBytes;           // bytes currently held by the tile cache
+
+    std::unordered_map<int, CacheEntry> tiles; // loaded tiles, keyed by tileY*nTilesX + tileX
+    std::list<int> lru;                        // tile keys, most recently used first
+    int lastKey;                               // last accessed tile: shortcut for sliding-window access
+    const Raster<float> *lastTile;
+
+    size_t nHits, nMisses, nEvictions, nReadErrors;
+
+    const Raster<float> *LoadTile(int key);
+    void Evict(size_t incomingBytes);
+
+  public:
+
+    GeotiffView(GDALDataset *dataset, int band = 1, size_t cacheBytes = GEOTIFF_VIEW_DEFAULT_CACHE);
+    GeotiffView(Geotiff &geotiff, int band = 1, size_t cacheBytes = GEOTIFF_VIEW_DEFAULT_CACHE);
+    /*
+     * Creates a lazy view over a band of an open dataset. Nothing is read
+     * until a pixel or tile is accessed. The dataset must outlive the view,
+     * and (as any GDAL handle) must not be used concurrently from other threads.
+     */
+
+    GeotiffView(const GeotiffView &) = delete;
+    GeotiffView &operator=(const GeotiffView &) = delete;
+
+    bool isValid();
+    /*
+     * function bool isValid()
+     * Returns false if the band could not be found in the dataset
+     */
+
+    float GetPixel(int x, int y);
+    float operator()(int x, int y) { return GetPixel(x, y); }
+    /*
+     * function float GetPixel(int x, int y)
+     * Returns the value of pixel (x, y), loading its tile on first access.
+     * Returns NaN for pixels outside the band, or if the tile cannot be read.
+     */
+
+    const Raster<float> *GetTile(int tileX, int tileY);
+    /*
+     * function const Raster<float> *GetTile(int tileX, int tileY)
+     * Returns tile (tileX, tileY), loading it if needed. Edge tiles are
+     * clipped to the band size. The pointer is valid until the tile is
+     * evicted, i.e. until the next access to a tile that is not cached.
+     * Returns NULL if the tile index is invalid or the tile cannot be read.
+     */
+
+    void GetTileWindow(int tileX, int tileY, int *window);
+    /*
+     * function void GetTileWindow(int tileX, int tileY, int *window)
+     * Returns the pixel window [xOff, yOff, xSize, ySize] covered by a tile
+     */
+
+    int GetTileXSize() { return nTileXSize; }
+    int GetTileYSize() { return nTileYSize; }
+    int GetTilesX() { return nTilesX; }
+    int GetTilesY() { return nTilesY; }
+
+    void SetCacheBudget(size_t bytes);
+    size_t GetCacheBudget() { return cacheBudget; }
+    size_t GetCachedBytes() { return cachedBytes; }
+    void ClearCache();
+    /*
+     * Tile cache management. Least recently used tiles are evicted
+     * first. A tile larger than the whole budget is still loaded, and
+     * it is the only tile kept in the cache.
+     */
+
+    size_t GetHits() { return nHits; }
+    size_t GetMisses() { return nMisses; }
+    size_t GetEvictions() { return nEvictions; }
+    size_t GetReadErrors() { return nReadErrors; }
+    void ResetCounters();
+    /*
+     * Cache counters: tile accesses served from the cache (hits), tiles
+     * read from the dataset (misses), tiles dropped to honour the budget
+     * (evictions), and failed tile reads.
+     */
+
+    struct Tile {
+      int tileX, tileY;           // tile index
+      int xOff, yOff;             // upper-left pixel of the tile in the band
+      const Raster<float> *data;  // tile pixels (NULL if the tile could not be read)
+    };
+
+    class TileIterator {
+      /*
+       * Row-major iteration over all the tiles of the view:
+       *   for (GeotiffView::Tile tile : view) { ... }
+       * Each tile is loaded (or fetched from the cache) when dereferenced.
+       */
+      private:
+        GeotiffView *view;
+        int index;
+      public:
+        TileIterator(GeotiffView *v, int i) : view(v), index(i) {}
+        Tile operator*();
+        TileIterator &operator++() { index++; return *this; }
+        bool operator!=(const TileIterator &other) const { return index != other.index; }
+        bool operator==(const TileIterator &other) const { return index == other.index; }
+    };
+
+    TileIterator begin() { return TileIterator(this, 0); }
+    TileIterator end() { return TileIterator(this, nTilesX*nTilesY); }
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef _GEOTIFF_WARP_HPP_
+#define _GEOTIFF_WARP_HPP_
+
+#include <cstddef>
+#include <string>
+#include <list>
+#include <gdal_priv.h>
+#include <gdalwarper.h>
+#include "raster.hpp"
+
+// Default working memory of a warp operation (bytes, GDALWarpOptions::dfWarpMemoryLimit)
+#define GEOTIFF_WARP_MEMORY_LIMIT (256*1024*1024)
+// Maximum error (in pixels) of the approximate transformer
+#define GEOTIFF_WARP_MAX_ERROR 0.125
+// Approximate transformers kept by a GeotiffWarper (one per source / target grid pair)
+#define GEOTIFF_WARP_CACHED_TRANSFORMERS 8
+
+class Geotiff;
+
+// Target grid of a warp: spatial reference, geotransform and size
+struct GeotiffGrid {
+  std::string wkt;          // spatial reference (WKT)
+  double geotransform[6];
+  int cols, rows;
+
+  GeotiffGrid();
+  GeotiffGrid(const char *srsWkt, const double *gt, int nCols, int nRows);
+  explicit GeotiffGrid(Geotiff &reference);
+  /*
+   * Grid of a reference Geotiff (SRS, geotransform and size), e.g. the
+   * common grid a set of surveys is aligned to.
+   */
+
+  bool isValid() const { return cols > 0 && rows > 0 && !wkt.empty(); }
+};
+
+class GeotiffWarper {
+
+  private:
+
+    struct CachedTransformer {
+      std::string key;      // source and target SRS and geotransforms
+      void *transformer;    // GDALCreateApproxTransformer over a GenImgProj transformer
+    };
+
+    double memoryLimit;
+    int nThreads;
+    std::list<CachedTransformer> transformers; // most recently used first
+    size_t nTransformerHits, nTransformerMisses;
+
+    void *GetTransformer(GDALDataset *source, GDALDataset *target);
+    Raster<float> WarpDataset(GDALDataset *source, int band, double srcNoData, bool hasNoData,
+                              const GeotiffGrid &target, GDALResampleAlg resampling);
+
+  public:
+
+    GeotiffWarper(size_t memoryBytes = GEOTIFF_WARP_MEMORY_LIMIT, int threads = 0);
+    /*
+     * Creates a warper using up to memoryBytes of working memory per warp
+     * and threads warp threads (<= 0: all CPU cores).
+     * Approximate transformers are cached between calls with the same
+     * source and target grids. As any GDAL handle, a warper must not be
+     * used concurrently from several threads (it is multithreaded inside).
+     */
+
+    ~GeotiffWarper();
+
+    GeotiffWarper(const GeotiffWarper &) = delete;
+    GeotiffWarper &operator=(const GeotiffWarper &) = delete;
+
+    Raster<float> Warp(Geotiff &source, int band, const GeotiffGrid &target, GDALResampleAlg resampling = GRA_Bilinear);
+    Raster<float> WarpWindow(Geotiff &source, int band, int xOff, int yOff, int xSize, int ySize,
+                             const GeotiffGrid &target, GDALResampleAlg resampling = GRA_Bilinear);
+    /*
+     * function Raster<float> Warp(Geotiff &source, int band, const GeotiffGrid &target, GDALResampleAlg resampling)
+     * Reprojects / resamples band of source (or only a pixel window of it)
+     * onto the target grid, straight into a (target.cols x target.rows)
+     * float Raster: no temporary file, no extra copy. GDALWarpOperation::ChunkAndWarpMulti
+     * overlaps the reads with the (NUM_THREADS) warp kernel.
+     * Target pixels not covered by valid source pixels are NaN (the source
+     * nodata value is honored). Returns an empty Raster on error.
+     */
+
+    size_t GetTransformerHits() { return nTransformerHits; }
+    size_t GetTransformerMisses() { return nTransformerMisses; }
+    void ClearTransformers();
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _GEOTIFF_WRITER_HPP_
+#define _GEOTIFF_WRITER_HPP_
+
+#include <string>
+#include <vector>
+#include <gdal_priv.h>
+#include "raster.hpp"
+
+class Geotiff;
+
+// Creation options of a GeotiffWriter (mapped to GDAL GTiff creation options)
+struct GeotiffWriterOptions {
+  bool tiled;               // TILED=YES (false: strips of blockYSize rows)
+  int blockXSize;           // BLOCKXSIZE (tiled only, multiple of 16)
+  int blockYSize;           // BLOCKYSIZE (tile height, or rows per strip)
+  std::string compression;  // COMPRESS: NONE, DEFLATE, ZSTD, LZW, ...
+  int predictor;            // PREDICTOR: 1 none, 2 horizontal, 3 floating point. 0: 2 for integer, 3 for float data
+  int level;                // ZLEVEL (DEFLATE) or ZSTD_LEVEL (ZSTD). < 0: GDAL default
+  std::string bigTiff;      // BIGTIFF: YES, NO, IF_NEEDED, IF_SAFER
+  int numThreads;           // NUM_THREADS used by GDAL to compress blocks. 0: GDAL default (single thread)
+
+  GeotiffWriterOptions() : tiled(true), blockXSize(256), blockYSize(256), compression("DEFLATE"),
+                           predictor(0), level(-1), bigTiff("IF_SAFER"), numThreads(0) {}
+};
+
+class GeotiffWriter {
+
+  private:
+
+    std::string filename;
+    GDALDataset *geotiffDataset; // output dataset, open while the writer is alive
+    int nRows, nCols, nBands;
+    int nBlockXSize, nBlockYSize; // block size of the output, used to flush completed block-rows
+    std::vector<int> streamedRows; // per band: rows written contiguously from the top (block-rows above are flushed)
+
+    template<typename T>
+    bool WriteBlockRows(int band, int xOff, int yOff, int xSize, int ySize, const T *data, size_t stride);
+
+  public:
+
+    GeotiffWriter(const char *filename, int nCols, int nRows, int nBands, GDALDataType dataType,
+                  const GeotiffWriterOptions &options = GeotiffWriterOptions());
+    /*
+     * Creates a new GeoTIFF file (overwriting any existing one) with the
+     * given size, band count, data type and creation options.
+     */
+
+    ~GeotiffWriter();
+
+    GeotiffWriter(const GeotiffWriter &) = delete;
+    GeotiffWriter &operator=(const GeotiffWriter &) = delete;
+
+    bool isValid() { return geotiffDataset != NULL; }
+    GDALDataset *GetDataset() { return geotiffDataset; }
+
+    bool CopyGeoreference(Geotiff &source);
+    /*
+     * function bool CopyGeoreference(Geotiff &source)
+     * Copies the geotransform and the spatial reference (datasetSpatialRef)
+     * of an existing Geotiff. Both rasters are expected to share the grid.
+     */
+
+    bool SetGeoTransform(const double *geotransform);
+    bool SetProjection(const char *wkt);
+    bool SetNoDataValue(int band, double noData);
+
+    template<typename T>
+    bool WriteRows(int band, int yOff, const Raster<T> &rows);
+    /*
+     * function bool WriteRows<T>(int band, int yOff, const Raster<T> &rows)
+     * Writes a block of full-width rows (rows.GetCols() must be nCols)
+     * starting at row yOff. Rows can be streamed top to bottom in any
+     * block height: every block-row of the output completed by a call is
+     * written to disk and dropped from the GDAL cache, so memory use stays
+     * bounded no matter the output size. Rows written out of order are
+     * kept in the cache until Close().
+     */
+
+    template<typename T>
+    bool WriteWindow(int band, int xOff, int yOff, const Raster<T> &window);
+    /*
+     * function bool WriteWindow<T>(int band, int xOff, int yOff, const Raster<T> &window)
+     * Writes a window at (xOff, yOff). GDAL converts from T to the file data type.
+     */
+
+    bool Close();
+    /*
+     * function bool Close()
+     * Flushes pending blocks and closes the file. Called by the destructor.
+     */
+};
+
+#endif
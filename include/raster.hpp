@@ -0,0 +1,306 @@
+#ifndef _RASTER_HPP_
+#define _RASTER_HPP_
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <new>
+#include <vector>
+#include <cpl_vsi.h>
+#include <gdal.h>
+#include "geotiff_counters.hpp"
+
+// Alignment (in bytes) of the raster buffer and of the start of every row.
+// 64 bytes covers a full cache line and the widest (AVX-512) SIMD register
+#define RASTER_ALIGNMENT 64
+
+template<typename T>
+class Raster {
+
+  private:
+
+    T *buffer;                    // single aligned allocation holding all the rows
+    int nCols, nRows;             // raster dimensions, in pixels
+    size_t stride;                // distance between the start of consecutive rows, in elements (>= nCols)
+    std::vector<T*> rowPointers;  // lazily built float**-like view, see GetRowPointers()
+
+    void release(){
+      if (buffer != NULL)
+        VSIFreeAligned(buffer);
+      buffer = NULL;
+      nCols = nRows = 0;
+      stride = 0;
+      rowPointers.clear();
+    }
+
+    void steal(Raster &other){
+      buffer = other.buffer;
+      nCols  = other.nCols;
+      nRows  = other.nRows;
+      stride = other.stride;
+      rowPointers.swap(other.rowPointers);
+      other.buffer = NULL;
+      other.nCols = other.nRows = 0;
+      other.stride = 0;
+      other.rowPointers.clear();
+    }
+
+  public:
+
+    Raster() : buffer(NULL), nCols(0), nRows(0), stride(0) {}
+
+    Raster(int cols, int rows) : buffer(NULL), nCols(0), nRows(0), stride(0) {
+      /*
+       * Allocates an uninitialized (cols x rows) raster. Every row starts at a
+       * RASTER_ALIGNMENT boundary, so the row stride may be larger than cols.
+       * Throws std::bad_alloc if the buffer cannot be allocated.
+       */
+      if (cols <= 0 || rows <= 0)
+        return;
+      size_t rowBytes = (size_t)cols * sizeof(T);
+      rowBytes = (rowBytes + RASTER_ALIGNMENT - 1) / RASTER_ALIGNMENT * RASTER_ALIGNMENT;
+      GEOTIFF_STATS_START(tAlloc);
+      buffer = (T *) VSIMallocAligned(RASTER_ALIGNMENT, rowBytes * rows);
+      if (buffer == NULL)
+        throw std::bad_alloc();
+      GEOTIFF_STATS_ALLOCATION(tAlloc, rowBytes * rows);
+      nCols  = cols;
+      nRows  = rows;
+      stride = rowBytes / sizeof(T);
+    }
+
+    ~Raster() { release(); }
+
+    // Rasters can be huge: copies must be explicit (see Clone()), moves are free
+    Raster(const Raster &) = delete;
+    Raster &operator=(const Raster &) = delete;
+
+    Raster(Raster &&other) noexcept : buffer(NULL), nCols(0), nRows(0), stride(0) {
+      steal(other);
+    }
+
+    Raster &operator=(Raster &&other) noexcept {
+      if (this != &other){
+        release();
+        steal(other);
+      }
+      return *this;
+    }
+
+    Raster Clone() const {
+      /*
+       * Returns a deep copy of the raster (same dimensions and stride)
+       */
+      Raster copy(nCols, nRows);
+      if (buffer != NULL)
+        memcpy(copy.buffer, buffer, stride * nRows * sizeof(T));
+      return copy;
+    }
+
+    bool isEmpty() const { return buffer == NULL; }
+
+    int GetCols() const { return nCols; }
+    int GetRows() const { return nRows; }
+
+    size_t GetStride() const { return stride; }                   // row stride, in elements
+    size_t GetStrideBytes() const { return stride * sizeof(T); }  // row stride, in bytes
+
+    T *GetData() { return buffer; }
+    const T *GetData() const { return buffer; }
+
+    T *GetRow(int y) { return buffer + (size_t)y * stride; }
+    const T *GetRow(int y) const { return buffer + (size_t)y * stride; }
+
+    T &operator()(int x, int y) { return buffer[(size_t)y * stride + x]; }
+    const T &operator()(int x, int y) const { return buffer[(size_t)y * stride + x]; }
+
+    T **GetRowPointers() {
+      /*
+       * Returns a T** view (one pointer per row) over the contiguous buffer, for
+       * code written against the legacy float** interface. The pointers belong to
+       * this Raster: they must not be deleted, and they are invalidated when the
+       * buffer is released (moving the Raster keeps them valid).
+       */
+      if (buffer == NULL)
+        return NULL;
+      if ((int)rowPointers.size() != nRows){
+        rowPointers.resize(nRows);
+        for (int y=0; y<nRows; y++)
+          rowPointers[y] = GetRow(y);
+      }
+      return rowPointers.data();
+    }
+};
+
+// Memory layout of a multiband RasterCube
+enum RasterLayout {
+  RASTER_BSQ = 0,   // band sequential (planar): one full plane per band. Best for per-band filtering
+  RASTER_BIP = 1    // band interleaved by pixel: all the bands of a pixel are adjacent. Best for per-pixel spectral indices
+};
+
+// Per-band metadata carried along with the pixel data
+struct RasterBandInfo {
+  int band;                 // 1-indexed band number in the source dataset
+  GDALDataType dataType;    // native data type in the source dataset
+  double noData;            // no-data value (valid only if hasNoData)
+  bool hasNoData;
+  double scale, offset;     // physical value = raw * scale + offset (1 and 0 if not defined)
+
+  RasterBandInfo() : band(0), dataType(GDT_Unknown), noData(0), hasNoData(false), scale(1), offset(0) {}
+};
+
+// Packed validity mask of a raster: one bit per pixel (1: valid, 0: nodata), least significant bit first.
+// Every row starts at a 64-bit word, so rows can be processed a word (64 pixels) at a time
+class RasterMask {
+
+  private:
+
+    std::vector<uint64_t> words;
+    int nCols, nRows;
+    size_t wordsPerRow;
+
+  public:
+
+    RasterMask() : nCols(0), nRows(0), wordsPerRow(0) {}
+
+    RasterMask(int cols, int rows) : nCols(0), nRows(0), wordsPerRow(0) {
+      /*
+       * Allocates a (cols x rows) mask with every pixel set to nodata (0)
+       */
+      if (cols <= 0 || rows <= 0)
+        return;
+      nCols = cols;
+      nRows = rows;
+      wordsPerRow = ((size_t)cols + 63) / 64;
+      words.assign(wordsPerRow * rows, 0);
+    }
+
+    bool isEmpty() const { return words.empty(); }
+    int GetCols() const { return nCols; }
+    int GetRows() const { return nRows; }
+    size_t GetWordsPerRow() const { return wordsPerRow; }
+
+    uint64_t *GetRow(int y) { return &words[(size_t)y * wordsPerRow]; }
+    const uint64_t *GetRow(int y) const { return &words[(size_t)y * wordsPerRow]; }
+
+    bool operator()(int x, int y) const { return (GetRow(y)[x >> 6] >> (x & 63)) & 1; }
+
+    size_t CountValid() const {
+      size_t count = 0;
+      for (size_t i=0; i<words.size(); i++)
+        count += __builtin_popcountll(words[i]);
+      return count;
+    }
+};
+
+template<typename T>
+class RasterCube {
+
+  private:
+
+    T *buffer;               // single aligned allocation holding all the bands
+    int nCols, nRows, nBands;
+    RasterLayout layout;
+    size_t pixelSpace;       // distance between consecutive pixels of a row, in elements
+    size_t lineSpace;        // distance between consecutive rows, in elements (RASTER_ALIGNMENT padded)
+    size_t bandSpace;        // distance between consecutive bands, in elements
+
+    void release(){
+      if (buffer != NULL)
+        VSIFreeAligned(buffer);
+      buffer = NULL;
+      nCols = nRows = nBands = 0;
+      pixelSpace = lineSpace = bandSpace = 0;
+    }
+
+    void steal(RasterCube &other){
+      buffer = other.buffer;
+      nCols = other.nCols; nRows = other.nRows; nBands = other.nBands;
+      layout = other.layout;
+      pixelSpace = other.pixelSpace; lineSpace = other.lineSpace; bandSpace = other.bandSpace;
+      bandInfo.swap(other.bandInfo);
+      other.buffer = NULL;
+      other.release();
+      other.bandInfo.clear();
+    }
+
+  public:
+
+    std::vector<RasterBandInfo> bandInfo; // one entry per band of the cube, in cube order
+
+    RasterCube() : buffer(NULL), nCols(0), nRows(0), nBands(0), layout(RASTER_BSQ),
+                   pixelSpace(0), lineSpace(0), bandSpace(0) {}
+
+    RasterCube(int cols, int rows, int bands, RasterLayout cubeLayout) :
+      buffer(NULL), nCols(0), nRows(0), nBands(0), layout(cubeLayout), pixelSpace(0), lineSpace(0), bandSpace(0) {
+      /*
+       * Allocates an uninitialized (cols x rows x bands) cube in a single
+       * aligned buffer. Every row starts at a RASTER_ALIGNMENT boundary.
+       * Throws std::bad_alloc if the buffer cannot be allocated.
+       */
+      if (cols <= 0 || rows <= 0 || bands <= 0)
+        return;
+      size_t samplesPerRow = (layout == RASTER_BIP) ? (size_t)cols * bands : (size_t)cols;
+      size_t rowBytes = samplesPerRow * sizeof(T);
+      rowBytes = (rowBytes + RASTER_ALIGNMENT - 1) / RASTER_ALIGNMENT * RASTER_ALIGNMENT;
+      size_t bufferBytes = (layout == RASTER_BIP) ? rowBytes * rows : rowBytes * rows * bands;
+      GEOTIFF_STATS_START(tAlloc);
+      buffer = (T *) VSIMallocAligned(RASTER_ALIGNMENT, bufferBytes);
+      if (buffer == NULL)
+        throw std::bad_alloc();
+      GEOTIFF_STATS_ALLOCATION(tAlloc, bufferBytes);
+      nCols = cols; nRows = rows; nBands = bands;
+      lineSpace = rowBytes / sizeof(T);
+      if (layout == RASTER_BIP){
+        pixelSpace = bands;
+        bandSpace  = 1;
+      }
+      else{
+        pixelSpace = 1;
+        bandSpace  = lineSpace * rows;
+      }
+      bandInfo.resize(bands);
+    }
+
+    ~RasterCube() { release(); }
+
+    RasterCube(const RasterCube &) = delete;
+    RasterCube &operator=(const RasterCube &) = delete;
+
+    RasterCube(RasterCube &&other) noexcept : buffer(NULL) { steal(other); }
+
+    RasterCube &operator=(RasterCube &&other) noexcept {
+      if (this != &other){
+        release();
+        steal(other);
+      }
+      return *this;
+    }
+
+    bool isEmpty() const { return buffer == NULL; }
+
+    int GetCols() const { return nCols; }
+    int GetRows() const { return nRows; }
+    int GetBands() const { return nBands; }
+    RasterLayout GetLayout() const { return layout; }
+
+    // element spacing, as used by GDALDataset::RasterIO (multiply by sizeof(T) for bytes)
+    size_t GetPixelSpace() const { return pixelSpace; }
+    size_t GetLineSpace() const { return lineSpace; }
+    size_t GetBandSpace() const { return bandSpace; }
+
+    T *GetData() { return buffer; }
+    const T *GetData() const { return buffer; }
+
+    T &operator()(int x, int y, int b) { return buffer[(size_t)y*lineSpace + (size_t)x*pixelSpace + (size_t)b*bandSpace]; }
+    const T &operator()(int x, int y, int b) const { return buffer[(size_t)y*lineSpace + (size_t)x*pixelSpace + (size_t)b*bandSpace]; }
+
+    T *GetRow(int y, int b = 0) { return buffer + (size_t)y*lineSpace + (size_t)b*bandSpace; }
+    const T *GetRow(int y, int b = 0) const { return buffer + (size_t)y*lineSpace + (size_t)b*bandSpace; }
+    /*
+     * BSQ: first pixel of row y of band b (pixels are contiguous).
+     * BIP: first sample of band b in row y (samples of band b are nBands apart).
+     */
+};
+
+#endif
@@ -10,6 +10,9 @@
  * */
 
 #include <geotiff.hpp>
+#include <geotiff_simd.hpp>
+#include <geotiff_stats.hpp>
+#include <geotiff_counters.hpp>
 // GDAL specific libraries
 #include <gdal_priv.h>
 #include <cpl_conv.h> // for CPLMalloc()
@@ -20,6 +23,11 @@
 #include <cpl_conv.h>
 #include <gdalwarper.h>
 #include <stdlib.h>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <limits>
  
 /**
  * @brief This function returns the filename of the Geotiff
@@ -76,46 +84,519 @@ float** Geotiff::GetRasterBand(int z) {
       * function float** GetRasterBand(int z): 
       * This function reads a band from a geotiff at a 
       * specified vertical level (z value, 1 ... 
-      * n bands). To this end, the Geotiff's GDAL 
-      * data type is passed to a switch statement, 
-      * and the template function GetArray2D (see below)
-      * is called with the appropriate C++ data type. 
-      * The GetArray2D function uses the passed-in C++ 
-      * data type to properly read the band data from 
-      * the Geotiff, cast the data to float**, and return
-      * it to this function. This function returns that 
-      * float** pointer. 
+      * n bands). GDAL converts the band data from its
+      * native type to float while reading it (see
+      * Read<T>), and this function returns a float**
+      * pointer to the rows.
       */
   // cout << "[Geotiff] Creating data container" << endl;
-  float** bandLayer = new float*[nRows];
-  switch( GDALGetRasterDataType(geotiffDataset->GetRasterBand(z)) ) {
-      case 0:
-      return NULL; // GDT_Unknown, or unknown data type.
-      case 1:
-      // GDAL GDT_Byte (-128 to 127) - unsigned  char
-      return GetArray2D<unsigned char>(z,bandLayer); 
-      case 2:
-      // GDAL GDT_UInt16 - short
-      return GetArray2D<unsigned short>(z,bandLayer);
-      case 3:
-      // GDT_Int16
-      return GetArray2D<short>(z,bandLayer);
-      case 4:
-      // GDT_UInt32
-      return GetArray2D<unsigned int>(z,bandLayer);
-      case 5:
-      // GDT_Int32
-      return GetArray2D<int>(z,bandLayer);
-      case 6:
-      // GDT_Float32
-      return GetArray2D<float>(z,bandLayer);
-      case 7:
-      // GDT_Float64
-      return GetArray2D<double>(z,bandLayer);
-      default:     
-      break;  
+  // the float** is a view over a contiguous Raster owned by this object, one per band
+  std::map<int, Raster<float> >::iterator it = rasterBands.find(z);
+  if (it != rasterBands.end())
+    return it->second.GetRowPointers();
+  Raster<float> raster = ReadRaster(z);
+  if (raster.isEmpty())
+    return NULL;
+  return (rasterBands[z] = std::move(raster)).GetRowPointers();
+}
+
+/**
+ * @brief Releases a band previously returned by GetRasterBand, before the Geotiff object is destroyed
+ * 
+ * @param bandLayer float** view returned by GetRasterBand
+ */
+void Geotiff::ReleaseRasterBand(float** bandLayer){
+  for (std::map<int, Raster<float> >::iterator it = rasterBands.begin(); it != rasterBands.end(); ++it){
+    if (it->second.GetRowPointers() == bandLayer){
+      rasterBands.erase(it);
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Reads a full band into a contiguous, owning float raster
+ * @details GDAL converts from the native band type straight into the float raster (see Read).
+ * The returned Raster owns a single aligned buffer, and it is released when it goes out of scope
+ * 
+ * @param z 1-indexed band number
+ * @return Raster<float> band data. Empty raster if the band could not be read
+ */
+Raster<float> Geotiff::ReadRaster(int z) {
+  return Read<float>(z);
+}
+
+/**
+ * @brief Reads a full band into a contiguous, owning raster of the requested type
+ * @details The raster buffer is handed to GDAL as the RasterIO destination (eBufType set from T),
+ * so there is no intermediate buffer: when T matches the band native type the data is copied as is,
+ * otherwise GDAL converts it while unpacking each block. The band is read by whole block-rows
+ * 
+ * @tparam T pixel type: unsigned char, unsigned short, short, unsigned int, int, float or double
+ * @param z 1-indexed band number
+ * @return Raster<T> band data. Empty raster if the band could not be read
+ */
+template<typename T>
+Raster<T> Geotiff::Read(int z) {
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_READ);
+  Raster<T> bandLayer(nCols, nRows);
+  if (!ReadBlockRows<T>(z, 0, 0, bandLayer)){
+    cout << "[geotiff] Error: Unable to read band " << z << " from " << filename << endl;
+    return Raster<T>();
+  }
+  return bandLayer;
+}
+
+/**
+ * @brief Reads a window of a band into a contiguous, owning raster of the requested type
+ * @details Same direct path as Read<T>, restricted to the window: GDAL only fetches and decodes
+ * the blocks intersecting it
+ * 
+ * @tparam T pixel type (see Read)
+ * @param z 1-indexed band number
+ * @param xOff, yOff upper-left corner of the window, in pixels
+ * @param xSize, ySize window size, in pixels. The window must lie inside the raster
+ * @return Raster<T> (xSize x ySize) window data. Empty raster if the window is invalid or could not be read
+ */
+template<typename T>
+Raster<T> Geotiff::ReadWindow(int z, int xOff, int yOff, int xSize, int ySize) {
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_READ_WINDOW);
+  if (xOff < 0 || yOff < 0 || xSize <= 0 || ySize <= 0 || xOff + xSize > nCols || yOff + ySize > nRows){
+    cout << "[geotiff] Error: invalid window [" << xOff << ", " << yOff << ", " << xSize << ", " << ySize
+         << "] for a " << nCols << "x" << nRows << " raster" << endl;
+    return Raster<T>();
+  }
+  Raster<T> window(xSize, ySize);
+  if (!ReadBlockRows<T>(z, xOff, yOff, window)){
+    cout << "[geotiff] Error: Unable to read window from band " << z << " of " << filename << endl;
+    return Raster<T>();
+  }
+  return window;
+}
+
+/**
+ * @brief Reads the part of a band covered by a georeferenced bounding box
+ * @details The box is converted to pixels with the cached geotransform (see GetGeoWindow), and
+ * clipped to the raster extent. Only the blocks intersecting the window are read
+ * 
+ * @tparam T pixel type (see Read)
+ * @param z 1-indexed band number
+ * @param minX, minY, maxX, maxY bounding box, in the dataset georeferenced coordinates
+ * @param window optional 4-element array where the pixel window [xOff, yOff, xSize, ySize] is returned
+ * @return Raster<T> window data. Empty raster if the box does not intersect the raster
+ */
+template<typename T>
+Raster<T> Geotiff::ReadGeoWindow(int z, double minX, double minY, double maxX, double maxY, int *window) {
+  int pixelWindow[4];
+  if (!GetGeoWindow(minX, minY, maxX, maxY, pixelWindow))
+    return Raster<T>();
+  if (window != NULL)
+    memcpy(window, pixelWindow, sizeof(pixelWindow));
+  return ReadWindow<T>(z, pixelWindow[0], pixelWindow[1], pixelWindow[2], pixelWindow[3]);
+}
+
+/**
+ * @brief Maps band z of the file for zero-copy access, or reads it when it cannot be mapped
+ * 
+ * @tparam T pixel type (see Read). Mapping requires T to be the band native type
+ * @param z 1-indexed band number
+ * @return GeotiffMappedBand<T> view. Check isMapped() / isValid()
+ */
+template<typename T>
+GeotiffMappedBand<T> Geotiff::MapBand(int z) {
+  return GeotiffMappedBand<T>(*this, z);
+}
+
+Raster<float> Geotiff::ReadMasked(int z, RasterMask *mask, bool nanFill) {
+  return ReadWindowMasked(z, 0, 0, nCols, nRows, mask, nanFill);
+}
+
+/**
+ * @brief Reads a window of a band as float, flagging nodata pixels during the conversion
+ * @details Each chunk of block-rows is read in the native type into the tail of its own rows of the
+ * output (as in GetArray1D) and widened in place by GeotiffConvertToFloatMasked, which compares against
+ * the band nodata, fills NaN and writes the mask bits in the same pass. Types that cannot be widened
+ * in place are read as float by GDAL and masked in place. If the band has a real GDAL mask band (not
+ * derived from nodata, not all-valid), its chunk is read and applied right after
+ * 
+ * @param z 1-indexed band number
+ * @param xOff, yOff, xSize, ySize window, in pixels (inside the raster)
+ * @param mask optional output validity mask, resized to (xSize x ySize)
+ * @param nanFill write invalid pixels as NaN
+ * @return Raster<float> window data. Empty raster if the window is invalid or could not be read
+ */
+Raster<float> Geotiff::ReadWindowMasked(int z, int xOff, int yOff, int xSize, int ySize, RasterMask *mask, bool nanFill) {
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_READ_MASKED);
+  if (z < 1 || z > nBands || xOff < 0 || yOff < 0 || xSize <= 0 || ySize <= 0 || xOff + xSize > nCols || yOff + ySize > nRows){
+    cout << "[geotiff] Error: invalid band or window [" << xOff << ", " << yOff << ", " << xSize << ", " << ySize
+         << "] for a masked read" << endl;
+    return Raster<float>();
+  }
+  GDALRasterBand *poBand = geotiffDataset->GetRasterBand(z);
+  const RasterBandInfo &info = bandInfo[z-1];
+  // GMF_NODATA masks are handled by the nodata compare; GMF_ALL_VALID needs nothing
+  int maskFlags = poBand->GetMaskFlags();
+  GDALRasterBand *poMask = (maskFlags & (GMF_ALL_VALID | GMF_NODATA)) ? NULL : poBand->GetMaskBand();
+
+  GDALDataType bandType = info.dataType;
+  int nbytes = GDALGetDataTypeSizeBytes(bandType);
+  bool bWiden = (bandType != GDT_Float32) && (nbytes <= (int)sizeof(float)) && GeotiffCanConvertToFloat(bandType);
+
+  Raster<float> output(xSize, ySize);
+  if (mask != NULL)
+    *mask = RasterMask(xSize, ySize);
+  std::vector<unsigned char> maskChunk;
+  int nChunkRows = GetChunkRows(z, xSize);
+
+  for (int row=yOff; row<yOff+ySize; ){
+    int nextRow = (row/nChunkRows + 1)*nChunkRows; // next block-row boundary
+    if (nextRow > yOff + ySize)
+      nextRow = yOff + ySize;
+    int nLines = nextRow - row;
+    int outRow = row - yOff;
+
+    CPLErr e;
+    if (bWiden){
+      // native rows packed at the end of the chunk rows; row j is widened before row j+1 is overwritten
+      unsigned char *nativeBuff = (unsigned char *) output.GetRow(outRow + nLines) - (size_t)nLines*xSize*nbytes;
+      GEOTIFF_STATS_START(tRead);
+      e = poBand->RasterIO(GF_Read, xOff, row, xSize, nLines, nativeBuff, xSize, nLines, bandType, 0, 0);
+      GEOTIFF_STATS_RASTERIO(tRead, (size_t)nLines*xSize*nbytes, GeotiffStatsBlocks(poBand, xOff, row, xSize, nLines));
+      GEOTIFF_STATS_START(tConvert);
+      for (int j=0; e == CE_None && j<nLines; j++)
+        GeotiffConvertToFloatMasked(nativeBuff + (size_t)j*xSize*nbytes, bandType, output.GetRow(outRow + j), xSize,
+                                    info.hasNoData, info.noData, nanFill, mask != NULL ? mask->GetRow(outRow + j) : NULL);
+      GEOTIFF_STATS_CONVERSION(tConvert);
+    }
+    else{
+      GEOTIFF_STATS_START(tRead);
+      e = poBand->RasterIO(GF_Read, xOff, row, xSize, nLines, output.GetRow(outRow), xSize, nLines,
+                           GDT_Float32, sizeof(float), output.GetStrideBytes());
+      GEOTIFF_STATS_RASTERIO(tRead, (size_t)nLines*xSize*sizeof(float), GeotiffStatsBlocks(poBand, xOff, row, xSize, nLines));
+      GEOTIFF_STATS_START(tConvert);
+      for (int j=0; e == CE_None && j<nLines; j++)
+        GeotiffConvertToFloatMasked(output.GetRow(outRow + j), GDT_Float32, output.GetRow(outRow + j), xSize,
+                                    info.hasNoData, info.noData, nanFill, mask != NULL ? mask->GetRow(outRow + j) : NULL);
+      GEOTIFF_STATS_CONVERSION(tConvert);
+    }
+    if (e == CE_None && poMask != NULL){
+      maskChunk.resize((size_t)xSize*nLines);
+      GEOTIFF_STATS_START(tMask);
+      e = poMask->RasterIO(GF_Read, xOff, row, xSize, nLines, &maskChunk[0], xSize, nLines, GDT_Byte, 0, 0);
+      GEOTIFF_STATS_RASTERIO(tMask, (size_t)nLines*xSize, GeotiffStatsBlocks(poMask, xOff, row, xSize, nLines));
+      GEOTIFF_STATS_START(tApply);
+      for (int j=0; e == CE_None && j<nLines; j++)
+        GeotiffApplyMaskBand(&maskChunk[(size_t)j*xSize], output.GetRow(outRow + j), xSize, nanFill,
+                             mask != NULL ? mask->GetRow(outRow + j) : NULL);
+      GEOTIFF_STATS_CONVERSION(tApply);
+    }
+    if (e != CE_None){
+      cout << "[geotiff] Error: Unable to read masked window from band " << z << " of " << filename << endl;
+      if (mask != NULL)
+        *mask = RasterMask();
+      return Raster<float>();
+    }
+    row = nextRow;
+  }
+  return output;
+}
+
+/**
+ * @brief Samples a band at a batch of georeferenced points
+ * 
+ * @param z 1-indexed band number
+ * @param x, y point coordinates, in srcSRS (NULL: dataset SRS)
+ * @param n number of points
+ * @param values output, one value per point (NaN: outside the raster or nodata)
+ * @param method interpolation (nearest, bilinear, bicubic)
+ * @param srcSRS spatial reference of the points (NULL: dataset SRS)
+ * @return size_t number of valid samples
+ */
+size_t Geotiff::Sample(int z, const double *x, const double *y, size_t n, float *values, SampleMethod method, const OGRSpatialReference *srcSRS) {
+  GeotiffSampler sampler(*this, z);
+  if (!sampler.SetSourceSRS(srcSRS)){
+    std::fill(values, values + n, numeric_limits<float>::quiet_NaN());
+    return 0;
+  }
+  return sampler.Sample(x, y, n, values, method);
+}
+
+/**
+ * @brief Warps a band onto a target grid (in memory, multithreaded)
+ * 
+ * @param z 1-indexed band number
+ * @param target target grid (SRS, geotransform, size)
+ * @param resampling GDAL resampling algorithm
+ * @return Raster<float> warped band (NaN where there is no data), empty on error
+ */
+Raster<float> Geotiff::Warp(int z, const GeotiffGrid &target, GDALResampleAlg resampling) {
+  GeotiffWarper warper;
+  return warper.Warp(*this, z, target, resampling);
+}
+
+template<typename T>
+Raster<T> Geotiff::ReadResampled(int z, int outCols, int outRows, GDALRIOResampleAlg resampling) {
+  return ReadWindowResampled<T>(z, 0, 0, nCols, nRows, outCols, outRows, resampling);
+}
+
+/**
+ * @brief Reads a pixel window of a band at a lower resolution, from the best overview when available
+ * @details The source is the coarsest overview whose decimation factor does not exceed the requested
+ * one (so the output is never upsampled from a too coarse level). The window is mapped to the source
+ * grid as a floating point window, and GDAL resamples it straight into the output raster
+ * 
+ * @tparam T pixel type (see Read)
+ * @param z 1-indexed band number
+ * @param xOff, yOff, xSize, ySize window, in full resolution pixels (inside the raster)
+ * @param outCols, outRows size of the output raster
+ * @param resampling GDAL RasterIO resampling method
+ * @return Raster<T> (outCols x outRows). Empty raster if the window is invalid or could not be read
+ */
+template<typename T>
+Raster<T> Geotiff::ReadWindowResampled(int z, int xOff, int yOff, int xSize, int ySize, int outCols, int outRows,
+                                       GDALRIOResampleAlg resampling) {
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_READ_RESAMPLED);
+  if (z < 1 || z > nBands || outCols <= 0 || outRows <= 0 ||
+      xOff < 0 || yOff < 0 || xSize <= 0 || ySize <= 0 || xOff + xSize > nCols || yOff + ySize > nRows){
+    cout << "[geotiff] Error: invalid band, window or output size for a resampled read" << endl;
+    return Raster<T>();
+  }
+  GDALRasterBand *poBand = geotiffDataset->GetRasterBand(z);
+  double factor = min((double)xSize / outCols, (double)ySize / outRows);
+  GDALRasterBand *poSource = poBand;
+  double sourceFactor = 1.0;
+  for (int i=0; i<poBand->GetOverviewCount(); i++){
+    GDALRasterBand *poOverview = poBand->GetOverview(i);
+    if (poOverview == NULL)
+      continue;
+    double overviewFactor = (double)nCols / poOverview->GetXSize();
+    if (overviewFactor <= factor && overviewFactor > sourceFactor){
+      poSource = poOverview;
+      sourceFactor = overviewFactor;
+    }
+  }
+
+  // window in the source grid: fractional, enclosed by the integer window GDAL requires
+  int sourceCols = poSource->GetXSize(), sourceRows = poSource->GetYSize();
+  double scaleX = (double)sourceCols / nCols, scaleY = (double)sourceRows / nRows;
+  GDALRasterIOExtraArg sExtraArg;
+  INIT_RASTERIO_EXTRA_ARG(sExtraArg);
+  sExtraArg.eResampleAlg = resampling;
+  sExtraArg.bFloatingPointWindowValidity = TRUE;
+  sExtraArg.dfXOff = xOff * scaleX;
+  sExtraArg.dfYOff = yOff * scaleY;
+  sExtraArg.dfXSize = min(xSize * scaleX, sourceCols - sExtraArg.dfXOff);
+  sExtraArg.dfYSize = min(ySize * scaleY, sourceRows - sExtraArg.dfYOff);
+  int srcXOff = (int)floor(sExtraArg.dfXOff), srcYOff = (int)floor(sExtraArg.dfYOff);
+  int srcXSize = max(1, min(sourceCols, (int)ceil(sExtraArg.dfXOff + sExtraArg.dfXSize)) - srcXOff);
+  int srcYSize = max(1, min(sourceRows, (int)ceil(sExtraArg.dfYOff + sExtraArg.dfYSize)) - srcYOff);
+
+  Raster<T> output(outCols, outRows);
+  GEOTIFF_STATS_START(tRead);
+  CPLErr e = poSource->RasterIO(GF_Read, srcXOff, srcYOff, srcXSize, srcYSize, output.GetData(), outCols, outRows,
+                                GDALTypeOf<T>::type, sizeof(T), output.GetStrideBytes(), &sExtraArg);
+  GEOTIFF_STATS_RASTERIO(tRead, (size_t)outCols*outRows*sizeof(T), GeotiffStatsBlocks(poSource, srcXOff, srcYOff, srcXSize, srcYSize));
+  if (e != CE_None){
+    cout << "[geotiff] Error: Unable to read resampled window from band " << z << " of " << filename << endl;
+    return Raster<T>();
+  }
+  return output;
+}
+
+template<typename T>
+RasterCube<T> Geotiff::ReadCube(const std::vector<int> &bands, RasterLayout layout) {
+  return ReadCubeWindow<T>(bands, layout, 0, 0, nCols, nRows);
+}
+
+/**
+ * @brief Reads a pixel window of several bands into a planar (BSQ) or pixel interleaved (BIP) cube
+ * @details Every chunk of block-rows is read for all the bands in a single GDALDataset::RasterIO call,
+ * with the pixel/line/band spacing of the cube layout, so GDAL writes each sample straight into place
+ * 
+ * @tparam T pixel type (see Read)
+ * @param bands 1-indexed band numbers, in cube order. Empty: all the bands
+ * @param layout RASTER_BSQ or RASTER_BIP
+ * @param xOff, yOff, xSize, ySize pixel window (must lie inside the raster)
+ * @return RasterCube<T> cube with per-band metadata. Empty cube on error
+ */
+template<typename T>
+RasterCube<T> Geotiff::ReadCubeWindow(const std::vector<int> &bands, RasterLayout layout, int xOff, int yOff, int xSize, int ySize) {
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_READ_CUBE);
+  std::vector<int> bandMap = bands;
+  if (bandMap.empty())
+    for (int b=1; b<=nBands; b++)
+      bandMap.push_back(b);
+  for (size_t i=0; i<bandMap.size(); i++){
+    if (bandMap[i] < 1 || bandMap[i] > nBands){
+      cout << "[geotiff] Error: invalid band number " << bandMap[i] << endl;
+      return RasterCube<T>();
+    }
+  }
+  if (xOff < 0 || yOff < 0 || xSize <= 0 || ySize <= 0 || xOff + xSize > nCols || yOff + ySize > nRows){
+    cout << "[geotiff] Error: invalid window [" << xOff << ", " << yOff << ", " << xSize << ", " << ySize
+         << "] for a " << nCols << "x" << nRows << " raster" << endl;
+    return RasterCube<T>();
+  }
+
+  RasterCube<T> cube(xSize, ySize, (int)bandMap.size(), layout);
+  for (size_t i=0; i<bandMap.size(); i++)
+    cube.bandInfo[i] = bandInfo[bandMap[i] - 1];
+
+  // chunks follow the block-rows of the first band (bands of a GeoTIFF share the block size)
+  int nChunkRows = GetChunkRows(bandMap[0], xSize * (int)bandMap.size());
+  for (int row=yOff; row<yOff+ySize; ){
+    int nextRow = (row/nChunkRows + 1)*nChunkRows;
+    if (nextRow > yOff + ySize)
+      nextRow = yOff + ySize;
+    int nLines = nextRow - row;
+
+    GEOTIFF_STATS_START(tRead);
+    CPLErr e = geotiffDataset->RasterIO(GF_Read, xOff, row, xSize, nLines, cube.GetRow(row - yOff), xSize, nLines,
+                                        GDALTypeOf<T>::type, (int)bandMap.size(), bandMap.data(),
+                                        cube.GetPixelSpace()*sizeof(T), cube.GetLineSpace()*sizeof(T),
+                                        cube.GetBandSpace()*sizeof(T));
+    GEOTIFF_STATS_RASTERIO(tRead, (size_t)nLines*xSize*bandMap.size()*sizeof(T),
+                           bandMap.size()*GeotiffStatsBlocks(geotiffDataset->GetRasterBand(bandMap[0]), xOff, row, xSize, nLines));
+    if (e != CE_None){
+      cout << "[geotiff] Error: Unable to read bands from " << filename << endl;
+      return RasterCube<T>();
+    }
+    row = nextRow;
+  }
+  return cube;
+}
+
+/**
+ * @brief Retrieves the per-band metadata (data type, no-data, scale and offset) of every band
+ */
+void Geotiff::LoadBandInfo(){
+  bandInfo.resize(nBands);
+  for (int b=1; b<=nBands; b++){
+    GDALRasterBand *poBand = geotiffDataset->GetRasterBand(b);
+    RasterBandInfo &info = bandInfo[b-1];
+    int bGotValue;
+    info.band = b;
+    info.dataType = poBand->GetRasterDataType();
+    info.noData = poBand->GetNoDataValue(&bGotValue);
+    info.hasNoData = (bGotValue != 0);
+    info.scale = poBand->GetScale(&bGotValue);
+    if (!bGotValue)
+      info.scale = 1.0;
+    info.offset = poBand->GetOffset(&bGotValue);
+    if (!bGotValue)
+      info.offset = 0.0;
+  }
+}
+
+/**
+ * @brief Returns the metadata of a band (data type, no-data, scale and offset)
+ * 
+ * @param layerIndex 1-indexed band number
+ * @return RasterBandInfo band metadata (default values for invalid band numbers)
+ */
+RasterBandInfo Geotiff::GetBandInfo(int layerIndex){
+  if (layerIndex < 1 || layerIndex > (int)bandInfo.size())
+    return RasterBandInfo();
+  return bandInfo[layerIndex-1];
+}
+
+/**
+ * @brief Converts a georeferenced bounding box into the pixel window that covers it
+ * 
+ * @param minX, minY, maxX, maxY bounding box, in the dataset georeferenced coordinates
+ * @param window 4-element array where the window [xOff, yOff, xSize, ySize] is returned, clipped to the raster
+ * @return true if the box intersects the raster
+ */
+bool Geotiff::GetGeoWindow(double minX, double minY, double maxX, double maxY, int *window){
+  // the 4 corners are transformed, so rotated/sheared geotransforms are handled too
+  const double cornerX[4] = {minX, maxX, minX, maxX};
+  const double cornerY[4] = {minY, minY, maxY, maxY};
+  double pxMin = 0, pxMax = 0, pyMin = 0, pyMax = 0;
+  for (int i=0; i<4; i++){
+    double px, py;
+    if (!GeoToPixel(cornerX[i], cornerY[i], &px, &py))
+      return false;
+    if (i == 0 || px < pxMin) pxMin = px;
+    if (i == 0 || px > pxMax) pxMax = px;
+    if (i == 0 || py < pyMin) pyMin = py;
+    if (i == 0 || py > pyMax) pyMax = py;
+  }
+  // every pixel touched by the box is included
+  double x0 = std::max(0.0, floor(pxMin));
+  double y0 = std::max(0.0, floor(pyMin));
+  double x1 = std::min((double)nCols, ceil(pxMax));
+  double y1 = std::min((double)nRows, ceil(pyMax));
+  if (x1 <= x0 || y1 <= y0)
+    return false; // no intersection with the raster
+  window[0] = (int)x0;
+  window[1] = (int)y0;
+  window[2] = (int)(x1 - x0);
+  window[3] = (int)(y1 - y0);
+  return true;
+}
+
+/**
+ * @brief Converts georeferenced coordinates into (fractional) pixel coordinates
+ * @details Uses the inverse of the geotransform cached at construction time. Pixel (0, 0) is the
+ * upper-left corner of the upper-left pixel, so the center of pixel (col, row) is (col + 0.5, row + 0.5)
+ * 
+ * @param geoX, geoY georeferenced coordinates
+ * @param pixelX, pixelY pixel coordinates
+ * @return true if the geotransform could be inverted
+ */
+bool Geotiff::GeoToPixel(double geoX, double geoY, double *pixelX, double *pixelY){
+  double invGeotransform[6];
+  if (!GDALInvGeoTransform(geotransform, invGeotransform))
+    return false;
+  GDALApplyGeoTransform(invGeotransform, geoX, geoY, pixelX, pixelY);
+  return true;
+}
+
+/**
+ * @brief Converts (fractional) pixel coordinates into georeferenced coordinates
+ * 
+ * @param pixelX, pixelY pixel coordinates
+ * @param geoX, geoY georeferenced coordinates
+ */
+void Geotiff::PixelToGeo(double pixelX, double pixelY, double *geoX, double *geoY){
+  GDALApplyGeoTransform(geotransform, pixelX, pixelY, geoX, geoY);
+}
+
+/**
+ * @brief Fills a raster with the band data at (xOff, yOff), one RasterIO call per chunk of block-rows
+ * @details The window size is the raster size. Chunk limits are aligned to absolute block-row
+ * boundaries, so no block is requested twice even when the window does not start on a block edge
+ * 
+ * @param layerIndex 1-indexed band number
+ * @param xOff, yOff upper-left corner of the window, in pixels
+ * @param bandLayer destination raster. GDAL writes directly into its rows using its stride
+ * @return true if every block-row was successfully read
+ */
+template<typename T>
+bool Geotiff::ReadBlockRows(int layerIndex, int xOff, int yOff, Raster<T> &bandLayer) {
+  if (layerIndex < 1 || layerIndex > nBands || bandLayer.isEmpty())
+    return false;
+
+  int xSize = bandLayer.GetCols();
+  int ySize = bandLayer.GetRows();
+  GDALRasterBand *poBand = geotiffDataset->GetRasterBand(layerIndex);
+  int nChunkRows = GetChunkRows(layerIndex, xSize);
+
+  for(int row=yOff; row<yOff+ySize; ) {     // iterate through block-rows
+    int nextRow = (row/nChunkRows + 1)*nChunkRows; // next block-row boundary
+    if (nextRow > yOff + ySize)
+      nextRow = yOff + ySize; // last block-row can be partial
+    int nLines = nextRow - row;
+
+    GEOTIFF_STATS_START(tRead);
+    CPLErr e = poBand->RasterIO(GF_Read,xOff,row,xSize,nLines,bandLayer.GetRow(row - yOff),xSize,nLines,
+                                GDALTypeOf<T>::type,sizeof(T),bandLayer.GetStrideBytes());
+    GEOTIFF_STATS_RASTERIO(tRead, (size_t)nLines*xSize*sizeof(T), GeotiffStatsBlocks(poBand, xOff, row, xSize, nLines));
+    if(!(e == 0))
+      return false;
+    row = nextRow;
   }
-  return NULL;  
+  return true;
 }
 
 GDALDataset *Geotiff::GetDataset(){
@@ -150,51 +631,266 @@ template<typename T>
 float** Geotiff::GetArray2D(int layerIndex,float** bandLayer) {
 
     /*
-    * function float** GetArray2D(int layerIndex): 
+    * function float** GetArray2D(int layerIndex, float** bandLayer): 
     * This function returns a pointer (to a pointer)
     * for a float array that holds the band (array)
     * data from the geotiff, for a specified layer 
     * index layerIndex (1,2,3... for GDAL, for Geotiffs
     * with more than one band or data layer, 3D that is). 
-    *
-    * Note this is a template function that is meant 
-    * to take in a valid C++ data type (i.e. char, 
-    * short, int, float), for the Geotiff in question 
-    * such that the Geotiff band data may be properly 
-    * read-in as numbers. Then, this function casts 
-    * the data to a float data type automatically. 
+    * bandLayer is an array of nRows pointers, supplied by the caller;
+    * every row is allocated here with new float[nCols].
+    * T is accepted for compatibility with existing callers only: GDAL
+    * converts the band to float while unpacking it, whatever T is.
     */
 
-    // get the raster data type (ENUM integer 1-12, 
-    // see GDAL C/C++ documentation for more details)        
-    GDALDataType bandType = GDALGetRasterDataType(geotiffDataset->GetRasterBand(layerIndex));
+    GEOTIFF_STATS_CALL(GEOTIFF_CALL_GETARRAY2D);
+    if (bandLayer == NULL || layerIndex < 1 || layerIndex > nBands)
+      return NULL;
+    // one chunk of block-rows at a time, copied into the caller rows (the band is never held twice)
+    int nChunkRows = GetChunkRows(layerIndex, nCols);
+    Raster<float> chunk;
+    for (int row=0; row<nRows; row+=nChunkRows){
+      int nLines = min(nChunkRows, nRows - row);
+      if (chunk.GetRows() != nLines)
+        chunk = Raster<float>(nCols, nLines);
+      if (!ReadBlockRows<float>(layerIndex, 0, row, chunk)){
+        cout << "[geotiff] Error: Unable to read band " << layerIndex << " from " << filename << endl;
+        for (int r=0; r<row; r++){
+          delete[] bandLayer[r];
+          bandLayer[r] = NULL;
+        }
+        return NULL;
+      }
+      for (int r=0; r<nLines; r++){
+        bandLayer[row + r] = new float[nCols];
+        memcpy(bandLayer[row + r], chunk.GetRow(r), nCols*sizeof(float));
+      }
+    }
+    return bandLayer;
+}
 
-    // get number of bytes per pixel in Geotiff
-    int nbytes = GDALGetDataTypeSizeBytes(bandType);
+float** Geotiff::GetArray2D(int layerIndex,Raster<float> &bandLayer) {
+    /*
+    * function float** GetArray2D(int layerIndex, Raster<float> &bandLayer): 
+    * Reads band layerIndex into bandLayer, which must be (nCols x nRows),
+    * and returns its row pointer view. GDAL converts the band to float
+    * while unpacking each block, one block-row at a time.
+    */
+    GEOTIFF_STATS_CALL(GEOTIFF_CALL_GETARRAY2D);
+    if (bandLayer.GetCols() != nCols || bandLayer.GetRows() != nRows || !ReadBlockRows<float>(layerIndex, 0, 0, bandLayer)){
+      cout << "[geotiff] Error: Unable to read band " << layerIndex << " from " << filename << endl;
+      return NULL;
+    }
+    return bandLayer.GetRowPointers();
+}
 
-    // cout << "[GetArray2D] Allocating rowBuff" << endl;    
-    // allocate pointer to memory block for one row (scanline) 
-    // in 2D Geotiff array.  
-    T *rowBuff = (T*) CPLMalloc(nbytes*nCols);
+// explicit instantiations for the supported pixel types
+template Raster<unsigned char> Geotiff::Read<unsigned char>(int z);
+template Raster<unsigned short> Geotiff::Read<unsigned short>(int z);
+template Raster<short> Geotiff::Read<short>(int z);
+template Raster<unsigned int> Geotiff::Read<unsigned int>(int z);
+template Raster<int> Geotiff::Read<int>(int z);
+template Raster<float> Geotiff::Read<float>(int z);
+template Raster<double> Geotiff::Read<double>(int z);
 
-    // cout << "[GetArray2D] Allocating rows:" << nRows << endl;    
-    for(int row=0; row<nRows; row++) {     // iterate through rows
+template Raster<unsigned char> Geotiff::ReadWindow<unsigned char>(int z, int xOff, int yOff, int xSize, int ySize);
+template Raster<unsigned short> Geotiff::ReadWindow<unsigned short>(int z, int xOff, int yOff, int xSize, int ySize);
+template Raster<short> Geotiff::ReadWindow<short>(int z, int xOff, int yOff, int xSize, int ySize);
+template Raster<unsigned int> Geotiff::ReadWindow<unsigned int>(int z, int xOff, int yOff, int xSize, int ySize);
+template Raster<int> Geotiff::ReadWindow<int>(int z, int xOff, int yOff, int xSize, int ySize);
+template Raster<float> Geotiff::ReadWindow<float>(int z, int xOff, int yOff, int xSize, int ySize);
+template Raster<double> Geotiff::ReadWindow<double>(int z, int xOff, int yOff, int xSize, int ySize);
+template Raster<unsigned char> Geotiff::ReadGeoWindow<unsigned char>(int z, double minX, double minY, double maxX, double maxY, int *window);
+template Raster<unsigned short> Geotiff::ReadGeoWindow<unsigned short>(int z, double minX, double minY, double maxX, double maxY, int *window);
+template Raster<short> Geotiff::ReadGeoWindow<short>(int z, double minX, double minY, double maxX, double maxY, int *window);
+template Raster<unsigned int> Geotiff::ReadGeoWindow<unsigned int>(int z, double minX, double minY, double maxX, double maxY, int *window);
+template Raster<int> Geotiff::ReadGeoWindow<int>(int z, double minX, double minY, double maxX, double maxY, int *window);
+template Raster<float> Geotiff::ReadGeoWindow<float>(int z, double minX, double minY, double maxX, double maxY, int *window);
+template Raster<double> Geotiff::ReadGeoWindow<double>(int z, double minX, double minY, double maxX, double maxY, int *window);
 
-      // cout << "Row:\t" << row << endl;
-      // read the scanline into the dynamically allocated row-buffer       
-      CPLErr e = geotiffDataset->GetRasterBand(layerIndex)->RasterIO(GF_Read,0,row,nCols,1,rowBuff,nCols,1,bandType,0,0);
-      if(!(e == 0)) { 
-        cout << "[geotiff] Error: Unable to read scanline in Geotiff!" << endl;
-        exit(1);
+template Raster<unsigned char> Geotiff::ReadResampled<unsigned char>(int z, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<unsigned short> Geotiff::ReadResampled<unsigned short>(int z, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<short> Geotiff::ReadResampled<short>(int z, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<unsigned int> Geotiff::ReadResampled<unsigned int>(int z, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<int> Geotiff::ReadResampled<int>(int z, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<float> Geotiff::ReadResampled<float>(int z, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<double> Geotiff::ReadResampled<double>(int z, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<unsigned char> Geotiff::ReadWindowResampled<unsigned char>(int z, int xOff, int yOff, int xSize, int ySize, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<unsigned short> Geotiff::ReadWindowResampled<unsigned short>(int z, int xOff, int yOff, int xSize, int ySize, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<short> Geotiff::ReadWindowResampled<short>(int z, int xOff, int yOff, int xSize, int ySize, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<unsigned int> Geotiff::ReadWindowResampled<unsigned int>(int z, int xOff, int yOff, int xSize, int ySize, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<int> Geotiff::ReadWindowResampled<int>(int z, int xOff, int yOff, int xSize, int ySize, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<float> Geotiff::ReadWindowResampled<float>(int z, int xOff, int yOff, int xSize, int ySize, int outCols, int outRows, GDALRIOResampleAlg resampling);
+template Raster<double> Geotiff::ReadWindowResampled<double>(int z, int xOff, int yOff, int xSize, int ySize, int outCols, int outRows, GDALRIOResampleAlg resampling);
+
+template GeotiffMappedBand<unsigned char> Geotiff::MapBand<unsigned char>(int z);
+template GeotiffMappedBand<unsigned short> Geotiff::MapBand<unsigned short>(int z);
+template GeotiffMappedBand<short> Geotiff::MapBand<short>(int z);
+template GeotiffMappedBand<unsigned int> Geotiff::MapBand<unsigned int>(int z);
+template GeotiffMappedBand<int> Geotiff::MapBand<int>(int z);
+template GeotiffMappedBand<float> Geotiff::MapBand<float>(int z);
+template GeotiffMappedBand<double> Geotiff::MapBand<double>(int z);
+
+template RasterCube<unsigned char> Geotiff::ReadCube<unsigned char>(const std::vector<int> &bands, RasterLayout layout);
+template RasterCube<unsigned short> Geotiff::ReadCube<unsigned short>(const std::vector<int> &bands, RasterLayout layout);
+template RasterCube<short> Geotiff::ReadCube<short>(const std::vector<int> &bands, RasterLayout layout);
+template RasterCube<unsigned int> Geotiff::ReadCube<unsigned int>(const std::vector<int> &bands, RasterLayout layout);
+template RasterCube<int> Geotiff::ReadCube<int>(const std::vector<int> &bands, RasterLayout layout);
+template RasterCube<float> Geotiff::ReadCube<float>(const std::vector<int> &bands, RasterLayout layout);
+template RasterCube<double> Geotiff::ReadCube<double>(const std::vector<int> &bands, RasterLayout layout);
+template RasterCube<unsigned char> Geotiff::ReadCubeWindow<unsigned char>(const std::vector<int> &bands, RasterLayout layout, int xOff, int yOff, int xSize, int ySize);
+template RasterCube<unsigned short> Geotiff::ReadCubeWindow<unsigned short>(const std::vector<int> &bands, RasterLayout layout, int xOff, int yOff, int xSize, int ySize);
+template RasterCube<short> Geotiff::ReadCubeWindow<short>(const std::vector<int> &bands, RasterLayout layout, int xOff, int yOff, int xSize, int ySize);
+template RasterCube<unsigned int> Geotiff::ReadCubeWindow<unsigned int>(const std::vector<int> &bands, RasterLayout layout, int xOff, int yOff, int xSize, int ySize);
+template RasterCube<int> Geotiff::ReadCubeWindow<int>(const std::vector<int> &bands, RasterLayout layout, int xOff, int yOff, int xSize, int ySize);
+template RasterCube<float> Geotiff::ReadCubeWindow<float>(const std::vector<int> &bands, RasterLayout layout, int xOff, int yOff, int xSize, int ySize);
+template RasterCube<double> Geotiff::ReadCubeWindow<double>(const std::vector<int> &bands, RasterLayout layout, int xOff, int yOff, int xSize, int ySize);
+
+template float** Geotiff::GetArray2D<unsigned char>(int layerIndex,float** bandLayer);
+template float** Geotiff::GetArray2D<unsigned short>(int layerIndex,float** bandLayer);
+template float** Geotiff::GetArray2D<short>(int layerIndex,float** bandLayer);
+template float** Geotiff::GetArray2D<unsigned int>(int layerIndex,float** bandLayer);
+template float** Geotiff::GetArray2D<int>(int layerIndex,float** bandLayer);
+template float** Geotiff::GetArray2D<float>(int layerIndex,float** bandLayer);
+template float** Geotiff::GetArray2D<double>(int layerIndex,float** bandLayer);
+
+/**
+ * @brief Returns the native data type of a given band
+ * 
+ * @param layerIndex 1-indexed band number
+ * @return GDALDataType native data type (GDT_Unknown for invalid band numbers)
+ */
+GDALDataType Geotiff::GetDataType(int layerIndex){
+  if (layerIndex < 1 || layerIndex > nBands)
+    return GDT_Unknown;
+  return geotiffDataset->GetRasterBand(layerIndex)->GetRasterDataType();
+}
+
+/**
+ * @brief Returns the number of overviews of a given band
+ * 
+ * @param layerIndex 1-indexed band number
+ * @return int number of overviews (0 for invalid band numbers)
+ */
+int Geotiff::GetOverviewCount(int layerIndex){
+  if (layerIndex < 1 || layerIndex > nBands)
+    return 0;
+  return geotiffDataset->GetRasterBand(layerIndex)->GetOverviewCount();
+}
+
+/**
+ * @brief Builds overviews of all the bands, internal or in a .ovr sidecar
+ * @details GDAL_NUM_THREADS is set as a thread-local configuration option, so the setting does not
+ * leak to other threads. Internal overviews need the file in update mode: the file is updated through a
+ * separate handle, then reopened read-only. The previous handle is retired (kept open until the object is
+ * destroyed), so band pointers already handed out stay valid
+ * 
+ * @param factors decimation factors (empty: 2, 4, 8, ... until the overview fits in one block)
+ * @param resampling GDAL overview resampling method ("AVERAGE", "NEAREST", "MODE", ...)
+ * @param external true: .ovr sidecar, false: inside the GeoTIFF
+ * @param nThreads threads used by GDAL (<= 0: all CPU cores)
+ * @return true on success
+ */
+bool Geotiff::BuildOverviews(const std::vector<int> &factors, const char *resampling, bool external, int nThreads){
+  if (!bValidDataset)
+    return false;
+  std::vector<int> levels(factors);
+  if (levels.empty()){
+    int blockSize[2];
+    GetBlockSize(1, blockSize);
+    int minBlock = max(64, min(blockSize[0], blockSize[1]));
+    for (int f=2; nCols / f >= minBlock || nRows / f >= minBlock; f *= 2)
+      levels.push_back(f);
+    if (levels.empty())
+      levels.push_back(2);
+  }
+
+  const char *pszPrevious = CPLGetThreadLocalConfigOption("GDAL_NUM_THREADS", NULL);
+  bool bHadPrevious = (pszPrevious != NULL);
+  std::string previousThreads = bHadPrevious ? pszPrevious : "";
+  std::ostringstream threads;
+  if (nThreads > 0)
+    threads << nThreads;
+  else
+    threads << "ALL_CPUS";
+  CPLSetThreadLocalConfigOption("GDAL_NUM_THREADS", threads.str().c_str());
+
+  CPLErr e;
+  bool bReopened = true;
+  if (external){
+    // on a read-only GTiff dataset GDAL writes the overviews to <filename>.ovr
+    e = GDALBuildOverviews(geotiffDataset, resampling, (int)levels.size(), &levels[0], 0, NULL, NULL, NULL);
+    GeotiffDatasetPool::Instance().Invalidate(filename); // pooled handles opened before the .ovr existed
+  }
+  else{
+    // the current handle stays open while the file is updated, so a failure leaves the object as it was
+    GDALDataset *poUpdate = (GDALDataset *) GDALOpen(filename, GA_Update);
+    if (poUpdate == NULL)
+      e = CE_Failure;
+    else{
+      e = GDALBuildOverviews(poUpdate, resampling, (int)levels.size(), &levels[0], 0, NULL, NULL, NULL);
+      GDALClose(poUpdate);
+    }
+    GeotiffDatasetPool::Instance().Invalidate(filename); // pooled handles opened before the update
+    if (e == CE_None){
+      GeotiffDatasetLease updated = GeotiffDatasetPool::Instance().Acquire(filename);
+      if (!updated.isValid()){
+        cout << "[geotiff] Error: Unable to reopen " << filename << " after building overviews, keeping the previous handle" << endl;
+        bReopened = false;
       }
-        
-      bandLayer[row] = new float[nCols];
-      for( int col=0; col<nCols; col++ ) { // iterate through columns
-        bandLayer[row][col] = (float)rowBuff[col];
+      else{
+        // views may still point into the old handle: it is retired, not closed
+        retiredLeases.push_back(std::move(lease));
+        lease = std::move(updated);
+        geotiffDataset = lease.Get();
       }
     }
-    CPLFree( rowBuff );
-    return bandLayer;
+  }
+  CPLSetThreadLocalConfigOption("GDAL_NUM_THREADS", bHadPrevious ? previousThreads.c_str() : NULL);
+
+  if (e != CE_None){
+    cout << "[geotiff] Error: Unable to build " << (external ? "external" : "internal") << " overviews for " << filename << endl;
+    return false;
+  }
+  return bReopened;
+}
+
+/**
+ * @brief Returns the natural block size (tile or strip) of a given band
+ * 
+ * @param layerIndex 1-indexed band number
+ * @param blockSize 2-element array where the block size (X, Y) is returned
+ */
+void Geotiff::GetBlockSize(int layerIndex, int *blockSize){
+  geotiffDataset->GetRasterBand(layerIndex)->GetBlockSize(&blockSize[0], &blockSize[1]);
+}
+
+/**
+ * @brief Returns the number of rows to be fetched per RasterIO call for a given band
+ * @details The number of rows is always a multiple of the block height, so each block-row
+ * (a full row of tiles, or one or more strips) is requested only once. For striped files with
+ * very short strips (e.g. 1 scanline per strip) several block-rows are grouped together until
+ * the chunk reaches GEOTIFF_CHUNK_BYTES, amortizing the per-call overhead
+ * 
+ * @param layerIndex 1-indexed band number
+ * @param xSize width (in pixels) of the requested window
+ * @return int number of rows per read (>= 1)
+ */
+int Geotiff::GetChunkRows(int layerIndex, int xSize){
+  int blockSize[2];
+  GetBlockSize(layerIndex, blockSize);
+  int nBlockYSize = (blockSize[1] > 0) ? blockSize[1] : 1;
+
+  GDALDataType bandType = GDALGetRasterDataType(geotiffDataset->GetRasterBand(layerIndex));
+  size_t nBlockRowBytes = (size_t)GDALGetDataTypeSizeBytes(bandType) * xSize * nBlockYSize;
+  size_t nBlockRows = 1;
+  if (nBlockRowBytes > 0 && nBlockRowBytes < GEOTIFF_CHUNK_BYTES)
+    nBlockRows = GEOTIFF_CHUNK_BYTES / nBlockRowBytes;
+
+  size_t nChunkRows = nBlockRows * nBlockYSize;
+  if (nChunkRows > (size_t)nRows)
+    nChunkRows = nRows;
+  return (nChunkRows > 0) ? (int)nChunkRows : 1;
 }
 
 bool Geotiff::isValid(){
@@ -232,8 +928,16 @@ void Geotiff::ShowInformation(){
         GDALGetColorInterpretationName(poBand->GetColorInterpretation()) );
     adfMinMax[0] = poBand->GetMinimum( &bGotMin );
     adfMinMax[1] = poBand->GetMaximum( &bGotMax );
-    if( ! (bGotMin && bGotMax) )
-      GDALComputeRasterMinMax((GDALRasterBandH)poBand, TRUE, adfMinMax);
+    if( ! (bGotMin && bGotMax) ){
+      // statistics already computed in this process, else an approximate scan: printing never writes a .aux.xml
+      RasterStatistics stats;
+      if (GeotiffFindCachedStatistics(filename, i, true, stats)){
+        adfMinMax[0] = stats.min;
+        adfMinMax[1] = stats.max;
+      }
+      else
+        GDALComputeRasterMinMax((GDALRasterBandH)poBand, TRUE, adfMinMax);
+    }
     cout << "Min = " << adfMinMax[0] <<",\tMax = " << adfMinMax[1] << endl;
     if( poBand->GetOverviewCount() > 0 )
       cout << "Band has " << poBand->GetOverviewCount() << "overviews" << endl;
@@ -242,18 +946,21 @@ void Geotiff::ShowInformation(){
 
     cout << "Units:\t\t" << poBand->GetUnitType() << endl;
 
-    // WARNING: this conditional is valid only for the first band which is retrieved in the construction at creation time
-    if (!bGotNodata){
+    // per-band no-data definition, retrieved at creation time
+    const RasterBandInfo &info = bandInfo[i-1];
+    if (!info.hasNoData){
       cout << "Current band does not provide explicit no-data field definition" << endl;
     }
     else{
-      if (CPLIsNan(dfNoData)){ //test if provided NoData is NaN
-        cout << "NoData value: NaN --> " << dfNoData << endl;
+      if (CPLIsNan(info.noData)){ //test if provided NoData is NaN
+        cout << "NoData value: NaN --> " << info.noData << endl;
       }
       else{
-        cout << "NoData value: " << dfNoData << endl;
+        cout << "NoData value: " << info.noData << endl;
       }
     }
+    if (info.scale != 1.0 || info.offset != 0.0)
+      cout << "Scale: " << info.scale << ",\tOffset: " << info.offset << endl;
   }
 	//*/
 	// NAMES AND ORDERING OF THE AXES
@@ -275,28 +982,76 @@ double Geotiff::GetGeoTransformParam(int paramID){
   return geotransform[paramID];
 }
 
-// template<typename T>
+/**
+ * @brief Reads a full band into a flat (row-major, nCols*nRows) float array
+ * @details Single-copy reader: each chunk of block-rows is read by GDAL straight into its final
+ * position in the float buffer. Integer types up to 32 bits are read in their native type into the
+ * tail of that chunk, and widened in place with the vectorized GeotiffConvertToFloat. Float32 is
+ * read as is, and any other type (e.g. Float64) is converted by GDAL while unpacking the blocks
+ * 
+ * @param layerIndex 1-indexed band number
+ * @param bandLayer caller supplied output buffer of at least nCols*nRows floats, or NULL to allocate
+ * a new one (to be released by the caller with delete[])
+ * @return float* pointer to the band data (bandLayer if provided), NULL if the band cannot be read
+ * (an array allocated here is released first)
+ */
 float* Geotiff::GetArray1D(int layerIndex,float* bandLayer) {
-    // get the raster data type (ENUM integer 1-12, 
+    GEOTIFF_STATS_CALL(GEOTIFF_CALL_GETARRAY1D);
+    if (layerIndex < 1 || layerIndex > nBands){
+      cout << "[geotiff] Error: invalid band " << layerIndex << endl;
+      return NULL;
+    }
+    // get the raster band only once, and its data type (ENUM integer 1-12, 
     // see GDAL C/C++ documentation for more details)        
-    GDALDataType bandType = GDALGetRasterDataType(geotiffDataset->GetRasterBand(layerIndex));
+    GDALRasterBand *poBand = geotiffDataset->GetRasterBand(layerIndex);
+    GDALDataType bandType = poBand->GetRasterDataType();
     
     // get number of bytes per pixel in Geotiff
     int nbytes = GDALGetDataTypeSizeBytes(bandType);
 
-    // allocate pointer to memory block for one row (scanline) 
-    // in 2D Geotiff array.  
-    float *dataBuff = (float *) CPLMalloc(nbytes*nCols*nRows);
-
-    CPLErr e = geotiffDataset->GetRasterBand(layerIndex)->RasterIO(GF_Read,0,0,nCols,nRows,dataBuff,nCols,nRows,bandType,0,0);
-    if(!(e == 0)) { 
-      cout << "Warning: Unable to read scanline in Geotiff!" << endl;
-      exit(1);
-    } 
-    bandLayer = new float[nCols*nRows];
-    for( int i=0; i<nCols*nRows; i++ ) { // iterate through columns
-      bandLayer[i] = (float)dataBuff[i];
+    // native types no wider than a float are read in place and widened with SIMD
+    bool bWiden = (bandType != GDT_Float32) && (nbytes <= (int)sizeof(float)) && GeotiffCanConvertToFloat(bandType);
+
+    bool bOwned = (bandLayer == NULL);
+    if (bOwned){
+      GEOTIFF_STATS_START(tAlloc);
+      bandLayer = new float[(size_t)nCols*nRows];
+      GEOTIFF_STATS_ALLOCATION(tAlloc, (size_t)nCols*nRows*sizeof(float));
+    }
+
+    int nChunkRows = GetChunkRows(layerIndex, nCols);
+    for (int row=0; row<nRows; row+=nChunkRows){
+      int nLines = nChunkRows;
+      if (row + nLines > nRows)
+        nLines = nRows - row; // last block-row can be partial
+
+      size_t nPixels = (size_t)nLines*nCols;
+      float *chunk = bandLayer + (size_t)row*nCols;
+      CPLErr e;
+      if (bWiden){
+        // the native pixels occupy the last nPixels*nbytes bytes of the chunk
+        unsigned char *nativeBuff = (unsigned char *)(chunk + nPixels) - nPixels*nbytes;
+        GEOTIFF_STATS_START(tRead);
+        e = poBand->RasterIO(GF_Read,0,row,nCols,nLines,nativeBuff,nCols,nLines,bandType,0,0);
+        GEOTIFF_STATS_RASTERIO(tRead, nPixels*nbytes, GeotiffStatsBlocks(poBand, 0, row, nCols, nLines));
+        if (e == CE_None){
+          GEOTIFF_STATS_START(tConvert);
+          GeotiffConvertToFloat(nativeBuff, bandType, chunk, nPixels);
+          GEOTIFF_STATS_CONVERSION(tConvert);
+        }
+      }
+      else{
+        GEOTIFF_STATS_START(tRead);
+        e = poBand->RasterIO(GF_Read,0,row,nCols,nLines,chunk,nCols,nLines,GDT_Float32,0,0);
+        GEOTIFF_STATS_RASTERIO(tRead, nPixels*sizeof(float), GeotiffStatsBlocks(poBand, 0, row, nCols, nLines));
+      }
+
+      if(!(e == 0)) { 
+        cout << "[geotiff] Error: Unable to read band " << layerIndex << " from " << filename << endl;
+        if (bOwned)
+          delete[] bandLayer;
+        return NULL;
+      } 
     }
-    CPLFree( dataBuff );
     return bandLayer;
-}
\ No newline at end of file
+}
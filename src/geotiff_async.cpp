@@ -0,0 +1,256 @@
+/**
+ * @file geotiff_async.cpp
+ * @brief Asynchronous window/tile reads on a bounded I/O thread pool, with request coalescing
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_async.hpp>
+#include <geotiff_counters.hpp>
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <cpl_error.h>
+
+using namespace std;
+
+GeotiffAsyncReader::GeotiffAsyncReader(const char *tiffname, int nThreads, size_t maxQueued) :
+  filename(tiffname), nRows(0), nCols(0), nBands(0), bValid(false), maxPending(max((size_t)1, maxQueued)),
+  nActive(0), bStop(false), nReads(0), nRequests(0), nMerged(0) {
+
+  if (nThreads <= 0)
+    nThreads = max(1, (int)std::thread::hardware_concurrency());
+
+  for (int i=0; i<nThreads; i++){
+    GeotiffDatasetLease lease = GeotiffDatasetPool::Instance().Acquire(tiffname);
+    if (!lease.isValid()){
+      cout << "[GeotiffAsyncReader] Error opening file: " << tiffname << endl;
+      handles.clear();
+      leases.clear();
+      return;
+    }
+    handles.push_back(lease.Get());
+    leases.push_back(std::move(lease));
+  }
+  nCols  = handles[0]->GetRasterXSize();
+  nRows  = handles[0]->GetRasterYSize();
+  nBands = handles[0]->GetRasterCount();
+  for (int b=1; b<=nBands; b++){
+    int bx, by;
+    handles[0]->GetRasterBand(b)->GetBlockSize(&bx, &by);
+    blockXSizes.push_back(max(1, bx));
+    blockYSizes.push_back(max(1, by));
+  }
+  bValid = true;
+  for (int i=0; i<nThreads; i++)
+    workers.push_back(std::thread(&GeotiffAsyncReader::Worker, this, i));
+}
+
+GeotiffAsyncReader::~GeotiffAsyncReader(){
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    bStop = true;
+  }
+  queueNotEmpty.notify_all();
+  queueNotFull.notify_all();
+  for (size_t i=0; i<workers.size(); i++)
+    workers[i].join();
+  // leases return the handles to the pool
+}
+
+void GeotiffAsyncReader::GetDimensions(int *dim){
+  dim[0] = nCols;
+  dim[1] = nRows;
+  dim[2] = nBands;
+}
+
+void GeotiffAsyncReader::GetBlockSize(int band, int *blockSize){
+  bool bValidBand = band >= 1 && band <= nBands;
+  blockSize[0] = bValidBand ? blockXSizes[band - 1] : 0;
+  blockSize[1] = bValidBand ? blockYSizes[band - 1] : 0;
+}
+
+void GeotiffAsyncReader::GetCounters(size_t *reads, size_t *requests, size_t *merged){
+  std::lock_guard<std::mutex> guard(lock);
+  *reads = nReads;
+  *requests = nRequests;
+  *merged = nMerged;
+}
+
+// Delivers the result of a request, through its callback or its promise
+void GeotiffAsyncReader::Complete(Request &request){
+  if (request.callback)
+    request.callback(request.result);
+  else
+    request.promise.set_value(std::move(request.result));
+}
+
+/**
+ * @brief Validates a request and queues it, blocking while the queue is full
+ * @details Invalid requests are completed at once, on the calling thread
+ */
+void GeotiffAsyncReader::Submit(Request &request){
+  GeotiffAsyncResult &r = request.result;
+  if (!bValid)
+    r.error = "Invalid dataset: " + filename;
+  else if (r.band < 1 || r.band > nBands)
+    r.error = "Invalid band number";
+  else if (r.xOff < 0 || r.yOff < 0 || r.xSize <= 0 || r.ySize <= 0 || r.xOff + r.xSize > nCols || r.yOff + r.ySize > nRows)
+    r.error = "Window outside the raster";
+  if (!r.error.empty()){
+    Complete(request);
+    return;
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  queueNotFull.wait(guard, [this]{ return pending.size() < maxPending || bStop; });
+  pending.push_back(std::move(request));
+  guard.unlock();
+  queueNotEmpty.notify_one();
+}
+
+std::future<GeotiffAsyncResult> GeotiffAsyncReader::ReadWindow(int band, int xOff, int yOff, int xSize, int ySize){
+  Request request;
+  request.result.band = band;
+  request.result.xOff = xOff;
+  request.result.yOff = yOff;
+  request.result.xSize = xSize;
+  request.result.ySize = ySize;
+  std::future<GeotiffAsyncResult> future = request.promise.get_future();
+  Submit(request);
+  return future;
+}
+
+void GeotiffAsyncReader::ReadWindow(int band, int xOff, int yOff, int xSize, int ySize, const Callback &callback){
+  Request request;
+  request.result.band = band;
+  request.result.xOff = xOff;
+  request.result.yOff = yOff;
+  request.result.xSize = xSize;
+  request.result.ySize = ySize;
+  request.callback = callback;
+  Submit(request);
+}
+
+std::future<GeotiffAsyncResult> GeotiffAsyncReader::ReadTile(int band, int tileX, int tileY){
+  int blockSize[2];
+  GetBlockSize(band, blockSize);
+  int xOff = tileX * blockSize[0], yOff = tileY * blockSize[1];
+  return ReadWindow(band, xOff, yOff, min(blockSize[0], nCols - xOff), min(blockSize[1], nRows - yOff));
+}
+
+void GeotiffAsyncReader::ReadTile(int band, int tileX, int tileY, const Callback &callback){
+  int blockSize[2];
+  GetBlockSize(band, blockSize);
+  int xOff = tileX * blockSize[0], yOff = tileY * blockSize[1];
+  ReadWindow(band, xOff, yOff, min(blockSize[0], nCols - xOff), min(blockSize[1], nRows - yOff), callback);
+}
+
+void GeotiffAsyncReader::Wait(){
+  std::unique_lock<std::mutex> guard(lock);
+  queueDrained.wait(guard, [this]{ return pending.empty() && nActive == 0; });
+}
+
+/**
+ * @brief I/O thread: takes the oldest request, merges the pending requests it can share a read with,
+ * reads their bounding box once and hands every request its own window
+ * @details A pending request joins the batch when it is on the same band and its window overlaps or
+ * touches the bounding box, as long as the merged box stays below GEOTIFF_ASYNC_MAX_MERGE_PIXELS and
+ * is at most twice the requested pixels (so diagonal neighbours do not pull in large unrequested areas)
+ *
+ * @param worker index of the thread, and of its GDAL handle
+ */
+void GeotiffAsyncReader::Worker(int worker){
+  GDALDataset *poDataset = handles[worker];
+  std::unique_lock<std::mutex> guard(lock);
+  while (true){
+    queueNotEmpty.wait(guard, [this]{ return bStop || !pending.empty(); });
+    if (pending.empty())
+      break; // stopping, and every request has been served
+
+    std::list<Request> batch;
+    batch.splice(batch.end(), pending, pending.begin());
+    const GeotiffAsyncResult &first = batch.front().result;
+    int band = first.band;
+    int x0 = first.xOff, y0 = first.yOff, x1 = first.xOff + first.xSize, y1 = first.yOff + first.ySize;
+    size_t requested = (size_t)first.xSize * first.ySize;
+    bool bGrown = true;
+    while (bGrown){
+      // the box grows as requests join: rescan until no other pending window can be merged
+      bGrown = false;
+      int scanned = 0;
+      for (std::list<Request>::iterator it = pending.begin(); it != pending.end() && scanned < GEOTIFF_ASYNC_MERGE_SCAN; scanned++){
+        const GeotiffAsyncResult &r = it->result;
+        if (r.band != band || r.xOff > x1 || r.xOff + r.xSize < x0 || r.yOff > y1 || r.yOff + r.ySize < y0){
+          ++it;
+          continue;
+        }
+        int nx0 = min(x0, r.xOff), ny0 = min(y0, r.yOff);
+        int nx1 = max(x1, r.xOff + r.xSize), ny1 = max(y1, r.yOff + r.ySize);
+        size_t box = (size_t)(nx1 - nx0) * (ny1 - ny0);
+        size_t nRequested = requested + (size_t)r.xSize * r.ySize;
+        if (box > GEOTIFF_ASYNC_MAX_MERGE_PIXELS || box > 2*nRequested){
+          ++it;
+          continue;
+        }
+        x0 = nx0; y0 = ny0; x1 = nx1; y1 = ny1;
+        requested = nRequested;
+        batch.splice(batch.end(), pending, it++);
+        bGrown = true;
+      }
+    }
+    nActive += batch.size();
+    guard.unlock();
+    queueNotFull.notify_all();
+
+    // one read for the whole batch; a lone request is read straight into its own buffer
+    int boxCols = x1 - x0, boxRows = y1 - y0;
+    Raster<float> box;
+    std::string error;
+    try {
+      box = Raster<float>(boxCols, boxRows);
+    } catch (const std::bad_alloc &){
+      error = "Out of memory";
+    }
+    if (error.empty()){
+      GEOTIFF_STATS_CALL(GEOTIFF_CALL_ASYNC_READ);
+      CPLErrorReset();
+      GEOTIFF_STATS_START(tRead);
+      CPLErr e = poDataset->GetRasterBand(band)->RasterIO(GF_Read, x0, y0, boxCols, boxRows, box.GetData(), boxCols, boxRows,
+                                                          GDT_Float32, 0, box.GetStrideBytes(), NULL);
+      GEOTIFF_STATS_RASTERIO(tRead, (size_t)boxCols*boxRows*sizeof(float),
+                             GeotiffStatsBlocks(poDataset->GetRasterBand(band), x0, y0, boxCols, boxRows));
+      if (e != CE_None){
+        const char *pszMessage = CPLGetLastErrorMsg();
+        error = (pszMessage != NULL && pszMessage[0] != 0) ? pszMessage : "RasterIO failed";
+      }
+    }
+    for (std::list<Request>::iterator it = batch.begin(); it != batch.end(); ++it){
+      GeotiffAsyncResult &r = it->result;
+      if (!error.empty())
+        r.error = error;
+      else if (batch.size() == 1)
+        r.data = std::move(box);
+      else {
+        try {
+          r.data = Raster<float>(r.xSize, r.ySize);
+          for (int y=0; y<r.ySize; y++)
+            memcpy(r.data.GetRow(y), box.GetRow(r.yOff - y0 + y) + (r.xOff - x0), r.xSize * sizeof(float));
+        } catch (const std::bad_alloc &){
+          r.error = "Out of memory";
+        }
+      }
+      Complete(*it);
+    }
+
+    guard.lock();
+    nActive -= batch.size();
+    nReads++;
+    nRequests += batch.size();
+    if (batch.size() > 1)
+      nMerged += batch.size();
+    if (pending.empty() && nActive == 0)
+      queueDrained.notify_all();
+  }
+}
@@ -0,0 +1,734 @@
+/**
+ * @file geotiff_bench.cpp
+ * @brief Benchmark suite: every public read API over a matrix of synthetic GeoTIFFs, with JSON results
+ *
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ *
+ */
+
+// Usage: geotiff_bench [options]
+//   --workdir DIR        folder where the synthetic files are created. Default: current folder
+//   --output FILE        JSON results. Default: geotiff_bench.json
+//   --sizes N[,N...]     width and height (pixels) of the synthetic rasters. Default: 1024,2048
+//   --repeat N           runs of every API on every file (min and median are reported). Default: 3
+//   --quick              only Float32, tiled, DEFLATE, 1 band (smoke test)
+//   --compare FILE       compare the throughput against a previous results file
+//   --threshold F        relative slowdown reported as a regression by --compare. Default: 0.10
+//
+// Synthetic files are generated deterministically (same pixels on every run) for every combination of
+// size, data type (Byte, Int16, Float32, Float64), layout (16-row strips, 256x256 tiles), compression
+// (NONE, DEFLATE, LZW) and band count (1, 4), and deleted afterwards. Every API is timed on each file,
+// including opening it, with the dataset pool flushed before each run so GDAL decodes the blocks again
+// (the OS page cache stays warm). For each run the peak RSS above the starting RSS (Linux) and the heap
+// allocations (glibc) are recorded. With --compare, the exit code is 1 if any (file, API) pair got slower
+// than the threshold.
+
+#include <gdal_priv.h>
+#include <cpl_conv.h>
+#include <cpl_string.h>
+#if GDAL_VERSION_NUM >= 2030000
+#include <cpl_json.h>
+#endif
+
+///Basic C and C++ libraries
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <thread>
+
+#include "geotiff.hpp"
+#include "geotiff_simd.hpp"
+#include "geotiff_view.hpp"
+#include "geotiff_parallel.hpp"
+#include "geotiff_async.hpp"
+#include "geotiff_sample.hpp"
+#include "geotiff_writer.hpp"
+#include "geotiff_warp.hpp"
+#include "geotiff_pipeline.hpp"
+#include "geotiff_info.hpp"
+#include "geotiff_mosaic.hpp"
+#include "geotiff_counters.hpp"
+#ifdef GEOTIFF_WITH_OPENCV
+#include "geotiff_opencv.hpp"
+#endif
+
+using namespace std;
+
+const std::string green("\033[1;32m");
+const std::string yellow("\033[1;33m");
+const std::string cyan("\033[1;36m");
+const std::string red("\033[1;31m");
+const std::string reset("\033[0m");
+
+// Points sampled by the "Sample" API run
+#define BENCH_SAMPLE_POINTS 65536
+// Spatial reference of the synthetic files (UTM 30N), needed by the warp run
+#define BENCH_EPSG 32630
+
+/////////////////////////// heap allocation counters ///////////////////////////
+// The glibc allocator entry points are interposed, so allocations made inside GDAL are counted too
+
+static std::atomic<unsigned long long> nAllocations(0), nAllocatedBytes(0);
+
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCATIONS 1
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+static inline void countAllocation(size_t size){
+    nAllocations.fetch_add(1, std::memory_order_relaxed);
+    nAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void *malloc(size_t size){
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size){
+    countAllocation(n*size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size){
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size){
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size){
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size){
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+    countAllocation(size);
+    *ptr = __libc_memalign(alignment, size);
+    return (*ptr != NULL) ? 0 : ENOMEM;
+}
+}
+#else
+#define BENCH_COUNT_ALLOCATIONS 0
+#endif
+
+/////////////////////////// peak RSS (Linux) ///////////////////////////
+
+/**
+ * @brief Returns a "Vm..." field of /proc/self/status, in bytes (-1 if not available)
+ */
+long long readProcStatus(const char *field){
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL)
+        return -1;
+    char line[256];
+    long long value = -1;
+    size_t n = strlen(field);
+    while (fgets(line, sizeof(line), f) != NULL){
+        if (strncmp(line, field, n) == 0 && line[n] == ':'){
+            value = atoll(line + n + 1) * 1024;
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+/**
+ * @brief Resets the peak RSS (VmHWM) of the process to its current RSS (Linux >= 4.0)
+ */
+bool resetPeakRSS(){
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (f == NULL)
+        return false;
+    bool bOk = fputs("5", f) >= 0;
+    return (fclose(f) == 0) && bOk;
+}
+
+/////////////////////////// synthetic datasets ///////////////////////////
+
+struct BenchDataset {
+    int size;
+    GDALDataType type;
+    bool tiled;
+    std::string compression;
+    int bands;
+    std::string fileName;
+
+    std::string Key() const {
+        ostringstream key;
+        key << size << "_" << GDALGetDataTypeName(type) << "_" << (tiled ? "tiled" : "striped") << "_"
+            << compression << "_" << bands << "b";
+        return key.str();
+    }
+    double NoData() const { return (type == GDT_Byte) ? 255.0 : -9999.0; }
+};
+
+/**
+ * @brief Writes a deterministic synthetic DEM with GeotiffWriter: smooth relief, high frequency texture
+ * and one nodata pixel every 997. Values are scaled to the range of the data type
+ *
+ * @return true if the file was created
+ */
+bool createDataset(const BenchDataset &d){
+    GeotiffWriterOptions options;
+    options.tiled = d.tiled;
+    options.blockXSize = 256;
+    options.blockYSize = d.tiled ? 256 : 16;
+    options.compression = d.compression;
+    GeotiffWriter writer(d.fileName.c_str(), d.size, d.size, d.bands, d.type, options);
+    if (!writer.isValid())
+        return false;
+    double geotransform[6] = {0.0, 1.0, 0.0, (double)d.size, 0.0, -1.0};
+    writer.SetGeoTransform(geotransform);
+    OGRSpatialReference srs;
+    char *pszWKT = NULL;
+    if (srs.importFromEPSG(BENCH_EPSG) == OGRERR_NONE && srs.exportToWkt(&pszWKT) == OGRERR_NONE)
+        writer.SetProjection(pszWKT);
+    CPLFree(pszWKT);
+    for (int b=1; b<=d.bands; b++)
+        writer.SetNoDataValue(b, d.NoData());
+
+    const int blockRows = 256;
+    for (int yOff=0; yOff<d.size; yOff+=blockRows){
+        Raster<float> block(d.size, std::min(blockRows, d.size - yOff));
+        for (int b=1; b<=d.bands; b++){
+            for (int y=0; y<block.GetRows(); y++){
+                float *row = block.GetRow(y);
+                int yy = yOff + y;
+                for (int x=0; x<d.size; x++){
+                    double v = 100.0*sin(yy*0.01 + b)*cos(x*0.013) + (yy*31 + x*17 + b) % 7;
+                    if (((size_t)yy*d.size + x) % 997 == 0)
+                        row[x] = (float)d.NoData();
+                    else if (d.type == GDT_Byte)
+                        row[x] = (float)std::min(254.0, std::max(0.0, 127.0 + v));
+                    else if (d.type == GDT_Int16)
+                        row[x] = (float)(10.0*v);
+                    else
+                        row[x] = (float)(-2000.0 + v);
+                }
+            }
+            if (!writer.WriteRows(b, yOff, block))
+                return false;
+        }
+    }
+    return writer.Close();
+}
+
+/////////////////////////// read APIs under test ///////////////////////////
+
+// A benchmarked call: reads from the file and returns a checksum (NaN on failure)
+struct BenchApi {
+    std::string name;
+    std::function<double(const BenchDataset &)> run;
+    std::function<double(const BenchDataset &)> pixels;     // pixels delivered by one call
+    std::function<double(const BenchDataset &)> pixelBytes; // bytes per delivered pixel (buffer type, not file type)
+};
+
+template<typename T>
+double readNative(const BenchDataset &d){
+    Geotiff geo(d.fileName.c_str());
+    Raster<T> band = geo.Read<T>(1);
+    if (band.isEmpty())
+        return NAN;
+    double sum = 0;
+    for (int y=0; y<band.GetRows(); y++)
+        sum += band(0, y);
+    return sum;
+}
+
+template<typename T>
+double mapNative(const BenchDataset &d){
+    Geotiff geo(d.fileName.c_str());
+    GeotiffMappedBand<T> band = geo.MapBand<T>(1);
+    if (!band.isValid())
+        return NAN;
+    double sum = 0; // every pixel is touched: a mapping alone reads nothing
+    for (int y=0; y<band.GetRows(); y++)
+        for (int x=0; x<band.GetCols(); x++)
+            sum += band(x, y);
+    return sum;
+}
+
+/**
+ * @brief Runs a typed API with the C++ type matching the native type of the dataset
+ */
+double dispatchNative(const BenchDataset &d, bool mapped){
+    switch (d.type){
+        case GDT_Byte:    return mapped ? mapNative<unsigned char>(d) : readNative<unsigned char>(d);
+        case GDT_Int16:   return mapped ? mapNative<short>(d) : readNative<short>(d);
+        case GDT_Float32: return mapped ? mapNative<float>(d) : readNative<float>(d);
+        case GDT_Float64: return mapped ? mapNative<double>(d) : readNative<double>(d);
+        default:          return NAN;
+    }
+}
+
+double rowChecksum(const Raster<float> &raster){
+    if (raster.isEmpty())
+        return NAN;
+    double sum = 0;
+    for (int y=0; y<raster.GetRows(); y++){
+        float v = raster(0, y);
+        if (v == v)
+            sum += v;
+    }
+    return sum;
+}
+
+std::vector<BenchApi> makeApis(){
+    std::vector<BenchApi> apis;
+    auto band = [](const BenchDataset &d){ return (double)d.size*d.size; };
+    auto window = [](const BenchDataset &d){ return (double)(d.size/2)*(d.size/2); }; // centered, half the size
+    auto floatBytes = [](const BenchDataset &){ return (double)sizeof(float); };
+    auto nativeBytes = [](const BenchDataset &d){ return (double)GDALGetDataTypeSizeBytes(d.type); };
+
+    apis.push_back({"GetRasterBand", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        float **rows = geo.GetRasterBand(1);
+        if (rows == NULL)
+            return (double)NAN;
+        double sum = 0;
+        for (int y=0; y<d.size; y++)
+            sum += rows[y][0];
+        geo.ReleaseRasterBand(rows);
+        return sum;
+    }, band, floatBytes});
+
+    apis.push_back({"GetArray1D", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        float *data = geo.GetArray1D(1, NULL);
+        if (data == NULL)
+            return (double)NAN;
+        double sum = 0;
+        for (int y=0; y<d.size; y++)
+            sum += data[(size_t)y*d.size];
+        delete[] data;
+        return sum;
+    }, band, floatBytes});
+
+    apis.push_back({"ReadRaster", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        return rowChecksum(geo.ReadRaster(1));
+    }, band, floatBytes});
+
+    apis.push_back({"ReadNative", [](const BenchDataset &d){ return dispatchNative(d, false); }, band, nativeBytes});
+
+    apis.push_back({"ReadWindow", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        return rowChecksum(geo.ReadWindow<float>(1, d.size/4, d.size/4, d.size/2, d.size/2));
+    }, window, floatBytes});
+
+    apis.push_back({"ReadGeoWindow", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        double q = d.size/4, h = d.size/2; // geotransform: 1 unit per pixel, y up
+        return rowChecksum(geo.ReadGeoWindow<float>(1, q, q, q + h, q + h));
+    }, window, floatBytes});
+
+    apis.push_back({"ReadWindowMasked", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        return rowChecksum(geo.ReadWindowMasked(1, d.size/4, d.size/4, d.size/2, d.size/2));
+    }, window, floatBytes});
+
+    apis.push_back({"ReadMasked", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        RasterMask mask;
+        Raster<float> data = geo.ReadMasked(1, &mask);
+        return data.isEmpty() ? NAN : (double)mask.CountValid();
+    }, band, floatBytes});
+
+    apis.push_back({"ReadCube", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        std::vector<int> bands;
+        for (int b=1; b<=d.bands; b++)
+            bands.push_back(b);
+        RasterCube<float> cube = geo.ReadCube<float>(bands, RASTER_BSQ);
+        if (cube.isEmpty())
+            return (double)NAN;
+        double sum = 0;
+        for (int b=0; b<cube.GetBands(); b++)
+            for (int y=0; y<cube.GetRows(); y++)
+                sum += cube(0, y, b);
+        return sum;
+    }, [](const BenchDataset &d){ return (double)d.size*d.size*d.bands; }, floatBytes});
+
+    apis.push_back({"ReadResampled", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        return rowChecksum(geo.ReadResampled<float>(1, d.size/4, d.size/4));
+    }, band, floatBytes});
+
+    apis.push_back({"ReadWindowResampled", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        return rowChecksum(geo.ReadWindowResampled<float>(1, d.size/4, d.size/4, d.size/2, d.size/2, d.size/8, d.size/8));
+    }, window, floatBytes});
+
+    apis.push_back({"ViewTiles", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        GeotiffView view(geo, 1);
+        if (!view.isValid())
+            return (double)NAN;
+        double sum = 0;
+        for (int ty=0; ty<view.GetTilesY(); ty++){
+            for (int tx=0; tx<view.GetTilesX(); tx++){
+                const Raster<float> *tile = view.GetTile(tx, ty);
+                if (tile == NULL)
+                    return (double)NAN;
+                sum += rowChecksum(*tile);
+            }
+        }
+        return sum;
+    }, band, floatBytes});
+
+    apis.push_back({"ParallelRead", [](const BenchDataset &d){
+        GeotiffParallelReader reader(d.fileName.c_str());
+        if (!reader.isValid())
+            return (double)NAN;
+        return rowChecksum(reader.ReadWindow<float>(1, 0, 0, d.size, d.size));
+    }, band, floatBytes});
+
+    apis.push_back({"AsyncTiles", [](const BenchDataset &d){
+        GeotiffAsyncReader reader(d.fileName.c_str());
+        if (!reader.isValid())
+            return (double)NAN;
+        int blockSize[2];
+        reader.GetBlockSize(1, blockSize);
+        std::vector<std::future<GeotiffAsyncResult> > tiles;
+        for (int ty=0; ty*blockSize[1]<d.size; ty++)
+            for (int tx=0; tx*blockSize[0]<d.size; tx++)
+                tiles.push_back(reader.ReadTile(1, tx, ty));
+        double sum = 0;
+        for (size_t i=0; i<tiles.size(); i++){
+            GeotiffAsyncResult result = tiles[i].get();
+            if (!result.isValid())
+                return (double)NAN;
+            sum += rowChecksum(result.data);
+        }
+        return sum;
+    }, band, floatBytes});
+
+    apis.push_back({"MapBand", [](const BenchDataset &d){ return dispatchNative(d, true); }, band, nativeBytes});
+
+    apis.push_back({"Sample", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        GeotiffSampler sampler(geo, 1);
+        if (!sampler.isValid())
+            return (double)NAN;
+        std::vector<double> x(BENCH_SAMPLE_POINTS), y(BENCH_SAMPLE_POINTS);
+        std::vector<float> values(BENCH_SAMPLE_POINTS);
+        unsigned int seed = 12345; // fixed LCG: the same points on every run
+        for (int i=0; i<BENCH_SAMPLE_POINTS; i++){
+            seed = seed*1664525u + 1013904223u;
+            x[i] = (seed >> 8) / 16777216.0 * d.size;
+            seed = seed*1664525u + 1013904223u;
+            y[i] = (seed >> 8) / 16777216.0 * d.size;
+        }
+        return (double)sampler.Sample(x.data(), y.data(), BENCH_SAMPLE_POINTS, values.data(), SAMPLE_BILINEAR);
+    }, [](const BenchDataset &){ return (double)BENCH_SAMPLE_POINTS; }, floatBytes});
+
+    apis.push_back({"Warp", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        GeotiffGrid grid(geo); // same SRS and extent, half the resolution
+        grid.geotransform[1] *= 2;
+        grid.geotransform[5] *= 2;
+        grid.cols = d.size/2;
+        grid.rows = d.size/2;
+        GeotiffWarper warper;
+        return rowChecksum(warper.Warp(geo, 1, grid));
+    }, window, floatBytes});
+
+    apis.push_back({"Pipeline", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        GeotiffPipeline pipeline;
+        if (!pipeline.AddInput(geo, 1))
+            return (double)NAN;
+        double sum = 0;
+        PipelineKernel copy = [](const std::vector<const Raster<float> *> &inputs, Raster<float> &output, const PipelineBlock &block){
+            for (int y=0; y<block.ySize; y++)
+                memcpy(output.GetRow(y), inputs[0]->GetRow(y), block.xSize*sizeof(float));
+            return true;
+        };
+        PipelineSink sink = [&sum](const Raster<float> &output, const PipelineBlock &){
+            sum += rowChecksum(output);
+            return true;
+        };
+        return pipeline.Run(copy, sink) ? sum : (double)NAN;
+    }, band, floatBytes});
+
+    apis.push_back({"Mosaic", [](const BenchDataset &d){
+        std::vector<GeotiffInfo> index(1);
+        GeotiffMosaic mosaic;
+        if (!GeotiffReadInfo(d.fileName.c_str(), index[0]) || !mosaic.Build(index))
+            return (double)NAN;
+        return rowChecksum(mosaic.Read(1, 0.0, 0.0, d.size, d.size));
+    }, band, floatBytes});
+
+#ifdef GEOTIFF_WITH_OPENCV
+    apis.push_back({"ReadMat", [](const BenchDataset &d){
+        Geotiff geo(d.fileName.c_str());
+        cv::Mat mat;
+        if (!GeotiffReadMat(geo, 1, mat))
+            return (double)NAN;
+        cv::Mat column;
+        mat.col(0).convertTo(column, CV_64F);
+        return cv::sum(column)[0];
+    }, band, nativeBytes});
+#endif
+
+    return apis;
+}
+
+/////////////////////////// measurement ///////////////////////////
+
+struct BenchRun {
+    double seconds;
+    long long peakRSS;                  // bytes above the RSS at the start of the run (-1: unknown)
+    unsigned long long allocations, allocatedBytes;
+    double checksum;
+};
+
+BenchRun runOnce(const BenchApi &api, const BenchDataset &d){
+    GeotiffDatasetPool::Instance().Clear(); // closing the pooled handles drops their cached blocks
+    GeotiffResetCounters();
+    BenchRun run;
+    bool bPeakReset = resetPeakRSS();
+    long long rss0 = readProcStatus("VmRSS");
+    unsigned long long allocs0 = nAllocations.load(), bytes0 = nAllocatedBytes.load();
+
+    auto t0 = std::chrono::steady_clock::now();
+    run.checksum = api.run(d);
+    auto t1 = std::chrono::steady_clock::now();
+
+    run.seconds = std::chrono::duration<double>(t1 - t0).count();
+    run.allocations = nAllocations.load() - allocs0;
+    run.allocatedBytes = nAllocatedBytes.load() - bytes0;
+    long long hwm = readProcStatus("VmHWM");
+    run.peakRSS = (bPeakReset && hwm >= 0 && rss0 >= 0) ? std::max(0LL, hwm - rss0) : -1;
+    return run;
+}
+
+/////////////////////////// main ///////////////////////////
+
+struct BenchConfig {
+    std::string workDir, output, compare;
+    std::vector<int> sizes;
+    int repeat;
+    bool quick;
+    double threshold;
+
+    BenchConfig() : workDir("."), output("geotiff_bench.json"), repeat(3), quick(false), threshold(0.10) {}
+};
+
+bool parseArguments(int argc, char *argv[], BenchConfig &config){
+    for (int i=1; i<argc; i++){
+        std::string arg = argv[i];
+        bool bHasValue = (i + 1 < argc);
+        if (arg == "--quick")
+            config.quick = true;
+        else if (arg == "--workdir" && bHasValue)
+            config.workDir = argv[++i];
+        else if (arg == "--output" && bHasValue)
+            config.output = argv[++i];
+        else if (arg == "--compare" && bHasValue)
+            config.compare = argv[++i];
+        else if (arg == "--repeat" && bHasValue)
+            config.repeat = atoi(argv[++i]);
+        else if (arg == "--threshold" && bHasValue)
+            config.threshold = atof(argv[++i]);
+        else if (arg == "--sizes" && bHasValue){
+            char **papszSizes = CSLTokenizeString2(argv[++i], ",", 0);
+            for (int j=0; papszSizes != NULL && papszSizes[j] != NULL; j++)
+                config.sizes.push_back(atoi(papszSizes[j]));
+            CSLDestroy(papszSizes);
+        }
+        else
+            return false;
+    }
+    if (config.sizes.empty()){
+        config.sizes.push_back(1024);
+        config.sizes.push_back(2048);
+    }
+    for (size_t i=0; i<config.sizes.size(); i++)
+        if (config.sizes[i] < 16)
+            return false;
+    return config.repeat > 0 && config.threshold > 0;
+}
+
+/**
+ * @brief Compares the throughput of every (file, API) pair against a previous results file
+ *
+ * @return int number of regressions (slower than threshold), -1 if the baseline cannot be read
+ */
+int compareResults(const std::string &baseline, const std::map<std::string, double> &current, double threshold){
+#if GDAL_VERSION_NUM >= 2030000
+    CPLJSONDocument doc;
+    if (!doc.Load(baseline))
+        return -1;
+    CPLJSONArray results = doc.GetRoot().GetArray("results");
+    if (!results.IsValid())
+        return -1;
+    int nRegressions = 0, nCompared = 0;
+    for (int i=0; i<results.Size(); i++){
+        CPLJSONObject result = results[i];
+        std::string key = result.GetString("dataset") + "/" + result.GetString("api");
+        double before = result.GetDouble("mpix_per_s", 0.0);
+        std::map<std::string, double>::const_iterator it = current.find(key);
+        if (it == current.end() || before <= 0)
+            continue;
+        nCompared++;
+        double change = it->second / before - 1.0;
+        if (change < -threshold){
+            nRegressions++;
+            cout << "\t" << red << "regression" << reset << "\t" << key << "\t" << std::fixed << std::setprecision(1)
+                 << before << " -> " << it->second << " Mpix/s (" << 100.0*change << "%)" << endl;
+        }
+    }
+    cout << "\tCompared " << nCompared << " results against " << baseline << ": " << nRegressions << " regressions" << endl;
+    return nRegressions;
+#else
+    cout << red << "--compare needs GDAL >= 2.3 (cpl_json.h)" << reset << endl;
+    return -1;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig config;
+    if (!parseArguments(argc, argv, config)){
+        cout << red << "Usage: " << reset << argv[0] << " [--workdir DIR] [--output FILE] [--sizes N,N...] [--repeat N]"
+             << " [--quick] [--compare FILE] [--threshold F]" << endl;
+        return -1;
+    }
+    GeotiffRegisterDrivers();
+
+    cout << cyan << "geotiff_bench" << reset << endl;
+    cout << "\tGit commit:\t" << yellow << GIT_COMMIT << reset << endl;
+    cout << "\tGDAL:\t\t" << GDALVersionInfo("RELEASE_NAME") << endl;
+    cout << "\tSIMD:\t\t" << GeotiffSIMDName() << endl;
+    cout << "\tGDAL cache:\t" << GDALGetCacheMax64()/(1024*1024) << " MB" << endl;
+    cout << "\tRepeat:\t\t" << config.repeat << endl;
+
+    std::vector<BenchDataset> datasets;
+    const GDALDataType types[] = {GDT_Byte, GDT_Int16, GDT_Float32, GDT_Float64};
+    const char *compressions[] = {"NONE", "DEFLATE", "LZW"};
+    const int bandCounts[] = {1, 4};
+    for (size_t s=0; s<config.sizes.size(); s++)
+        for (int t=0; t<4; t++)
+            for (int tiled=0; tiled<2; tiled++)
+                for (int c=0; c<3; c++)
+                    for (int b=0; b<2; b++){
+                        BenchDataset d;
+                        d.size = config.sizes[s];
+                        d.type = types[t];
+                        d.tiled = (tiled == 1);
+                        d.compression = compressions[c];
+                        d.bands = bandCounts[b];
+                        if (config.quick && (d.type != GDT_Float32 || !d.tiled || d.compression != "DEFLATE" || d.bands != 1))
+                            continue;
+                        d.fileName = config.workDir + "/geotiff_bench_" + d.Key() + ".tif";
+                        datasets.push_back(d);
+                    }
+
+    std::vector<BenchApi> apis = makeApis();
+    std::map<std::string, double> throughput; // dataset/api -> Mpix/s, for --compare
+    ostringstream json;
+    json << std::setprecision(9);
+    json << "{\n  \"meta\": {\"git_commit\": \"" << GIT_COMMIT << "\", \"gdal\": \"" << GDALVersionInfo("RELEASE_NAME")
+         << "\", \"simd\": \"" << GeotiffSIMDName() << "\", \"hardware_threads\": " << std::thread::hardware_concurrency()
+         << ", \"gdal_cache_bytes\": " << GDALGetCacheMax64() << ", \"repeat\": " << config.repeat
+         << ", \"allocations_counted\": " << (BENCH_COUNT_ALLOCATIONS ? "true" : "false")
+         << ", \"counters\": " << (GeotiffGetCounters().enabled ? "true" : "false") << "},\n  \"results\": [";
+    bool bFirstResult = true;
+    int nErrors = 0;
+
+    for (size_t i=0; i<datasets.size(); i++){
+        const BenchDataset &d = datasets[i];
+        if (!createDataset(d)){
+            cout << red << "Error creating synthetic file: " << reset << d.fileName << endl;
+            nErrors++;
+            continue;
+        }
+        cout << green << d.Key() << reset << endl;
+
+        for (size_t a=0; a<apis.size(); a++){
+            const BenchApi &api = apis[a];
+            std::vector<BenchRun> runs;
+            for (int r=0; r<config.repeat; r++)
+                runs.push_back(runOnce(api, d));
+            std::vector<double> seconds;
+            long long peakRSS = -1;
+            for (size_t r=0; r<runs.size(); r++){
+                seconds.push_back(runs[r].seconds);
+                peakRSS = std::max(peakRSS, runs[r].peakRSS);
+            }
+            std::sort(seconds.begin(), seconds.end());
+            double tMin = seconds.front(), tMedian = seconds[seconds.size()/2];
+            double pixels = api.pixels(d);
+            double bytes = pixels * api.pixelBytes(d);
+            double mpix = pixels / 1.0e6 / tMedian;
+            double checksum = runs.back().checksum;
+            bool bOk = (checksum == checksum);
+            if (!bOk)
+                nErrors++;
+            throughput[d.Key() + "/" + api.name] = mpix;
+
+            cout << "\t" << std::left << std::setw(20) << api.name << std::right << std::fixed << std::setprecision(4)
+                 << tMedian << " s\t" << std::setprecision(1) << std::setw(8) << mpix << " Mpix/s\t"
+                 << std::setw(8) << (peakRSS >= 0 ? peakRSS/1048576.0 : -1.0) << " MB peak\t"
+                 << runs.back().allocations << " allocs" << (bOk ? "" : red + "\tFAILED" + reset) << endl;
+
+            json << (bFirstResult ? "" : ",") << "\n    {\"dataset\": \"" << d.Key() << "\", \"size\": " << d.size
+                 << ", \"type\": \"" << GDALGetDataTypeName(d.type) << "\", \"layout\": \"" << (d.tiled ? "tiled" : "striped")
+                 << "\", \"compression\": \"" << d.compression << "\", \"bands\": " << d.bands
+                 << ", \"api\": \"" << api.name << "\", \"ok\": " << (bOk ? "true" : "false")
+                 << ", \"pixels\": " << pixels << ", \"seconds_min\": " << tMin << ", \"seconds_median\": " << tMedian
+                 << ", \"mpix_per_s\": " << mpix << ", \"mb_per_s\": " << bytes/1048576.0/tMedian
+                 << ", \"peak_rss_bytes\": " << peakRSS << ", \"allocations\": " << runs.back().allocations
+                 << ", \"allocated_bytes\": " << runs.back().allocatedBytes;
+            if (GeotiffGetCounters().enabled)
+                json << ", \"counters\": " << GeotiffCountersToJSON(GeotiffGetCounters());
+            json << "}";
+            bFirstResult = false;
+        }
+        GeotiffDatasetPool::Instance().Invalidate(d.fileName.c_str());
+        GeotiffDatasetPool::Instance().Clear();
+        GetGDALDriverManager()->GetDriverByName("GTiff")->Delete(d.fileName.c_str());
+    }
+    json << "\n  ]\n}\n";
+
+    ofstream out(config.output.c_str());
+    out << json.str();
+    out.close();
+    if (out.fail()){
+        cout << red << "Error writing results: " << reset << config.output << endl;
+        return -1;
+    }
+    cout << "\tResults:\t" << config.output << endl;
+
+    if (!config.compare.empty()){
+        int nRegressions = compareResults(config.compare, throughput, config.threshold);
+        if (nRegressions != 0)
+            return 1;
+    }
+    return (nErrors > 0) ? 1 : 0;
+}
@@ -0,0 +1,895 @@
+/**
+ * @file geotiff_check.cpp
+ * @brief Self-checks of the library logic that has exact expected results (no timing involved)
+ *
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ *
+ */
+
+// Usage: geotiff_check
+// Runs every group of checks and prints one line per group. Rasters needed by the checks are created in
+// /vsimem/, except those of the memory mapping checks (temporary files, removed at the end of the group).
+// Unlike assert(), the checks are not compiled out in release builds.
+// Exit code: 0 if every check passed, 1 otherwise
+
+#include <gdal_priv.h>
+#include <cpl_conv.h>
+#include <cpl_vsi.h>
+#include <cpl_string.h>
+
+///Basic C and C++ libraries
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <future>
+
+#include "geotiff.hpp"
+#include "geotiff_info.hpp"
+#include "geotiff_writer.hpp"
+#include "geotiff_mosaic.hpp"
+#include "geotiff_async.hpp"
+#include "geotiff_mmap.hpp"
+#include "geotiff_terrain.hpp"
+
+using namespace std;
+
+const std::string green("\033[1;32m");
+const std::string yellow("\033[1;33m");
+const std::string cyan("\033[1;36m");
+const std::string red("\033[1;31m");
+const std::string reset("\033[0m");
+
+static int nFailed = 0;
+
+// Reports a failed condition (with its source line) and keeps going, so one run lists every failure
+#define CHECK(condition) do { \
+    if (!(condition)){ \
+        cout << red << "\tFAILED " << reset << __FILE__ << ":" << __LINE__ << ": " << #condition << endl; \
+        nFailed++; \
+    } \
+} while (0)
+
+// true if both are NaN, or equal
+static bool sameValue(float a, float b){
+    return (a != a) ? (b != b) : (a == b);
+}
+
+/**
+ * @brief Writes a single band Float32 raster (uncompressed strips), value(x, y) for every pixel
+ * @return true if the file was created
+ */
+bool writeRaster(const char *fileName, int cols, int rows, const double *geotransform, double noData,
+                 std::function<float(int, int)> value){
+    GeotiffWriterOptions options;
+    options.tiled = false;
+    options.blockYSize = 16;
+    options.compression = "NONE";
+    GeotiffWriter writer(fileName, cols, rows, 1, GDT_Float32, options);
+    if (!writer.isValid())
+        return false;
+    writer.SetGeoTransform(geotransform);
+    writer.SetNoDataValue(1, noData);
+    Raster<float> data(cols, rows);
+    for (int y=0; y<rows; y++)
+        for (int x=0; x<cols; x++)
+            data(x, y) = value(x, y);
+    return writer.WriteRows(1, 0, data) && writer.Close();
+}
+
+// Deletes a file written by the checks, with the pooled handles still open on it
+void removeRaster(const char *fileName){
+    GeotiffDatasetPool::Instance().Invalidate(fileName);
+    VSIUnlink(fileName);
+}
+
+/////////////////////////// Geotiff::ReadWindowMasked ///////////////////////////
+
+// Pixel (x, y) of the masked read checks, in the range of type. The nodata value on a sparse pattern, NaN on another
+static double maskedValue(GDALDataType type, int x, int y){
+    if ((x*7 + y*3) % 11 == 0)
+        return (type == GDT_Byte) ? 0 : -9999;
+    if (type == GDT_Float64 && (x + y) % 17 == 0)
+        return std::numeric_limits<double>::quiet_NaN();
+    if (type == GDT_Byte)
+        return 1 + (x + 3*y) % 250;
+    if (type == GDT_Int16)
+        return x*100 - y*37;
+    return x*0.5 + y*1000.25 + 1e-3*x*y;
+}
+
+// Pixels cleared in the mask band of the files that have one
+static bool maskBandValid(int x, int y){
+    return (x + 2*y) % 13 != 0;
+}
+
+/**
+ * @brief Writes a single band 80 x 70 raster in 16 x 16 tiles: maskedValue(), optionally with its nodata
+ * value set and with a per-dataset mask band (maskBandValid())
+ * @return true if the file was created
+ */
+template<typename T>
+bool writeMaskedRaster(const char *fileName, GDALDataType type, bool hasNoData, bool withMaskBand){
+    const int cols = 80, rows = 70;
+    GeotiffWriterOptions options;
+    options.tiled = true;
+    options.blockXSize = 16;
+    options.blockYSize = 16;
+    options.compression = "NONE";
+    GeotiffWriter writer(fileName, cols, rows, 1, type, options);
+    if (!writer.isValid())
+        return false;
+    double gt[6] = {0, 1, 0, (double)rows, 0, -1};
+    writer.SetGeoTransform(gt);
+    if (hasNoData && !writer.SetNoDataValue(1, maskedValue(type, 0, 0)))
+        return false;
+    Raster<T> data(cols, rows);
+    for (int y=0; y<rows; y++)
+        for (int x=0; x<cols; x++)
+            data(x, y) = (T) maskedValue(type, x, y);
+    if (!writer.WriteRows(1, 0, data))
+        return false;
+    if (withMaskBand){
+        if (writer.GetDataset()->CreateMaskBand(GMF_PER_DATASET) != CE_None)
+            return false;
+        std::vector<unsigned char> mask((size_t)cols*rows);
+        for (int y=0; y<rows; y++)
+            for (int x=0; x<cols; x++)
+                mask[(size_t)y*cols + x] = maskBandValid(x, y) ? 255 : 0;
+        GDALRasterBand *poMask = writer.GetDataset()->GetRasterBand(1)->GetMaskBand();
+        if (poMask->RasterIO(GF_Write, 0, 0, cols, rows, &mask[0], cols, rows, GDT_Byte, 0, 0) != CE_None)
+            return false;
+    }
+    return writer.Close();
+}
+
+// Every ReadWindowMasked output pixel and mask bit, on windows that are not block aligned
+template<typename T>
+void checkMaskedType(GDALDataType type){
+    const char *fileName = "/vsimem/geotiff_check_masked.tif";
+    const int windows[4][4] = {{3, 5, 29, 19}, {17, 33, 50, 37}, {0, 0, 80, 70}, {79, 1, 1, 68}}; // x, y, cols, rows
+    for (int variant=0; variant<3; variant++){
+        bool hasNoData = (variant != 1), withMaskBand = (variant != 0); // nodata, mask band, both
+        CHECK(writeMaskedRaster<T>(fileName, type, hasNoData, withMaskBand));
+        {
+            Geotiff geo(fileName);
+            CHECK(geo.isValid());
+            for (int w=0; w<4; w++){
+                for (int fill=0; fill<2; fill++){
+                    bool nanFill = (fill == 0);
+                    const int *window = windows[w];
+                    RasterMask mask;
+                    Raster<float> out = geo.ReadWindowMasked(1, window[0], window[1], window[2], window[3], &mask, nanFill);
+                    CHECK(out.GetCols() == window[2] && out.GetRows() == window[3]);
+                    CHECK(mask.GetCols() == window[2] && mask.GetRows() == window[3]);
+                    if (out.GetCols() != window[2] || out.GetRows() != window[3] ||
+                        mask.GetCols() != window[2] || mask.GetRows() != window[3])
+                        continue;
+                    int nWrongMask = 0, nWrongValue = 0;
+                    for (int y=0; y<window[3]; y++){
+                        for (int x=0; x<window[2]; x++){
+                            int px = window[0] + x, py = window[1] + y;
+                            double value = maskedValue(type, px, py);
+                            bool bValid = (value == value) && !(hasNoData && value == maskedValue(type, 0, 0)) &&
+                                          !(withMaskBand && !maskBandValid(px, py));
+                            if (mask(x, y) != bValid)
+                                nWrongMask++;
+                            float expected = (!bValid && nanFill) ? std::numeric_limits<float>::quiet_NaN() : (float)(T)value;
+                            if (!sameValue(out(x, y), expected))
+                                nWrongValue++;
+                        }
+                    }
+                    CHECK(nWrongMask == 0);
+                    CHECK(nWrongValue == 0);
+                }
+            }
+        }
+        removeRaster(fileName);
+        VSIUnlink((std::string(fileName) + ".msk").c_str()); // mask band of GDAL builds without internal masks
+    }
+}
+
+void checkReadWindowMasked(){
+    checkMaskedType<unsigned char>(GDT_Byte);
+    checkMaskedType<short>(GDT_Int16);
+    checkMaskedType<double>(GDT_Float64);
+}
+
+/////////////////////////// GeotiffMappedBand ///////////////////////////
+
+// Pixel (x, y) of band b of the mapped view checks: fits every band type
+static double mappedValue(int x, int y, int b){
+    return (x*3 + y*7 + b*11) % 200 + b;
+}
+
+/**
+ * @brief Writes a raster with the GTiff creation options given (layout, interleave, compression)
+ * @return true if the file was created
+ */
+bool writeLayoutRaster(const char *fileName, GDALDataType type, int cols, int rows, int bands, char **papszOptions){
+    GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    GDALDataset *poDataset = (poDriver != NULL) ? poDriver->Create(fileName, cols, rows, bands, type, papszOptions) : NULL;
+    CSLDestroy(papszOptions);
+    if (poDataset == NULL)
+        return false;
+    std::vector<double> data((size_t)cols*rows);
+    CPLErr e = CE_None;
+    for (int b=1; b<=bands && e == CE_None; b++){
+        for (int y=0; y<rows; y++)
+            for (int x=0; x<cols; x++)
+                data[(size_t)y*cols + x] = mappedValue(x, y, b);
+        e = poDataset->GetRasterBand(b)->RasterIO(GF_Write, 0, 0, cols, rows, &data[0], cols, rows, GDT_Float64, 0, 0);
+    }
+    GDALClose(poDataset);
+    return (e == CE_None);
+}
+
+// The view of band against Read<T>: every pixel, and every row of striped files
+template<typename T>
+void checkMappedView(const char *fileName, int band, bool bMapped){
+    Geotiff geo(fileName);
+    CHECK(geo.isValid());
+    GeotiffMappedBand<T> view(geo, band);
+    Raster<T> reference = geo.Read<T>(band);
+    CHECK(view.isValid());
+    CHECK(view.isMapped() == bMapped);
+    CHECK(view.GetCols() == reference.GetCols() && view.GetRows() == reference.GetRows());
+    if (!view.isValid() || view.GetCols() != reference.GetCols() || view.GetRows() != reference.GetRows())
+        return;
+    int nWrong = 0;
+    for (int y=0; y<view.GetRows(); y++){
+        const T *row = view.GetRow(y);
+        for (int x=0; x<view.GetCols(); x++){
+            if (view(x, y) != reference(x, y))
+                nWrong++;
+            if (row != NULL && row[x*view.GetPixelSpace()] != reference(x, y))
+                nWrong++;
+        }
+    }
+    CHECK(nWrong == 0);
+}
+
+void checkMappedBand(){
+    // a memory mapping needs a plain file: /vsimem is not mappable
+    std::string base = CPLGenerateTempFilename("geotiff_check_mmap");
+    std::string striped = base + "_striped.tif", tiled = base + "_tiled.tif";
+    std::string pixel = base + "_pixel.tif", deflate = base + "_deflate.tif";
+
+    // 50 x 37 pixels: partial bottom strip, partial right and bottom tiles
+    CHECK(writeLayoutRaster(striped.c_str(), GDT_Int16, 50, 37, 1, CSLSetNameValue(NULL, "BLOCKYSIZE", "7")));
+    char **papszTiled = CSLSetNameValue(NULL, "TILED", "YES");
+    papszTiled = CSLSetNameValue(papszTiled, "BLOCKXSIZE", "16");
+    papszTiled = CSLSetNameValue(papszTiled, "BLOCKYSIZE", "16");
+    CHECK(writeLayoutRaster(tiled.c_str(), GDT_Float32, 50, 37, 1, papszTiled));
+    char **papszPixel = CSLSetNameValue(NULL, "INTERLEAVE", "PIXEL");
+    papszPixel = CSLSetNameValue(papszPixel, "BLOCKYSIZE", "5");
+    CHECK(writeLayoutRaster(pixel.c_str(), GDT_Byte, 50, 37, 3, papszPixel));
+    CHECK(writeLayoutRaster(deflate.c_str(), GDT_Float32, 50, 37, 1, CSLSetNameValue(NULL, "COMPRESS", "DEFLATE")));
+
+    checkMappedView<short>(striped.c_str(), 1, true);
+    checkMappedView<float>(tiled.c_str(), 1, true);
+    for (int b=1; b<=3; b++)
+        checkMappedView<unsigned char>(pixel.c_str(), b, true);
+    checkMappedView<float>(deflate.c_str(), 1, false); // compressed: served by a regular read
+    checkMappedView<double>(tiled.c_str(), 1, false);  // not the native type: converted by a regular read
+
+    const std::string files[] = {striped, tiled, pixel, deflate};
+    for (int i=0; i<4; i++)
+        removeRaster(files[i].c_str());
+}
+
+/////////////////////////// GeotiffAsyncReader ///////////////////////////
+
+// true if result holds the window it asked for, of the raster written by checkAsyncCoalescing
+static bool isWindowOf256(const GeotiffAsyncResult &result){
+    if (!result.isValid() || result.data.GetCols() != result.xSize || result.data.GetRows() != result.ySize)
+        return false;
+    for (int y=0; y<result.ySize; y++)
+        for (int x=0; x<result.xSize; x++)
+            if (result.data(x, y) != (float)((result.yOff + y)*256 + result.xOff + x))
+                return false;
+    return true;
+}
+
+/**
+ * @brief Which pending requests are merged into one read: same band, windows overlapping or touching, and a
+ * bounding box no larger than twice the pixels requested
+ * @details A single I/O thread is held by a first request whose callback blocks until every other request
+ * has been queued, so the batches seen by the worker do not depend on thread scheduling
+ */
+void checkAsyncCoalescing(){
+    const char *fileName = "/vsimem/geotiff_check_async.tif";
+    double gt[6] = {0, 1, 0, 256, 0, -1};
+    CHECK(writeRaster(fileName, 256, 256, gt, -9999, [](int x, int y){ return (float)(y*256 + x); }));
+    {
+        GeotiffAsyncReader reader(fileName, 1);
+        CHECK(reader.isValid());
+        size_t nReads, nRequests, nMerged;
+
+        // touching windows are merged (box 128 x 64 = requested), a distant one is read alone
+        std::promise<void> gate;
+        std::shared_future<void> opened = gate.get_future().share();
+        reader.ReadWindow(1, 240, 240, 8, 8, [opened](GeotiffAsyncResult &){ opened.wait(); });
+        std::future<GeotiffAsyncResult> b = reader.ReadWindow(1, 0, 0, 64, 64);
+        std::future<GeotiffAsyncResult> c = reader.ReadWindow(1, 64, 0, 64, 64);
+        std::future<GeotiffAsyncResult> d = reader.ReadWindow(1, 128, 128, 64, 64);
+        gate.set_value();
+        reader.Wait();
+        reader.GetCounters(&nReads, &nRequests, &nMerged);
+        CHECK(nReads == 3 && nRequests == 4 && nMerged == 2);
+        CHECK(isWindowOf256(b.get()));
+        CHECK(isWindowOf256(c.get()));
+        CHECK(isWindowOf256(d.get()));
+
+        // windows touching at a corner only, whose bounding box (72 x 72) is over twice the 2 x 512 pixels requested
+        std::promise<void> gate2;
+        std::shared_future<void> opened2 = gate2.get_future().share();
+        reader.ReadWindow(1, 240, 240, 8, 8, [opened2](GeotiffAsyncResult &){ opened2.wait(); });
+        std::future<GeotiffAsyncResult> f = reader.ReadWindow(1, 0, 0, 64, 8);
+        std::future<GeotiffAsyncResult> g = reader.ReadWindow(1, 64, 8, 8, 64);
+        // overlapping windows: merged, and each one gets its own pixels back
+        std::future<GeotiffAsyncResult> h = reader.ReadWindow(1, 100, 100, 32, 32);
+        std::future<GeotiffAsyncResult> k = reader.ReadWindow(1, 110, 104, 32, 32);
+        gate2.set_value();
+        reader.Wait();
+        reader.GetCounters(&nReads, &nRequests, &nMerged);
+        CHECK(nReads == 3 + 4 && nRequests == 4 + 5 && nMerged == 2 + 2);
+        CHECK(isWindowOf256(f.get()));
+        CHECK(isWindowOf256(g.get()));
+        CHECK(isWindowOf256(h.get()));
+        CHECK(isWindowOf256(k.get()));
+
+        // invalid requests are completed at once, with an error, and are not counted
+        GeotiffAsyncResult outside = reader.ReadWindow(1, 250, 0, 8, 8).get();
+        CHECK(!outside.isValid() && !outside.error.empty());
+        CHECK(!reader.ReadWindow(2, 0, 0, 8, 8).get().isValid());
+        reader.GetCounters(&nReads, &nRequests, &nMerged);
+        CHECK(nRequests == 9);
+    }
+    removeRaster(fileName);
+}
+
+/////////////////////////// GeotiffDatasetPool ///////////////////////////
+
+/**
+ * @brief Reuse, soft cap, least recently used eviction, and closing of stale handles (file rewritten or
+ * invalidated), with a limit of two handles. Counters are compared as deltas: the pool is process-wide
+ */
+void checkPool(){
+    GeotiffDatasetPool &pool = GeotiffDatasetPool::Instance();
+    const char *p1 = "/vsimem/geotiff_check_pool_1.tif";
+    const char *p2 = "/vsimem/geotiff_check_pool_2.tif";
+    const char *p3 = "/vsimem/geotiff_check_pool_3.tif";
+    double gt[6] = {0, 1, 0, 16, 0, -1};
+    const char *paths[] = {p1, p2, p3};
+    for (int i=0; i<3; i++)
+        CHECK(writeRaster(paths[i], 16, 16, gt, -9999, [](int x, int y){ return (float)(x + y); }));
+
+    pool.Clear();
+    pool.SetLimits(2, 60);
+    size_t open, opens0, reuses0, evictions0, opens, reuses, evictions;
+    pool.GetCounters(&open, &opens0, &reuses0, &evictions0);
+    CHECK(open == 0); // no lease is held by the previous checks
+
+    // a released handle is reused
+    GeotiffDatasetLease a = pool.Acquire(p1);
+    CHECK(a.isValid());
+    GDALDataset *poFirst = a.Get();
+    a.Release();
+    a = pool.Acquire(p1);
+    CHECK(a.Get() == poFirst);
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(open == 1 && opens - opens0 == 1 && reuses - reuses0 == 1);
+
+    // soft cap: with every handle leased, one more is opened past the limit (no wait), and closed on release
+    GeotiffDatasetLease b = pool.Acquire(p2);
+    GeotiffDatasetLease c = pool.Acquire(p3);
+    CHECK(b.isValid() && c.isValid());
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(open == 3 && opens - opens0 == 3);
+    c.Release();
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(open == 2 && evictions == evictions0);
+    a.Release(); // p1 idle, then p2 idle
+    b.Release();
+
+    // at the limit, the least recently used idle handle (p1) is closed to open p3
+    c = pool.Acquire(p3);
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(open == 2 && opens - opens0 == 4 && evictions - evictions0 == 1);
+    c.Release();
+    b = pool.Acquire(p2); // still idle
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(reuses - reuses0 == 2);
+    a = pool.Acquire(p1); // was evicted: reopened, closing the idle p3
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(open == 2 && opens - opens0 == 5 && evictions - evictions0 == 2);
+
+    // rewriting a file starts a new generation: new leases see the new file, the old lease is closed on release
+    CHECK(writeRaster(p1, 20, 20, gt, -9999, [](int x, int y){ return (float)(x - y); }));
+    GeotiffDatasetLease a2 = pool.Acquire(p1);
+    CHECK(a2.isValid() && a2->GetRasterXSize() == 20);
+    CHECK(a->GetRasterXSize() == 16);
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(open == 3 && opens - opens0 == 6);
+    a.Release();
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(open == 2);
+    a2.Release();
+    a = pool.Acquire(p1);
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(a->GetRasterXSize() == 20 && reuses - reuses0 == 3 && open == 2);
+    a.Release();
+
+    // an invalidated path: the leased handle is closed on release, and the next lease opens a new one
+    pool.Invalidate(p2);
+    b.Release();
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(open == 1);
+    b = pool.Acquire(p2);
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(b.isValid() && opens - opens0 == 7 && reuses - reuses0 == 3);
+    b.Release();
+
+    pool.SetLimits(GEOTIFF_POOL_MAX_HANDLES, GEOTIFF_POOL_IDLE_SECONDS);
+    pool.Clear();
+    pool.GetCounters(&open, &opens, &reuses, &evictions);
+    CHECK(open == 0);
+    for (int i=0; i<3; i++)
+        removeRaster(paths[i]);
+}
+
+/////////////////////////// GeotiffParseEPSG / GeotiffReadInfo ///////////////////////////
+
+void checkParseEPSG(){
+    // WKT1: the root AUTHORITY comes last, after those of the datum, ellipsoid, prime meridian and units
+    const char *wkt1 =
+        "PROJCS[\"WGS 84 / UTM zone 30N\",GEOGCS[\"WGS 84\",DATUM[\"WGS_1984\",SPHEROID[\"WGS 84\",6378137,298.257223563,"
+        "AUTHORITY[\"EPSG\",\"7030\"]],AUTHORITY[\"EPSG\",\"6326\"]],PRIMEM[\"Greenwich\",0,AUTHORITY[\"EPSG\",\"8901\"]],"
+        "UNIT[\"degree\",0.0174532925199433,AUTHORITY[\"EPSG\",\"9122\"]],AUTHORITY[\"EPSG\",\"4326\"]],"
+        "PROJECTION[\"Transverse_Mercator\"],PARAMETER[\"latitude_of_origin\",0],PARAMETER[\"central_meridian\",-3],"
+        "PARAMETER[\"scale_factor\",0.9996],PARAMETER[\"false_easting\",500000],PARAMETER[\"false_northing\",0],"
+        "UNIT[\"metre\",1,AUTHORITY[\"EPSG\",\"9001\"]],AXIS[\"Easting\",EAST],AXIS[\"Northing\",NORTH],"
+        "AUTHORITY[\"EPSG\",\"32630\"]]";
+    CHECK(GeotiffParseEPSG(wkt1) == 32630);
+
+    // same CRS without a root AUTHORITY: the datum / base CRS codes must not leak out
+    const char *wkt1NoRoot =
+        "PROJCS[\"unnamed\",GEOGCS[\"WGS 84\",DATUM[\"WGS_1984\",SPHEROID[\"WGS 84\",6378137,298.257223563,"
+        "AUTHORITY[\"EPSG\",\"7030\"]],AUTHORITY[\"EPSG\",\"6326\"]],PRIMEM[\"Greenwich\",0],"
+        "UNIT[\"degree\",0.0174532925199433],AUTHORITY[\"EPSG\",\"4326\"]],PROJECTION[\"Transverse_Mercator\"],"
+        "UNIT[\"metre\",1,AUTHORITY[\"EPSG\",\"9001\"]]]";
+    CHECK(GeotiffParseEPSG(wkt1NoRoot) == 0);
+
+    const char *wkt1Geographic =
+        "GEOGCS[\"WGS 84\",DATUM[\"WGS_1984\",SPHEROID[\"WGS 84\",6378137,298.257223563,AUTHORITY[\"EPSG\",\"7030\"]],"
+        "AUTHORITY[\"EPSG\",\"6326\"]],PRIMEM[\"Greenwich\",0],UNIT[\"degree\",0.0174532925199433],AUTHORITY[\"EPSG\",\"4326\"]]";
+    CHECK(GeotiffParseEPSG(wkt1Geographic) == 4326);
+
+    // WKT2: ID nodes, unquoted codes, and IDs nested in the base CRS, conversion method and parameters
+    const char *wkt2 =
+        "PROJCRS[\"WGS 84 / UTM zone 30N\",BASEGEOGCRS[\"WGS 84\",DATUM[\"World Geodetic System 1984\","
+        "ELLIPSOID[\"WGS 84\",6378137,298.257223563,LENGTHUNIT[\"metre\",1]]],PRIMEM[\"Greenwich\",0,"
+        "ANGLEUNIT[\"degree\",0.0174532925199433]],ID[\"EPSG\",4326]],CONVERSION[\"UTM zone 30N\","
+        "METHOD[\"Transverse Mercator\",ID[\"EPSG\",9807]],PARAMETER[\"Latitude of natural origin\",0,"
+        "ANGLEUNIT[\"degree\",0.0174532925199433],ID[\"EPSG\",8801]]],CS[Cartesian,2],"
+        "AXIS[\"(E)\",east,ORDER[1],LENGTHUNIT[\"metre\",1]],AXIS[\"(N)\",north,ORDER[2],LENGTHUNIT[\"metre\",1]],"
+        "USAGE[SCOPE[\"Engineering survey, topographic mapping.\"],AREA[\"Between 6°W and 0°W\"],BBOX[0,-6,84,0]],"
+        "ID[\"EPSG\",32630]]";
+    CHECK(GeotiffParseEPSG(wkt2) == 32630);
+
+    const char *wkt2NoRoot =
+        "PROJCRS[\"unknown\",BASEGEOGCRS[\"WGS 84\",DATUM[\"World Geodetic System 1984\",ELLIPSOID[\"WGS 84\",6378137,"
+        "298.257223563]],ID[\"EPSG\",4326]],CONVERSION[\"unknown\",METHOD[\"Transverse Mercator\",ID[\"EPSG\",9807]]],"
+        "CS[Cartesian,2],AXIS[\"(E)\",east],AXIS[\"(N)\",north],LENGTHUNIT[\"metre\",1]]";
+    CHECK(GeotiffParseEPSG(wkt2NoRoot) == 0);
+
+    // brackets, quotes and keywords inside names are text, not nodes
+    const char *wkt1Quoted =
+        "GEOGCS[\"my \"\"AUTHORITY[\"\"EPSG\"\",\"\"1\"\"]\"\" ] crs\",DATUM[\"WGS_1984\",AUTHORITY[\"EPSG\",\"6326\"]],"
+        "PRIMEM[\"Greenwich\",0],UNIT[\"degree\",0.0174532925199433],AUTHORITY[\"EPSG\",\"4326\"]]";
+    CHECK(GeotiffParseEPSG(wkt1Quoted) == 4326);
+
+    // other authorities, empty and missing definitions
+    CHECK(GeotiffParseEPSG("PROJCS[\"WGS 84 / Pseudo-Mercator\",GEOGCS[\"WGS 84\",AUTHORITY[\"EPSG\",\"4326\"]],"
+                           "AUTHORITY[\"ESRI\",\"102100\"]]") == 0);
+    CHECK(GeotiffParseEPSG("") == 0);
+    CHECK(GeotiffParseEPSG(NULL) == 0);
+}
+
+// EPSG code from the GeoKeys of classic and BigTIFF files: projected, geographic and no CRS
+void checkReadInfoEPSG(){
+    const int codes[3] = {32630, 4326, 0};
+    const char *bigTiff[2] = {"NO", "YES"};
+    for (int b=0; b<2; b++){
+        for (int c=0; c<3; c++){
+            const char *fileName = "/vsimem/geotiff_check_epsg.tif";
+            GeotiffWriterOptions options;
+            options.compression = "NONE";
+            options.bigTiff = bigTiff[b];
+            {
+                GeotiffWriter writer(fileName, 8, 8, 1, GDT_Byte, options);
+                CHECK(writer.isValid());
+                double gt[6] = {500000, 10, 0, 4000000, 0, -10};
+                writer.SetGeoTransform(gt);
+                if (codes[c] != 0){
+                    OGRSpatialReference srs;
+                    char *pszWkt = NULL;
+                    CHECK(srs.importFromEPSG(codes[c]) == OGRERR_NONE && srs.exportToWkt(&pszWkt) == OGRERR_NONE);
+                    CHECK(writer.SetProjection(pszWkt));
+                    CPLFree(pszWkt);
+                }
+                CHECK(writer.Close());
+            }
+            GeotiffInfo info, full;
+            CHECK(GeotiffReadInfo(fileName, info));
+            CHECK(info.epsg == codes[c]);
+            CHECK(info.wkt.empty());
+            CHECK(GeotiffReadInfo(fileName, full, true));
+            CHECK(full.epsg == codes[c]);
+            CHECK(full.wkt.empty() == (codes[c] == 0));
+            removeRaster(fileName);
+        }
+    }
+}
+
+/////////////////////////// GeotiffMosaic ///////////////////////////
+
+// Footprint of a tile (no file behind it: Build, Query, Save and Load never open the tiles)
+GeotiffInfo makeTileInfo(const std::string &fileName, double x0, double y0, int cols, int rows, double pixelSize){
+    GeotiffInfo info;
+    info.filename = fileName;
+    info.cols = cols;
+    info.rows = rows;
+    info.bands = 1;
+    info.dataType = GDT_Float32;
+    info.blockXSize = cols;
+    info.blockYSize = 16;
+    double gt[6] = {x0, pixelSize, 0, y0, 0, -pixelSize};
+    std::copy(gt, gt + 6, info.geotransform);
+    info.hasGeoTransform = true;
+    info.hasNoData = true;
+    info.noData = -9999;
+    info.epsg = 32630;
+    return info;
+}
+
+// Tiles of 100 x 100 one unit pixels in a nx x ny grid, north-west corner at (x0, y0), row by row
+std::vector<GeotiffInfo> makeTileGrid(int nx, int ny, double x0, double y0){
+    std::vector<GeotiffInfo> index;
+    for (int j=0; j<ny; j++)
+        for (int i=0; i<nx; i++)
+            index.push_back(makeTileInfo("grid_" + std::to_string(j) + "_" + std::to_string(i) + ".tif",
+                                         x0 + 100*i, y0 - 100*j, 100, 100, 1.0));
+    return index;
+}
+
+// Box query of every tile, by brute force (closed boxes: touching footprints intersect)
+std::vector<int> bruteQuery(const GeotiffMosaic &mosaic, double minX, double minY, double maxX, double maxY){
+    std::vector<int> result;
+    for (size_t i=0; i<mosaic.GetTileCount(); i++){
+        double e[4];
+        mosaic.GetTile(i).GetExtent(e);
+        if (e[0] <= maxX && e[2] >= minX && e[1] <= maxY && e[3] >= minY)
+            result.push_back((int)i);
+    }
+    return result;
+}
+
+// Point query by brute force (half-open footprints: left and top edges belong to the tile)
+std::vector<int> brutePoint(const GeotiffMosaic &mosaic, double x, double y){
+    std::vector<int> result;
+    for (size_t i=0; i<mosaic.GetTileCount(); i++){
+        double e[4];
+        mosaic.GetTile(i).GetExtent(e);
+        if (x >= e[0] && x < e[2] && y > e[1] && y <= e[3])
+            result.push_back((int)i);
+    }
+    return result;
+}
+
+void checkMosaicQuery(){
+    const double x0 = 500000, y0 = 4000000;
+    const int nx = 20, ny = 15; // 300 tiles: three levels of R-tree nodes
+
+    // exact answers on a regular grid: points on shared edges and corners belong to a single tile
+    GeotiffMosaic grid;
+    CHECK(grid.Build(makeTileGrid(nx, ny, x0, y0)));
+    CHECK(grid.GetTileCount() == (size_t)(nx*ny));
+    int i = 7, j = 4, tile = j*nx + i;
+    CHECK(grid.Query(x0 + 100*i + 50, y0 - 100*j - 50) == std::vector<int>(1, tile));
+    CHECK(grid.Query(x0 + 100*(i + 1), y0 - 100*j - 50) == std::vector<int>(1, tile + 1));       // vertical edge: east tile
+    CHECK(grid.Query(x0 + 100*i + 50, y0 - 100*(j + 1)) == std::vector<int>(1, tile + nx));      // horizontal edge: south tile
+    CHECK(grid.Query(x0 + 100*(i + 1), y0 - 100*(j + 1)) == std::vector<int>(1, tile + nx + 1)); // corner: south-east tile
+    CHECK(grid.Query(x0, y0) == std::vector<int>(1, 0));                                         // north-west corner of the mosaic
+    CHECK(grid.Query(x0 + 100*nx, y0 - 50).empty());                                             // east edge of the mosaic
+    CHECK(grid.Query(x0 + 50, y0 - 100*ny).empty());                                             // south edge of the mosaic
+    CHECK(grid.Query(x0 - 1e-6, y0 - 50).empty());
+    // a box touching a shared edge intersects both tiles
+    std::vector<int> both;
+    both.push_back(tile);
+    both.push_back(tile + 1);
+    CHECK(grid.Query(x0 + 100*i + 10, y0 - 100*j - 60, x0 + 100*(i + 1), y0 - 100*j - 40) == both);
+    // corners given in any order
+    CHECK(grid.Query(x0 + 100*(i + 1), y0 - 100*j - 40, x0 + 100*i + 10, y0 - 100*j - 60) == both);
+
+    // R-tree vs brute force, with overlapping tiles of random size added to the grid
+    std::vector<GeotiffInfo> index = makeTileGrid(nx, ny, x0, y0);
+    unsigned seed = 12345;
+    std::function<double()> random01 = [&seed](){
+        seed = seed*1103515245u + 12345u;
+        return ((seed >> 8) & 0xFFFF) / 65536.0;
+    };
+    for (int k=0; k<60; k++){
+        double tx = x0 - 100 + random01()*100*(nx + 1);
+        double ty = y0 + 100 - random01()*100*(ny + 1);
+        index.push_back(makeTileInfo("random_" + std::to_string(k) + ".tif", tx, ty,
+                                     10 + (int)(random01()*300), 10 + (int)(random01()*300), 1.0/3));
+    }
+    GeotiffMosaic mosaic;
+    CHECK(mosaic.Build(index));
+    CHECK(mosaic.GetTileCount() == index.size());
+    for (int k=0; k<500; k++){
+        double ax = x0 - 200 + random01()*100*(nx + 4), ay = y0 + 200 - random01()*100*(ny + 4);
+        double bx = ax + random01()*400, by = ay - random01()*400;
+        CHECK(mosaic.Query(ax, by, bx, ay) == bruteQuery(mosaic, ax, by, bx, ay));
+        CHECK(mosaic.Query(ax, ay) == brutePoint(mosaic, ax, ay));
+        // the same point snapped to the grid lines (shared edges and corners)
+        double sx = x0 + 100*floor((ax - x0)/100), sy = y0 - 100*floor((y0 - ay)/100);
+        CHECK(mosaic.Query(sx, ay) == brutePoint(mosaic, sx, ay));
+        CHECK(mosaic.Query(ax, sy) == brutePoint(mosaic, ax, sy));
+        CHECK(mosaic.Query(sx, sy) == brutePoint(mosaic, sx, sy));
+    }
+}
+
+void checkMosaicSaveLoad(){
+    std::vector<GeotiffInfo> index = makeTileGrid(3, 2, 431250.125, 4512345.675);
+    // pixel sizes and origins that are not exact in decimal, nodata NaN, and a file name with spaces
+    index.push_back(makeTileInfo("/data/tiles/with spaces/tile 7.tif", 431250.1 + 1.0/3, 4512345.675 - 0.1, 90, 70, 0.1 + 0.2));
+    index.back().noData = std::numeric_limits<double>::quiet_NaN();
+    index.back().bands = 3;
+    index.back().dataType = GDT_Int16;
+    index[1].hasNoData = false;
+
+    GeotiffMosaic mosaic;
+    CHECK(mosaic.Build(index));
+    const char *pszIndex = CPLGenerateTempFilename("geotiff_check_mosaic");
+    std::string fileName = pszIndex;
+    CHECK(mosaic.Save(fileName.c_str()));
+
+    GeotiffMosaic loaded;
+    CHECK(loaded.Load(fileName.c_str()));
+    VSIUnlink(fileName.c_str());
+    CHECK(loaded.GetTileCount() == mosaic.GetTileCount());
+    for (size_t i=0; i<loaded.GetTileCount() && i<mosaic.GetTileCount(); i++){
+        const GeotiffInfo &a = mosaic.GetTile(i), &b = loaded.GetTile(i);
+        CHECK(a.filename == b.filename);
+        CHECK(a.cols == b.cols && a.rows == b.rows && a.bands == b.bands && a.dataType == b.dataType);
+        CHECK(a.blockXSize == b.blockXSize && a.blockYSize == b.blockYSize);
+        CHECK(a.hasGeoTransform == b.hasGeoTransform && a.hasNoData == b.hasNoData && a.epsg == b.epsg);
+        CHECK(std::equal(a.geotransform, a.geotransform + 6, b.geotransform)); // bit exact
+        CHECK((a.noData != a.noData) ? (b.noData != b.noData) : (a.noData == b.noData));
+    }
+    CHECK(loaded.Query(431250.125 + 150, 4512345.675 - 50) == mosaic.Query(431250.125 + 150, 4512345.675 - 50));
+
+    CHECK(!loaded.Load("/nonexistent/geotiff_check_mosaic.txt"));
+}
+
+// Value of the global pixel (x, y) in the 80 x 80 test mosaic
+static float mosaicValue(int x, int y){
+    return (float)(x + 1000*y);
+}
+
+/**
+ * @brief Sample must return what Read returns for the output pixel containing the point, for every
+ * overlap rule and output resolution (same grid, same nearest mapping, same nodata handling)
+ */
+void checkMosaicSample(){
+    // 2 x 2 tiles of 40 x 40 pixels over [0, 80] x [0, 80], plus a tile overlapping all four
+    std::vector<std::string> fileNames;
+    for (int j=0; j<2; j++){
+        for (int i=0; i<2; i++){
+            std::string fileName = "/vsimem/geotiff_check_tile_" + std::to_string(j) + std::to_string(i) + ".tif";
+            double gt[6] = {40.0*i, 1, 0, 80 - 40.0*j, 0, -1};
+            bool bOk = writeRaster(fileName.c_str(), 40, 40, gt, -9999, [i, j](int x, int y){
+                if (x == 5 && y == 5)
+                    return -9999.0f; // one nodata pixel per tile
+                return mosaicValue(40*i + x, 40*j + y);
+            });
+            CHECK(bOk);
+            fileNames.push_back(fileName);
+        }
+    }
+    double gtOverlap[6] = {20, 1, 0, 60, 0, -1};
+    CHECK(writeRaster("/vsimem/geotiff_check_tile_overlap.tif", 40, 40, gtOverlap, -9999, [](int x, int y){
+        return -mosaicValue(20 + x, 20 + y) - 1;
+    }));
+    fileNames.push_back("/vsimem/geotiff_check_tile_overlap.tif");
+
+    std::vector<GeotiffInfo> index(fileNames.size());
+    for (size_t i=0; i<fileNames.size(); i++)
+        CHECK(GeotiffReadInfo(fileNames[i].c_str(), index[i]));
+    {
+        GeotiffMosaic mosaic;
+        CHECK(mosaic.Build(index));
+        // explicit values at resolution 1: plain pixel, overlap, nodata
+        CHECK(mosaic.Sample(1, 10.5, 70.5) == mosaicValue(10, 9));
+        CHECK(mosaic.Sample(1, 30.5, 50.5) == mosaicValue(30, 29));
+        mosaic.SetOverlap(MOSAIC_LAST);
+        CHECK(mosaic.Sample(1, 30.5, 50.5) == -mosaicValue(30, 29) - 1);
+        mosaic.SetOverlap(MOSAIC_MEAN);
+        CHECK(mosaic.Sample(1, 30.5, 50.5) == (mosaicValue(30, 29) - mosaicValue(30, 29) - 1) / 2);
+        CHECK(mosaic.Sample(1, 5.5, 74.5) != mosaic.Sample(1, 5.5, 74.5)); // nodata, no overlap: NaN
+        CHECK(mosaic.Sample(1, 85, 40) != mosaic.Sample(1, 85, 40));       // outside: NaN
+
+        const double resolutions[] = {1.0, 0.7, 2.5};
+        const MosaicOverlap rules[] = {MOSAIC_FIRST, MOSAIC_LAST, MOSAIC_MEAN};
+        for (int r=0; r<3; r++){
+            mosaic.SetResolution(resolutions[r], resolutions[r]);
+            for (int o=0; o<3; o++){
+                mosaic.SetOverlap(rules[o]);
+                double gt[6];
+                Raster<float> output = mosaic.Read(1, 3.3, 2.9, 77.1, 78.6, gt);
+                CHECK(!output.isEmpty());
+                if (output.isEmpty())
+                    continue;
+                std::vector<double> x, y;
+                std::vector<float> expected;
+                for (int row=0; row<output.GetRows(); row++){
+                    for (int col=0; col<output.GetCols(); col++){
+                        // the pixel center, and a point near its south-east corner
+                        x.push_back(gt[0] + (col + 0.5)*gt[1]);
+                        y.push_back(gt[3] + (row + 0.5)*gt[5]);
+                        x.push_back(gt[0] + (col + 0.95)*gt[1]);
+                        y.push_back(gt[3] + (row + 0.95)*gt[5]);
+                        expected.push_back(output(col, row));
+                        expected.push_back(output(col, row));
+                    }
+                }
+                std::vector<float> values(x.size());
+                size_t nValid = mosaic.Sample(1, x.data(), y.data(), x.size(), values.data());
+                size_t nMismatch = 0, nExpectedValid = 0;
+                for (size_t k=0; k<values.size(); k++){
+                    if (!sameValue(values[k], expected[k]))
+                        nMismatch++;
+                    if (expected[k] == expected[k])
+                        nExpectedValid++;
+                }
+                CHECK(nMismatch == 0);
+                CHECK(nValid == nExpectedValid);
+                CHECK(sameValue(mosaic.Sample(1, x[0], y[0]), expected[0]));
+            }
+        }
+        // reads larger than the limit are refused instead of allocated
+        CHECK(mosaic.Read(1, 0, 0, 1e9, 1e9).isEmpty());
+    }
+    for (size_t i=0; i<fileNames.size(); i++)
+        removeRaster(fileNames[i].c_str());
+}
+
+/////////////////////////// GeotiffTerrain ///////////////////////////
+
+// Difference between two products; aspect wraps around at 360 degrees
+static double terrainError(TerrainProduct product, float a, float b){
+    double diff = fabs((double)a - (double)b);
+    if (product == TERRAIN_ASPECT)
+        diff = min(diff, 360.0 - diff);
+    return diff;
+}
+
+void checkTerrain(){
+    // 61 x 53: vector rows end in a scalar tail with SSE2 and AVX2, and the rows split over three threads
+    const int cols = 61, rows = 53;
+    Raster<float> dem(cols, rows);
+    for (int y=0; y<rows; y++)
+        for (int x=0; x<cols; x++){
+            if (x >= 40 && y >= 30)
+                dem(x, y) = 250.0f; // flat corner: no aspect
+            else // slopes from gentle to near vertical, facing every direction
+                dem(x, y) = (float)(200.0*sin(y*0.07)*cos(x*0.05) + 40.0*sin(x*0.4 + y*0.3) + 0.02*x*x);
+        }
+    const float fNaN = std::numeric_limits<float>::quiet_NaN();
+    const int bad[4][2] = {{10, 10}, {33, 20}, {7, 45}, {57, 3}}; // (x, y): nodata, NaN, nodata, NaN
+    for (int i=0; i<4; i++)
+        dem(bad[i][0], bad[i][1]) = (i % 2 == 0) ? -9999.0f : fNaN;
+
+    TerrainOptions options;
+    options.pixelX = 10.0;
+    options.pixelY = -10.0;
+    options.hasNoData = true;
+    options.noData = -9999.0f;
+    options.nThreads = 3;
+
+    std::vector<float *> demRows(rows);
+    for (int y=0; y<rows; y++)
+        demRows[y] = &dem(0, y);
+    Raster<float> output(cols, rows);
+    std::vector<float *> outputRows(rows);
+    for (int y=0; y<rows; y++)
+        outputRows[y] = &output(0, y);
+
+    for (int p=TERRAIN_SLOPE; p<=TERRAIN_RUGOSITY; p++){
+        TerrainProduct product = (TerrainProduct)p;
+        Raster<float> reference = GeotiffTerrainReference(dem, product, options);
+        Raster<float> result = GeotiffTerrain(dem, product, options);
+        CHECK(GeotiffTerrain(&demRows[0], cols, rows, &outputRows[0], product, options));
+        CHECK(result.GetCols() == cols && result.GetRows() == rows);
+        CHECK(reference.GetCols() == cols && reference.GetRows() == rows);
+        if (result.GetCols() != cols || result.GetRows() != rows || reference.GetCols() != cols || reference.GetRows() != rows)
+            continue;
+
+        // NaN on the border and around every nodata / NaN pixel, in the reference and in both vector outputs
+        int nWrongNaN = 0, nMissingNaN = 0, nOutOfTolerance = 0;
+        double maxError = 0;
+        for (int y=0; y<rows; y++){
+            for (int x=0; x<cols; x++){
+                bool bInvalid = (x == 0 || y == 0 || x == cols - 1 || y == rows - 1);
+                for (int i=0; i<4; i++)
+                    bInvalid = bInvalid || (abs(x - bad[i][0]) <= 1 && abs(y - bad[i][1]) <= 1);
+                if (bInvalid && !(reference(x, y) != reference(x, y)))
+                    nMissingNaN++;
+                float r = reference(x, y);
+                if ((r != r) != (result(x, y) != result(x, y)) || (r != r) != (output(x, y) != output(x, y))){
+                    nWrongNaN++;
+                    continue;
+                }
+                if (r != r)
+                    continue;
+                double error = max(terrainError(product, r, result(x, y)), terrainError(product, r, output(x, y)));
+                maxError = max(maxError, error);
+                // slope and aspect: atan approximation, error < 0.001 degrees. Other products: float rounding
+                double tolerance = (product == TERRAIN_SLOPE || product == TERRAIN_ASPECT) ? 1e-3 : 1e-4*max(1.0, fabs((double)r));
+                if (error >= tolerance)
+                    nOutOfTolerance++;
+            }
+        }
+        CHECK(nMissingNaN == 0);
+        CHECK(nWrongNaN == 0);
+        CHECK(nOutOfTolerance == 0);
+        if (product == TERRAIN_ASPECT)
+            CHECK(reference(50, 40) != reference(50, 40)); // flat
+        if (nMissingNaN != 0 || nWrongNaN != 0 || nOutOfTolerance != 0)
+            cout << "		" << GeotiffTerrainName(product) << ": max error " << maxError << endl;
+    }
+}
+
+/////////////////////////// main ///////////////////////////
+
+struct CheckGroup {
+    const char *name;
+    void (*run)();
+};
+
+int main()
+{
+    GeotiffRegisterDrivers();
+    cout << cyan << "geotiff_check" << reset << endl;
+    cout << "\tGit commit:\t" << yellow << GIT_COMMIT << reset << endl;
+
+    const CheckGroup groups[] = {
+        {"Geotiff::ReadWindowMasked", checkReadWindowMasked},
+        {"GeotiffMappedBand", checkMappedBand},
+        {"GeotiffAsyncReader merging", checkAsyncCoalescing},
+        {"GeotiffDatasetPool", checkPool},
+        {"GeotiffParseEPSG", checkParseEPSG},
+        {"GeotiffReadInfo EPSG", checkReadInfoEPSG},
+        {"GeotiffMosaic::Query", checkMosaicQuery},
+        {"GeotiffMosaic::Save / Load", checkMosaicSaveLoad},
+        {"GeotiffMosaic::Sample", checkMosaicSample},
+        {"GeotiffTerrain", checkTerrain}
+    };
+    int nGroupsFailed = 0;
+    for (size_t g=0; g<sizeof(groups)/sizeof(groups[0]); g++){
+        int nBefore = nFailed;
+        groups[g].run();
+        bool bOk = (nFailed == nBefore);
+        if (!bOk)
+            nGroupsFailed++;
+        cout << "\t" << groups[g].name << "\t" << (bOk ? green + "ok" : red + "FAILED") << reset << endl;
+    }
+    cout << "\t" << nFailed << " failed checks in " << nGroupsFailed << " groups" << endl;
+    return (nFailed > 0) ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file geotiff_counters.cpp
+ * @brief Optional (compile-time) I/O instrumentation: bytes, RasterIO calls, blocks, conversion and allocation time
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_counters.hpp>
+
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+#ifdef GEOTIFF_ENABLE_STATS
+// zero-initialized: static storage
+GeotiffCounterState geotiffCounterState;
+#endif
+
+static const char *callNames[GEOTIFF_CALL_COUNT] = {
+  "GetArray2D", "GetArray1D", "Read", "ReadWindow", "ReadMasked", "ReadResampled", "ReadCube",
+  "ViewTile", "ParallelTile", "AsyncRead", "PipelineBlock", "Sample", "Warp", "Mosaic"
+};
+
+const char *GeotiffCallName(int call){
+  if (call < 0 || call >= GEOTIFF_CALL_COUNT)
+    return "";
+  return callNames[call];
+}
+
+/**
+ * @brief Returns a snapshot of the process-wide counters
+ *
+ * @return GeotiffCounters counters. All zero (and enabled false) when built without GEOTIFF_ENABLE_STATS
+ */
+GeotiffCounters GeotiffGetCounters(){
+  GeotiffCounters counters;
+  memset(&counters, 0, sizeof(counters));
+#ifdef GEOTIFF_ENABLE_STATS
+  GeotiffCounterState &s = geotiffCounterState;
+  counters.enabled           = true;
+  counters.bytesRead         = s.bytesRead;
+  counters.rasterIOCalls     = s.rasterIOCalls;
+  counters.blocksRead        = s.blocksRead;
+  counters.rasterIOSeconds   = s.rasterIONanos * 1e-9;
+  counters.conversionSeconds = s.conversionNanos * 1e-9;
+  counters.allocations       = s.allocations;
+  counters.allocationBytes   = s.allocationBytes;
+  counters.allocationSeconds = s.allocationNanos * 1e-9;
+  for (int i=0; i<GEOTIFF_CALL_COUNT; i++){
+    counters.calls[i].calls   = s.callCount[i];
+    counters.calls[i].seconds = s.callNanos[i] * 1e-9;
+  }
+#endif
+  return counters;
+}
+
+void GeotiffResetCounters(){
+#ifdef GEOTIFF_ENABLE_STATS
+  GeotiffCounterState &s = geotiffCounterState;
+  s.bytesRead = 0;
+  s.rasterIOCalls = 0;
+  s.blocksRead = 0;
+  s.rasterIONanos = 0;
+  s.conversionNanos = 0;
+  s.allocations = 0;
+  s.allocationBytes = 0;
+  s.allocationNanos = 0;
+  for (int i=0; i<GEOTIFF_CALL_COUNT; i++){
+    s.callCount[i] = 0;
+    s.callNanos[i] = 0;
+  }
+#endif
+}
+
+/**
+ * @brief Serializes the counters as a single-line JSON object
+ *
+ * @param counters snapshot returned by GeotiffGetCounters
+ * @return std::string JSON object
+ */
+std::string GeotiffCountersToJSON(const GeotiffCounters &counters){
+  ostringstream json;
+  json << setprecision(9);
+  json << "{\"enabled\":" << (counters.enabled ? "true" : "false")
+       << ",\"bytesRead\":" << counters.bytesRead
+       << ",\"rasterIOCalls\":" << counters.rasterIOCalls
+       << ",\"blocksRead\":" << counters.blocksRead
+       << ",\"rasterIOSeconds\":" << counters.rasterIOSeconds
+       << ",\"conversionSeconds\":" << counters.conversionSeconds
+       << ",\"allocations\":" << counters.allocations
+       << ",\"allocationBytes\":" << counters.allocationBytes
+       << ",\"allocationSeconds\":" << counters.allocationSeconds
+       << ",\"calls\":{";
+  bool bFirst = true;
+  for (int i=0; i<GEOTIFF_CALL_COUNT; i++){
+    if (counters.calls[i].calls == 0)
+      continue;
+    json << (bFirst ? "" : ",") << "\"" << callNames[i] << "\":{\"calls\":" << counters.calls[i].calls
+         << ",\"seconds\":" << counters.calls[i].seconds << "}";
+    bFirst = false;
+  }
+  json << "}}";
+  return json.str();
+}
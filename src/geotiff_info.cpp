@@ -0,0 +1,360 @@
+/**
+ * @file geotiff_info.cpp
+ * @brief Metadata-only GeoTIFF open, and parallel directory scan into an in-memory index
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_info.hpp>
+#include <geotiff_pool.hpp>
+
+#include <iostream>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <cpl_conv.h>
+#include <cpl_string.h>
+#include <cpl_vsi.h>
+#include <cpl_error.h>
+
+using namespace std;
+
+GeotiffInfo::GeotiffInfo() :
+  cols(0), rows(0), bands(0), dataType(GDT_Unknown), blockXSize(0), blockYSize(0),
+  hasGeoTransform(false), hasNoData(false), noData(0), epsg(0) {
+  double identity[6] = {0, 1, 0, 0, 0, 1};
+  memcpy(geotransform, identity, sizeof(geotransform));
+}
+
+void GeotiffInfo::GetExtent(double *extent) const {
+  const double *gt = geotransform;
+  double px[4] = {0, (double)cols, 0, (double)cols};
+  double py[4] = {0, 0, (double)rows, (double)rows};
+  for (int i=0; i<4; i++){
+    double x = gt[0] + px[i]*gt[1] + py[i]*gt[2];
+    double y = gt[3] + px[i]*gt[4] + py[i]*gt[5];
+    if (i == 0 || x < extent[0]) extent[0] = x;
+    if (i == 0 || y < extent[1]) extent[1] = y;
+    if (i == 0 || x > extent[2]) extent[2] = x;
+    if (i == 0 || y > extent[3]) extent[3] = y;
+  }
+}
+
+OGRSpatialReference *GeotiffInfo::CreateSpatialRef() const {
+  if (!wkt.empty())
+    return new OGRSpatialReference(wkt.c_str());
+  OGRSpatialReference *srs = new OGRSpatialReference();
+  if (epsg > 0 && srs->importFromEPSG(epsg) == OGRERR_NONE)
+    return srs;
+  delete srs;
+  GeotiffInfo full;
+  if (!GeotiffReadInfo(filename.c_str(), full, true) || full.wkt.empty())
+    return NULL;
+  return new OGRSpatialReference(full.wkt.c_str());
+}
+
+// true if the WKT keyword at p starts a token (not the tail of a longer name) and is followed by an opening bracket
+static bool isNode(const char *wkt, const char *p, const char *keyword, const char **args){
+  size_t n = strlen(keyword);
+  if (p != wkt && (isalnum((unsigned char)p[-1]) || p[-1] == '_'))
+    return false;
+  for (size_t i=0; i<n; i++)
+    if (toupper((unsigned char)p[i]) != keyword[i])
+      return false;
+  p += n;
+  while (isspace((unsigned char)*p))
+    p++;
+  if (*p != '[' && *p != '(')
+    return false;
+  *args = p + 1;
+  return true;
+}
+
+/**
+ * @brief Extracts the EPSG code of the root CRS from its WKT, without building an OGR object
+ * @details Only the AUTHORITY / ID nodes directly under the root node (bracket depth 1) are
+ * considered, so the codes of the datum, ellipsoid, units or axes are ignored. The last one wins,
+ * as in WKT1 the root AUTHORITY follows its children
+ *
+ * @param wkt WKT1 or WKT2 definition (may be NULL)
+ * @return int EPSG code, 0 if the root node has no EPSG identifier
+ */
+int GeotiffParseEPSG(const char *wkt){
+  if (wkt == NULL)
+    return 0;
+  int epsg = 0, depth = 0;
+  bool bQuoted = false;
+  for (const char *p=wkt; *p; p++){
+    if (*p == '"'){
+      bQuoted = !bQuoted; // doubled quotes inside a string toggle twice
+      continue;
+    }
+    if (bQuoted)
+      continue;
+    if (*p == '[' || *p == '('){
+      depth++;
+      continue;
+    }
+    if (*p == ']' || *p == ')'){
+      depth--;
+      continue;
+    }
+    const char *args;
+    if (depth != 1 || !(isNode(wkt, p, "AUTHORITY", &args) || isNode(wkt, p, "ID", &args)))
+      continue;
+    // args: "EPSG", "4326"] (WKT1) or "EPSG", 4326] (WKT2)
+    while (isspace((unsigned char)*args))
+      args++;
+    if (*args != '"' || !EQUALN(args + 1, "EPSG\"", 5))
+      continue;
+    args += 6;
+    while (isspace((unsigned char)*args) || *args == ',' || *args == '"')
+      args++;
+    int code = atoi(args);
+    if (code > 0)
+      epsg = code;
+  }
+  return epsg;
+}
+
+// Unsigned TIFF integer of nBytes at p, in the byte order of the file
+static uint64_t tiffValue(const unsigned char *p, int nBytes, bool bigEndian){
+  uint64_t value = 0;
+  for (int i=0; i<nBytes; i++)
+    value = (value << 8) | p[bigEndian ? i : nBytes - 1 - i];
+  return value;
+}
+
+// GeoKeyDirectoryTag (SHORT values) of the first IFD of an open TIFF file, classic or BigTIFF
+static std::vector<unsigned short> readGeoKeyDirectory(VSILFILE *fp){
+  std::vector<unsigned short> keys;
+  unsigned char header[16];
+  if (VSIFReadL(header, 1, sizeof(header), fp) < 8)
+    return keys;
+  if (!((header[0] == 'I' && header[1] == 'I') || (header[0] == 'M' && header[1] == 'M')))
+    return keys;
+  bool bigEndian = (header[0] == 'M');
+  int version = (int) tiffValue(header + 2, 2, bigEndian);
+  if (version != 42 && version != 43)
+    return keys;
+  bool bigTiff = (version == 43);
+  // classic: 2 byte entry count, 12 byte entries with 4 byte count / value. BigTIFF: 8, 20, 8
+  int countBytes = bigTiff ? 8 : 2, entryBytes = bigTiff ? 20 : 12, valueBytes = bigTiff ? 8 : 4;
+  uint64_t ifdOffset = bigTiff ? tiffValue(header + 8, 8, bigEndian) : tiffValue(header + 4, 4, bigEndian);
+
+  unsigned char count[8];
+  if (VSIFSeekL(fp, ifdOffset, SEEK_SET) != 0 || VSIFReadL(count, 1, countBytes, fp) != (size_t)countBytes)
+    return keys;
+  uint64_t nEntries = tiffValue(count, countBytes, bigEndian);
+  if (nEntries == 0 || nEntries > 4096)
+    return keys;
+  std::vector<unsigned char> entries(nEntries*entryBytes);
+  if (VSIFReadL(&entries[0], 1, entries.size(), fp) != entries.size())
+    return keys;
+
+  for (uint64_t i=0; i<nEntries; i++){
+    const unsigned char *entry = &entries[i*entryBytes];
+    if (tiffValue(entry, 2, bigEndian) != 34735 || tiffValue(entry + 2, 2, bigEndian) != 3) // GeoKeyDirectoryTag, SHORT
+      continue;
+    uint64_t nValues = tiffValue(entry + 4, valueBytes, bigEndian);
+    if (nValues < 4 || nValues > 65536)
+      return keys;
+    std::vector<unsigned char> raw(nValues*2);
+    const unsigned char *value = entry + 4 + valueBytes; // values inline when they fit, offset otherwise
+    if (raw.size() <= (size_t)valueBytes)
+      memcpy(&raw[0], value, raw.size());
+    else if (VSIFSeekL(fp, tiffValue(value, valueBytes, bigEndian), SEEK_SET) != 0 ||
+             VSIFReadL(&raw[0], 1, raw.size(), fp) != raw.size())
+      return keys;
+    keys.resize(nValues);
+    for (size_t k=0; k<keys.size(); k++)
+      keys[k] = (unsigned short) tiffValue(&raw[2*k], 2, bigEndian);
+    break;
+  }
+  return keys;
+}
+
+/**
+ * @brief Reads the EPSG code of a GeoTIFF from its GeoKeys, without GDAL or OGR
+ * @details Only the GeoKeyDirectory of the first IFD is read: ProjectedCSTypeGeoKey for projected
+ * models, GeographicTypeGeoKey for geographic ones. User-defined CRS (32767) give 0
+ *
+ * @return int EPSG code, 0 if the file has no EPSG coded CRS (or is not a TIFF file)
+ */
+static int readGeoKeyEPSG(const char *path){
+  VSILFILE *fp = VSIFOpenL(path, "rb");
+  if (fp == NULL)
+    return 0;
+  std::vector<unsigned short> keys = readGeoKeyDirectory(fp);
+  VSIFCloseL(fp);
+  if (keys.size() < 4)
+    return 0;
+  // header: version, revision, minor revision, number of keys. Then 4 SHORTs per key:
+  // id, tag holding the value (0: value is inline), count, value
+  int model = 0, geographic = 0, projected = 0;
+  size_t nKeys = min((size_t)keys[3], (keys.size() - 4)/4);
+  for (size_t k=0; k<nKeys; k++){
+    const unsigned short *key = &keys[4 + 4*k];
+    if (key[1] != 0)
+      continue;
+    if (key[0] == 1024)      // GTModelTypeGeoKey
+      model = key[3];
+    else if (key[0] == 2048) // GeographicTypeGeoKey
+      geographic = key[3];
+    else if (key[0] == 3072) // ProjectedCSTypeGeoKey
+      projected = key[3];
+  }
+  if (projected >= 32767) projected = 0;
+  if (geographic >= 32767) geographic = 0;
+  if (model == 1)
+    return projected;
+  if (model == 2)
+    return geographic;
+  return (model == 0) ? (projected != 0 ? projected : geographic) : 0;
+}
+
+// Fills info from an open dataset
+static void readInfo(GDALDataset *poDataset, GeotiffInfo &info, bool withWKT){
+  info.cols  = poDataset->GetRasterXSize();
+  info.rows  = poDataset->GetRasterYSize();
+  info.bands = poDataset->GetRasterCount();
+  info.hasGeoTransform = (poDataset->GetGeoTransform(info.geotransform) == CE_None);
+  if (!info.hasGeoTransform){
+    double identity[6] = {0, 1, 0, 0, 0, 1};
+    memcpy(info.geotransform, identity, sizeof(identity));
+  }
+  if (info.bands > 0){
+    GDALRasterBand *poBand = poDataset->GetRasterBand(1);
+    info.dataType = poBand->GetRasterDataType();
+    poBand->GetBlockSize(&info.blockXSize, &info.blockYSize);
+    int bGotNoData = FALSE;
+    info.noData = poBand->GetNoDataValue(&bGotNoData);
+    info.hasNoData = (bGotNoData != FALSE);
+  }
+  // the EPSG code comes from the GeoKeys (readGeoKeyEPSG): GetProjectionRef() / GetSpatialRef() make the
+  // driver build the OGR SRS of the file, and are only called when the WKT is requested
+  if (!withWKT)
+    return;
+  const char *pszWKT = poDataset->GetProjectionRef();
+  if (pszWKT != NULL)
+    info.wkt = pszWKT;
+  if (info.epsg == 0) // e.g. SRS from a .aux.xml sidecar
+    info.epsg = GeotiffParseEPSG(pszWKT);
+}
+
+// Opens path with the GTiff driver only. siblings: listing of its directory (NULL: GDAL lists it)
+static bool openInfo(const char *path, GeotiffInfo &info, bool withWKT, char **siblings){
+  static const char *const allowedDrivers[] = {"GTiff", NULL};
+  CPLPushErrorHandler(CPLQuietErrorHandler);
+  GDALDataset *poDataset = (GDALDataset *) GDALOpenEx(path, GDAL_OF_RASTER | GDAL_OF_READONLY, allowedDrivers, NULL, siblings);
+  CPLPopErrorHandler();
+  if (poDataset == NULL)
+    return false;
+  info.filename = path;
+  info.epsg = readGeoKeyEPSG(path);
+  readInfo(poDataset, info, withWKT);
+  GDALClose(poDataset);
+  return true;
+}
+
+bool GeotiffReadInfo(const char *filename, GeotiffInfo &info, bool withWKT){
+  GeotiffRegisterDrivers();
+  info = GeotiffInfo();
+  if (filename == NULL)
+    return false;
+  return openInfo(filename, info, withWKT, NULL);
+}
+
+static bool isTiffName(const std::string &name){
+  size_t dot = name.rfind('.');
+  if (dot == std::string::npos)
+    return false;
+  std::string ext = name.substr(dot + 1);
+  return EQUAL(ext.c_str(), "tif") || EQUAL(ext.c_str(), "tiff");
+}
+
+/**
+ * @brief Reads the metadata of every GeoTIFF of a directory, in parallel
+ * @details The directory (tree) is listed once on the calling thread. Files are grouped by
+ * directory, and each open gets the listing of its own directory as GDAL sibling files, which
+ * prevents GDAL from listing the directory again for every file (the dominant cost in directories
+ * with thousands of tiles). Worker threads take files from a shared atomic counter
+ *
+ * @param directory directory to scan
+ * @param recursive also scan the subdirectories
+ * @param nThreads worker threads (<= 0: one per CPU core)
+ * @param withWKT keep the SRS WKT of every file (larger index)
+ * @param failed optional output: files with a GeoTIFF extension that could not be read
+ * @return std::vector<GeotiffInfo> index, sorted by file name
+ */
+std::vector<GeotiffInfo> GeotiffScanDirectory(const char *directory, bool recursive, int nThreads, bool withWKT,
+                                              std::vector<std::string> *failed){
+  GeotiffRegisterDrivers();
+  std::vector<GeotiffInfo> index;
+  if (directory == NULL)
+    return index;
+
+  char **papszEntries = recursive ? VSIReadDirRecursive(directory) : VSIReadDir(directory);
+  if (papszEntries == NULL){
+    cout << "[GeotiffScanDirectory] Error: Unable to list directory " << directory << endl;
+    return index;
+  }
+  // sibling listing of every directory: entry names relative to their own directory
+  std::map<std::string, std::vector<std::string> > listings;
+  std::vector<std::pair<std::string, std::string> > files; // (directory, file name)
+  for (int i=0; papszEntries[i] != NULL; i++){
+    std::string entry = papszEntries[i];
+    size_t slash = entry.find_last_of("/\\");
+    std::string subdir = (slash == std::string::npos) ? "" : entry.substr(0, slash);
+    std::string name = (slash == std::string::npos) ? entry : entry.substr(slash + 1);
+    if (name.empty())
+      continue;
+    listings[subdir].push_back(name);
+    if (isTiffName(name))
+      files.push_back(std::make_pair(subdir, name));
+  }
+  CSLDestroy(papszEntries);
+  std::sort(files.begin(), files.end());
+
+  // NULL terminated string lists, as GDALOpenEx expects them
+  std::map<std::string, std::vector<char *> > siblings;
+  for (std::map<std::string, std::vector<std::string> >::iterator it = listings.begin(); it != listings.end(); ++it){
+    std::vector<char *> &list = siblings[it->first];
+    for (size_t i=0; i<it->second.size(); i++)
+      list.push_back(const_cast<char *>(it->second[i].c_str()));
+    list.push_back(NULL);
+  }
+
+  std::vector<GeotiffInfo> infos(files.size());
+  std::vector<char> bRead(files.size(), 0);
+  if (nThreads <= 0)
+    nThreads = max(1, (int)std::thread::hardware_concurrency());
+  nThreads = (int) min((size_t)nThreads, max((size_t)1, files.size()));
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (int t=0; t<nThreads; t++){
+    workers.push_back(std::thread([&](){
+      size_t i;
+      while ((i = next++) < files.size()){
+        std::string dir = files[i].first.empty() ? std::string(directory) : std::string(directory) + "/" + files[i].first;
+        std::string path = dir + "/" + files[i].second;
+        bRead[i] = openInfo(path.c_str(), infos[i], withWKT, &siblings.find(files[i].first)->second[0]);
+      }
+    }));
+  }
+  for (size_t t=0; t<workers.size(); t++)
+    workers[t].join();
+
+  index.reserve(files.size());
+  for (size_t i=0; i<files.size(); i++){
+    if (bRead[i])
+      index.push_back(std::move(infos[i]));
+    else if (failed != NULL)
+      failed->push_back(std::string(directory) + "/" + (files[i].first.empty() ? "" : files[i].first + "/") + files[i].second);
+  }
+  return index;
+}
@@ -0,0 +1,155 @@
+/**
+ * @file geotiff_mmap.cpp
+ * @brief Zero-copy, memory mapped access to the bands of uncompressed GeoTIFF files
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_mmap.hpp>
+#include <geotiff.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cpl_string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+GeotiffMappedFile::GeotiffMappedFile(const char *filename) : address(NULL), length(0) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat sStat;
+  if (fstat(fd, &sStat) == 0 && sStat.st_size > 0){
+    void *p = mmap(NULL, (size_t)sStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED){
+      address = (const unsigned char *) p;
+      length = (size_t)sStat.st_size;
+    }
+  }
+  close(fd); // the mapping keeps its own reference to the file
+}
+
+GeotiffMappedFile::~GeotiffMappedFile(){
+  if (address != NULL)
+    munmap((void *) address, length);
+}
+
+template<typename T>
+GeotiffMappedBand<T>::GeotiffMappedBand() :
+  nCols(0), nRows(0), nBlockXSize(1), nBlockYSize(1), nBlocksX(0), lineSpace(0), pixelSpace(1) {}
+
+template<typename T>
+GeotiffMappedBand<T>::GeotiffMappedBand(Geotiff &geotiff, int band) :
+  nCols(0), nRows(0), nBlockXSize(1), nBlockYSize(1), nBlocksX(0), lineSpace(0), pixelSpace(1) {
+  if (!geotiff.isValid())
+    return;
+  if (Map(geotiff.GetDataset(), geotiff.GetFileName(), band))
+    return;
+
+  // not mappable: serve a regular (converting) read of the band through the same interface
+  file.reset();
+  blocks.clear();
+  fallback = geotiff.Read<T>(band);
+  if (fallback.isEmpty())
+    return;
+  nCols = nBlockXSize = fallback.GetCols();
+  nRows = nBlockYSize = fallback.GetRows();
+  nBlocksX = 1;
+  lineSpace = fallback.GetStride();
+  pixelSpace = 1;
+  blocks.push_back(fallback.GetData());
+}
+
+/**
+ * @brief Locates every block of the band inside a mapping of the file
+ * @details Only the layouts where the file bytes are exactly the pixels of T are accepted:
+ * GTiff driver, no compression, full-width samples (no NBITS), native type T, host byte order,
+ * blocks present (not sparse), complete and aligned to sizeof(T)
+ *
+ * @return true if the whole band is mapped
+ */
+template<typename T>
+bool GeotiffMappedBand<T>::Map(GDALDataset *dataset, const char *filename, int band){
+  if (dataset == NULL || filename == NULL || band < 1 || band > dataset->GetRasterCount())
+    return false;
+  GDALDriver *poDriver = dataset->GetDriver();
+  if (poDriver == NULL || !EQUAL(poDriver->GetDescription(), "GTiff"))
+    return false;
+  GDALRasterBand *poBand = dataset->GetRasterBand(band);
+  if (poBand->GetRasterDataType() != GDALTypeOf<T>::type)
+    return false;
+  const char *pszCompression = dataset->GetMetadataItem("COMPRESSION", "IMAGE_STRUCTURE");
+  if (pszCompression != NULL && !EQUAL(pszCompression, "NONE"))
+    return false;
+  const char *pszNBits = poBand->GetMetadataItem("NBITS", "IMAGE_STRUCTURE");
+  if (pszNBits != NULL && atoi(pszNBits) != (int)(8*sizeof(T)))
+    return false;
+  const char *pszInterleave = dataset->GetMetadataItem("INTERLEAVE", "IMAGE_STRUCTURE");
+  bool bPixelInterleaved = dataset->GetRasterCount() > 1 && pszInterleave != NULL && EQUAL(pszInterleave, "PIXEL");
+
+  std::shared_ptr<GeotiffMappedFile> mapping(new GeotiffMappedFile(filename));
+  if (!mapping->isValid() || mapping->GetLength() < 8)
+    return false;
+  const unsigned char *base = mapping->GetAddress();
+  bool bFileLittleEndian = (base[0] == 'I' && base[1] == 'I');
+  if (!bFileLittleEndian && !(base[0] == 'M' && base[1] == 'M'))
+    return false;
+  unsigned short one = 1;
+  bool bHostLittleEndian = (*(unsigned char *)&one == 1);
+  if (sizeof(T) > 1 && bFileLittleEndian != bHostLittleEndian)
+    return false;
+
+  int bx, by;
+  poBand->GetBlockSize(&bx, &by);
+  int cols = poBand->GetXSize(), rows = poBand->GetYSize();
+  int blocksX = (cols + bx - 1) / bx, blocksY = (rows + by - 1) / by;
+  size_t samples = bPixelInterleaved ? (size_t)dataset->GetRasterCount() : 1;
+
+  std::vector<const T *> blockTable;
+  blockTable.reserve((size_t)blocksX * blocksY);
+  char szKey[64];
+  for (int y=0; y<blocksY; y++){
+    // bottom strips are shorter; tiles are always stored full size
+    size_t blockRows = min(by, rows - y*by);
+    size_t needed = ((blockRows - 1) * bx + (size_t)min(bx, cols)) * samples * sizeof(T);
+    for (int x=0; x<blocksX; x++){
+      snprintf(szKey, sizeof(szKey), "BLOCK_OFFSET_%d_%d", x, y);
+      const char *pszOffset = poBand->GetMetadataItem(szKey, "TIFF");
+      snprintf(szKey, sizeof(szKey), "BLOCK_SIZE_%d_%d", x, y);
+      const char *pszSize = poBand->GetMetadataItem(szKey, "TIFF");
+      if (pszOffset == NULL || pszSize == NULL)
+        return false;
+      unsigned long long offset = strtoull(pszOffset, NULL, 10);
+      unsigned long long size = strtoull(pszSize, NULL, 10);
+      if (offset == 0 || size < needed || offset + needed > mapping->GetLength() || offset % sizeof(T) != 0)
+        return false; // sparse, truncated or misaligned block
+      const T *block = (const T *)(base + offset);
+      blockTable.push_back(bPixelInterleaved ? block + (band - 1) : block);
+    }
+  }
+
+  file = mapping;
+  blocks.swap(blockTable);
+  nCols = cols;
+  nRows = rows;
+  nBlockXSize = bx;
+  nBlockYSize = by;
+  nBlocksX = blocksX;
+  pixelSpace = samples;
+  lineSpace = (size_t)bx * samples;
+  return true;
+}
+
+// explicit instantiations for the supported pixel types
+template class GeotiffMappedBand<unsigned char>;
+template class GeotiffMappedBand<unsigned short>;
+template class GeotiffMappedBand<short>;
+template class GeotiffMappedBand<unsigned int>;
+template class GeotiffMappedBand<int>;
+template class GeotiffMappedBand<float>;
+template class GeotiffMappedBand<double>;
@@ -0,0 +1,511 @@
+/**
+ * @file geotiff_mosaic.cpp
+ * @brief Mosaic of many GeoTIFF tiles: packed R-tree of footprints, seamless window reads, serializable index
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_mosaic.hpp>
+#include <geotiff.hpp>
+#include <geotiff_view.hpp>
+#include <geotiff_counters.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <climits>
+#include <new>
+#include <cmath>
+#include <algorithm>
+#include <cpl_conv.h>
+#include <cpl_string.h>
+
+using namespace std;
+
+#define GEOTIFF_MOSAIC_MAGIC "GEOTIFF_MOSAIC"
+#define GEOTIFF_MOSAIC_VERSION 1
+
+GeotiffMosaic::GeotiffMosaic() :
+  overlap(MOSAIC_FIRST), resX(1), resY(1), originX(0), originY(0) {}
+
+GeotiffMosaic::~GeotiffMosaic(){
+  while (!handleLru.empty())
+    CloseTile(handleLru.back());
+}
+
+bool GeotiffMosaic::Build(const std::vector<GeotiffInfo> &index){
+  while (!handleLru.empty())
+    CloseTile(handleLru.back()); // tile indices are about to change
+  tiles.clear();
+  int epsg = -1;
+  for (size_t i=0; i<index.size(); i++){
+    const GeotiffInfo &info = index[i];
+    const double *gt = info.geotransform;
+    if (!info.isValid() || gt[1] == 0 || gt[5] == 0 || gt[2] != 0 || gt[4] != 0){
+      cout << "[GeotiffMosaic] Skipping " << info.filename << ": empty raster or rotated geotransform" << endl;
+      continue;
+    }
+    if (epsg < 0)
+      epsg = info.epsg;
+    else if (info.epsg != epsg){
+      cout << "[GeotiffMosaic] Skipping " << info.filename << ": EPSG " << info.epsg << " differs from the mosaic EPSG " << epsg << endl;
+      continue;
+    }
+    tiles.push_back(info);
+  }
+  if (tiles.empty()){
+    cout << "[GeotiffMosaic] Error: no tile could be indexed" << endl;
+    BuildTree();
+    return false;
+  }
+  const double *gt = tiles[0].geotransform;
+  resX = fabs(gt[1]);
+  resY = fabs(gt[5]);
+  originX = gt[1] > 0 ? gt[0] : gt[0] + gt[1]*tiles[0].cols;
+  originY = gt[5] < 0 ? gt[3] : gt[3] + gt[5]*tiles[0].rows;
+  BuildTree();
+  return true;
+}
+
+bool GeotiffMosaic::BuildFromDirectory(const char *directory, bool recursive, int nThreads){
+  return Build(GeotiffScanDirectory(directory, recursive, nThreads));
+}
+
+void GeotiffMosaic::SetResolution(double pixelX, double pixelY){
+  if (pixelX == 0 || pixelY == 0)
+    return;
+  resX = fabs(pixelX);
+  resY = fabs(pixelY);
+}
+
+// Sort-Tile-Recursive order of boxes (4 doubles each): vertical slices by center X, then by center Y inside each slice
+static std::vector<int> strOrder(const std::vector<double> &boxes){
+  int n = (int)(boxes.size() / 4);
+  std::vector<int> idx(n);
+  for (int i=0; i<n; i++)
+    idx[i] = i;
+  int nGroups = (n + GEOTIFF_MOSAIC_NODE_SIZE - 1) / GEOTIFF_MOSAIC_NODE_SIZE;
+  int nSlices = (int)ceil(sqrt((double)nGroups));
+  size_t sliceSize = (size_t)nSlices * GEOTIFF_MOSAIC_NODE_SIZE;
+  std::sort(idx.begin(), idx.end(), [&](int a, int b){
+    return boxes[4*a] + boxes[4*a+2] < boxes[4*b] + boxes[4*b+2];
+  });
+  for (size_t s=0; s<idx.size(); s+=sliceSize){
+    std::vector<int>::iterator last = idx.begin() + min(idx.size(), s + sliceSize);
+    std::sort(idx.begin() + s, last, [&](int a, int b){
+      return boxes[4*a+1] + boxes[4*a+3] < boxes[4*b+1] + boxes[4*b+3];
+    });
+  }
+  return idx;
+}
+
+/**
+ * @brief Bulk-loads the packed R-tree over the tile footprints (Sort-Tile-Recursive)
+ * @details Leaves group up to GEOTIFF_MOSAIC_NODE_SIZE tiles; every upper level groups the nodes of the
+ * level below, sorted the same way, so the children of a node are always contiguous. The tree is static:
+ * it is rebuilt whenever the tile set changes
+ */
+void GeotiffMosaic::BuildTree(){
+  extents.assign(tiles.size()*4, 0);
+  for (size_t i=0; i<tiles.size(); i++)
+    tiles[i].GetExtent(&extents[4*i]);
+  nodes.clear();
+  order = strOrder(extents);
+
+  std::vector<Node> level;
+  for (size_t first=0; first<order.size(); first+=GEOTIFF_MOSAIC_NODE_SIZE){
+    Node node;
+    node.first = (int)first;
+    node.count = (int)min((size_t)GEOTIFF_MOSAIC_NODE_SIZE, order.size() - first);
+    node.leaf = true;
+    for (int k=0; k<node.count; k++){
+      const double *e = &extents[4*order[first + k]];
+      for (int j=0; j<4; j++)
+        node.box[j] = (k == 0) ? e[j] : (j < 2 ? min(node.box[j], e[j]) : max(node.box[j], e[j]));
+    }
+    level.push_back(node);
+  }
+  while (level.size() > 1){
+    std::vector<double> boxes(level.size()*4);
+    for (size_t i=0; i<level.size(); i++)
+      std::copy(level[i].box, level[i].box + 4, &boxes[4*i]);
+    std::vector<int> idx = strOrder(boxes);
+    size_t base = nodes.size();
+    for (size_t i=0; i<idx.size(); i++)
+      nodes.push_back(level[idx[i]]);
+
+    std::vector<Node> parents;
+    for (size_t first=0; first<idx.size(); first+=GEOTIFF_MOSAIC_NODE_SIZE){
+      Node node;
+      node.first = (int)(base + first);
+      node.count = (int)min((size_t)GEOTIFF_MOSAIC_NODE_SIZE, idx.size() - first);
+      node.leaf = false;
+      for (int k=0; k<node.count; k++){
+        const double *e = nodes[node.first + k].box;
+        for (int j=0; j<4; j++)
+          node.box[j] = (k == 0) ? e[j] : (j < 2 ? min(node.box[j], e[j]) : max(node.box[j], e[j]));
+      }
+      parents.push_back(node);
+    }
+    level.swap(parents);
+  }
+  if (!level.empty())
+    nodes.push_back(level[0]);
+}
+
+void GeotiffMosaic::Search(double minX, double minY, double maxX, double maxY, std::vector<int> &result) const {
+  result.clear();
+  if (nodes.empty())
+    return;
+  std::vector<int> stack(1, (int)nodes.size() - 1);
+  while (!stack.empty()){
+    const Node &node = nodes[stack.back()];
+    stack.pop_back();
+    if (node.box[0] > maxX || node.box[2] < minX || node.box[1] > maxY || node.box[3] < minY)
+      continue;
+    for (int k=0; k<node.count; k++){
+      if (!node.leaf){
+        stack.push_back(node.first + k);
+        continue;
+      }
+      int tile = order[node.first + k];
+      const double *e = &extents[4*tile];
+      if (e[0] <= maxX && e[2] >= minX && e[1] <= maxY && e[3] >= minY)
+        result.push_back(tile);
+    }
+  }
+  std::sort(result.begin(), result.end()); // index order, for the overlap rules
+}
+
+std::vector<int> GeotiffMosaic::Query(double minX, double minY, double maxX, double maxY) const {
+  std::vector<int> result;
+  Search(min(minX, maxX), min(minY, maxY), max(minX, maxX), max(minY, maxY), result);
+  return result;
+}
+
+std::vector<int> GeotiffMosaic::Query(double x, double y) const {
+  std::vector<int> result, candidates;
+  Search(x, y, x, y, candidates);
+  // footprints are half-open: a point on a shared edge belongs to one tile only
+  for (size_t i=0; i<candidates.size(); i++){
+    const double *e = &extents[4*candidates[i]];
+    if (x >= e[0] && x < e[2] && y > e[1] && y <= e[3])
+      result.push_back(candidates[i]);
+  }
+  return result;
+}
+
+// Nearest tile pixel along one axis of an output pixel center (-1: outside the tile). Read and Sample share it
+static int nearestPixel(double center, double origin, double pixelSize, int size){
+  double p = floor((center - origin) / pixelSize);
+  return (p >= 0 && p < size) ? (int)p : -1;
+}
+
+/**
+ * @brief Returns the open handle of a tile, opening it (and closing the least recently used one) if needed
+ * @return TileHandle* handle, NULL if the tile cannot be opened
+ */
+GeotiffMosaic::TileHandle *GeotiffMosaic::OpenTile(int tile){
+  std::unordered_map<int, TileHandle>::iterator it = handles.find(tile);
+  if (it != handles.end()){
+    handleLru.splice(handleLru.begin(), handleLru, it->second.lruPosition);
+    return &it->second;
+  }
+  Geotiff *geotiff = new Geotiff(tiles[tile].filename.c_str());
+  if (!geotiff->isValid()){
+    delete geotiff;
+    return NULL;
+  }
+  while (handles.size() >= GEOTIFF_MOSAIC_MAX_OPEN_TILES)
+    CloseTile(handleLru.back());
+  handleLru.push_front(tile);
+  TileHandle &handle = handles[tile];
+  handle.geotiff = geotiff;
+  handle.view = NULL;
+  handle.viewBand = 0;
+  handle.viewMasked = false;
+  handle.hasNoData = false;
+  handle.noData = 0;
+  handle.lruPosition = handleLru.begin();
+  return &handle;
+}
+
+void GeotiffMosaic::CloseTile(int tile){
+  std::unordered_map<int, TileHandle>::iterator it = handles.find(tile);
+  if (it == handles.end())
+    return;
+  delete it->second.view;      // the view points into the dataset: released first
+  delete it->second.geotiff;
+  handleLru.erase(it->second.lruPosition);
+  handles.erase(it);
+}
+
+/**
+ * @brief Reads a band of the mosaic over a georeferenced box, as a single seamless raster
+ * @details The box is snapped outwards to the output pixel grid. For every intersecting tile, the output
+ * pixels it covers are mapped (nearest, separable as tiles are north-up) to its pixels, and only the window
+ * spanned by those pixels is read, as float with nodata as NaN (Geotiff::ReadWindowMasked). Tiles stay open
+ * between calls (up to GEOTIFF_MOSAIC_MAX_OPEN_TILES), so tiles shared by consecutive queries are not reopened
+ *
+ * @param band 1-indexed band number
+ * @param minX, minY, maxX, maxY bounding box, in the tiles georeferenced coordinates
+ * @param geotransform optional 6-element array where the geotransform of the result is returned
+ * @return Raster<float> mosaic (NaN where no tile has data), empty if the box is invalid or too large
+ */
+Raster<float> GeotiffMosaic::Read(int band, double minX, double minY, double maxX, double maxY, double *geotransform){
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_MOSAIC);
+  if (tiles.empty() || band < 1 || !(maxX > minX) || !(maxY > minY)){
+    cout << "[GeotiffMosaic] Error: empty mosaic, invalid band or invalid box" << endl;
+    return Raster<float>();
+  }
+  double x0 = originX + floor((minX - originX) / resX) * resX;
+  double y0 = originY + ceil((maxY - originY) / resY) * resY;   // top edge
+  double dCols = ceil((maxX - x0) / resX - 1e-9);
+  double dRows = ceil((y0 - minY) / resY - 1e-9);
+  if (!(dCols >= 1 && dRows >= 1))
+    return Raster<float>();
+  if (dCols > INT_MAX || dRows > INT_MAX || dCols*dRows > GEOTIFF_MOSAIC_MAX_PIXELS){
+    cout << "[GeotiffMosaic] Error: box of " << dCols << " x " << dRows << " pixels exceeds the read limit of "
+         << (double)GEOTIFF_MOSAIC_MAX_PIXELS << " pixels" << endl;
+    return Raster<float>();
+  }
+  int cols = (int)dCols;
+  int rows = (int)dRows;
+
+  Raster<float> output, sum;
+  Raster<unsigned short> count;
+  try {
+    output = Raster<float>(cols, rows);
+    if (overlap == MOSAIC_MEAN){
+      sum = Raster<float>(cols, rows);
+      count = Raster<unsigned short>(cols, rows);
+    }
+  } catch (const std::bad_alloc &){
+    cout << "[GeotiffMosaic] Error: out of memory for a " << cols << " x " << rows << " mosaic read" << endl;
+    return Raster<float>();
+  }
+  if (geotransform != NULL){
+    double gt[6] = {x0, resX, 0, y0, 0, -resY};
+    std::copy(gt, gt + 6, geotransform);
+  }
+  const float fNaN = std::numeric_limits<float>::quiet_NaN();
+  for (int r=0; r<rows; r++)
+    std::fill(output.GetRow(r), output.GetRow(r) + cols, fNaN);
+  if (overlap == MOSAIC_MEAN){
+    for (int r=0; r<rows; r++){
+      std::fill(sum.GetRow(r), sum.GetRow(r) + cols, 0.0f);
+      std::fill(count.GetRow(r), count.GetRow(r) + cols, (unsigned short)0);
+    }
+  }
+
+  std::vector<int> hits;
+  Search(x0, y0 - rows*resY, x0 + cols*resX, y0, hits);
+  std::vector<int> srcCol(cols), srcRow(rows);
+  for (size_t h=0; h<hits.size(); h++){
+    const GeotiffInfo &tile = tiles[hits[h]];
+    if (band > tile.bands)
+      continue;
+    const double *gt = tile.geotransform;
+    // nearest tile pixel of every output column / row center (-1: outside the tile)
+    int wx0 = tile.cols, wx1 = -1, wy0 = tile.rows, wy1 = -1;
+    for (int c=0; c<cols; c++){
+      srcCol[c] = nearestPixel(x0 + (c + 0.5)*resX, gt[0], gt[1], tile.cols);
+      if (srcCol[c] >= 0){
+        wx0 = min(wx0, srcCol[c]);
+        wx1 = max(wx1, srcCol[c]);
+      }
+    }
+    for (int r=0; r<rows; r++){
+      srcRow[r] = nearestPixel(y0 - (r + 0.5)*resY, gt[3], gt[5], tile.rows);
+      if (srcRow[r] >= 0){
+        wy0 = min(wy0, srcRow[r]);
+        wy1 = max(wy1, srcRow[r]);
+      }
+    }
+    if (wx1 < wx0 || wy1 < wy0)
+      continue; // the footprint only touches the box
+
+    TileHandle *handle = OpenTile(hits[h]);
+    if (handle == NULL)
+      continue;
+    Raster<float> window = handle->geotiff->ReadWindowMasked(band, wx0, wy0, wx1 - wx0 + 1, wy1 - wy0 + 1);
+    if (window.isEmpty())
+      continue;
+
+    for (int r=0; r<rows; r++){
+      if (srcRow[r] < 0)
+        continue;
+      const float *src = window.GetRow(srcRow[r] - wy0);
+      float *dst = output.GetRow(r);
+      for (int c=0; c<cols; c++){
+        if (srcCol[c] < 0)
+          continue;
+        float v = src[srcCol[c] - wx0];
+        if (v != v)
+          continue;
+        if (overlap == MOSAIC_MEAN){
+          sum(c, r) += v;
+          count(c, r)++;
+        }
+        else if (overlap == MOSAIC_LAST || dst[c] != dst[c])
+          dst[c] = v;
+      }
+    }
+  }
+
+  if (overlap == MOSAIC_MEAN){
+    for (int r=0; r<rows; r++)
+      for (int c=0; c<cols; c++)
+        if (count(c, r) > 0)
+          output(c, r) = sum(c, r) / count(c, r);
+  }
+  return output;
+}
+
+/**
+ * @brief Value of a tile pixel, as ReadWindowMasked would return it (nodata and masked pixels as NaN)
+ * @details Pixels come from a GeotiffView block cache kept with the open tile, compared against the band
+ * nodata. Bands with a real mask band (not derived from nodata) are read through ReadWindowMasked instead
+ */
+float GeotiffMosaic::TileValue(int tile, int band, int col, int row){
+  const float fNaN = std::numeric_limits<float>::quiet_NaN();
+  TileHandle *handle = OpenTile(tile);
+  if (handle == NULL || band > handle->geotiff->GetDataset()->GetRasterCount())
+    return fNaN;
+  if (handle->viewBand != band){
+    delete handle->view;
+    handle->view = new GeotiffView(*handle->geotiff, band, GEOTIFF_MOSAIC_VIEW_CACHE);
+    handle->viewBand = band;
+    GDALRasterBand *poBand = handle->geotiff->GetDataset()->GetRasterBand(band);
+    handle->viewMasked = (poBand->GetMaskFlags() & (GMF_ALL_VALID | GMF_NODATA)) == 0;
+    RasterBandInfo info = handle->geotiff->GetBandInfo(band);
+    handle->hasNoData = info.hasNoData;
+    handle->noData = (float)info.noData;
+  }
+  if (handle->viewMasked){
+    Raster<float> pixel = handle->geotiff->ReadWindowMasked(band, col, row, 1, 1);
+    return pixel.isEmpty() ? fNaN : pixel(0, 0);
+  }
+  float value = handle->view->GetPixel(col, row);
+  return (handle->hasNoData && value == handle->noData) ? fNaN : value;
+}
+
+/**
+ * @brief Value of the mosaic at a point: the output pixel containing it is resolved exactly as in Read
+ * @details The point is snapped to the center of its output pixel (left and top edges belong to the pixel, as
+ * in Query), which is mapped to every tile with the same nearest rule as Read, and the tile values are
+ * combined with the overlap rule
+ *
+ * @param hits scratch vector for the R-tree search (reused across the points of a batch)
+ */
+float GeotiffMosaic::SamplePoint(int band, double x, double y, std::vector<int> &hits){
+  float value = std::numeric_limits<float>::quiet_NaN();
+  if (band < 1 || !(x == x) || !(y == y))
+    return value;
+  double cx = originX + (floor((x - originX) / resX) + 0.5) * resX;
+  double cy = originY - (floor((originY - y) / resY) + 0.5) * resY;
+  Search(cx, cy, cx, cy, hits);
+  float sum = 0; // accumulated in float, as Read does
+  int n = 0;
+  for (size_t h=0; h<hits.size(); h++){
+    const GeotiffInfo &tile = tiles[hits[h]];
+    if (band > tile.bands)
+      continue;
+    const double *gt = tile.geotransform;
+    int col = nearestPixel(cx, gt[0], gt[1], tile.cols);
+    int row = nearestPixel(cy, gt[3], gt[5], tile.rows);
+    if (col < 0 || row < 0)
+      continue;
+    float v = TileValue(hits[h], band, col, row);
+    if (v != v)
+      continue;
+    if (overlap == MOSAIC_FIRST)
+      return v;
+    value = v;
+    sum += v;
+    n++;
+  }
+  if (overlap == MOSAIC_MEAN && n > 0)
+    value = sum / n;
+  return value;
+}
+
+float GeotiffMosaic::Sample(int band, double x, double y){
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_MOSAIC);
+  std::vector<int> hits;
+  return SamplePoint(band, x, y, hits);
+}
+
+size_t GeotiffMosaic::Sample(int band, const double *x, const double *y, size_t n, float *values){
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_MOSAIC);
+  std::vector<int> hits;
+  size_t nValid = 0;
+  for (size_t i=0; i<n; i++){
+    values[i] = SamplePoint(band, x[i], y[i], hits);
+    if (values[i] == values[i])
+      nValid++;
+  }
+  return nValid;
+}
+
+/**
+ * @brief Writes the tile index as text: a header line, then one line per tile with the file name last
+ * @details Doubles are written with 17 significant digits, so geotransforms round-trip exactly
+ */
+bool GeotiffMosaic::Save(const char *filename) const {
+  ofstream out(filename);
+  if (!out){
+    cout << "[GeotiffMosaic] Error: Unable to write " << filename << endl;
+    return false;
+  }
+  out << GEOTIFF_MOSAIC_MAGIC << " " << GEOTIFF_MOSAIC_VERSION << " " << tiles.size() << "\n";
+  for (size_t i=0; i<tiles.size(); i++){
+    const GeotiffInfo &t = tiles[i];
+    out << t.cols << " " << t.rows << " " << t.bands << " " << (int)t.dataType << " "
+        << t.blockXSize << " " << t.blockYSize << " " << (t.hasGeoTransform ? 1 : 0);
+    for (int j=0; j<6; j++)
+      out << " " << CPLSPrintf("%.17g", t.geotransform[j]);
+    out << " " << (t.hasNoData ? 1 : 0) << " " << CPLSPrintf("%.17g", t.noData) << " " << t.epsg << " " << t.filename << "\n";
+  }
+  out.close();
+  return !out.fail();
+}
+
+bool GeotiffMosaic::Load(const char *filename){
+  ifstream in(filename);
+  std::string magic;
+  int version = 0;
+  size_t nTiles = 0;
+  if (!(in >> magic >> version >> nTiles) || magic != GEOTIFF_MOSAIC_MAGIC || version != GEOTIFF_MOSAIC_VERSION){
+    cout << "[GeotiffMosaic] Error: " << filename << " is not a mosaic index" << endl;
+    return false;
+  }
+  in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  std::vector<GeotiffInfo> index(nTiles);
+  for (size_t i=0; i<nTiles; i++){
+    std::string line;
+    if (!getline(in, line)){
+      cout << "[GeotiffMosaic] Error: " << filename << " is truncated" << endl;
+      return false;
+    }
+    istringstream fields(line);
+    GeotiffInfo &t = index[i];
+    int dataType, hasGT, hasNoData;
+    std::string value; // doubles are parsed with CPLAtof, which also reads nan / inf
+    fields >> t.cols >> t.rows >> t.bands >> dataType >> t.blockXSize >> t.blockYSize >> hasGT;
+    for (int j=0; j<6 && (fields >> value); j++)
+      t.geotransform[j] = CPLAtof(value.c_str());
+    fields >> hasNoData >> value >> t.epsg;
+    t.noData = CPLAtof(value.c_str());
+    fields.get(); // separator before the file name, which may contain spaces
+    getline(fields, t.filename);
+    if (fields.bad() || t.filename.empty()){
+      cout << "[GeotiffMosaic] Error: invalid line " << i + 2 << " in " << filename << endl;
+      return false;
+    }
+    t.dataType = (GDALDataType)dataType;
+    t.hasGeoTransform = (hasGT != 0);
+    t.hasNoData = (hasNoData != 0);
+  }
+  return Build(index);
+}
@@ -0,0 +1,149 @@
+/**
+ * @file geotiff_opencv.cpp
+ * @brief Zero-copy reads into / writes from OpenCV cv::Mat
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_opencv.hpp>
+#include <geotiff.hpp>
+#include <geotiff_counters.hpp>
+
+#include <iostream>
+
+using namespace std;
+
+int GeotiffCvDepth(GDALDataType dataType){
+  switch (dataType){
+    case GDT_Byte:    return CV_8U;
+    case GDT_UInt16:  return CV_16U;
+    case GDT_Int16:   return CV_16S;
+    case GDT_Int32:   return CV_32S;
+    case GDT_UInt32:  return CV_64F;
+    case GDT_Float32: return CV_32F;
+    case GDT_Float64: return CV_64F;
+#if GDAL_VERSION_NUM >= 3070000
+    case GDT_Int8:    return CV_8S;
+#endif
+    default:          return -1;
+  }
+}
+
+GDALDataType GeotiffGDALType(int cvDepth){
+  switch (cvDepth){
+    case CV_8U:  return GDT_Byte;
+    case CV_16U: return GDT_UInt16;
+    case CV_16S: return GDT_Int16;
+    case CV_32S: return GDT_Int32;
+    case CV_32F: return GDT_Float32;
+    case CV_64F: return GDT_Float64;
+#if GDAL_VERSION_NUM >= 3070000
+    case CV_8S:  return GDT_Int8;
+#endif
+    default:     return GDT_Unknown;
+  }
+}
+
+bool GeotiffReadMat(Geotiff &geotiff, int band, cv::Mat &mat){
+  int dim[3];
+  geotiff.GetDimensions(dim);
+  return GeotiffReadMatWindow(geotiff, band, 0, 0, dim[0], dim[1], mat);
+}
+
+bool GeotiffReadMatWindow(Geotiff &geotiff, int band, int xOff, int yOff, int xSize, int ySize, cv::Mat &mat){
+  return GeotiffReadMatBands(geotiff, std::vector<int>(1, band), xOff, yOff, xSize, ySize, mat);
+}
+
+/**
+ * @brief Reads a window of one or more bands straight into a cv::Mat
+ * @details A single GDALDataset::RasterIO call, with the pixel, line and band spacing of the Mat: GDAL
+ * unpacks every block into its final position (converting to the Mat depth if needed), interleaving the
+ * bands as the Mat channels. No Raster or float** is allocated on the way
+ *
+ * @param geotiff source dataset
+ * @param bands 1-indexed band numbers, one per Mat channel
+ * @param xOff, yOff, xSize, ySize window, in pixels (inside the raster)
+ * @param mat output. Kept (buffer and depth) if it already has the window size and band count
+ * @return true if the window was read
+ */
+bool GeotiffReadMatBands(Geotiff &geotiff, const std::vector<int> &bands, int xOff, int yOff, int xSize, int ySize, cv::Mat &mat){
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_READ_WINDOW);
+  GDALDataset *poDataset = geotiff.GetDataset();
+  if (poDataset == NULL)
+    return false;
+  int dim[3];
+  geotiff.GetDimensions(dim);
+  int nChannels = (int)bands.size();
+  if (nChannels < 1 || nChannels > CV_CN_MAX || xOff < 0 || yOff < 0 || xSize <= 0 || ySize <= 0
+      || xOff + xSize > dim[0] || yOff + ySize > dim[1]){
+    cout << "[geotiff] Error: invalid bands or window [" << xOff << ", " << yOff << ", " << xSize << ", " << ySize
+         << "] for a cv::Mat read" << endl;
+    return false;
+  }
+  for (int i=0; i<nChannels; i++){
+    if (bands[i] < 1 || bands[i] > dim[2]){
+      cout << "[geotiff] Error: invalid band " << bands[i] << " for a cv::Mat read" << endl;
+      return false;
+    }
+  }
+
+  bool bReuse = !mat.empty() && mat.dims == 2 && mat.cols == xSize && mat.rows == ySize && mat.channels() == nChannels
+                && GeotiffGDALType(mat.depth()) != GDT_Unknown;
+  if (!bReuse){
+    int depth = GeotiffCvDepth(poDataset->GetRasterBand(bands[0])->GetRasterDataType());
+    if (depth < 0){
+      cout << "[geotiff] Error: band data type has no cv::Mat depth" << endl;
+      return false;
+    }
+    mat.create(ySize, xSize, CV_MAKETYPE(depth, nChannels));
+  }
+  GDALDataType bufType = GeotiffGDALType(mat.depth());
+  size_t elemSize = mat.elemSize1();
+  std::vector<int> bandMap(bands);
+
+  GEOTIFF_STATS_START(tRead);
+  CPLErr e = poDataset->RasterIO(GF_Read, xOff, yOff, xSize, ySize, mat.data, xSize, ySize, bufType,
+                                 nChannels, &bandMap[0], (GSpacing)(elemSize*nChannels), (GSpacing)mat.step[0],
+                                 (GSpacing)elemSize);
+  GEOTIFF_STATS_RASTERIO(tRead, (size_t)xSize*ySize*elemSize*nChannels,
+                         GeotiffStatsBlocks(poDataset->GetRasterBand(bands[0]), xOff, yOff, xSize, ySize)*nChannels);
+  if (e != CE_None){
+    cout << "[geotiff] Error: Unable to read window into cv::Mat from " << geotiff.GetFileName() << endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Writes a cv::Mat to a new GeoTIFF georeferenced as reference, straight from the Mat buffer
+ * @details The output is created by GeotiffWriter (same creation options), and filled with one
+ * GDALDataset::RasterIO call using the Mat spacing, so GDAL reads the pixels in place
+ */
+bool GeotiffWriteMat(const char *filename, const cv::Mat &mat, Geotiff &reference, const GeotiffWriterOptions &options){
+  GDALDataType dataType = GeotiffGDALType(mat.depth());
+  if (mat.empty() || mat.dims != 2 || dataType == GDT_Unknown){
+    cout << "[geotiff] Error: cv::Mat is empty or its depth has no GDAL data type" << endl;
+    return false;
+  }
+  int nChannels = mat.channels();
+  GeotiffWriter writer(filename, mat.cols, mat.rows, nChannels, dataType, options);
+  if (!writer.isValid())
+    return false;
+  if (reference.isValid()){
+    writer.CopyGeoreference(reference);
+    RasterBandInfo info = reference.GetBandInfo(1);
+    for (int b=1; info.hasNoData && b<=nChannels; b++)
+      writer.SetNoDataValue(b, info.noData);
+  }
+  std::vector<int> bandMap(nChannels);
+  for (int b=0; b<nChannels; b++)
+    bandMap[b] = b + 1;
+  size_t elemSize = mat.elemSize1();
+  CPLErr e = writer.GetDataset()->RasterIO(GF_Write, 0, 0, mat.cols, mat.rows, (void *)mat.data, mat.cols, mat.rows, dataType,
+                                           nChannels, &bandMap[0], (GSpacing)(elemSize*nChannels), (GSpacing)mat.step[0],
+                                           (GSpacing)elemSize);
+  if (e != CE_None){
+    cout << "[geotiff] Error: Unable to write cv::Mat to " << filename << endl;
+    return false;
+  }
+  return writer.Close();
+}
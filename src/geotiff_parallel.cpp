@@ -0,0 +1,238 @@
+/**
+ * @file geotiff_parallel.cpp
+ * @brief Multi-threaded band/tile reader: one GDAL handle per worker and a work stealing scheduler
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_parallel.hpp>
+#include <geotiff.hpp>
+#include <geotiff_counters.hpp>
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+GeotiffParallelReader::GeotiffParallelReader(const char *tiffname, int nThreads) :
+  filename(tiffname), nRows(0), nCols(0), nBands(0), bValid(false) {
+
+  if (nThreads <= 0)
+    nThreads = max(1, (int)std::thread::hardware_concurrency());
+
+  for (int i=0; i<nThreads; i++){
+    // independent (non shared) handles: each one has its own file pointer and decoder state.
+    // They are leased from the process-wide pool, so repeated readers on a file do not reopen it
+    GeotiffDatasetLease lease = GeotiffDatasetPool::Instance().Acquire(tiffname);
+    if (!lease.isValid()){
+      cout << "[GeotiffParallelReader] Error opening file: " << tiffname << endl;
+      return;
+    }
+    handles.push_back(lease.Get());
+    leases.push_back(std::move(lease));
+  }
+  nCols  = handles[0]->GetRasterXSize();
+  nRows  = handles[0]->GetRasterYSize();
+  nBands = handles[0]->GetRasterCount();
+  bValid = true;
+}
+
+GeotiffParallelReader::~GeotiffParallelReader(){
+  // leases return the handles to the pool
+}
+
+void GeotiffParallelReader::GetDimensions(int *dim){
+  dim[0] = nCols;
+  dim[1] = nRows;
+  dim[2] = nBands;
+}
+
+/**
+ * @brief Splits a window of a band into block-aligned tile tasks
+ *
+ * @param band 1-indexed band number
+ * @param xOff, yOff, xSize, ySize pixel window (must lie inside the raster)
+ * @param output output index stored in every task
+ * @return std::vector<GeotiffTileTask> tiles, in raster (row-major) order
+ */
+std::vector<GeotiffTileTask> GeotiffParallelReader::MakeTiles(int band, int xOff, int yOff, int xSize, int ySize, int output){
+  std::vector<GeotiffTileTask> tiles;
+  if (!bValid || band < 1 || band > nBands || xSize <= 0 || ySize <= 0)
+    return tiles;
+
+  GDALRasterBand *poBand = handles[0]->GetRasterBand(band);
+  int nBlockXSize, nBlockYSize;
+  poBand->GetBlockSize(&nBlockXSize, &nBlockYSize);
+  nBlockXSize = max(1, nBlockXSize);
+  nBlockYSize = max(1, nBlockYSize);
+
+  // group whole blocks vertically until the task is large enough to amortize the per-call overhead
+  size_t nBlockBytes = (size_t)nBlockXSize*nBlockYSize*GDALGetDataTypeSizeBytes(poBand->GetRasterDataType());
+  int nTileYSize = nBlockYSize;
+  if (nBlockBytes > 0 && nBlockBytes < GEOTIFF_PARALLEL_TASK_BYTES)
+    nTileYSize = nBlockYSize * (int)(GEOTIFF_PARALLEL_TASK_BYTES / nBlockBytes);
+  int nTileXSize = nBlockXSize;
+
+  // tile limits follow the absolute block grid, so tiles at the window edges are clipped, not shifted
+  for (int y = yOff; y < yOff + ySize; ){
+    int yEnd = min((y/nTileYSize + 1)*nTileYSize, yOff + ySize);
+    for (int x = xOff; x < xOff + xSize; ){
+      int xEnd = min((x/nTileXSize + 1)*nTileXSize, xOff + xSize);
+      GeotiffTileTask tile;
+      tile.band   = band;
+      tile.xOff   = x;
+      tile.yOff   = y;
+      tile.xSize  = xEnd - x;
+      tile.ySize  = yEnd - y;
+      tile.output = output;
+      tiles.push_back(tile);
+      x = xEnd;
+    }
+    y = yEnd;
+  }
+  return tiles;
+}
+
+/**
+ * @brief Fetches the next task for a worker: its own queue first, then steals from the others
+ */
+bool GeotiffParallelReader::NextTask(std::vector<WorkQueue> &queues, int worker, GeotiffTileTask &task){
+  {
+    std::lock_guard<std::mutex> guard(queues[worker].lock);
+    if (!queues[worker].tasks.empty()){
+      task = queues[worker].tasks.front();
+      queues[worker].tasks.pop_front();
+      return true;
+    }
+  }
+  // own queue is empty: steal from the back of the other queues (no task is ever added, so a
+  // full round without finding work means we are done)
+  int nQueues = (int)queues.size();
+  for (int i=1; i<nQueues; i++){
+    WorkQueue &victim = queues[(worker + i) % nQueues];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks.empty()){
+      task = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Runs process() for every tile on the worker threads (work stealing scheduler)
+ *
+ * @return true if every call to process() succeeded
+ */
+bool GeotiffParallelReader::ForEachTile(const std::vector<GeotiffTileTask> &tiles,
+                                        const std::function<bool(GDALDataset *, const GeotiffTileTask &, int)> &process){
+  if (!bValid)
+    return false;
+  if (tiles.empty())
+    return true;
+
+  int nWorkers = (int) min(handles.size(), tiles.size());
+  std::vector<WorkQueue> queues(nWorkers);
+
+  // deal the tiles in contiguous runs, so each worker walks neighbouring blocks
+  size_t nPerWorker = (tiles.size() + nWorkers - 1) / nWorkers;
+  for (size_t i=0; i<tiles.size(); i++)
+    queues[i / nPerWorker].tasks.push_back(tiles[i]);
+
+  std::atomic<bool> bFailed(false);
+  std::vector<std::thread> workers;
+  for (int w=0; w<nWorkers; w++){
+    workers.push_back(std::thread([&, w](){
+      GeotiffTileTask task;
+      while (!bFailed && NextTask(queues, w, task)){
+        if (!process(handles[w], task, w))
+          bFailed = true;
+      }
+    }));
+  }
+  for (size_t w=0; w<workers.size(); w++)
+    workers[w].join();
+  return !bFailed;
+}
+
+/**
+ * @brief Reads a set of tiles straight into their output rasters
+ *
+ * @param tiles tile tasks. tile.output selects the output raster
+ * @param outputs destination rasters (already allocated)
+ * @param xOffsets, yOffsets upper-left pixel (in the band) of each output raster
+ * @return true if every tile was read
+ */
+template<typename T>
+bool GeotiffParallelReader::ReadTiles(const std::vector<GeotiffTileTask> &tiles, std::vector<Raster<T> > &outputs,
+                                      const std::vector<int> &xOffsets, const std::vector<int> &yOffsets){
+  return ForEachTile(tiles, [&](GDALDataset *dataset, const GeotiffTileTask &tile, int){
+    GEOTIFF_STATS_CALL(GEOTIFF_CALL_PARALLEL_TILE);
+    Raster<T> &out = outputs[tile.output];
+    T *dst = out.GetRow(tile.yOff - yOffsets[tile.output]) + (tile.xOff - xOffsets[tile.output]);
+    GEOTIFF_STATS_START(tRead);
+    CPLErr e = dataset->GetRasterBand(tile.band)->RasterIO(GF_Read, tile.xOff, tile.yOff, tile.xSize, tile.ySize,
+                                                           dst, tile.xSize, tile.ySize, GDALTypeOf<T>::type,
+                                                           sizeof(T), out.GetStrideBytes());
+    GEOTIFF_STATS_RASTERIO(tRead, (size_t)tile.xSize*tile.ySize*sizeof(T),
+                           GeotiffStatsBlocks(dataset->GetRasterBand(tile.band), tile.xOff, tile.yOff, tile.xSize, tile.ySize));
+    return e == CE_None;
+  });
+}
+
+template<typename T>
+std::vector<Raster<T> > GeotiffParallelReader::ReadBands(const std::vector<int> &bands){
+  std::vector<Raster<T> > outputs;
+  std::vector<GeotiffTileTask> tiles;
+  for (size_t i=0; i<bands.size(); i++){
+    if (bands[i] < 1 || bands[i] > nBands){
+      cout << "[GeotiffParallelReader] Invalid band number: " << bands[i] << endl;
+      return std::vector<Raster<T> >();
+    }
+    outputs.push_back(Raster<T>(nCols, nRows));
+    std::vector<GeotiffTileTask> bandTiles = MakeTiles(bands[i], 0, 0, nCols, nRows, (int)i);
+    tiles.insert(tiles.end(), bandTiles.begin(), bandTiles.end());
+  }
+  std::vector<int> offsets(bands.size(), 0);
+  if (!ReadTiles<T>(tiles, outputs, offsets, offsets)){
+    cout << "[GeotiffParallelReader] Error: Unable to read bands from " << filename << endl;
+    return std::vector<Raster<T> >();
+  }
+  return outputs;
+}
+
+template<typename T>
+Raster<T> GeotiffParallelReader::ReadWindow(int band, int xOff, int yOff, int xSize, int ySize){
+  if (!bValid || band < 1 || band > nBands || xOff < 0 || yOff < 0 || xSize <= 0 || ySize <= 0 ||
+      xOff + xSize > nCols || yOff + ySize > nRows){
+    cout << "[GeotiffParallelReader] Error: invalid band or window" << endl;
+    return Raster<T>();
+  }
+  std::vector<Raster<T> > outputs;
+  outputs.push_back(Raster<T>(xSize, ySize));
+  std::vector<int> xOffsets(1, xOff), yOffsets(1, yOff);
+  if (!ReadTiles<T>(MakeTiles(band, xOff, yOff, xSize, ySize, 0), outputs, xOffsets, yOffsets)){
+    cout << "[GeotiffParallelReader] Error: Unable to read window from " << filename << endl;
+    return Raster<T>();
+  }
+  return std::move(outputs[0]);
+}
+
+// explicit instantiations for the supported pixel types
+template std::vector<Raster<unsigned char> > GeotiffParallelReader::ReadBands<unsigned char>(const std::vector<int> &bands);
+template std::vector<Raster<unsigned short> > GeotiffParallelReader::ReadBands<unsigned short>(const std::vector<int> &bands);
+template std::vector<Raster<short> > GeotiffParallelReader::ReadBands<short>(const std::vector<int> &bands);
+template std::vector<Raster<unsigned int> > GeotiffParallelReader::ReadBands<unsigned int>(const std::vector<int> &bands);
+template std::vector<Raster<int> > GeotiffParallelReader::ReadBands<int>(const std::vector<int> &bands);
+template std::vector<Raster<float> > GeotiffParallelReader::ReadBands<float>(const std::vector<int> &bands);
+template std::vector<Raster<double> > GeotiffParallelReader::ReadBands<double>(const std::vector<int> &bands);
+
+template Raster<unsigned char> GeotiffParallelReader::ReadWindow<unsigned char>(int band, int xOff, int yOff, int xSize, int ySize);
+template Raster<unsigned short> GeotiffParallelReader::ReadWindow<unsigned short>(int band, int xOff, int yOff, int xSize, int ySize);
+template Raster<short> GeotiffParallelReader::ReadWindow<short>(int band, int xOff, int yOff, int xSize, int ySize);
+template Raster<unsigned int> GeotiffParallelReader::ReadWindow<unsigned int>(int band, int xOff, int yOff, int xSize, int ySize);
+template Raster<int> GeotiffParallelReader::ReadWindow<int>(int band, int xOff, int yOff, int xSize, int ySize);
+template Raster<float> GeotiffParallelReader::ReadWindow<float>(int band, int xOff, int yOff, int xSize, int ySize);
+template Raster<double> GeotiffParallelReader::ReadWindow<double>(int band, int xOff, int yOff, int xSize, int ySize);
@@ -0,0 +1,257 @@
+/**
+ * @file geotiff_pipeline.cpp
+ * @brief Streaming, block-wise map/reduce pipeline over GeoTIFF bands (read / compute / sink stages)
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_pipeline.hpp>
+#include <geotiff.hpp>
+#include <geotiff_writer.hpp>
+#include <geotiff_counters.hpp>
+
+#include <iostream>
+#include <limits>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// Closable FIFO between the reader and the compute workers
+template<typename T>
+class BlockQueue {
+  private:
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<T> items;
+    bool bClosed;
+  public:
+    BlockQueue() : bClosed(false) {}
+    void Push(T &&item){
+      std::lock_guard<std::mutex> guard(lock);
+      items.push_back(std::move(item));
+      changed.notify_one();
+    }
+    bool Pop(T &item){ // false once the queue is closed and empty
+      std::unique_lock<std::mutex> guard(lock);
+      changed.wait(guard, [this](){ return bClosed || !items.empty(); });
+      if (items.empty())
+        return false;
+      item = std::move(items.front());
+      items.pop_front();
+      return true;
+    }
+    void Close(){
+      std::lock_guard<std::mutex> guard(lock);
+      bClosed = true;
+      changed.notify_all();
+    }
+};
+
+struct ReadItem {
+  PipelineBlock block;
+  std::vector<Raster<float> > inputs;
+};
+
+}
+
+GeotiffPipeline::GeotiffPipeline() : halo(0), blockRows(0), nWorkers(1), maxInFlight(0), nRows(0), nCols(0) {
+  nWorkers = max(1, (int)std::thread::hardware_concurrency());
+}
+
+bool GeotiffPipeline::AddInput(Geotiff &geotiff, int band){
+  int dim[3];
+  geotiff.GetDimensions(dim);
+  if (!geotiff.isValid() || band < 1 || band > dim[2]){
+    cout << "[GeotiffPipeline] Invalid input or band number: " << band << endl;
+    return false;
+  }
+  if (!inputs.empty() && (dim[0] != nCols || dim[1] != nRows)){
+    cout << "[GeotiffPipeline] Input size " << dim[0] << "x" << dim[1] << " does not match " << nCols << "x" << nRows << endl;
+    return false;
+  }
+  nCols = dim[0];
+  nRows = dim[1];
+  Input input;
+  input.geotiff = &geotiff;
+  input.band = band;
+  inputs.push_back(input);
+  return true;
+}
+
+/**
+ * @brief Returns the height of the pipeline blocks: the user setting, or the first input block height
+ * grouped up to GEOTIFF_CHUNK_BYTES (so each block of the file is decoded once per pass)
+ */
+int GeotiffPipeline::GetBlockRows(){
+  if (blockRows > 0 || inputs.empty())
+    return blockRows;
+  int blockSize[2];
+  inputs[0].geotiff->GetBlockSize(inputs[0].band, blockSize);
+  int nBlockYSize = max(1, blockSize[1]);
+  size_t nBlockRowBytes = (size_t)nCols * nBlockYSize * sizeof(float);
+  size_t nGroup = 1;
+  if (nBlockRowBytes > 0 && nBlockRowBytes < GEOTIFF_CHUNK_BYTES)
+    nGroup = GEOTIFF_CHUNK_BYTES / nBlockRowBytes;
+  return (int) min((size_t)nRows, nGroup * nBlockYSize);
+}
+
+/**
+ * @brief Reads one block (plus halo) of every input. Halo pixels outside the raster are set to NaN
+ */
+bool GeotiffPipeline::ReadBlock(const PipelineBlock &block, std::vector<Raster<float> > &blockInputs){
+  const float fNaN = numeric_limits<float>::quiet_NaN();
+  int width  = block.xSize + 2*halo;
+  int height = block.ySize + 2*halo;
+  int firstRow = max(0, block.yOff - halo);                    // first raster row inside the halo'ed block
+  int lastRow  = min(nRows, block.yOff + block.ySize + halo);  // one past the last one
+  int firstCol = max(0, block.xOff - halo);
+  int lastCol  = min(nCols, block.xOff + block.xSize + halo);
+
+  blockInputs.clear();
+  for (size_t i=0; i<inputs.size(); i++){
+    Raster<float> data(width, height);
+    // NaN only where the halo falls outside the raster
+    for (int y=0; y<height; y++){
+      float *row = data.GetRow(y);
+      int rasterRow = block.yOff - halo + y;
+      if (rasterRow < firstRow || rasterRow >= lastRow)
+        std::fill(row, row + width, fNaN);
+      else{
+        std::fill(row, row + (firstCol - (block.xOff - halo)), fNaN);
+        std::fill(row + (lastCol - (block.xOff - halo)), row + width, fNaN);
+      }
+    }
+    float *dst = data.GetRow(firstRow - (block.yOff - halo)) + (firstCol - (block.xOff - halo));
+    GDALRasterBand *poBand = inputs[i].geotiff->GetDataset()->GetRasterBand(inputs[i].band);
+    GEOTIFF_STATS_CALL(GEOTIFF_CALL_PIPELINE_BLOCK);
+    GEOTIFF_STATS_START(tRead);
+    CPLErr e = poBand->RasterIO(GF_Read, firstCol, firstRow, lastCol - firstCol, lastRow - firstRow, dst,
+                                lastCol - firstCol, lastRow - firstRow, GDT_Float32, sizeof(float), data.GetStrideBytes());
+    GEOTIFF_STATS_RASTERIO(tRead, (size_t)(lastCol - firstCol)*(lastRow - firstRow)*sizeof(float),
+                           GeotiffStatsBlocks(poBand, firstCol, firstRow, lastCol - firstCol, lastRow - firstRow));
+    if (e != CE_None){
+      cout << "[GeotiffPipeline] Error: Unable to read rows [" << firstRow << ", " << lastRow << ") of input " << i << endl;
+      return false;
+    }
+    blockInputs.push_back(std::move(data));
+  }
+  return true;
+}
+
+bool GeotiffPipeline::Run(const PipelineKernel &kernel, const PipelineSink &sink){
+  if (inputs.empty()){
+    cout << "[GeotiffPipeline] No inputs" << endl;
+    return false;
+  }
+  int nBlockRows = GetBlockRows();
+  int nBlocks = (nRows + nBlockRows - 1) / nBlockRows;
+  int nInFlightMax = (maxInFlight > 0) ? maxInFlight : 2*nWorkers + 2;
+
+  // shared state between the stages: in-flight tokens, finished blocks and the failure flag
+  std::mutex stateLock;
+  std::condition_variable stateChanged;
+  int nInFlight = 0;
+  std::map<int, std::pair<PipelineBlock, Raster<float> > > results;
+  std::atomic<bool> bFailed(false);
+
+  BlockQueue<ReadItem> readQueue;
+
+  // stage 1: reader. Only this thread touches the input datasets
+  std::thread reader([&](){
+    for (int i=0; i<nBlocks && !bFailed; i++){
+      {
+        std::unique_lock<std::mutex> guard(stateLock);
+        stateChanged.wait(guard, [&](){ return nInFlight < nInFlightMax || bFailed; });
+        if (bFailed)
+          break;
+        nInFlight++;
+      }
+      ReadItem item;
+      item.block.index = i;
+      item.block.xOff  = 0;
+      item.block.yOff  = i*nBlockRows;
+      item.block.xSize = nCols;
+      item.block.ySize = min(nBlockRows, nRows - item.block.yOff);
+      item.block.halo  = halo;
+      if (!ReadBlock(item.block, item.inputs)){
+        std::lock_guard<std::mutex> guard(stateLock);
+        bFailed = true;
+        stateChanged.notify_all();
+        break;
+      }
+      readQueue.Push(std::move(item));
+    }
+    readQueue.Close();
+  });
+
+  // stage 2: compute workers
+  std::vector<std::thread> workers;
+  for (int w=0; w<nWorkers; w++){
+    workers.push_back(std::thread([&](){
+      ReadItem item;
+      while (readQueue.Pop(item)){
+        if (bFailed)
+          continue; // drain the queue
+        Raster<float> output(item.block.xSize, item.block.ySize);
+        std::vector<const Raster<float> *> kernelInputs;
+        for (size_t i=0; i<item.inputs.size(); i++)
+          kernelInputs.push_back(&item.inputs[i]);
+        bool bOk = kernel(kernelInputs, output, item.block);
+        item.inputs.clear(); // release the input blocks as soon as possible
+
+        std::lock_guard<std::mutex> guard(stateLock);
+        if (!bOk){
+          cout << "[GeotiffPipeline] Kernel failed on block " << item.block.index << endl;
+          bFailed = true;
+        }
+        else
+          results[item.block.index] = std::make_pair(item.block, std::move(output));
+        stateChanged.notify_all();
+      }
+    }));
+  }
+
+  // stage 3: sink, in raster order, on the calling thread
+  for (int next=0; next<nBlocks; next++){
+    std::pair<PipelineBlock, Raster<float> > result;
+    {
+      std::unique_lock<std::mutex> guard(stateLock);
+      stateChanged.wait(guard, [&](){ return results.count(next) > 0 || bFailed; });
+      if (bFailed)
+        break;
+      result = std::move(results[next]);
+      results.erase(next);
+    }
+    bool bOk = sink(result.second, result.first);
+    std::lock_guard<std::mutex> guard(stateLock);
+    nInFlight--;
+    if (!bOk){
+      cout << "[GeotiffPipeline] Sink failed on block " << next << endl;
+      bFailed = true;
+    }
+    stateChanged.notify_all();
+    if (bFailed)
+      break;
+  }
+
+  // on failure the reader and the workers have been notified: they stop and drain the queue
+  reader.join();
+  for (size_t w=0; w<workers.size(); w++)
+    workers[w].join();
+  return !bFailed;
+}
+
+bool GeotiffPipeline::Run(const PipelineKernel &kernel, GeotiffWriter &writer, int band){
+  if (!writer.isValid())
+    return false;
+  return Run(kernel, [&writer, band](const Raster<float> &output, const PipelineBlock &block){
+    return writer.WriteWindow(band, block.xOff, block.yOff, output);
+  });
+}
@@ -0,0 +1,293 @@
+/**
+ * @file geotiff_pool.cpp
+ * @brief Process-wide pool of open (read-only) GDAL dataset handles, leased per user
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_pool.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cpl_vsi.h>
+
+using namespace std;
+
+static std::once_flag driversRegistered;
+
+void GeotiffRegisterDrivers(){
+  std::call_once(driversRegistered, [](){ GDALAllRegister(); });
+}
+
+static double poolClock(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void closeAll(std::vector<GDALDataset *> &toClose){
+  for (size_t i=0; i<toClose.size(); i++)
+    GDALClose(toClose[i]);
+  toClose.clear();
+}
+
+GeotiffDatasetLease::GeotiffDatasetLease(GeotiffDatasetLease &&other) :
+  pool(other.pool), dataset(other.dataset), path(std::move(other.path)), generation(other.generation) {
+  other.pool = NULL;
+  other.dataset = NULL;
+}
+
+GeotiffDatasetLease &GeotiffDatasetLease::operator=(GeotiffDatasetLease &&other){
+  if (this != &other){
+    Release();
+    pool = other.pool;
+    dataset = other.dataset;
+    path = std::move(other.path);
+    generation = other.generation;
+    other.pool = NULL;
+    other.dataset = NULL;
+  }
+  return *this;
+}
+
+void GeotiffDatasetLease::Release(){
+  if (pool != NULL && dataset != NULL)
+    pool->Return(*this);
+  pool = NULL;
+  dataset = NULL;
+}
+
+OGRSpatialReference *GeotiffDatasetLease::CloneSpatialRef() const {
+  if (pool == NULL || dataset == NULL)
+    return NULL;
+  return pool->CloneSpatialRef(*this);
+}
+
+GeotiffDatasetPool::GeotiffDatasetPool() :
+  nOpen(0), maxHandles(GEOTIFF_POOL_MAX_HANDLES), idleSeconds(GEOTIFF_POOL_IDLE_SECONDS), lastSweep(0),
+  nOpens(0), nReuses(0), nEvictions(0) {}
+
+GeotiffDatasetPool &GeotiffDatasetPool::Instance(){
+  // intentionally leaked: static objects holding leases may be destroyed after any static pool would
+  static GeotiffDatasetPool *pool = new GeotiffDatasetPool();
+  return *pool;
+}
+
+void GeotiffDatasetPool::CloseIdle(Entry &entry, std::vector<GDALDataset *> &toClose){
+  for (size_t i=0; i<entry.idle.size(); i++){
+    toClose.push_back(entry.idle[i]->dataset);
+    idleLru.erase(entry.idle[i]);
+  }
+  nOpen -= entry.idle.size();
+  entry.idle.clear();
+}
+
+// Closes one idle handle, and drops its entry if nothing else refers to the path
+void GeotiffDatasetPool::CloseIdleHandle(std::list<IdleHandle>::iterator handle, std::vector<GDALDataset *> &toClose){
+  std::map<std::string, Entry>::iterator it = entries.find(handle->path);
+  std::vector<std::list<IdleHandle>::iterator> &idle = it->second.idle;
+  idle.erase(std::find(idle.begin(), idle.end(), handle));
+  toClose.push_back(handle->dataset);
+  idleLru.erase(handle);
+  nOpen--;
+  Prune(it);
+}
+
+// Drops an entry with no open handle and no lease: the map only holds the paths in use
+void GeotiffDatasetPool::Prune(std::map<std::string, Entry>::iterator entry){
+  if (!entry->second.idle.empty() || entry->second.leased > 0)
+    return;
+  delete entry->second.srs;
+  entries.erase(entry);
+}
+
+/**
+ * @brief Closes the least recently used idle handle, of any path
+ * @return false if there is no idle handle
+ */
+bool GeotiffDatasetPool::EvictOldestIdle(std::vector<GDALDataset *> &toClose){
+  if (idleLru.empty())
+    return false;
+  CloseIdleHandle(idleLru.begin(), toClose);
+  nEvictions++;
+  return true;
+}
+
+void GeotiffDatasetPool::SweepIdle(double now, std::vector<GDALDataset *> &toClose){
+  lastSweep = now;
+  while (!idleLru.empty() && now - idleLru.front().lastUsed > idleSeconds){
+    CloseIdleHandle(idleLru.begin(), toClose);
+    nEvictions++;
+  }
+}
+
+/**
+ * @brief Leases a read-only handle on a file, reusing an idle one when possible
+ * @details The file is stat'ed on every call: if its modification time or size changed, the idle
+ * handles (opened on the previous contents) are closed and the leased ones are closed on release.
+ * GDALOpenEx runs outside the pool lock, so a slow open does not stall the other threads
+ *
+ * @param path file name (the pool key, used as given)
+ * @return GeotiffDatasetLease lease, invalid if the file cannot be opened
+ */
+GeotiffDatasetLease GeotiffDatasetPool::Acquire(const char *path){
+  GeotiffRegisterDrivers();
+  GeotiffDatasetLease lease;
+  if (path == NULL)
+    return lease;
+  VSIStatBufL sStat;
+  bool bHaveStat = (VSIStatL(path, &sStat) == 0);
+
+  std::vector<GDALDataset *> toClose;
+  std::unique_lock<std::mutex> guard(lock);
+  double now = poolClock();
+  if (now - lastSweep > 1.0)
+    SweepIdle(now, toClose);
+
+  std::map<std::string, Entry>::iterator it = entries.insert(std::make_pair(std::string(path), Entry())).first;
+  Entry &entry = it->second;
+  if (bHaveStat && (entry.mtime != (long long)sStat.st_mtime || entry.size != (long long)sStat.st_size)){
+    if (entry.mtime != -1 || entry.size != -1){
+      // the file was rewritten: handles (and the parsed SRS) describe the old contents
+      CloseIdle(entry, toClose);
+      entry.generation++;
+      delete entry.srs;
+      entry.srs = NULL;
+    }
+    entry.mtime = (long long)sStat.st_mtime;
+    entry.size = (long long)sStat.st_size;
+  }
+
+  if (!entry.idle.empty()){
+    lease.dataset = entry.idle.back()->dataset;
+    idleLru.erase(entry.idle.back());
+    entry.idle.pop_back();
+    entry.leased++;
+    nReuses++;
+    lease.pool = this;
+    lease.path = path;
+    lease.generation = entry.generation;
+    guard.unlock();
+    closeAll(toClose);
+    return lease;
+  }
+  // soft cap: make room by closing idle handles (entry has none, so it is not pruned); if every handle
+  // is leased, open past the limit anyway (never wait: the caller may hold all the leases itself).
+  // Return() closes the excess
+  while (nOpen >= maxHandles && EvictOldestIdle(toClose))
+    ;
+  nOpen++;
+  entry.leased++;
+  unsigned generation = entry.generation;
+  guard.unlock();
+  closeAll(toClose);
+
+  GDALDataset *poDataset = (GDALDataset *) GDALOpenEx(path, GDAL_OF_RASTER | GDAL_OF_READONLY, NULL, NULL, NULL);
+
+  guard.lock();
+  if (poDataset == NULL){
+    nOpen--;
+    entry.leased--;
+    Prune(it);
+    guard.unlock();
+    cout << "[GeotiffDatasetPool] Error opening file: " << path << endl;
+    return lease;
+  }
+  nOpens++;
+  guard.unlock();
+  lease.pool = this;
+  lease.dataset = poDataset;
+  lease.path = path;
+  lease.generation = generation;
+  return lease;
+}
+
+void GeotiffDatasetPool::Return(GeotiffDatasetLease &lease){
+  std::vector<GDALDataset *> toClose;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, Entry>::iterator it = entries.find(lease.path); // kept while leased
+    Entry &entry = it->second;
+    entry.leased--;
+    double now = poolClock();
+    if (lease.generation != entry.generation || nOpen > maxHandles){
+      toClose.push_back(lease.dataset);
+      nOpen--;
+      Prune(it);
+    }
+    else{
+      IdleHandle handle;
+      handle.dataset = lease.dataset;
+      handle.lastUsed = now;
+      handle.path = lease.path;
+      entry.idle.push_back(idleLru.insert(idleLru.end(), handle));
+    }
+    if (now - lastSweep > 1.0)
+      SweepIdle(now, toClose);
+  }
+  closeAll(toClose);
+}
+
+OGRSpatialReference *GeotiffDatasetPool::CloneSpatialRef(const GeotiffDatasetLease &lease){
+  std::lock_guard<std::mutex> guard(lock);
+  Entry &entry = entries.find(lease.path)->second; // kept while leased
+  if (lease.generation != entry.generation) // stale handle: do not cache what it reports
+    return new OGRSpatialReference(lease.dataset->GetProjectionRef());
+  if (entry.srs == NULL)
+    entry.srs = new OGRSpatialReference(lease.dataset->GetProjectionRef());
+  return new OGRSpatialReference(*entry.srs);
+}
+
+void GeotiffDatasetPool::Invalidate(const char *path){
+  std::vector<GDALDataset *> toClose;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    std::map<std::string, Entry>::iterator it = entries.find(path);
+    if (it == entries.end())
+      return;
+    CloseIdle(it->second, toClose);
+    it->second.generation++;
+    it->second.mtime = it->second.size = -1;
+    delete it->second.srs;
+    it->second.srs = NULL;
+    Prune(it);
+  }
+  closeAll(toClose);
+}
+
+void GeotiffDatasetPool::SetLimits(size_t maxOpenHandles, double idleTimeoutSeconds){
+  std::vector<GDALDataset *> toClose;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    maxHandles = max((size_t)1, maxOpenHandles);
+    idleSeconds = idleTimeoutSeconds;
+    while (nOpen > maxHandles && EvictOldestIdle(toClose))
+      ;
+  }
+  closeAll(toClose);
+}
+
+void GeotiffDatasetPool::EvictIdle(){
+  std::vector<GDALDataset *> toClose;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    SweepIdle(poolClock(), toClose);
+  }
+  closeAll(toClose);
+}
+
+void GeotiffDatasetPool::Clear(){
+  std::vector<GDALDataset *> toClose;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    while (!idleLru.empty())
+      CloseIdleHandle(idleLru.begin(), toClose);
+  }
+  closeAll(toClose);
+}
+
+void GeotiffDatasetPool::GetCounters(size_t *open, size_t *opens, size_t *reuses, size_t *evictions){
+  std::lock_guard<std::mutex> guard(lock);
+  *open = nOpen;
+  *opens = nOpens;
+  *reuses = nReuses;
+  *evictions = nEvictions;
+}
@@ -0,0 +1,163 @@
+/**
+ * @file geotiff_read_bench.cpp
+ * @brief Benchmark: scanline vs block-aligned band reads on striped and tiled GeoTIFF files
+ *
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ *
+ */
+
+// Usage: geotiff_read_bench [size] [workdir]
+//   size:    width and height (pixels) of the synthetic rasters. Default: 4096
+//   workdir: folder where the synthetic files are created. Default: current folder
+// Two DEFLATE compressed Float32 files are created: one striped (1 scanline per strip) and one tiled (256x256).
+// Each file is read with the legacy per-scanline loop, and with Geotiff::ReadRaster (block-aligned reads)
+
+#include <gdal_priv.h>
+#include <cpl_conv.h> // for CPLMalloc()
+#include <cpl_string.h>
+
+///Basic C and C++ libraries
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+
+#include "geotiff.hpp"
+
+using namespace std;
+
+const std::string green("\033[1;32m");
+const std::string yellow("\033[1;33m");
+const std::string cyan("\033[1;36m");
+const std::string red("\033[1;31m");
+const std::string reset("\033[0m");
+
+/**
+ * @brief Creates a synthetic DEM-like Float32 GeoTIFF
+ *
+ * @param fileName output file name
+ * @param size width and height in pixels
+ * @param tiled true: 256x256 tiles. false: 1 scanline strips
+ * @return true if the file was created
+ */
+bool createSyntheticFile(const std::string &fileName, int size, bool tiled){
+    GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    if (poDriver == NULL)
+        return false;
+
+    char **papszOptions = NULL;
+    papszOptions = CSLSetNameValue(papszOptions, "COMPRESS", "DEFLATE");
+    if (tiled){
+        papszOptions = CSLSetNameValue(papszOptions, "TILED", "YES");
+        papszOptions = CSLSetNameValue(papszOptions, "BLOCKXSIZE", "256");
+        papszOptions = CSLSetNameValue(papszOptions, "BLOCKYSIZE", "256");
+    }
+    else
+        papszOptions = CSLSetNameValue(papszOptions, "BLOCKYSIZE", "1");
+
+    GDALDataset *poDataset = poDriver->Create(fileName.c_str(), size, size, 1, GDT_Float32, papszOptions);
+    CSLDestroy(papszOptions);
+    if (poDataset == NULL)
+        return false;
+
+    double adfGeoTransform[6] = {0.0, 1.0, 0.0, 0.0, 0.0, -1.0};
+    poDataset->SetGeoTransform(adfGeoTransform);
+
+    float *rowBuff = (float *) CPLMalloc(sizeof(float)*size);
+    GDALRasterBand *poBand = poDataset->GetRasterBand(1);
+    CPLErr e = CE_None;
+    for (int row=0; row<size && e == CE_None; row++){
+        for (int col=0; col<size; col++) // smooth surface + some high frequency so DEFLATE has some work to do
+            rowBuff[col] = (float)(100.0*sin(row*0.01)*cos(col*0.01) + (row*31 + col*17) % 7);
+        e = poBand->RasterIO(GF_Write,0,row,size,1,rowBuff,size,1,GDT_Float32,0,0);
+    }
+    CPLFree(rowBuff);
+    GDALClose(poDataset);
+    return (e == CE_None);
+}
+
+/**
+ * @brief Legacy reader: one RasterIO call per scanline (the pre block-aligned GetArray2D behaviour)
+ *
+ * @return double checksum of the band, to avoid the loop being optimized away
+ */
+double readScanlines(const std::string &fileName){
+    Geotiff geo(fileName.c_str());
+    int *dim = geo.GetDimensions();
+    int nCols = dim[0], nRows = dim[1];
+    float *rowBuff = (float *) CPLMalloc(sizeof(float)*nCols);
+    double sum = 0;
+    for (int row=0; row<nRows; row++){
+        geo.GetDataset()->GetRasterBand(1)->RasterIO(GF_Read,0,row,nCols,1,rowBuff,nCols,1,GDT_Float32,0,0);
+        sum += rowBuff[0];
+    }
+    CPLFree(rowBuff);
+    return sum;
+}
+
+/**
+ * @brief Block-aligned reader, using Geotiff::ReadRaster
+ *
+ * @return double checksum of the band, to avoid the loop being optimized away
+ */
+double readBlocks(const std::string &fileName){
+    Geotiff geo(fileName.c_str());
+    Raster<float> band = geo.ReadRaster(1);
+    double sum = 0;
+    for (int row=0; row<band.GetRows(); row++)
+        sum += band(0, row);
+    return sum;
+}
+
+/**
+ * @brief Runs a reader function and prints elapsed time and throughput
+ */
+void timeReader(const std::string &label, double (*reader)(const std::string &), const std::string &fileName, int size){
+    auto t0 = std::chrono::steady_clock::now();
+    double checksum = reader(fileName);
+    auto t1 = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(t1 - t0).count();
+    double mpix = (double)size*size/1.0e6;
+    cout << "\t" << std::left << std::setw(12) << label << std::right << std::fixed << std::setprecision(3)
+         << seconds << " s\t" << std::setprecision(1) << mpix/seconds << " Mpix/s"
+         << "\t(checksum " << checksum << ")" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int size = 4096;
+    std::string workDir = ".";
+    if (argc > 1)
+        size = atoi(argv[1]);
+    if (argc > 2)
+        workDir = argv[2];
+    if (size <= 0){
+        cout << red << "Invalid raster size: " << reset << argv[1] << endl;
+        return -1;
+    }
+
+    cout << cyan << "geotiff_read_bench" << reset << endl;
+    cout << "\tGit commit:\t" << yellow << GIT_COMMIT << reset << endl;
+    cout << "\tRaster size:\t" << size << "x" << size << " Float32 DEFLATE" << endl;
+    cout << "\tGDAL cache:\t" << GDALGetCacheMax64()/(1024*1024) << " MB" << endl;
+
+    GDALAllRegister();
+    const char *layouts[2] = {"striped", "tiled"};
+    for (int i=0; i<2; i++){
+        std::string fileName = workDir + "/bench_" + layouts[i] + ".tif";
+        if (!createSyntheticFile(fileName, size, i == 1)){
+            cout << red << "Error creating synthetic file: " << reset << fileName << endl;
+            return -1;
+        }
+        cout << green << layouts[i] << reset << " (" << fileName << ")" << endl;
+        // closing the pooled handles drops their cached blocks: every reader decodes the whole file
+        GeotiffDatasetPool::Instance().Clear();
+        timeReader("scanline", readScanlines, fileName, size);
+        GeotiffDatasetPool::Instance().Clear();
+        timeReader("block", readBlocks, fileName, size);
+        GetGDALDriverManager()->GetDriverByName("GTiff")->Delete(fileName.c_str());
+    }
+    return 0;
+}
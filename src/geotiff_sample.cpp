@@ -0,0 +1,266 @@
+/**
+ * @file geotiff_sample.cpp
+ * @brief Batched point sampling (nearest, bilinear, bicubic) of a band at georeferenced positions
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_sample.hpp>
+#include <geotiff.hpp>
+#include <geotiff_counters.hpp>
+
+#include <iostream>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// points transformed per OGRCoordinateTransformation::Transform call
+#define GEOTIFF_SAMPLE_TRANSFORM_BATCH 65536
+
+GeotiffSampler::GeotiffSampler(Geotiff &geotiff, int band, size_t cacheBytes) :
+  view(geotiff, band, cacheBytes), nCols(0), nRows(0), bValidGeotransform(false), bHasNoData(false), fNoData(0.0f),
+  targetSRS(NULL), poTransform(NULL) {
+
+  if (!view.isValid())
+    return;
+  int dim[3];
+  geotiff.GetDimensions(dim);
+  nCols = dim[0];
+  nRows = dim[1];
+  bValidGeotransform = GDALInvGeoTransform(geotiff.GetGeoTransform(), invGeotransform) != 0;
+  if (!bValidGeotransform)
+    cout << "[GeotiffSampler] Geotransform of " << geotiff.GetFileName() << " is not invertible" << endl;
+  RasterBandInfo info = geotiff.GetBandInfo(band);
+  bHasNoData = info.hasNoData;
+  fNoData = (float) info.noData;
+  if (geotiff.datasetSpatialRef != NULL){
+    targetSRS = new OGRSpatialReference(*geotiff.datasetSpatialRef);
+#if GDAL_VERSION_MAJOR >= 3
+    targetSRS->SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER);
+#endif
+  }
+}
+
+GeotiffSampler::~GeotiffSampler(){
+  if (poTransform != NULL)
+    OGRCoordinateTransformation::DestroyCT(poTransform);
+  delete targetSRS;
+}
+
+bool GeotiffSampler::SetSourceSRS(const OGRSpatialReference *srs){
+  if (poTransform != NULL)
+    OGRCoordinateTransformation::DestroyCT(poTransform);
+  poTransform = NULL;
+  if (srs == NULL)
+    return true;
+  if (targetSRS == NULL){
+    cout << "[GeotiffSampler] The dataset has no spatial reference: cannot transform the points" << endl;
+    return false;
+  }
+  OGRSpatialReference source(*srs);
+#if GDAL_VERSION_MAJOR >= 3
+  source.SetAxisMappingStrategy(OAMS_TRADITIONAL_GIS_ORDER); // always (x, y) = (lon, lat) / (E, N)
+#endif
+  if (source.IsSame(targetSRS))
+    return true;
+  poTransform = OGRCreateCoordinateTransformation(&source, targetSRS);
+  if (poTransform == NULL){
+    cout << "[GeotiffSampler] No coordinate transformation to the dataset SRS" << endl;
+    return false;
+  }
+  return true;
+}
+
+bool GeotiffSampler::SetSourceEPSG(int epsg){
+  OGRSpatialReference source;
+  if (source.importFromEPSG(epsg) != OGRERR_NONE){
+    cout << "[GeotiffSampler] Unknown EPSG code: " << epsg << endl;
+    return false;
+  }
+  return SetSourceSRS(&source);
+}
+
+// Keys cubic convolution kernel (a = -0.5) weights for the 4 taps around fractional offset t in [0, 1)
+static inline void cubicWeights(double t, double *w){
+  const double a = -0.5;
+  double t2 = t*t, t3 = t2*t;
+  w[0] = a*t3 - 2*a*t2 + a*t;
+  w[1] = (a + 2)*t3 - (a + 3)*t2 + 1;
+  w[2] = -(a + 2)*t3 + (2*a + 3)*t2 - a*t;
+  w[3] = -a*t3 + a*t2;
+}
+
+/**
+ * @brief Interpolates the band at pixel position (px, py) (pixel (0, 0) spans [0, 1) x [0, 1))
+ * @details When the whole neighbourhood lies in the current tile it is read directly from it.
+ * Otherwise every sample goes through the view, which may evict the current tile: tile is then
+ * reset to NULL and the caller fetches it again. Neighbours beyond the raster edge replicate the edge pixels
+ *
+ * @param tile current tile (may be NULL), with upper-left pixel (tileX0, tileY0)
+ * @return interpolated value, NaN if no valid pixel contributes
+ */
+float GeotiffSampler::Interpolate(double px, double py, SampleMethod method, const Raster<float> *&tile, int tileX0, int tileY0){
+  const float fNaN = numeric_limits<float>::quiet_NaN();
+  if (method == SAMPLE_NEAREST){
+    int ix = (int) px, iy = (int) py;
+    float v;
+    if (tile != NULL && ix >= tileX0 && iy >= tileY0 && ix < tileX0 + tile->GetCols() && iy < tileY0 + tile->GetRows())
+      v = (*tile)(ix - tileX0, iy - tileY0);
+    else{
+      v = view.GetPixel(ix, iy);
+      tile = NULL;
+    }
+    return isValidValue(v) ? v : fNaN;
+  }
+
+  // neighbourhood: taps around the pixel centres (pixel i has its centre at i + 0.5)
+  int taps = (method == SAMPLE_BICUBIC) ? 4 : 2;
+  double u = px - 0.5, v = py - 0.5;
+  int x0 = (int) floor(u), y0 = (int) floor(v);
+  double fx = u - x0, fy = v - y0;
+  int first = (method == SAMPLE_BICUBIC) ? -1 : 0;
+
+  float samples[16];
+  int xs[4], ys[4];
+  for (int k=0; k<taps; k++){
+    xs[k] = min(max(x0 + first + k, 0), nCols - 1);
+    ys[k] = min(max(y0 + first + k, 0), nRows - 1);
+  }
+  bool bInTile = tile != NULL && xs[0] >= tileX0 && ys[0] >= tileY0 &&
+                 xs[taps-1] < tileX0 + tile->GetCols() && ys[taps-1] < tileY0 + tile->GetRows();
+  bool bAllValid = true;
+  for (int j=0; j<taps; j++)
+    for (int i=0; i<taps; i++){
+      float s = bInTile ? (*tile)(xs[i] - tileX0, ys[j] - tileY0) : view.GetPixel(xs[i], ys[j]);
+      samples[j*taps + i] = s;
+      bAllValid = bAllValid && isValidValue(s);
+    }
+  if (!bInTile)
+    tile = NULL;
+
+  if (method == SAMPLE_BICUBIC){
+    if (bAllValid){
+      double wx[4], wy[4];
+      cubicWeights(fx, wx);
+      cubicWeights(fy, wy);
+      double sum = 0.0;
+      for (int j=0; j<4; j++){
+        double row = 0.0;
+        for (int i=0; i<4; i++)
+          row += wx[i] * samples[j*4 + i];
+        sum += wy[j] * row;
+      }
+      return (float) sum;
+    }
+    // nodata in the 4x4 neighbourhood: bilinear on the inner 2x2, which renormalizes
+    float inner[4] = {samples[5], samples[6], samples[9], samples[10]};
+    memcpy(samples, inner, sizeof(inner));
+  }
+
+  double w[4] = {(1 - fx)*(1 - fy), fx*(1 - fy), (1 - fx)*fy, fx*fy};
+  double sum = 0.0, weight = 0.0;
+  for (int k=0; k<4; k++){
+    if (!isValidValue(samples[k]))
+      continue;
+    sum += w[k] * samples[k];
+    weight += w[k];
+  }
+  return (weight > 0.0) ? (float)(sum / weight) : fNaN;
+}
+
+/**
+ * @brief Samples a batch of points, visiting them tile by tile
+ *
+ * @param x, y point coordinates, in the source SRS (see SetSourceSRS)
+ * @param n number of points
+ * @param values output, one value per point (NaN: outside the raster or nodata)
+ * @param method interpolation
+ * @return number of valid samples
+ */
+size_t GeotiffSampler::Sample(const double *x, const double *y, size_t n, float *values, SampleMethod method){
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_SAMPLE);
+  const float fNaN = numeric_limits<float>::quiet_NaN();
+  if (!isValid()){
+    std::fill(values, values + n, fNaN);
+    return 0;
+  }
+  pixelX.assign(x, x + n);
+  pixelY.assign(y, y + n);
+
+  // (1) source SRS -> dataset SRS, in place
+  if (poTransform != NULL){
+    std::vector<int> success(min(n, (size_t)GEOTIFF_SAMPLE_TRANSFORM_BATCH));
+    for (size_t i=0; i<n; i+=GEOTIFF_SAMPLE_TRANSFORM_BATCH){
+      size_t count = min(n - i, (size_t)GEOTIFF_SAMPLE_TRANSFORM_BATCH);
+#if GDAL_VERSION_MAJOR >= 3
+      poTransform->Transform(count, &pixelX[i], &pixelY[i], NULL, &success[0]);
+#else
+      poTransform->TransformEx((int)count, &pixelX[i], &pixelY[i], NULL, &success[0]);
+#endif
+      for (size_t k=0; k<count; k++)
+        if (!success[k])
+          pixelX[i + k] = pixelY[i + k] = numeric_limits<double>::quiet_NaN();
+    }
+  }
+
+  // (2) dataset SRS -> pixel, and tile of each point (-1: outside the raster)
+  int tileXSize = view.GetTileXSize(), tileYSize = view.GetTileYSize();
+  int nTiles = view.GetTilesX() * view.GetTilesY();
+  tileKeys.resize(n);
+  for (size_t i=0; i<n; i++){
+    double gx = pixelX[i], gy = pixelY[i];
+    double px = invGeotransform[0] + gx*invGeotransform[1] + gy*invGeotransform[2];
+    double py = invGeotransform[3] + gx*invGeotransform[4] + gy*invGeotransform[5];
+    pixelX[i] = px;
+    pixelY[i] = py;
+    if (!(px >= 0.0 && py >= 0.0 && px < nCols && py < nRows)) // also rejects NaN
+      tileKeys[i] = -1;
+    else
+      tileKeys[i] = ((int)py / tileYSize) * view.GetTilesX() + (int)px / tileXSize;
+  }
+
+  // (3) order the points by tile: counting sort when the tile grid is small compared with the batch
+  order.resize(n);
+  if ((size_t)nTiles <= n){
+    std::vector<size_t> start(nTiles + 2, 0);
+    for (size_t i=0; i<n; i++)
+      start[tileKeys[i] + 2]++;
+    for (int k=2; k<nTiles + 2; k++)
+      start[k] += start[k-1];
+    for (size_t i=0; i<n; i++)
+      order[start[tileKeys[i] + 1]++] = i;
+  }
+  else{
+    for (size_t i=0; i<n; i++)
+      order[i] = i;
+    std::vector<int> &keys = tileKeys;
+    std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b){ return keys[a] < keys[b]; });
+  }
+
+  // (4) interpolate, one tile at a time
+  size_t nValid = 0;
+  int currentKey = -2;
+  const Raster<float> *tile = NULL;
+  int tileX0 = 0, tileY0 = 0;
+  for (size_t k=0; k<n; k++){
+    size_t i = order[k];
+    int key = tileKeys[i];
+    if (key < 0){
+      values[i] = fNaN;
+      continue;
+    }
+    if (key != currentKey || tile == NULL){
+      currentKey = key;
+      int tx = key % view.GetTilesX(), ty = key / view.GetTilesX();
+      tile = view.GetTile(tx, ty);
+      tileX0 = tx * tileXSize;
+      tileY0 = ty * tileYSize;
+    }
+    values[i] = Interpolate(pixelX[i], pixelY[i], method, tile, tileX0, tileY0);
+    if (values[i] == values[i])
+      nValid++;
+  }
+  return nValid;
+}
@@ -0,0 +1,706 @@
+/**
+ * @file geotiff_simd.cpp
+ * @brief Vectorized (AVX2 / SSE2) pixel kernels used by the Geotiff read paths
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_simd.hpp>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GEOTIFF_SIMD_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GEOTIFF_SIMD_SSE2
+#endif
+
+// NOTE: every vector step loads its whole input before storing its output, and the output
+// of step i never reaches the input of step i+1 when src sits at the end of dst (in-place widening).
+// Loads are sized exactly to the input elements, so no byte beyond src + n is ever touched
+
+/**
+ * @brief Scalar conversion of pixels [i0, n)
+ */
+template<typename T>
+static void convertScalar(const T *src, float *dst, size_t i0, size_t n){
+  for (size_t i=i0; i<n; i++){
+    T v;
+    memcpy(&v, src + i, sizeof(T)); // src may alias dst: no typed access through dst-overlapping pointers
+    dst[i] = (float)v;
+  }
+}
+
+#if defined(GEOTIFF_SIMD_AVX2)
+
+static size_t convertVector(const unsigned char *src, float *dst, size_t n){
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8){
+    __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(v));
+  }
+  return i;
+}
+
+static size_t convertVector(const unsigned short *src, float *dst, size_t n){
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8){
+    __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(v));
+  }
+  return i;
+}
+
+static size_t convertVector(const short *src, float *dst, size_t n){
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8){
+    __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(v));
+  }
+  return i;
+}
+
+static size_t convertVector(const int *src, float *dst, size_t n){
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8){
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(v));
+  }
+  return i;
+}
+
+static size_t convertVector(const unsigned int *src, float *dst, size_t n){
+  // no unsigned 32-bit conversion before AVX-512: split in 16-bit halves, hi*65536 is exact
+  const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+  const __m256 scale = _mm256_set1_ps(65536.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8){
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16));
+    __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(v, lowMask));
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_mul_ps(hi, scale), lo));
+  }
+  return i;
+}
+
+#elif defined(GEOTIFF_SIMD_SSE2)
+
+static size_t convertVector(const unsigned char *src, float *dst, size_t n){
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4){
+    int packed;
+    memcpy(&packed, src + i, 4);
+    __m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+    v = _mm_unpacklo_epi16(v, zero);
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(v));
+  }
+  return i;
+}
+
+static size_t convertVector(const unsigned short *src, float *dst, size_t n){
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4){
+    __m128i v = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(src + i)), zero);
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(v));
+  }
+  return i;
+}
+
+static size_t convertVector(const short *src, float *dst, size_t n){
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4){
+    __m128i v = _mm_loadl_epi64((const __m128i *)(src + i));
+    v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); // sign extension
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(v));
+  }
+  return i;
+}
+
+static size_t convertVector(const int *src, float *dst, size_t n){
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4){
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(v));
+  }
+  return i;
+}
+
+static size_t convertVector(const unsigned int *src, float *dst, size_t n){
+  const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+  const __m128 scale = _mm_set1_ps(65536.0f);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4){
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(v, 16));
+    __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(v, lowMask));
+    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(hi, scale), lo));
+  }
+  return i;
+}
+
+#else
+
+template<typename T>
+static size_t convertVector(const T *, float *, size_t){
+  return 0; // scalar build: everything is handled by convertScalar
+}
+
+#endif
+
+template<typename T>
+static void convert(const void *src, float *dst, size_t n){
+  const T *typedSrc = (const T *) src;
+  size_t i = convertVector(typedSrc, dst, n);
+  convertScalar(typedSrc, dst, i, n);
+}
+
+bool GeotiffCanConvertToFloat(GDALDataType srcType){
+  switch (srcType){
+    case GDT_Byte:
+    case GDT_UInt16:
+    case GDT_Int16:
+    case GDT_UInt32:
+    case GDT_Int32:
+    case GDT_Float32:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Widens n pixels of type srcType to float, in place when src is at the tail of dst
+ *
+ * @param src input pixels, in srcType
+ * @param srcType GDAL data type of the input pixels
+ * @param dst output float buffer (n elements)
+ * @param n number of pixels
+ * @return true if srcType is supported
+ */
+bool GeotiffConvertToFloat(const void *src, GDALDataType srcType, float *dst, size_t n){
+  switch (srcType){
+    case GDT_Byte:
+      convert<unsigned char>(src, dst, n);
+      return true;
+    case GDT_UInt16:
+      convert<unsigned short>(src, dst, n);
+      return true;
+    case GDT_Int16:
+      convert<short>(src, dst, n);
+      return true;
+    case GDT_UInt32:
+      convert<unsigned int>(src, dst, n);
+      return true;
+    case GDT_Int32:
+      convert<int>(src, dst, n);
+      return true;
+    case GDT_Float32:
+      if ((const void *) dst != src)
+        memmove(dst, src, n*sizeof(float));
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Masked conversion: the nodata compare runs on the source values (widened to 32-bit lanes for the
+// integer types, where equality is exact), the NaN blend and the mask bits come from the same compare.
+// Same load-before-store order as convertVector, so it is safe in place as well
+
+static inline void setMaskBits(uint64_t *mask, size_t i, uint64_t validBits){
+  mask[i >> 6] |= validBits << (i & 63);
+}
+
+#if defined(GEOTIFF_SIMD_AVX2)
+
+static inline __m256i load8(const unsigned char *p){ return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) p)); }
+static inline __m256i load8(const unsigned short *p){ return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) p)); }
+static inline __m256i load8(const short *p){ return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) p)); }
+static inline __m256i load8(const int *p){ return _mm256_loadu_si256((const __m256i *) p); }
+static inline __m256i load8(const unsigned int *p){ return _mm256_loadu_si256((const __m256i *) p); }
+
+template<typename T>
+static inline __m256 toFloat8(__m256i v, const T *){ return _mm256_cvtepi32_ps(v); }
+static inline __m256 toFloat8(__m256i v, const unsigned int *){
+  __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16));
+  __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(v, _mm256_set1_epi32(0xFFFF)));
+  return _mm256_add_ps(_mm256_mul_ps(hi, _mm256_set1_ps(65536.0f)), lo);
+}
+
+template<typename T>
+static size_t convertMaskedVector(const T *src, float *dst, size_t n, bool compare, int32_t noDataBits,
+                                  bool nanFill, uint64_t *mask){
+  const __m256i nd = _mm256_set1_epi32(noDataBits);
+  const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8){
+    __m256i v = load8(src + i);
+    __m256 f = toFloat8(v, src);
+    __m256 invalid = compare ? _mm256_castsi256_ps(_mm256_cmpeq_epi32(v, nd)) : _mm256_setzero_ps();
+    if (nanFill)
+      f = _mm256_blendv_ps(f, nan, invalid);
+    _mm256_storeu_ps(dst + i, f);
+    if (mask != NULL)
+      setMaskBits(mask, i, ~_mm256_movemask_ps(invalid) & 0xFF);
+  }
+  return i;
+}
+
+static size_t convertMaskedVector(const float *src, float *dst, size_t n, bool compare, float noData,
+                                  bool nanFill, uint64_t *mask){
+  const __m256 nd = _mm256_set1_ps(noData);
+  const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8){
+    __m256 v = _mm256_loadu_ps(src + i);
+    __m256 invalid = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+    if (compare)
+      invalid = _mm256_or_ps(invalid, _mm256_cmp_ps(v, nd, _CMP_EQ_OQ));
+    if (nanFill)
+      v = _mm256_blendv_ps(v, nan, invalid);
+    _mm256_storeu_ps(dst + i, v);
+    if (mask != NULL)
+      setMaskBits(mask, i, ~_mm256_movemask_ps(invalid) & 0xFF);
+  }
+  return i;
+}
+
+#elif defined(GEOTIFF_SIMD_SSE2)
+
+static inline __m128i load4(const unsigned char *p){
+  int packed;
+  memcpy(&packed, p, 4);
+  __m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), _mm_setzero_si128());
+  return _mm_unpacklo_epi16(v, _mm_setzero_si128());
+}
+static inline __m128i load4(const unsigned short *p){ return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) p), _mm_setzero_si128()); }
+static inline __m128i load4(const short *p){
+  __m128i v = _mm_loadl_epi64((const __m128i *) p);
+  return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+static inline __m128i load4(const int *p){ return _mm_loadu_si128((const __m128i *) p); }
+static inline __m128i load4(const unsigned int *p){ return _mm_loadu_si128((const __m128i *) p); }
+
+template<typename T>
+static inline __m128 toFloat4(__m128i v, const T *){ return _mm_cvtepi32_ps(v); }
+static inline __m128 toFloat4(__m128i v, const unsigned int *){
+  __m128 hi = _mm_cvtepi32_ps(_mm_srli_epi32(v, 16));
+  __m128 lo = _mm_cvtepi32_ps(_mm_and_si128(v, _mm_set1_epi32(0xFFFF)));
+  return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo);
+}
+
+template<typename T>
+static size_t convertMaskedVector(const T *src, float *dst, size_t n, bool compare, int32_t noDataBits,
+                                  bool nanFill, uint64_t *mask){
+  const __m128i nd = _mm_set1_epi32(noDataBits);
+  const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4){
+    __m128i v = load4(src + i);
+    __m128 f = toFloat4(v, src);
+    __m128 invalid = compare ? _mm_castsi128_ps(_mm_cmpeq_epi32(v, nd)) : _mm_setzero_ps();
+    if (nanFill)
+      f = _mm_or_ps(_mm_andnot_ps(invalid, f), _mm_and_ps(invalid, nan));
+    _mm_storeu_ps(dst + i, f);
+    if (mask != NULL)
+      setMaskBits(mask, i, ~_mm_movemask_ps(invalid) & 0xF);
+  }
+  return i;
+}
+
+static size_t convertMaskedVector(const float *src, float *dst, size_t n, bool compare, float noData,
+                                  bool nanFill, uint64_t *mask){
+  const __m128 nd = _mm_set1_ps(noData);
+  const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4){
+    __m128 v = _mm_loadu_ps(src + i);
+    __m128 invalid = _mm_cmpunord_ps(v, v);
+    if (compare)
+      invalid = _mm_or_ps(invalid, _mm_cmpeq_ps(v, nd));
+    if (nanFill)
+      v = _mm_or_ps(_mm_andnot_ps(invalid, v), _mm_and_ps(invalid, nan));
+    _mm_storeu_ps(dst + i, v);
+    if (mask != NULL)
+      setMaskBits(mask, i, ~_mm_movemask_ps(invalid) & 0xF);
+  }
+  return i;
+}
+
+#else
+
+template<typename T>
+static size_t convertMaskedVector(const T *, float *, size_t, bool, int32_t, bool, uint64_t *){
+  return 0;
+}
+
+static size_t convertMaskedVector(const float *, float *, size_t, bool, float, bool, uint64_t *){
+  return 0;
+}
+
+#endif
+
+/**
+ * @brief Masked conversion of integer pixels. The nodata value must be representable in T
+ */
+template<typename T>
+static void convertMasked(const void *src, float *dst, size_t n, bool compare, double noData,
+                          bool nanFill, uint64_t *mask){
+  const T *typedSrc = (const T *) src;
+  T noDataValue = compare ? (T) noData : 0;
+  uint32_t noDataBits = (uint32_t)(int32_t) noDataValue; // value of the widened 32-bit lane
+  if (mask != NULL)
+    memset(mask, 0, (n + 63) / 64 * sizeof(uint64_t));
+  size_t i = convertMaskedVector(typedSrc, dst, n, compare, (int32_t) noDataBits, nanFill, mask);
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for (; i<n; i++){
+    T v;
+    memcpy(&v, typedSrc + i, sizeof(T));
+    bool valid = !(compare && v == noDataValue);
+    dst[i] = (valid || !nanFill) ? (float) v : nan;
+    if (valid && mask != NULL)
+      setMaskBits(mask, i, 1);
+  }
+}
+
+static void convertMaskedFloat(const void *src, float *dst, size_t n, bool compare, double noData,
+                               bool nanFill, uint64_t *mask){
+  const float *typedSrc = (const float *) src;
+  float noDataValue = (float) noData;
+  if (mask != NULL)
+    memset(mask, 0, (n + 63) / 64 * sizeof(uint64_t));
+  size_t i = convertMaskedVector(typedSrc, dst, n, compare, noDataValue, nanFill, mask);
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for (; i<n; i++){
+    float v;
+    memcpy(&v, typedSrc + i, sizeof(float));
+    bool valid = (v == v) && !(compare && v == noDataValue);
+    dst[i] = (valid || !nanFill) ? v : nan;
+    if (valid && mask != NULL)
+      setMaskBits(mask, i, 1);
+  }
+}
+
+// true if noData is a value of the integer type [minValue, maxValue]
+static bool isIntegerNoData(double noData, double minValue, double maxValue){
+  return noData == noData && noData >= minValue && noData <= maxValue && noData == (double)(long long) noData;
+}
+
+/**
+ * @brief Widens n pixels to float and flags nodata / NaN pixels in the same pass
+ *
+ * @param src input pixels, in srcType (may overlap dst as in GeotiffConvertToFloat)
+ * @param srcType GDAL data type of the input pixels
+ * @param dst output float buffer (n elements)
+ * @param n number of pixels
+ * @param hasNoData, noData nodata definition of the band
+ * @param nanFill write invalid pixels as NaN
+ * @param mask optional packed validity bits (ceil(n / 64) words)
+ * @return true if srcType is supported
+ */
+bool GeotiffConvertToFloatMasked(const void *src, GDALDataType srcType, float *dst, size_t n,
+                                 bool hasNoData, double noData, bool nanFill, uint64_t *mask){
+  switch (srcType){
+    case GDT_Byte:
+      convertMasked<unsigned char>(src, dst, n, hasNoData && isIntegerNoData(noData, 0, 255), noData, nanFill, mask);
+      return true;
+    case GDT_UInt16:
+      convertMasked<unsigned short>(src, dst, n, hasNoData && isIntegerNoData(noData, 0, 65535), noData, nanFill, mask);
+      return true;
+    case GDT_Int16:
+      convertMasked<short>(src, dst, n, hasNoData && isIntegerNoData(noData, -32768, 32767), noData, nanFill, mask);
+      return true;
+    case GDT_UInt32:
+      convertMasked<unsigned int>(src, dst, n, hasNoData && isIntegerNoData(noData, 0, 4294967295.0), noData, nanFill, mask);
+      return true;
+    case GDT_Int32:
+      convertMasked<int>(src, dst, n, hasNoData && isIntegerNoData(noData, -2147483648.0, 2147483647.0), noData, nanFill, mask);
+      return true;
+    case GDT_Float32:
+      convertMaskedFloat(src, dst, n, hasNoData && noData == noData, noData, nanFill, mask);
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Invalidates the pixels where a GDAL mask band is 0
+ * @details The mask band is scanned 16 bytes at a time: fully valid runs (the common case) cost one
+ * compare, and only runs with masked pixels touch dst and the mask bits
+ */
+void GeotiffApplyMaskBand(const unsigned char *maskBand, float *dst, size_t n, bool nanFill, uint64_t *mask){
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  size_t i = 0;
+#if defined(GEOTIFF_SIMD_AVX2) || defined(GEOTIFF_SIMD_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16){
+    __m128i m = _mm_loadu_si128((const __m128i *)(maskBand + i));
+    unsigned int invalidBits = _mm_movemask_epi8(_mm_cmpeq_epi8(m, zero));
+    if (invalidBits == 0)
+      continue;
+    if (mask != NULL){
+      // 16 bits never straddle a word: i is a multiple of 16
+      mask[i >> 6] &= ~((uint64_t) invalidBits << (i & 63));
+    }
+    if (nanFill){
+      for (int k=0; k<16; k++)
+        if (invalidBits & (1u << k))
+          dst[i + k] = nan;
+    }
+  }
+#endif
+  for (; i<n; i++){
+    if (maskBand[i] != 0)
+      continue;
+    if (mask != NULL)
+      mask[i >> 6] &= ~((uint64_t) 1 << (i & 63));
+    if (nanFill)
+      dst[i] = nan;
+  }
+}
+
+/**
+ * @brief Merges two partial reductions (Chan et al. pairwise update)
+ */
+void GeotiffReductionMerge(GeotiffReduction &dst, const GeotiffReduction &src){
+  dst.noDataCount += src.noDataCount;
+  if (src.count == 0)
+    return;
+  if (dst.count == 0){
+    size_t noData = dst.noDataCount;
+    dst = src;
+    dst.noDataCount = noData;
+    return;
+  }
+  double n = (double)(dst.count + src.count);
+  double delta = src.mean - dst.mean;
+  dst.mean += delta * src.count / n;
+  dst.m2 += src.m2 + delta * delta * ((double)dst.count * src.count / n);
+  dst.count += src.count;
+  dst.min = std::min(dst.min, src.min);
+  dst.max = std::max(dst.max, src.max);
+}
+
+// Vector part of the reduction: accumulates min, max, the valid count and the sums of (v - shift)
+// and (v - shift)^2 in double lanes. Returns the number of pixels processed
+#if defined(GEOTIFF_SIMD_AVX2)
+
+static size_t reduceVector(const float *src, size_t n, bool hasNoData, float noData, float shift,
+                           float &vmin, float &vmax, size_t &count, double &s1, double &s2){
+  const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  const __m256 ninf = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+  const __m256 nd = _mm256_set1_ps(noData);
+  const __m256 sh = _mm256_set1_ps(shift);
+  __m256 mn = inf, mx = ninf;
+  __m256d sum = _mm256_setzero_pd(), sumSq = _mm256_setzero_pd();
+  size_t valid = 0;
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8){
+    __m256 v = _mm256_loadu_ps(src + i);
+    __m256 mask = _mm256_cmp_ps(v, v, _CMP_ORD_Q);
+    if (hasNoData)
+      mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, nd, _CMP_NEQ_UQ));
+    valid += __builtin_popcount(_mm256_movemask_ps(mask));
+    mn = _mm256_min_ps(mn, _mm256_blendv_ps(inf, v, mask));
+    mx = _mm256_max_ps(mx, _mm256_blendv_ps(ninf, v, mask));
+    __m256 d = _mm256_and_ps(_mm256_sub_ps(v, sh), mask);
+    __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(d));
+    __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1));
+    sum = _mm256_add_pd(sum, _mm256_add_pd(lo, hi));
+#if defined(__FMA__)
+    sumSq = _mm256_fmadd_pd(lo, lo, sumSq);
+    sumSq = _mm256_fmadd_pd(hi, hi, sumSq);
+#else // -mavx2 without -mfma
+    sumSq = _mm256_add_pd(sumSq, _mm256_add_pd(_mm256_mul_pd(lo, lo), _mm256_mul_pd(hi, hi)));
+#endif
+  }
+  float lanes[8];
+  double dlanes[4];
+  _mm256_storeu_ps(lanes, mn);
+  vmin = *std::min_element(lanes, lanes + 8);
+  _mm256_storeu_ps(lanes, mx);
+  vmax = *std::max_element(lanes, lanes + 8);
+  _mm256_storeu_pd(dlanes, sum);
+  s1 = dlanes[0] + dlanes[1] + dlanes[2] + dlanes[3];
+  _mm256_storeu_pd(dlanes, sumSq);
+  s2 = dlanes[0] + dlanes[1] + dlanes[2] + dlanes[3];
+  count = valid;
+  return i;
+}
+
+#elif defined(GEOTIFF_SIMD_SSE2)
+
+static size_t reduceVector(const float *src, size_t n, bool hasNoData, float noData, float shift,
+                           float &vmin, float &vmax, size_t &count, double &s1, double &s2){
+  static const int bitCount[16] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4};
+  const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  const __m128 ninf = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+  const __m128 nd = _mm_set1_ps(noData);
+  const __m128 sh = _mm_set1_ps(shift);
+  __m128 mn = inf, mx = ninf;
+  __m128d sum = _mm_setzero_pd(), sumSq = _mm_setzero_pd();
+  size_t valid = 0;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4){
+    __m128 v = _mm_loadu_ps(src + i);
+    __m128 mask = _mm_cmpord_ps(v, v);
+    if (hasNoData)
+      mask = _mm_and_ps(mask, _mm_cmpneq_ps(v, nd));
+    valid += bitCount[_mm_movemask_ps(mask)];
+    mn = _mm_min_ps(mn, _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, inf)));
+    mx = _mm_max_ps(mx, _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, ninf)));
+    __m128 d = _mm_and_ps(_mm_sub_ps(v, sh), mask);
+    __m128d lo = _mm_cvtps_pd(d);
+    __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(d, d));
+    sum = _mm_add_pd(sum, _mm_add_pd(lo, hi));
+    sumSq = _mm_add_pd(sumSq, _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+  }
+  float lanes[4];
+  double dlanes[2];
+  _mm_storeu_ps(lanes, mn);
+  vmin = *std::min_element(lanes, lanes + 4);
+  _mm_storeu_ps(lanes, mx);
+  vmax = *std::max_element(lanes, lanes + 4);
+  _mm_storeu_pd(dlanes, sum);
+  s1 = dlanes[0] + dlanes[1];
+  _mm_storeu_pd(dlanes, sumSq);
+  s2 = dlanes[0] + dlanes[1];
+  count = valid;
+  return i;
+}
+
+#else
+
+static size_t reduceVector(const float *, size_t, bool, float, float,
+                           float &vmin, float &vmax, size_t &count, double &s1, double &s2){
+  vmin = std::numeric_limits<float>::infinity();
+  vmax = -std::numeric_limits<float>::infinity();
+  count = 0;
+  s1 = s2 = 0.0;
+  return 0;
+}
+
+#endif
+
+static inline bool isValidPixel(float v, bool hasNoData, float noData){
+  return v == v && !(hasNoData && v == noData);
+}
+
+/**
+ * @brief Accumulates the statistics of n float pixels into r
+ *
+ * Sums are taken around the first valid pixel (shift) so the m2 = S2 - S1^2/n step does not cancel
+ * catastrophically when the values are large compared with their spread (e.g. elevations)
+ */
+void GeotiffReduceFloat(const float *src, size_t n, bool hasNoData, float noData, GeotiffReduction &r){
+  size_t first = 0;
+  while (first < n && !isValidPixel(src[first], hasNoData, noData))
+    first++;
+  GeotiffReduction local;
+  local.noDataCount = first;
+  if (first == n){
+    GeotiffReductionMerge(r, local);
+    return;
+  }
+  src += first;
+  n -= first;
+  float shift = src[0];
+
+  float vmin, vmax;
+  size_t count;
+  double s1, s2;
+  size_t i = reduceVector(src, n, hasNoData, noData, shift, vmin, vmax, count, s1, s2);
+  for (; i<n; i++){
+    float v = src[i];
+    if (!isValidPixel(v, hasNoData, noData))
+      continue;
+    count++;
+    vmin = std::min(vmin, v);
+    vmax = std::max(vmax, v);
+    double d = (double)(v - shift);
+    s1 += d;
+    s2 += d*d;
+  }
+  local.noDataCount += n - count;
+  local.count = count;
+  local.min = vmin;
+  local.max = vmax;
+  local.mean = shift + s1 / count;
+  local.m2 = std::max(0.0, s2 - s1 * s1 / count);
+  GeotiffReductionMerge(r, local);
+}
+
+/**
+ * @brief Adds the valid pixels of src to an nBins histogram over [min, max]
+ *
+ * Bin indices are computed in vector lanes; invalid pixels are sent to an extra overflow bin,
+ * so the scatter loop has no branches
+ */
+void GeotiffHistogramFloat(const float *src, size_t n, bool hasNoData, float noData,
+                           double min, double max, int nBins, GUIntBig *histogram){
+  if (nBins <= 0)
+    return;
+  std::vector<GUIntBig> local(nBins + 1, 0);
+  float fmin = (float) min;
+  float fscale = (max > min) ? (float)(nBins / (max - min)) : 0.0f;
+  float flast = (float)(nBins - 1);
+  size_t i = 0;
+#if defined(GEOTIFF_SIMD_AVX2)
+  const __m256 vmin = _mm256_set1_ps(fmin), vscale = _mm256_set1_ps(fscale);
+  const __m256 vlast = _mm256_set1_ps(flast), zero = _mm256_setzero_ps(), nd = _mm256_set1_ps(noData);
+  const __m256i overflow = _mm256_set1_epi32(nBins);
+  int idx[8];
+  for (; i + 8 <= n; i += 8){
+    __m256 v = _mm256_loadu_ps(src + i);
+    __m256 mask = _mm256_cmp_ps(v, v, _CMP_ORD_Q);
+    if (hasNoData)
+      mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, nd, _CMP_NEQ_UQ));
+    __m256 f = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(v, vmin), vscale), zero), vlast);
+    __m256i bin = _mm256_blendv_epi8(overflow, _mm256_cvttps_epi32(f), _mm256_castps_si256(mask));
+    _mm256_storeu_si256((__m256i *) idx, bin);
+    for (int k=0; k<8; k++)
+      local[idx[k]]++;
+  }
+#elif defined(GEOTIFF_SIMD_SSE2)
+  const __m128 vmin = _mm_set1_ps(fmin), vscale = _mm_set1_ps(fscale);
+  const __m128 vlast = _mm_set1_ps(flast), zero = _mm_setzero_ps(), nd = _mm_set1_ps(noData);
+  const __m128i overflow = _mm_set1_epi32(nBins);
+  int idx[4];
+  for (; i + 4 <= n; i += 4){
+    __m128 v = _mm_loadu_ps(src + i);
+    __m128 mask = _mm_cmpord_ps(v, v);
+    if (hasNoData)
+      mask = _mm_and_ps(mask, _mm_cmpneq_ps(v, nd));
+    __m128 f = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(v, vmin), vscale), zero), vlast);
+    __m128i m = _mm_castps_si128(mask);
+    __m128i bin = _mm_or_si128(_mm_and_si128(m, _mm_cvttps_epi32(f)), _mm_andnot_si128(m, overflow));
+    _mm_storeu_si128((__m128i *) idx, bin);
+    for (int k=0; k<4; k++)
+      local[idx[k]]++;
+  }
+#endif
+  for (; i<n; i++){
+    float v = src[i];
+    if (!isValidPixel(v, hasNoData, noData))
+      continue;
+    float f = std::min(std::max((v - fmin) * fscale, 0.0f), flast);
+    local[(int) f]++;
+  }
+  for (int b=0; b<nBins; b++)
+    histogram[b] += local[b];
+}
+
+const char *GeotiffSIMDName(){
+#if defined(GEOTIFF_SIMD_AVX2)
+  return "AVX2";
+#elif defined(GEOTIFF_SIMD_SSE2)
+  return "SSE2";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,330 @@
+/**
+ * @file geotiff_stats.cpp
+ * @brief Exact (parallel, SIMD) and approximate band statistics, cached in memory and in PAM sidecars
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_stats.hpp>
+#include <geotiff_simd.hpp>
+#include <geotiff_parallel.hpp>
+#include <geotiff_counters.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <mutex>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <cpl_conv.h>
+#include <cpl_string.h>
+#include <cpl_vsi.h>
+
+using namespace std;
+
+// PAM metadata items written next to the standard STATISTICS_* ones
+#define GEOTIFF_STATS_VALID_COUNT   "STATISTICS_VALID_COUNT"
+#define GEOTIFF_STATS_NODATA_COUNT  "STATISTICS_NODATA_COUNT"
+#define GEOTIFF_STATS_APPROXIMATE   "STATISTICS_APPROXIMATE"
+
+namespace {
+
+struct StatsCacheEntry {
+  long long mtime, size;        // identity of the file the statistics were computed from
+  RasterStatistics stats;
+};
+
+std::mutex statsCacheLock;
+std::map<std::string, StatsCacheEntry> statsCache;
+
+std::string cacheKey(const char *filename, int band, int nBins){
+  std::ostringstream ss;
+  ss << filename << '#' << band << '#' << nBins;
+  return ss.str();
+}
+
+// Cached statistics of key, if computed from the file as it is now (and exact, unless approximate is accepted)
+bool findCached(const std::string &key, const VSIStatBufL &sStat, bool approximate, RasterStatistics &stats){
+  std::lock_guard<std::mutex> guard(statsCacheLock);
+  std::map<std::string, StatsCacheEntry>::iterator it = statsCache.find(key);
+  if (it == statsCache.end() || it->second.mtime != (long long)sStat.st_mtime || it->second.size != (long long)sStat.st_size ||
+      (!approximate && it->second.stats.approximate))
+    return false;
+  stats = it->second.stats;
+  return true;
+}
+
+std::string toString(size_t value){
+  std::ostringstream ss;
+  ss << value;
+  return ss.str();
+}
+
+}
+
+/**
+ * @brief Reads statistics previously stored in the PAM metadata of the band
+ *
+ * @return true if complete statistics (including our counts and an nBins histogram) are available
+ */
+static bool readPAMStatistics(GDALRasterBand *poBand, bool approximate, int nBins, RasterStatistics &stats){
+  const char *pszApprox = poBand->GetMetadataItem(GEOTIFF_STATS_APPROXIMATE);
+  bool bApprox = (pszApprox != NULL && EQUAL(pszApprox, "YES"));
+  if (bApprox && !approximate)
+    return false;
+  const char *pszValid = poBand->GetMetadataItem(GEOTIFF_STATS_VALID_COUNT);
+  const char *pszNoData = poBand->GetMetadataItem(GEOTIFF_STATS_NODATA_COUNT);
+  if (pszValid == NULL || pszNoData == NULL)
+    return false; // written by another tool: counts unknown
+  // bForce = FALSE: only return what is already stored
+  if (poBand->GetStatistics(approximate, FALSE, &stats.min, &stats.max, &stats.mean, &stats.stdDev) != CE_None)
+    return false;
+  int nBuckets = 0;
+  GUIntBig *panHistogram = NULL;
+  if (poBand->GetDefaultHistogram(&stats.histMin, &stats.histMax, &nBuckets, &panHistogram, FALSE, NULL, NULL) != CE_None){
+    CPLFree(panHistogram);
+    return false;
+  }
+  bool bOk = (nBuckets == nBins && panHistogram != NULL);
+  if (bOk)
+    stats.histogram.assign(panHistogram, panHistogram + nBuckets);
+  CPLFree(panHistogram);
+  stats.validCount = strtoull(pszValid, NULL, 10);
+  stats.noDataCount = strtoull(pszNoData, NULL, 10);
+  stats.approximate = bApprox;
+  return bOk;
+}
+
+/**
+ * @brief Stores the statistics in the PAM metadata of the band (written to .aux.xml when the dataset is closed)
+ */
+static void writePAMStatistics(GDALRasterBand *poBand, RasterStatistics &stats){
+  poBand->SetStatistics(stats.min, stats.max, stats.mean, stats.stdDev);
+  poBand->SetMetadataItem(GEOTIFF_STATS_VALID_COUNT, toString(stats.validCount).c_str());
+  poBand->SetMetadataItem(GEOTIFF_STATS_NODATA_COUNT, toString(stats.noDataCount).c_str());
+  poBand->SetMetadataItem(GEOTIFF_STATS_APPROXIMATE, stats.approximate ? "YES" : NULL);
+  if (!stats.histogram.empty())
+    poBand->SetDefaultHistogram(stats.histMin, stats.histMax, (int)stats.histogram.size(), &stats.histogram[0]);
+}
+
+// Integer (non complex) data types. GDALDataTypeIsInteger needs GDAL 2.3, while 2.2 is supported
+static bool isIntegerType(GDALDataType dataType){
+  switch (dataType){
+    case GDT_Byte:
+    case GDT_UInt16:
+    case GDT_Int16:
+    case GDT_UInt32:
+    case GDT_Int32:
+#if GDAL_VERSION_NUM >= 3070000
+    case GDT_Int8:
+#endif
+#if GDAL_VERSION_NUM >= 3050000
+    case GDT_UInt64:
+    case GDT_Int64:
+#endif
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Fills min ... stdDev and the histogram range from a reduction
+ */
+static void setFromReduction(const GeotiffReduction &r, GDALDataType dataType, int nBins, RasterStatistics &stats){
+  stats.validCount = r.count;
+  stats.noDataCount = r.noDataCount;
+  stats.histogram.assign(nBins, 0);
+  if (r.count == 0)
+    return;
+  stats.min = r.min;
+  stats.max = r.max;
+  stats.mean = r.mean;
+  stats.stdDev = sqrt(r.m2 / r.count);
+  // integer values sit in the middle of their bins, as in gdalinfo -hist
+  bool bInteger = isIntegerType(dataType);
+  stats.histMin = bInteger ? r.min - 0.5 : r.min;
+  stats.histMax = bInteger ? r.max + 0.5 : r.max;
+}
+
+/**
+ * @brief Exact statistics: two parallel passes over the band (reduction, then histogram over [min, max])
+ */
+static bool computeExact(const char *filename, int band, GDALDataType dataType, bool hasNoData, float noData,
+                         int nBins, int nThreads, RasterStatistics &stats){
+  GeotiffParallelReader reader(filename, nThreads);
+  if (!reader.isValid())
+    return false;
+  int dim[3];
+  reader.GetDimensions(dim);
+  std::vector<GeotiffTileTask> tiles = reader.MakeTiles(band, 0, 0, dim[0], dim[1]);
+  int nWorkers = reader.GetThreadCount();
+  std::vector<std::vector<float> > buffers(nWorkers);
+
+  // pass 1: per-worker reductions, merged at the end
+  std::vector<GeotiffReduction> reductions(nWorkers);
+  bool bOk = reader.ForEachTile(tiles, [&](GDALDataset *dataset, const GeotiffTileTask &tile, int worker){
+    std::vector<float> &buffer = buffers[worker];
+    buffer.resize((size_t)tile.xSize * tile.ySize);
+    GEOTIFF_STATS_START(tRead);
+    CPLErr e = dataset->GetRasterBand(tile.band)->RasterIO(GF_Read, tile.xOff, tile.yOff, tile.xSize, tile.ySize,
+                                                           &buffer[0], tile.xSize, tile.ySize, GDT_Float32, 0, 0);
+    GEOTIFF_STATS_RASTERIO(tRead, buffer.size()*sizeof(float),
+                           GeotiffStatsBlocks(dataset->GetRasterBand(tile.band), tile.xOff, tile.yOff, tile.xSize, tile.ySize));
+    if (e != CE_None)
+      return false;
+    GeotiffReduceFloat(&buffer[0], buffer.size(), hasNoData, noData, reductions[worker]);
+    return true;
+  });
+  if (!bOk)
+    return false;
+  GeotiffReduction total;
+  for (int w=0; w<nWorkers; w++)
+    GeotiffReductionMerge(total, reductions[w]);
+  setFromReduction(total, dataType, nBins, stats);
+  if (total.count == 0)
+    return true;
+
+  // pass 2: per-worker histograms
+  std::vector<std::vector<GUIntBig> > histograms(nWorkers, std::vector<GUIntBig>(nBins, 0));
+  bOk = reader.ForEachTile(tiles, [&](GDALDataset *dataset, const GeotiffTileTask &tile, int worker){
+    std::vector<float> &buffer = buffers[worker];
+    buffer.resize((size_t)tile.xSize * tile.ySize);
+    GEOTIFF_STATS_START(tRead);
+    CPLErr e = dataset->GetRasterBand(tile.band)->RasterIO(GF_Read, tile.xOff, tile.yOff, tile.xSize, tile.ySize,
+                                                           &buffer[0], tile.xSize, tile.ySize, GDT_Float32, 0, 0);
+    GEOTIFF_STATS_RASTERIO(tRead, buffer.size()*sizeof(float),
+                           GeotiffStatsBlocks(dataset->GetRasterBand(tile.band), tile.xOff, tile.yOff, tile.xSize, tile.ySize));
+    if (e != CE_None)
+      return false;
+    GeotiffHistogramFloat(&buffer[0], buffer.size(), hasNoData, noData, stats.histMin, stats.histMax, nBins, &histograms[worker][0]);
+    return true;
+  });
+  if (!bOk)
+    return false;
+  for (int w=0; w<nWorkers; w++)
+    for (int b=0; b<nBins; b++)
+      stats.histogram[b] += histograms[w][b];
+  return true;
+}
+
+/**
+ * @brief Approximate statistics on the smallest overview with enough pixels, or on a decimated read
+ */
+static bool computeApproximate(GDALRasterBand *poBand, bool hasNoData, float noData, int nBins, RasterStatistics &stats){
+  GDALRasterBand *poSample = poBand;
+  size_t nPixels = (size_t)poBand->GetXSize() * poBand->GetYSize();
+  for (int i=0; i<poBand->GetOverviewCount(); i++){
+    GDALRasterBand *poOverview = poBand->GetOverview(i);
+    if (poOverview == NULL)
+      continue;
+    size_t nOverviewPixels = (size_t)poOverview->GetXSize() * poOverview->GetYSize();
+    if (nOverviewPixels >= GEOTIFF_STATS_SAMPLE_PIXELS && nOverviewPixels < nPixels){
+      poSample = poOverview;
+      nPixels = nOverviewPixels;
+    }
+  }
+  int xSize = poSample->GetXSize(), ySize = poSample->GetYSize();
+  int bufXSize = xSize, bufYSize = ySize;
+  if (nPixels > GEOTIFF_STATS_SAMPLE_PIXELS){
+    // no suitable overview: let GDAL decimate the band (nearest neighbour)
+    double step = sqrt((double)nPixels / GEOTIFF_STATS_SAMPLE_PIXELS);
+    bufXSize = max(1, (int)(xSize / step));
+    bufYSize = max(1, (int)(ySize / step));
+  }
+  std::vector<float> sample((size_t)bufXSize * bufYSize);
+  GEOTIFF_STATS_START(tRead);
+  CPLErr e = poSample->RasterIO(GF_Read, 0, 0, xSize, ySize, &sample[0], bufXSize, bufYSize, GDT_Float32, 0, 0);
+  GEOTIFF_STATS_RASTERIO(tRead, sample.size()*sizeof(float), GeotiffStatsBlocks(poSample, 0, 0, xSize, ySize));
+  if (e != CE_None)
+    return false;
+
+  GeotiffReduction r;
+  GeotiffReduceFloat(&sample[0], sample.size(), hasNoData, noData, r);
+  setFromReduction(r, poBand->GetRasterDataType(), nBins, stats);
+  if (r.count > 0)
+    GeotiffHistogramFloat(&sample[0], sample.size(), hasNoData, noData, stats.histMin, stats.histMax, nBins, &stats.histogram[0]);
+  // counts refer to the sample: scale them to the full band
+  double scale = ((double)poBand->GetXSize() * poBand->GetYSize()) / sample.size();
+  stats.validCount = (size_t)(r.count * scale + 0.5);
+  stats.noDataCount = (size_t)(r.noDataCount * scale + 0.5);
+  return true;
+}
+
+RasterStatistics GeotiffGetStatistics(const char *filename, int band, bool approximate, int nBins, int nThreads){
+  RasterStatistics stats;
+  if (filename == NULL || nBins <= 0)
+    return stats;
+
+  // (1) in-memory cache, valid while the file is unchanged
+  VSIStatBufL sStat;
+  bool bHaveStat = (VSIStatL(filename, &sStat) == 0);
+  std::string key = cacheKey(filename, band, nBins);
+  if (bHaveStat && findCached(key, sStat, approximate, stats))
+    return stats;
+
+  // own (non pooled) handle: closing it is what writes the PAM .aux.xml
+  GeotiffRegisterDrivers();
+  GDALDataset *poDataset = (GDALDataset *) GDALOpenEx(filename, GDAL_OF_RASTER | GDAL_OF_READONLY, NULL, NULL, NULL);
+  if (poDataset == NULL){
+    cout << "[geotiff] Error: Unable to open " << filename << " for statistics" << endl;
+    return stats;
+  }
+  if (band < 1 || band > poDataset->GetRasterCount()){
+    cout << "[geotiff] Error: invalid band " << band << " for statistics of " << filename << endl;
+    GDALClose(poDataset);
+    return stats;
+  }
+  GDALRasterBand *poBand = poDataset->GetRasterBand(band);
+
+  // (2) PAM, unless the sidecar is older than the file (file rewritten since)
+  bool bPAMCurrent = true;
+  VSIStatBufL sAuxStat;
+  std::string auxName = std::string(filename) + ".aux.xml";
+  if (bHaveStat && VSIStatL(auxName.c_str(), &sAuxStat) == 0 && sAuxStat.st_mtime < sStat.st_mtime)
+    bPAMCurrent = false;
+  bool bFound = bPAMCurrent && readPAMStatistics(poBand, approximate, nBins, stats);
+
+  if (!bFound){
+    int bHasNoData = FALSE;
+    double dfNoData = poBand->GetNoDataValue(&bHasNoData);
+    bool bOk;
+    if (approximate){
+      stats.approximate = true;
+      bOk = computeApproximate(poBand, bHasNoData != 0, (float)dfNoData, nBins, stats);
+    }
+    else
+      bOk = computeExact(filename, band, poBand->GetRasterDataType(), bHasNoData != 0, (float)dfNoData, nBins, nThreads, stats);
+    if (!bOk){
+      cout << "[geotiff] Error: Unable to compute statistics of band " << band << " of " << filename << endl;
+      GDALClose(poDataset);
+      return RasterStatistics();
+    }
+    if (stats.validCount > 0)
+      writePAMStatistics(poBand, stats);
+  }
+  stats.band = band;
+  GDALClose(poDataset); // writes the .aux.xml if the PAM metadata changed
+
+  if (bHaveStat){
+    std::lock_guard<std::mutex> guard(statsCacheLock);
+    StatsCacheEntry &entry = statsCache[key];
+    entry.mtime = (long long)sStat.st_mtime;
+    entry.size = (long long)sStat.st_size;
+    entry.stats = stats;
+  }
+  return stats;
+}
+
+bool GeotiffFindCachedStatistics(const char *filename, int band, bool approximate, RasterStatistics &stats, int nBins){
+  VSIStatBufL sStat;
+  if (filename == NULL || VSIStatL(filename, &sStat) != 0)
+    return false;
+  return findCached(cacheKey(filename, band, nBins), sStat, approximate, stats);
+}
+
+void GeotiffClearStatisticsCache(){
+  std::lock_guard<std::mutex> guard(statsCacheLock);
+  statsCache.clear();
+}
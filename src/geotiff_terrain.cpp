@@ -0,0 +1,374 @@
+/**
+ * @file geotiff_terrain.cpp
+ * @brief Vectorized (AVX2 / SSE2), multithreaded terrain derivatives: slope, aspect, hillshade, curvature, rugosity
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_terrain.hpp>
+#include <geotiff.hpp>
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GEOTIFF_TERRAIN_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GEOTIFF_TERRAIN_SSE2
+#endif
+
+using namespace std;
+
+TerrainOptions::TerrainOptions() :
+  pixelX(1), pixelY(-1), zFactor(1), hasNoData(false), noData(0),
+  azimuth(GEOTIFF_TERRAIN_AZIMUTH), altitude(GEOTIFF_TERRAIN_ALTITUDE), nThreads(0) {}
+
+TerrainOptions::TerrainOptions(Geotiff &geotiff, int band) :
+  pixelX(1), pixelY(-1), zFactor(1), hasNoData(false), noData(0),
+  azimuth(GEOTIFF_TERRAIN_AZIMUTH), altitude(GEOTIFF_TERRAIN_ALTITUDE), nThreads(0) {
+  if (!geotiff.isValid())
+    return;
+  double sx = geotiff.GetGeoTransformParam(GEOTIFF_PARAM_SX);
+  double sy = geotiff.GetGeoTransformParam(GEOTIFF_PARAM_SY);
+  if (sx != 0 && sy != 0){
+    pixelX = sx;
+    pixelY = sy;
+  }
+  RasterBandInfo info = geotiff.GetBandInfo(band);
+  hasNoData = info.hasNoData;
+  noData = (float) info.noData;
+}
+
+const char *GeotiffTerrainName(TerrainProduct product){
+  static const char *names[] = {"slope", "aspect", "hillshade", "curvature", "rugosity"};
+  return (product >= TERRAIN_SLOPE && product <= TERRAIN_RUGOSITY) ? names[product] : "";
+}
+
+// Per-call constants of the kernels, derived from TerrainOptions
+struct TerrainCoefficients {
+  float kx, ky;             // Horn gradient -> dz/deast, dz/dnorth (z factor included)
+  float cx, cy;             // 1 / pixel size^2, for the curvature
+  float curvatureScale;     // -200 * z factor
+  float sinAlt, cosAltSinAz, cosAltCosAz;
+  bool hasNoData;
+  float noData;
+
+  TerrainCoefficients(const TerrainOptions &options){
+    const double deg = M_PI / 180.0;
+    kx = (float)(options.zFactor / (8.0 * options.pixelX));
+    ky = (float)(options.zFactor / (8.0 * options.pixelY)); // rows go the way of pixelY: (bottom - top) / (8 * SY)
+    cx = (float)(1.0 / (options.pixelX * options.pixelX));
+    cy = (float)(1.0 / (options.pixelY * options.pixelY));
+    curvatureScale = (float)(-200.0 * options.zFactor);
+    sinAlt = (float) sin(options.altitude * deg);
+    cosAltSinAz = (float)(cos(options.altitude * deg) * sin(options.azimuth * deg));
+    cosAltCosAz = (float)(cos(options.altitude * deg) * cos(options.azimuth * deg));
+    hasNoData = options.hasNoData;
+    noData = options.noData;
+  }
+};
+
+/**
+ * @brief Scalar kernel over one row: out[x] from the 3x3 neighbourhood centered on row[x]
+ * @details above, row and below point to the center column of three consecutive input rows, so
+ * columns x-1 and x+1 must be readable. Used by the reference implementation, and for the tail of
+ * the vector rows
+ */
+static void terrainRowScalar(const float *above, const float *row, const float *below, float *out, int n,
+                             TerrainProduct product, const TerrainCoefficients &k, int x0 = 0){
+  const float fNaN = std::numeric_limits<float>::quiet_NaN();
+  const double rad = 180.0 / M_PI;
+  for (int x=x0; x<n; x++){
+    float a = above[x-1], b = above[x], c = above[x+1];
+    float d = row[x-1],   e = row[x],   f = row[x+1];
+    float g = below[x-1], h = below[x], i = below[x+1];
+    float sum = a + b + c + d + e + f + g + h + i;
+    bool bValid = (sum == sum);
+    if (bValid && k.hasNoData)
+      bValid = a != k.noData && b != k.noData && c != k.noData && d != k.noData && e != k.noData
+            && f != k.noData && g != k.noData && h != k.noData && i != k.noData;
+    if (!bValid){
+      out[x] = fNaN;
+      continue;
+    }
+    float p = ((c + 2*f + i) - (a + 2*d + g)) * k.kx;   // dz/deast
+    float q = ((g + 2*h + i) - (a + 2*b + c)) * k.ky;   // dz/dnorth
+    float s2 = p*p + q*q;
+    switch (product){
+      case TERRAIN_SLOPE:
+        out[x] = (float)(atan(sqrt((double)s2)) * rad);
+        break;
+      case TERRAIN_ASPECT:
+        if (s2 > 0){
+          double aspect = atan2(0.0 - p, 0.0 - q) * rad; // downhill direction, clockwise from north (0 - p: no -0)
+          out[x] = (float)(aspect < 0 ? aspect + 360.0 : aspect);
+        }
+        else
+          out[x] = fNaN;
+        break;
+      case TERRAIN_HILLSHADE: {
+        float hs = (k.sinAlt - (p*k.cosAltSinAz + q*k.cosAltCosAz)) / sqrtf(1.0f + s2);
+        out[x] = 255.0f * std::max(hs, 0.0f);
+        break;
+      }
+      case TERRAIN_CURVATURE:
+        out[x] = k.curvatureScale * (k.cx*(0.5f*(d + f) - e) + k.cy*(0.5f*(b + h) - e));
+        break;
+      case TERRAIN_RUGOSITY:
+        out[x] = sqrtf(1.0f + s2);
+        break;
+    }
+  }
+}
+
+#if defined(GEOTIFF_TERRAIN_AVX2) || defined(GEOTIFF_TERRAIN_SSE2)
+
+// Thin wrappers so a single kernel body serves both instruction sets
+#if defined(GEOTIFF_TERRAIN_AVX2)
+#define TERRAIN_LANES 8
+typedef __m256 vfloat;
+static inline vfloat vload(const float *p) { return _mm256_loadu_ps(p); }
+static inline void vstore(float *p, vfloat v) { _mm256_storeu_ps(p, v); }
+static inline vfloat vset(float v) { return _mm256_set1_ps(v); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+static inline vfloat vdiv(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+static inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a); }
+static inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+static inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+static inline vfloat vand(vfloat a, vfloat b) { return _mm256_and_ps(a, b); }
+static inline vfloat vandnot(vfloat a, vfloat b) { return _mm256_andnot_ps(a, b); }
+static inline vfloat vxor(vfloat a, vfloat b) { return _mm256_xor_ps(a, b); }
+static inline vfloat vordered(vfloat a) { return _mm256_cmp_ps(a, a, _CMP_ORD_Q); }
+static inline vfloat vnotequal(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+static inline vfloat vgreater(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, mask); }
+#else
+#define TERRAIN_LANES 4
+typedef __m128 vfloat;
+static inline vfloat vload(const float *p) { return _mm_loadu_ps(p); }
+static inline void vstore(float *p, vfloat v) { _mm_storeu_ps(p, v); }
+static inline vfloat vset(float v) { return _mm_set1_ps(v); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vfloat vdiv(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+static inline vfloat vsqrt(vfloat a) { return _mm_sqrt_ps(a); }
+static inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+static inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+static inline vfloat vand(vfloat a, vfloat b) { return _mm_and_ps(a, b); }
+static inline vfloat vandnot(vfloat a, vfloat b) { return _mm_andnot_ps(a, b); }
+static inline vfloat vxor(vfloat a, vfloat b) { return _mm_xor_ps(a, b); }
+static inline vfloat vordered(vfloat a) { return _mm_cmpord_ps(a, a); }
+static inline vfloat vnotequal(vfloat a, vfloat b) { return _mm_cmpneq_ps(a, b); }
+static inline vfloat vgreater(vfloat a, vfloat b) { return _mm_cmpgt_ps(a, b); }
+static inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+#endif
+
+/**
+ * @brief Vector atan2, in radians
+ * @details atan of min(|x|, |y|) / max(|x|, |y|) in [0, 1] by a degree 11 minimax polynomial (max error
+ * 2e-6 rad), then moved to its octant. atan2(0, 0) is NaN (callers mask it)
+ */
+static inline vfloat vatan2(vfloat y, vfloat x){
+  const vfloat signMask = vset(-0.0f);
+  vfloat ax = vandnot(signMask, x), ay = vandnot(signMask, y);
+  vfloat t = vdiv(vmin(ax, ay), vmax(ax, ay));
+  vfloat t2 = vmul(t, t);
+  vfloat r = vset(-0.01172120f);
+  r = vadd(vmul(r, t2), vset(0.05265332f));
+  r = vadd(vmul(r, t2), vset(-0.11643287f));
+  r = vadd(vmul(r, t2), vset(0.19354346f));
+  r = vadd(vmul(r, t2), vset(-0.33262347f));
+  r = vadd(vmul(r, t2), vset(0.99997726f));
+  r = vmul(r, t);
+  r = vselect(vgreater(ay, ax), vsub(vset((float)(M_PI/2)), r), r);
+  r = vselect(vgreater(vset(0.0f), x), vsub(vset((float)M_PI), r), r);
+  return vxor(r, vand(y, signMask)); // sign of y
+}
+
+/**
+ * @brief Vector kernel over one row (same contract as terrainRowScalar)
+ * @details Nine unaligned loads per step: the three columns of each of the three rows. Validity is one
+ * ordered compare of the sum of the nine pixels (NaN propagates through the sum), plus nine nodata compares
+ * when the band has a nodata value. Invalid pixels are blended to NaN after the product is computed, so
+ * the loop has no branches. The tail (less than one vector) is done by the scalar kernel
+ */
+static void terrainRowVector(const float *above, const float *row, const float *below, float *out, int n,
+                             TerrainProduct product, const TerrainCoefficients &k){
+  const vfloat vNaN = vset(std::numeric_limits<float>::quiet_NaN());
+  const vfloat two = vset(2.0f), half = vset(0.5f), one = vset(1.0f), zero = vset(0.0f);
+  const vfloat kx = vset(k.kx), ky = vset(k.ky), noData = vset(k.noData);
+  const vfloat toDegrees = vset((float)(180.0 / M_PI));
+  int x = 0;
+  for (; x + TERRAIN_LANES <= n; x += TERRAIN_LANES){
+    vfloat a = vload(above + x - 1), b = vload(above + x), c = vload(above + x + 1);
+    vfloat d = vload(row + x - 1),   e = vload(row + x),   f = vload(row + x + 1);
+    vfloat g = vload(below + x - 1), h = vload(below + x), i = vload(below + x + 1);
+
+    vfloat valid = vordered(vadd(vadd(vadd(vadd(a, b), vadd(c, d)), vadd(vadd(e, f), vadd(g, h))), i));
+    if (k.hasNoData){
+      valid = vand(valid, vand(vnotequal(a, noData), vnotequal(b, noData)));
+      valid = vand(valid, vand(vnotequal(c, noData), vnotequal(d, noData)));
+      valid = vand(valid, vand(vnotequal(e, noData), vnotequal(f, noData)));
+      valid = vand(valid, vand(vnotequal(g, noData), vnotequal(h, noData)));
+      valid = vand(valid, vnotequal(i, noData));
+    }
+    vfloat p = vmul(vsub(vadd(vadd(c, vmul(two, f)), i), vadd(vadd(a, vmul(two, d)), g)), kx);
+    vfloat q = vmul(vsub(vadd(vadd(g, vmul(two, h)), i), vadd(vadd(a, vmul(two, b)), c)), ky);
+    vfloat s2 = vadd(vmul(p, p), vmul(q, q));
+
+    vfloat result;
+    switch (product){
+      case TERRAIN_SLOPE:
+        result = vmul(vatan2(vsqrt(s2), one), toDegrees);
+        break;
+      case TERRAIN_ASPECT: {
+        vfloat aspect = vmul(vatan2(vsub(zero, p), vsub(zero, q)), toDegrees);
+        result = vselect(vgreater(zero, aspect), vadd(aspect, vset(360.0f)), aspect);
+        valid = vand(valid, vgreater(s2, zero)); // flat: no aspect
+        break;
+      }
+      case TERRAIN_HILLSHADE: {
+        vfloat light = vadd(vmul(p, vset(k.cosAltSinAz)), vmul(q, vset(k.cosAltCosAz)));
+        vfloat hs = vdiv(vsub(vset(k.sinAlt), light), vsqrt(vadd(one, s2)));
+        result = vmul(vset(255.0f), vmax(hs, zero));
+        break;
+      }
+      case TERRAIN_CURVATURE: {
+        vfloat dx2 = vsub(vmul(half, vadd(d, f)), e);
+        vfloat dy2 = vsub(vmul(half, vadd(b, h)), e);
+        result = vmul(vset(k.curvatureScale), vadd(vmul(vset(k.cx), dx2), vmul(vset(k.cy), dy2)));
+        break;
+      }
+      default:
+        result = vsqrt(vadd(one, s2));
+        break;
+    }
+    vstore(out + x, vselect(valid, result, vNaN));
+  }
+  terrainRowScalar(above, row, below, out, n, product, k, x);
+}
+
+#else
+
+static void terrainRowVector(const float *above, const float *row, const float *below, float *out, int n,
+                             TerrainProduct product, const TerrainCoefficients &k){
+  terrainRowScalar(above, row, below, out, n, product, k);
+}
+
+#endif
+
+typedef void (*TerrainRowFunction)(const float *, const float *, const float *, float *, int, TerrainProduct, const TerrainCoefficients &);
+
+static void scalarRow(const float *above, const float *row, const float *below, float *out, int n,
+                      TerrainProduct product, const TerrainCoefficients &k){
+  terrainRowScalar(above, row, below, out, n, product, k);
+}
+
+/**
+ * @brief Runs the row kernel over rows [y0, y1) of a band given as row pointers. Border pixels are NaN
+ */
+static void terrainRows(float *const *dem, int cols, int rows, float *const *output, int y0, int y1,
+                        TerrainProduct product, const TerrainCoefficients &k, TerrainRowFunction rowFunction){
+  const float fNaN = std::numeric_limits<float>::quiet_NaN();
+  for (int y=y0; y<y1; y++){
+    float *out = output[y];
+    if (y == 0 || y == rows - 1 || cols < 3){
+      std::fill(out, out + cols, fNaN);
+      continue;
+    }
+    rowFunction(dem[y-1] + 1, dem[y] + 1, dem[y+1] + 1, out + 1, cols - 2, product, k);
+    out[0] = out[cols-1] = fNaN;
+  }
+}
+
+/**
+ * @brief Splits the rows of the band in contiguous ranges, one per thread
+ */
+static void terrainBand(float *const *dem, int cols, int rows, float *const *output, TerrainProduct product,
+                        const TerrainOptions &options, TerrainRowFunction rowFunction, int nThreads){
+  TerrainCoefficients k(options);
+  if (nThreads <= 0)
+    nThreads = max(1, (int)std::thread::hardware_concurrency());
+  nThreads = max(1, min(nThreads, rows / 16)); // at least 16 rows per thread
+  if (nThreads == 1){
+    terrainRows(dem, cols, rows, output, 0, rows, product, k, rowFunction);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int t=0; t<nThreads; t++){
+    int y0 = (int)((long long)rows * t / nThreads);
+    int y1 = (int)((long long)rows * (t + 1) / nThreads);
+    workers.push_back(std::thread(terrainRows, dem, cols, rows, output, y0, y1, product, std::cref(k), rowFunction));
+  }
+  for (size_t t=0; t<workers.size(); t++)
+    workers[t].join();
+}
+
+static Raster<float> terrainRaster(const Raster<float> &dem, TerrainProduct product, const TerrainOptions &options,
+                                   TerrainRowFunction rowFunction, int nThreads){
+  if (dem.isEmpty())
+    return Raster<float>();
+  int cols = dem.GetCols(), rows = dem.GetRows();
+  Raster<float> output(cols, rows);
+  std::vector<float *> in(rows), out(rows);
+  for (int y=0; y<rows; y++){
+    in[y] = const_cast<float *>(dem.GetRow(y)); // read only
+    out[y] = output.GetRow(y);
+  }
+  terrainBand(in.data(), cols, rows, out.data(), product, options, rowFunction, nThreads);
+  return output;
+}
+
+/**
+ * @brief Computes a terrain derivative of a whole band, vectorized and multithreaded
+ *
+ * @param dem elevation band (e.g. Geotiff::ReadRaster)
+ * @param product derivative to compute
+ * @param options pixel size, nodata, illumination and threads (see TerrainOptions(Geotiff &, int))
+ * @return Raster<float> derivative, same size as dem. NaN on the border and where the 3x3 neighbourhood has nodata
+ */
+Raster<float> GeotiffTerrain(const Raster<float> &dem, TerrainProduct product, const TerrainOptions &options){
+  return terrainRaster(dem, product, options, terrainRowVector, options.nThreads);
+}
+
+bool GeotiffTerrain(float **dem, int cols, int rows, float **output, TerrainProduct product, const TerrainOptions &options){
+  if (dem == NULL || output == NULL || cols <= 0 || rows <= 0)
+    return false;
+  terrainBand(dem, cols, rows, output, product, options, terrainRowVector, options.nThreads);
+  return true;
+}
+
+Raster<float> GeotiffTerrainReference(const Raster<float> &dem, TerrainProduct product, const TerrainOptions &options){
+  return terrainRaster(dem, product, options, scalarRow, 1);
+}
+
+/**
+ * @brief Pipeline kernel: the derivative of every output pixel is computed from the halo-extended input block
+ * @details Input pixel (halo + x, halo + y) is output pixel (x, y); halo pixels outside the raster are NaN,
+ * so the raster border comes out NaN as in GeotiffTerrain. The pipeline runs the blocks on its own workers,
+ * so each block is processed on a single thread
+ */
+PipelineKernel GeotiffTerrainKernel(TerrainProduct product, const TerrainOptions &options){
+  TerrainCoefficients k(options);
+  return [product, k](const std::vector<const Raster<float> *> &inputs, Raster<float> &output, const PipelineBlock &block){
+    if (inputs.empty() || block.halo < 1){
+      cout << "[GeotiffTerrainKernel] Error: terrain kernels need one input and a halo >= 1" << endl;
+      return false;
+    }
+    const Raster<float> &in = *inputs[0];
+    for (int y=0; y<block.ySize; y++){
+      int iy = y + block.halo;
+      terrainRowVector(in.GetRow(iy - 1) + block.halo, in.GetRow(iy) + block.halo, in.GetRow(iy + 1) + block.halo,
+                       output.GetRow(y), block.xSize, product, k);
+    }
+    return true;
+  };
+}
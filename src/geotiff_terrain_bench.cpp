@@ -0,0 +1,122 @@
+/**
+ * @file geotiff_terrain_bench.cpp
+ * @brief Benchmark: vectorized / multithreaded terrain kernels vs the scalar reference
+ *
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ *
+ */
+
+// Usage: geotiff_terrain_bench [size] [threads]
+//   size:    width and height (pixels) of the synthetic DEM. Default: 4096
+//   threads: worker threads of the multithreaded run. Default: all CPU cores
+// A synthetic DEM (with a sprinkle of nodata pixels) is generated in memory, and every terrain product
+// is computed with the scalar reference, the SIMD kernels on one thread, and the SIMD kernels on all threads.
+// The maximum absolute difference against the reference is reported along with the throughput
+
+///Basic C and C++ libraries
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <thread>
+
+#include "geotiff.hpp"
+#include "geotiff_simd.hpp"
+#include "geotiff_terrain.hpp"
+
+using namespace std;
+
+const std::string green("\033[1;32m");
+const std::string yellow("\033[1;33m");
+const std::string cyan("\033[1;36m");
+const std::string red("\033[1;31m");
+const std::string reset("\033[0m");
+
+/**
+ * @brief Runs a terrain function and returns the elapsed time, in seconds
+ */
+double timeTerrain(Raster<float> (*terrain)(const Raster<float> &, TerrainProduct, const TerrainOptions &),
+                   const Raster<float> &dem, TerrainProduct product, const TerrainOptions &options, Raster<float> &result){
+    auto t0 = std::chrono::steady_clock::now();
+    result = terrain(dem, product, options);
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+/**
+ * @brief Maximum absolute difference between two rasters. Pixels that are NaN in only one of them count as infinite
+ */
+double maxDifference(const Raster<float> &a, const Raster<float> &b){
+    double diff = 0;
+    for (int y=0; y<a.GetRows(); y++){
+        for (int x=0; x<a.GetCols(); x++){
+            float u = a(x, y), v = b(x, y);
+            if ((u != u) != (v != v))
+                return INFINITY;
+            if (u == u)
+                diff = std::max(diff, (double)fabs(u - v));
+        }
+    }
+    return diff;
+}
+
+void printResult(const std::string &label, double seconds, double mpix, double reference, double diff){
+    cout << "\t" << std::left << std::setw(12) << label << std::right << std::fixed << std::setprecision(3)
+         << seconds << " s\t" << std::setprecision(1) << mpix/seconds << " Mpix/s\tx" << reference/seconds;
+    if (diff >= 0)
+        cout << "\t(max diff " << std::scientific << std::setprecision(2) << diff << ")";
+    cout << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int size = 4096;
+    int nThreads = std::thread::hardware_concurrency();
+    if (argc > 1)
+        size = atoi(argv[1]);
+    if (argc > 2)
+        nThreads = atoi(argv[2]);
+    if (size < 3 || nThreads < 1){
+        cout << red << "Invalid raster size or thread count" << reset << endl;
+        return -1;
+    }
+
+    cout << cyan << "geotiff_terrain_bench" << reset << endl;
+    cout << "\tGit commit:\t" << yellow << GIT_COMMIT << reset << endl;
+    cout << "\tRaster size:\t" << size << "x" << size << " Float32" << endl;
+    cout << "\tSIMD:\t\t" << GeotiffSIMDName() << endl;
+    cout << "\tThreads:\t" << nThreads << endl;
+
+    // smooth terrain with some high frequency relief, and one nodata pixel every 997
+    Raster<float> dem(size, size);
+    for (int y=0; y<size; y++)
+        for (int x=0; x<size; x++)
+            dem(x, y) = ((size_t)y*size + x) % 997 == 0 ? -9999.0f :
+                        (float)(100.0*sin(y*0.01)*cos(x*0.013) + 3.0*sin(x*0.2 + y*0.3));
+
+    TerrainOptions options;
+    options.pixelX = 2.0;
+    options.pixelY = -2.0;
+    options.hasNoData = true;
+    options.noData = -9999.0f;
+    double mpix = (double)size*size/1.0e6;
+
+    for (int p=TERRAIN_SLOPE; p<=TERRAIN_RUGOSITY; p++){
+        TerrainProduct product = (TerrainProduct)p;
+        cout << green << GeotiffTerrainName(product) << reset << endl;
+        Raster<float> reference, result;
+        double tReference = timeTerrain(GeotiffTerrainReference, dem, product, options, reference);
+        printResult("scalar", tReference, mpix, tReference, -1);
+
+        options.nThreads = 1;
+        double tSIMD = timeTerrain(GeotiffTerrain, dem, product, options, result);
+        printResult("simd", tSIMD, mpix, tReference, maxDifference(reference, result));
+
+        options.nThreads = nThreads;
+        double tThreads = timeTerrain(GeotiffTerrain, dem, product, options, result);
+        printResult("simd+mt", tThreads, mpix, tReference, maxDifference(reference, result));
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * @file geotiff_view.cpp
+ * @brief Lazy, tile based view of a GeoTIFF band with its own LRU tile cache
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_view.hpp>
+#include <geotiff.hpp>
+#include <geotiff_counters.hpp>
+
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+GeotiffView::GeotiffView(GDALDataset *dataset, int band, size_t cacheBytes) :
+  poBand(NULL), nCols(0), nRows(0), nTileXSize(1), nTileYSize(1), nTilesX(0), nTilesY(0),
+  cacheBudget(cacheBytes), cachedBytes(0), lastKey(-1), lastTile(NULL),
+  nHits(0), nMisses(0), nEvictions(0), nReadErrors(0) {
+
+  if (dataset == NULL || band < 1 || band > dataset->GetRasterCount() || dataset->GetRasterXSize() < 1 || dataset->GetRasterYSize() < 1){
+    cout << "[GeotiffView] Invalid dataset or band number: " << band << endl;
+    return;
+  }
+  poBand = dataset->GetRasterBand(band);
+  nCols  = poBand->GetXSize();
+  nRows  = poBand->GetYSize();
+
+  // tiles follow the natural block size, so every tile read decodes whole blocks only once.
+  // Very small blocks (e.g. 1 scanline strips) are stacked until the tile is large enough
+  int nBlockXSize, nBlockYSize;
+  poBand->GetBlockSize(&nBlockXSize, &nBlockYSize);
+  nTileXSize = (nBlockXSize > 0) ? min(nBlockXSize, nCols) : nCols;
+  nTileYSize = (nBlockYSize > 0) ? nBlockYSize : 1;
+  while ((size_t)nTileXSize*nTileYSize < GEOTIFF_VIEW_MIN_TILE_PIXELS && nTileYSize < nRows)
+    nTileYSize += (nBlockYSize > 0) ? nBlockYSize : 1;
+  nTileYSize = min(nTileYSize, nRows);
+
+  nTilesX = (nCols + nTileXSize - 1) / nTileXSize;
+  nTilesY = (nRows + nTileYSize - 1) / nTileYSize;
+}
+
+GeotiffView::GeotiffView(Geotiff &geotiff, int band, size_t cacheBytes) :
+  GeotiffView(geotiff.GetDataset(), band, cacheBytes) {}
+
+bool GeotiffView::isValid(){
+  return poBand != NULL;
+}
+
+/**
+ * @brief Returns the pixel window [xOff, yOff, xSize, ySize] covered by a tile (clipped to the band)
+ */
+void GeotiffView::GetTileWindow(int tileX, int tileY, int *window){
+  window[0] = tileX*nTileXSize;
+  window[1] = tileY*nTileYSize;
+  window[2] = min(nTileXSize, nCols - window[0]);
+  window[3] = min(nTileYSize, nRows - window[1]);
+}
+
+/**
+ * @brief Returns a tile from the cache, or reads it (evicting least recently used tiles if needed)
+ *
+ * @param key tile key: tileY*nTilesX + tileX
+ * @return const Raster<float>* tile data, NULL if it could not be read
+ */
+const Raster<float> *GeotiffView::LoadTile(int key){
+  if (key == lastKey && lastTile != NULL){
+    nHits++; // LRU order is already up to date for the last accessed tile
+    return lastTile;
+  }
+
+  unordered_map<int, CacheEntry>::iterator it = tiles.find(key);
+  if (it != tiles.end()){
+    nHits++;
+    lru.splice(lru.begin(), lru, it->second.lruPosition); // move to front, iterators stay valid
+    lastKey  = key;
+    lastTile = &it->second.tile;
+    return lastTile;
+  }
+
+  nMisses++;
+  int window[4];
+  GetTileWindow(key % nTilesX, key / nTilesX, window);
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_VIEW_TILE);
+  Raster<float> tile(window[2], window[3]);
+  GEOTIFF_STATS_START(tRead);
+  CPLErr e = poBand->RasterIO(GF_Read, window[0], window[1], window[2], window[3], tile.GetData(),
+                              window[2], window[3], GDT_Float32, sizeof(float), tile.GetStrideBytes());
+  GEOTIFF_STATS_RASTERIO(tRead, (size_t)window[2]*window[3]*sizeof(float),
+                         GeotiffStatsBlocks(poBand, window[0], window[1], window[2], window[3]));
+  if (e != CE_None){
+    nReadErrors++;
+    cout << "[GeotiffView] Error: Unable to read tile [" << window[0] << ", " << window[1] << "]" << endl;
+    return NULL;
+  }
+
+  size_t tileBytes = tile.GetStrideBytes()*tile.GetRows();
+  Evict(tileBytes);
+  lru.push_front(key);
+  CacheEntry &entry = tiles[key];
+  entry.tile = std::move(tile);
+  entry.lruPosition = lru.begin();
+  cachedBytes += tileBytes;
+
+  lastKey  = key;
+  lastTile = &entry.tile;
+  return lastTile;
+}
+
+/**
+ * @brief Drops least recently used tiles until incomingBytes fit in the budget (or the cache is empty)
+ */
+void GeotiffView::Evict(size_t incomingBytes){
+  while (!lru.empty() && cachedBytes + incomingBytes > cacheBudget){
+    int key = lru.back();
+    unordered_map<int, CacheEntry>::iterator it = tiles.find(key);
+    cachedBytes -= it->second.tile.GetStrideBytes()*it->second.tile.GetRows();
+    tiles.erase(it);
+    lru.pop_back();
+    nEvictions++;
+    if (key == lastKey){
+      lastKey  = -1;
+      lastTile = NULL;
+    }
+  }
+}
+
+float GeotiffView::GetPixel(int x, int y){
+  if (poBand == NULL || x < 0 || y < 0 || x >= nCols || y >= nRows)
+    return numeric_limits<float>::quiet_NaN();
+  int tileX = x / nTileXSize;
+  int tileY = y / nTileYSize;
+  const Raster<float> *tile = LoadTile(tileY*nTilesX + tileX);
+  if (tile == NULL)
+    return numeric_limits<float>::quiet_NaN();
+  return (*tile)(x - tileX*nTileXSize, y - tileY*nTileYSize);
+}
+
+const Raster<float> *GeotiffView::GetTile(int tileX, int tileY){
+  if (poBand == NULL || tileX < 0 || tileY < 0 || tileX >= nTilesX || tileY >= nTilesY)
+    return NULL;
+  return LoadTile(tileY*nTilesX + tileX);
+}
+
+void GeotiffView::SetCacheBudget(size_t bytes){
+  cacheBudget = bytes;
+  Evict(0);
+}
+
+void GeotiffView::ClearCache(){
+  tiles.clear();
+  lru.clear();
+  cachedBytes = 0;
+  lastKey  = -1;
+  lastTile = NULL;
+}
+
+void GeotiffView::ResetCounters(){
+  nHits = nMisses = nEvictions = nReadErrors = 0;
+}
+
+GeotiffView::Tile GeotiffView::TileIterator::operator*(){
+  Tile tile;
+  tile.tileX = index % view->nTilesX;
+  tile.tileY = index / view->nTilesX;
+  tile.xOff  = tile.tileX*view->nTileXSize;
+  tile.yOff  = tile.tileY*view->nTileYSize;
+  tile.data  = view->GetTile(tile.tileX, tile.tileY);
+  return tile;
+}
@@ -0,0 +1,252 @@
+/**
+ * @file geotiff_warp.cpp
+ * @brief In-memory, multithreaded warping of GeoTIFF bands onto a target grid
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_warp.hpp>
+#include <geotiff.hpp>
+#include <geotiff_counters.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <limits>
+#include <cstring>
+#include <cpl_conv.h>
+#include <cpl_string.h>
+#include <gdal_vrt.h>
+
+using namespace std;
+
+GeotiffGrid::GeotiffGrid() : cols(0), rows(0) {
+  memset(geotransform, 0, sizeof(geotransform));
+}
+
+GeotiffGrid::GeotiffGrid(const char *srsWkt, const double *gt, int nCols, int nRows) :
+  wkt(srsWkt != NULL ? srsWkt : ""), cols(nCols), rows(nRows) {
+  memcpy(geotransform, gt, sizeof(geotransform));
+}
+
+GeotiffGrid::GeotiffGrid(Geotiff &reference) : cols(0), rows(0) {
+  memset(geotransform, 0, sizeof(geotransform));
+  if (!reference.isValid())
+    return;
+  const char *pszWkt = reference.GetProjection();
+  wkt = (pszWkt != NULL) ? pszWkt : "";
+  memcpy(geotransform, reference.GetGeoTransform(), sizeof(geotransform));
+  int dim[3];
+  reference.GetDimensions(dim);
+  cols = dim[0];
+  rows = dim[1];
+}
+
+GeotiffWarper::GeotiffWarper(size_t memoryBytes, int threads) :
+  memoryLimit((double)memoryBytes), nThreads(threads), nTransformerHits(0), nTransformerMisses(0) {}
+
+GeotiffWarper::~GeotiffWarper(){
+  ClearTransformers();
+}
+
+void GeotiffWarper::ClearTransformers(){
+  for (std::list<CachedTransformer>::iterator it = transformers.begin(); it != transformers.end(); ++it)
+    GDALDestroyTransformer(it->transformer);
+  transformers.clear();
+}
+
+/**
+ * @brief Returns the approximate transformer between two datasets, from the cache when both grids were already seen
+ * @details The transformer only depends on the SRS and geotransform of both datasets, so it can be reused
+ * with any other datasets on the same grids (GDAL clones it for each warp thread)
+ *
+ * @return transformer (owned by the cache), NULL if the grids cannot be related
+ */
+void *GeotiffWarper::GetTransformer(GDALDataset *source, GDALDataset *target){
+  double srcGt[6], dstGt[6];
+  source->GetGeoTransform(srcGt);
+  target->GetGeoTransform(dstGt);
+  ostringstream key;
+  key.precision(17);
+  key << source->GetProjectionRef() << '|' << target->GetProjectionRef();
+  for (int i=0; i<6; i++)
+    key << '|' << srcGt[i] << '|' << dstGt[i];
+
+  for (std::list<CachedTransformer>::iterator it = transformers.begin(); it != transformers.end(); ++it){
+    if (it->key != key.str())
+      continue;
+    transformers.splice(transformers.begin(), transformers, it);
+    nTransformerHits++;
+    return transformers.front().transformer;
+  }
+
+  nTransformerMisses++;
+  void *hGenImg = GDALCreateGenImgProjTransformer2((GDALDatasetH) source, (GDALDatasetH) target, NULL);
+  if (hGenImg == NULL)
+    return NULL;
+  void *hApprox = GDALCreateApproxTransformer(GDALGenImgProjTransform, hGenImg, GEOTIFF_WARP_MAX_ERROR);
+  GDALApproxTransformerOwnsSubtransformer(hApprox, TRUE);
+
+  CachedTransformer entry;
+  entry.key = key.str();
+  entry.transformer = hApprox;
+  transformers.push_front(entry);
+  while (transformers.size() > GEOTIFF_WARP_CACHED_TRANSFORMERS){
+    GDALDestroyTransformer(transformers.back().transformer);
+    transformers.pop_back();
+  }
+  return hApprox;
+}
+
+/**
+ * @brief Warps one band of a dataset into a float Raster, through a MEM dataset wrapping the Raster buffer
+ *
+ * @param source source dataset
+ * @param band 1-indexed band of source
+ * @param srcNoData, hasNoData source no-data value
+ * @param target target grid
+ * @param resampling GDAL resampling algorithm
+ * @return Raster<float> warped band (NaN where there is no data), empty on error
+ */
+Raster<float> GeotiffWarper::WarpDataset(GDALDataset *source, int band, double srcNoData, bool hasNoData,
+                                         const GeotiffGrid &target, GDALResampleAlg resampling){
+  GEOTIFF_STATS_CALL(GEOTIFF_CALL_WARP);
+  GDALDriver *poMemDriver = GetGDALDriverManager()->GetDriverByName("MEM");
+  if (poMemDriver == NULL){
+    cout << "[GeotiffWarper] Error: MEM driver not available" << endl;
+    return Raster<float>();
+  }
+  Raster<float> output(target.cols, target.rows);
+
+  // MEM dataset with no band of its own: its band 1 is the Raster buffer (row stride included)
+  GDALDataset *poTarget = poMemDriver->Create("", target.cols, target.rows, 0, GDT_Float32, NULL);
+  if (poTarget == NULL){
+    cout << "[GeotiffWarper] Error: Unable to create the target dataset" << endl;
+    return Raster<float>();
+  }
+  char szPointer[64] = {0};
+  int nLength = CPLPrintPointer(szPointer, output.GetData(), sizeof(szPointer) - 1);
+  szPointer[nLength] = 0;
+  char **papszBandOptions = NULL;
+  papszBandOptions = CSLSetNameValue(papszBandOptions, "DATAPOINTER", szPointer);
+  papszBandOptions = CSLSetNameValue(papszBandOptions, "PIXELOFFSET", CPLSPrintf("%d", (int)sizeof(float)));
+  papszBandOptions = CSLSetNameValue(papszBandOptions, "LINEOFFSET", CPLSPrintf("%lu", (unsigned long)output.GetStrideBytes()));
+  CPLErr e = poTarget->AddBand(GDT_Float32, papszBandOptions);
+  CSLDestroy(papszBandOptions);
+  double gt[6];
+  memcpy(gt, target.geotransform, sizeof(gt));
+  if (e == CE_None){
+    poTarget->SetGeoTransform(gt);
+    poTarget->SetProjection(target.wkt.c_str());
+  }
+
+  void *hTransformer = (e == CE_None) ? GetTransformer(source, poTarget) : NULL;
+  if (hTransformer == NULL){
+    cout << "[GeotiffWarper] Error: No transformation between the source and the target grids" << endl;
+    GDALClose((GDALDatasetH) poTarget);
+    return Raster<float>();
+  }
+
+  GDALWarpOptions *psWarpOptions = GDALCreateWarpOptions();
+  psWarpOptions->hSrcDS = (GDALDatasetH) source;
+  psWarpOptions->hDstDS = (GDALDatasetH) poTarget;
+  psWarpOptions->nBandCount = 1;
+  psWarpOptions->panSrcBands = (int *) CPLMalloc(sizeof(int));
+  psWarpOptions->panSrcBands[0] = band;
+  psWarpOptions->panDstBands = (int *) CPLMalloc(sizeof(int));
+  psWarpOptions->panDstBands[0] = 1;
+  psWarpOptions->eResampleAlg = resampling;
+  psWarpOptions->eWorkingDataType = GDT_Float32;
+  psWarpOptions->dfWarpMemoryLimit = memoryLimit;
+  if (hasNoData){
+    psWarpOptions->padfSrcNoDataReal = (double *) CPLMalloc(sizeof(double));
+    psWarpOptions->padfSrcNoDataReal[0] = srcNoData;
+    psWarpOptions->padfSrcNoDataImag = (double *) CPLMalloc(sizeof(double));
+    psWarpOptions->padfSrcNoDataImag[0] = 0.0;
+  }
+  psWarpOptions->padfDstNoDataReal = (double *) CPLMalloc(sizeof(double));
+  psWarpOptions->padfDstNoDataReal[0] = numeric_limits<double>::quiet_NaN();
+  psWarpOptions->padfDstNoDataImag = (double *) CPLMalloc(sizeof(double));
+  psWarpOptions->padfDstNoDataImag[0] = 0.0;
+  psWarpOptions->papszWarpOptions = CSLSetNameValue(psWarpOptions->papszWarpOptions, "INIT_DEST", "NO_DATA");
+  psWarpOptions->papszWarpOptions = CSLSetNameValue(psWarpOptions->papszWarpOptions, "NUM_THREADS",
+                                                    nThreads > 0 ? CPLSPrintf("%d", nThreads) : "ALL_CPUS");
+  psWarpOptions->pfnTransformer = GDALApproxTransform;
+  psWarpOptions->pTransformerArg = hTransformer;
+
+  // I/O of the next chunk overlaps the warp of the current one
+  GDALWarpOperation oOperation;
+  e = oOperation.Initialize(psWarpOptions);
+  if (e == CE_None)
+    e = oOperation.ChunkAndWarpMulti(0, 0, target.cols, target.rows);
+  psWarpOptions->pTransformerArg = NULL; // owned by the cache
+  GDALDestroyWarpOptions(psWarpOptions);
+  GDALClose((GDALDatasetH) poTarget);      // does not free the wrapped buffer
+
+  if (e != CE_None){
+    cout << "[GeotiffWarper] Error: Warp failed" << endl;
+    return Raster<float>();
+  }
+  return output;
+}
+
+/**
+ * @brief Warps a band onto a target grid
+ *
+ * @param source source Geotiff
+ * @param band 1-indexed band number
+ * @param target target grid
+ * @param resampling GDAL resampling algorithm
+ * @return Raster<float> warped band (NaN where there is no data), empty on error
+ */
+Raster<float> GeotiffWarper::Warp(Geotiff &source, int band, const GeotiffGrid &target, GDALResampleAlg resampling){
+  int dim[3];
+  source.GetDimensions(dim);
+  return WarpWindow(source, band, 0, 0, dim[0], dim[1], target, resampling);
+}
+
+/**
+ * @brief Warps a pixel window of a band onto a target grid
+ * @details Windows are exposed to the warper as an in-memory VRT (a view, nothing is read up front),
+ * so only the source blocks intersecting the window are ever read
+ *
+ * @param source source Geotiff
+ * @param band 1-indexed band number
+ * @param xOff, yOff, xSize, ySize source window, in pixels (inside the raster)
+ * @param target target grid
+ * @param resampling GDAL resampling algorithm
+ * @return Raster<float> warped window (NaN where there is no data), empty on error
+ */
+Raster<float> GeotiffWarper::WarpWindow(Geotiff &source, int band, int xOff, int yOff, int xSize, int ySize,
+                                        const GeotiffGrid &target, GDALResampleAlg resampling){
+  if (!source.isValid() || !target.isValid()){
+    cout << "[GeotiffWarper] Error: Invalid source dataset or target grid" << endl;
+    return Raster<float>();
+  }
+  int dim[3];
+  source.GetDimensions(dim);
+  if (band < 1 || band > dim[2] || xOff < 0 || yOff < 0 || xSize <= 0 || ySize <= 0 ||
+      xOff + xSize > dim[0] || yOff + ySize > dim[1]){
+    cout << "[GeotiffWarper] Error: Invalid band or window for " << source.GetFileName() << endl;
+    return Raster<float>();
+  }
+  RasterBandInfo info = source.GetBandInfo(band);
+  GDALDataset *poSource = source.GetDataset();
+  if (xOff == 0 && yOff == 0 && xSize == dim[0] && ySize == dim[1])
+    return WarpDataset(poSource, band, info.noData, info.hasNoData, target, resampling);
+
+  double *srcGt = source.GetGeoTransform();
+  double gt[6] = {srcGt[0] + xOff*srcGt[1] + yOff*srcGt[2], srcGt[1], srcGt[2],
+                  srcGt[3] + xOff*srcGt[4] + yOff*srcGt[5], srcGt[4], srcGt[5]};
+  VRTDatasetH hVRT = VRTCreate(xSize, ySize);
+  GDALSetGeoTransform(hVRT, gt);
+  GDALSetProjection(hVRT, poSource->GetProjectionRef());
+  GDALAddBand(hVRT, info.dataType, NULL);
+  VRTSourcedRasterBandH hVRTBand = (VRTSourcedRasterBandH) GDALGetRasterBand(hVRT, 1);
+  VRTAddSimpleSource(hVRTBand, (GDALRasterBandH) poSource->GetRasterBand(band),
+                     xOff, yOff, xSize, ySize, 0, 0, xSize, ySize, "near", VRT_NODATA_UNSET);
+  if (info.hasNoData)
+    GDALSetRasterNoDataValue((GDALRasterBandH) hVRTBand, info.noData);
+
+  Raster<float> output = WarpDataset((GDALDataset *) hVRT, 1, info.noData, info.hasNoData, target, resampling);
+  GDALClose(hVRT);
+  return output;
+}
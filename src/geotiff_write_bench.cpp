@@ -0,0 +1,124 @@
+/**
+ * @file geotiff_write_bench.cpp
+ * @brief Benchmark: GeotiffWriter throughput and output size across compression settings
+ *
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ *
+ */
+
+// Usage: geotiff_write_bench [size] [workdir]
+//   size:    width and height (pixels) of the synthetic raster. Default: 4096
+//   workdir: folder where the output files are created. Default: current folder
+// A synthetic Float32 DEM is streamed through GeotiffWriter, one block-row at a time,
+// for every compression / predictor combination. Throughput and file size are reported.
+
+#include <gdal_priv.h>
+#include <cpl_conv.h>
+#include <cpl_vsi.h>
+
+///Basic C and C++ libraries
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#include "geotiff.hpp"
+#include "geotiff_writer.hpp"
+
+using namespace std;
+
+const std::string green("\033[1;32m");
+const std::string yellow("\033[1;33m");
+const std::string cyan("\033[1;36m");
+const std::string red("\033[1;31m");
+const std::string reset("\033[0m");
+
+/**
+ * @brief Fills a block of rows of the synthetic DEM (smooth surface plus some high frequency noise)
+ */
+void fillRows(Raster<float> &rows, int yOff){
+    for (int y=0; y<rows.GetRows(); y++){
+        float *row = rows.GetRow(y);
+        int yy = yOff + y;
+        for (int x=0; x<rows.GetCols(); x++)
+            row[x] = (float)(-2000.0 + 150.0*sin(yy*0.003)*cos(x*0.002) + 0.01*((yy*31 + x*17) % 97));
+    }
+}
+
+/**
+ * @brief Streams the synthetic DEM through a GeotiffWriter
+ *
+ * @return double elapsed seconds (< 0 on error)
+ */
+double writeFile(const std::string &fileName, int size, const GeotiffWriterOptions &options){
+    auto t0 = std::chrono::steady_clock::now();
+    GeotiffWriter writer(fileName.c_str(), size, size, 1, GDT_Float32, options);
+    if (!writer.isValid())
+        return -1;
+    double adfGeoTransform[6] = {0.0, 1.0, 0.0, 0.0, 0.0, -1.0};
+    writer.SetGeoTransform(adfGeoTransform);
+
+    int nBlockRows = options.blockYSize;
+    Raster<float> rows(size, nBlockRows);
+    for (int y=0; y<size; y+=nBlockRows){
+        int nLines = min(nBlockRows, size - y);
+        if (nLines != rows.GetRows())
+            rows = Raster<float>(size, nLines);
+        fillRows(rows, y);
+        if (!writer.WriteRows(1, y, rows))
+            return -1;
+    }
+    writer.Close();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+    int size = 4096;
+    std::string workDir = ".";
+    if (argc > 1)
+        size = atoi(argv[1]);
+    if (argc > 2)
+        workDir = argv[2];
+    if (size <= 0){
+        cout << red << "Invalid raster size: " << reset << argv[1] << endl;
+        return -1;
+    }
+
+    cout << cyan << "geotiff_write_bench" << reset << endl;
+    cout << "\tGit commit:\t" << yellow << GIT_COMMIT << reset << endl;
+    cout << "\tRaster size:\t" << size << "x" << size << " Float32, tiled 256x256" << endl;
+
+    const char *compressions[4] = {"NONE", "LZW", "DEFLATE", "ZSTD"};
+    const int predictors[2] = {1, 3};
+    double rawMB = (double)size*size*sizeof(float)/(1024.0*1024.0);
+
+    for (int c=0; c<4; c++){
+        for (int p=0; p<2; p++){
+            if (c == 0 && p == 1)
+                continue; // predictor is meaningless without compression
+            GeotiffWriterOptions options;
+            options.compression = compressions[c];
+            options.predictor = predictors[p];
+            std::string fileName = workDir + "/bench_write_" + compressions[c] + ".tif";
+
+            double seconds = writeFile(fileName, size, options);
+            if (seconds < 0){
+                cout << red << "Error writing " << reset << fileName << " (" << compressions[c] << " not available?)" << endl;
+                continue;
+            }
+            VSIStatBufL sStat;
+            double fileMB = (VSIStatL(fileName.c_str(), &sStat) == 0) ? sStat.st_size/(1024.0*1024.0) : 0.0;
+            cout << "\t" << green << std::left << std::setw(8) << compressions[c] << reset << "predictor=" << predictors[p]
+                 << std::right << std::fixed << std::setprecision(3) << "\t" << seconds << " s\t"
+                 << std::setprecision(1) << rawMB/seconds << " MB/s\t" << fileMB << " MB ("
+                 << std::setprecision(2) << rawMB/std::max(fileMB, 1e-6) << "x)" << endl;
+            GetGDALDriverManager()->GetDriverByName("GTiff")->Delete(fileName.c_str());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,194 @@
+/**
+ * @file geotiff_writer.cpp
+ * @brief Streaming GeoTIFF writer: tiling, compression and row-block output
+ * @copyright Licensed under GNU GPLv3 (see LICENSE)
+ * */
+
+#include <geotiff_writer.hpp>
+#include <geotiff.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cpl_string.h>
+
+using namespace std;
+
+static std::string toString(int value){
+  std::ostringstream ss;
+  ss << value;
+  return ss.str();
+}
+
+GeotiffWriter::GeotiffWriter(const char *tiffname, int cols, int rows, int bands, GDALDataType dataType,
+                             const GeotiffWriterOptions &options) :
+  filename(tiffname), geotiffDataset(NULL), nRows(rows), nCols(cols), nBands(bands), nBlockXSize(1), nBlockYSize(1) {
+
+  GeotiffRegisterDrivers();
+  // pooled read handles on a previous file with this name must not outlive it
+  GeotiffDatasetPool::Instance().Invalidate(tiffname);
+  GDALDriver *poDriver = GetGDALDriverManager()->GetDriverByName("GTiff");
+  if (poDriver == NULL){
+    cout << "[GeotiffWriter] GTiff driver not available" << endl;
+    return;
+  }
+
+  char **papszOptions = NULL;
+  if (options.tiled){
+    papszOptions = CSLSetNameValue(papszOptions, "TILED", "YES");
+    papszOptions = CSLSetNameValue(papszOptions, "BLOCKXSIZE", toString(options.blockXSize).c_str());
+  }
+  papszOptions = CSLSetNameValue(papszOptions, "BLOCKYSIZE", toString(options.blockYSize).c_str());
+  if (!options.compression.empty())
+    papszOptions = CSLSetNameValue(papszOptions, "COMPRESS", options.compression.c_str());
+
+  bool bCompressed = !options.compression.empty() && !EQUAL(options.compression.c_str(), "NONE");
+  if (bCompressed){
+    int predictor = options.predictor;
+    if (predictor == 0) // horizontal differencing for integers, floating point predictor for floats
+      predictor = (dataType == GDT_Float32 || dataType == GDT_Float64) ? 3 : 2;
+    papszOptions = CSLSetNameValue(papszOptions, "PREDICTOR", toString(predictor).c_str());
+    if (options.level >= 0){
+      const char *levelKey = EQUAL(options.compression.c_str(), "ZSTD") ? "ZSTD_LEVEL" : "ZLEVEL";
+      papszOptions = CSLSetNameValue(papszOptions, levelKey, toString(options.level).c_str());
+    }
+    if (options.numThreads > 0)
+      papszOptions = CSLSetNameValue(papszOptions, "NUM_THREADS", toString(options.numThreads).c_str());
+  }
+  // each band in its own blocks, so a band can be streamed and flushed independently of the others
+  if (bands > 1)
+    papszOptions = CSLSetNameValue(papszOptions, "INTERLEAVE", "BAND");
+  if (!options.bigTiff.empty())
+    papszOptions = CSLSetNameValue(papszOptions, "BIGTIFF", options.bigTiff.c_str());
+
+  geotiffDataset = poDriver->Create(tiffname, cols, rows, bands, dataType, papszOptions);
+  CSLDestroy(papszOptions);
+  if (geotiffDataset == NULL){
+    cout << "[GeotiffWriter] Error creating file: " << tiffname << endl;
+    return;
+  }
+  geotiffDataset->GetRasterBand(1)->GetBlockSize(&nBlockXSize, &nBlockYSize);
+  nBlockXSize = max(1, nBlockXSize);
+  nBlockYSize = max(1, nBlockYSize);
+  streamedRows.assign(bands, 0);
+}
+
+GeotiffWriter::~GeotiffWriter(){
+  Close();
+}
+
+bool GeotiffWriter::Close(){
+  if (geotiffDataset == NULL)
+    return false;
+  GDALClose(geotiffDataset); // flushes the pending blocks
+  geotiffDataset = NULL;
+  GeotiffDatasetPool::Instance().Invalidate(filename.c_str());
+  return true;
+}
+
+bool GeotiffWriter::CopyGeoreference(Geotiff &source){
+  if (geotiffDataset == NULL)
+    return false;
+  bool bOk = SetGeoTransform(source.GetGeoTransform());
+  if (source.datasetSpatialRef != NULL){
+    char *pszWkt = NULL;
+    if (source.datasetSpatialRef->exportToWkt(&pszWkt) == OGRERR_NONE && pszWkt != NULL)
+      bOk = SetProjection(pszWkt) && bOk;
+    CPLFree(pszWkt);
+  }
+  return bOk;
+}
+
+bool GeotiffWriter::SetGeoTransform(const double *geotransform){
+  if (geotiffDataset == NULL)
+    return false;
+  double adfGeoTransform[6];
+  for (int i=0; i<6; i++)
+    adfGeoTransform[i] = geotransform[i];
+  return geotiffDataset->SetGeoTransform(adfGeoTransform) == CE_None;
+}
+
+bool GeotiffWriter::SetProjection(const char *wkt){
+  if (geotiffDataset == NULL)
+    return false;
+  return geotiffDataset->SetProjection(wkt) == CE_None;
+}
+
+bool GeotiffWriter::SetNoDataValue(int band, double noData){
+  if (geotiffDataset == NULL || band < 1 || band > nBands)
+    return false;
+  return geotiffDataset->GetRasterBand(band)->SetNoDataValue(noData) == CE_None;
+}
+
+/**
+ * @brief Writes a window, then flushes the block-rows of the band it completes
+ *
+ * @param data first pixel of the window
+ * @param stride distance between consecutive rows of data, in elements
+ * @return true on success
+ */
+template<typename T>
+bool GeotiffWriter::WriteBlockRows(int band, int xOff, int yOff, int xSize, int ySize, const T *data, size_t stride){
+  if (geotiffDataset == NULL || band < 1 || band > nBands || xOff < 0 || yOff < 0 ||
+      xSize <= 0 || ySize <= 0 || xOff + xSize > nCols || yOff + ySize > nRows){
+    cout << "[GeotiffWriter] Error: invalid band or window" << endl;
+    return false;
+  }
+  GDALRasterBand *poBand = geotiffDataset->GetRasterBand(band);
+  CPLErr e = poBand->RasterIO(GF_Write, xOff, yOff, xSize, ySize, (void *) data, xSize, ySize,
+                              GDALTypeOf<T>::type, sizeof(T), stride*sizeof(T));
+  if (e != CE_None){
+    cout << "[GeotiffWriter] Error: Unable to write rows [" << yOff << ", " << yOff + ySize << ") to " << filename << endl;
+    return false;
+  }
+  // a full-width write continuing the rows streamed so far completes the block-rows it reaches: compress
+  // and write each of them once, and drop it from the GDAL cache. The block-row it ends in stays cached
+  // until the next rows complete it (flushing it now would write it twice, compressed files grow)
+  int yEnd = yOff + ySize;
+  if (xSize != nCols || yOff != streamedRows[band - 1])
+    return true;
+  streamedRows[band - 1] = yEnd;
+  int firstBlockRow = yOff / nBlockYSize;
+  int endBlockRow = (yEnd == nRows) ? (nRows + nBlockYSize - 1) / nBlockYSize : yEnd / nBlockYSize;
+  int nBlocksPerRow = (nCols + nBlockXSize - 1) / nBlockXSize;
+  for (int by=firstBlockRow; by<endBlockRow; by++){
+    for (int bx=0; bx<nBlocksPerRow; bx++){
+      if (poBand->FlushBlock(bx, by) != CE_None){
+        cout << "[GeotiffWriter] Error: Unable to write block (" << bx << ", " << by << ") of " << filename << endl;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+template<typename T>
+bool GeotiffWriter::WriteRows(int band, int yOff, const Raster<T> &rows){
+  if (rows.GetCols() != nCols){
+    cout << "[GeotiffWriter] Error: WriteRows expects full-width rows (" << nCols << " columns)" << endl;
+    return false;
+  }
+  return WriteBlockRows<T>(band, 0, yOff, rows.GetCols(), rows.GetRows(), rows.GetData(), rows.GetStride());
+}
+
+template<typename T>
+bool GeotiffWriter::WriteWindow(int band, int xOff, int yOff, const Raster<T> &window){
+  return WriteBlockRows<T>(band, xOff, yOff, window.GetCols(), window.GetRows(), window.GetData(), window.GetStride());
+}
+
+// explicit instantiations for the supported pixel types
+template bool GeotiffWriter::WriteRows<unsigned char>(int band, int yOff, const Raster<unsigned char> &rows);
+template bool GeotiffWriter::WriteRows<unsigned short>(int band, int yOff, const Raster<unsigned short> &rows);
+template bool GeotiffWriter::WriteRows<short>(int band, int yOff, const Raster<short> &rows);
+template bool GeotiffWriter::WriteRows<unsigned int>(int band, int yOff, const Raster<unsigned int> &rows);
+template bool GeotiffWriter::WriteRows<int>(int band, int yOff, const Raster<int> &rows);
+template bool GeotiffWriter::WriteRows<float>(int band, int yOff, const Raster<float> &rows);
+template bool GeotiffWriter::WriteRows<double>(int band, int yOff, const Raster<double> &rows);
+
+template bool GeotiffWriter::WriteWindow<unsigned char>(int band, int xOff, int yOff, const Raster<unsigned char> &window);
+template bool GeotiffWriter::WriteWindow<unsigned short>(int band, int xOff, int yOff, const Raster<unsigned short> &window);
+template bool GeotiffWriter::WriteWindow<short>(int band, int xOff, int yOff, const Raster<short> &window);
+template bool GeotiffWriter::WriteWindow<unsigned int>(int band, int xOff, int yOff, const Raster<unsigned int> &window);
+template bool GeotiffWriter::WriteWindow<int>(int band, int xOff, int yOff, const Raster<int> &window);
+template bool GeotiffWriter::WriteWindow<float>(int band, int xOff, int yOff, const Raster<float> &window);
+template bool GeotiffWriter::WriteWindow<double>(int band, int xOff, int yOff, const Raster<double> &window);